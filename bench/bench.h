@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// ------------------------------------------
+// timing helpers shared by the benchmarks
+
+// wall time of a single call of f in ms
+template<typename F>
+double bench_time_ms(F &&f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// median over 'runs' calls of f in ms, after one warm-up call
+template<typename F>
+double bench_median_ms(uint32_t runs, F &&f) {
+    f();
+    std::vector<double> times(std::max(1u, runs));
+    for (double &t: times)
+        t = bench_time_ms(f);
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+inline void bench_report(const char *name, double ms) {
+    std::printf("%-48s %10.3f ms\n", name, ms);
+}
+
+inline void bench_report_throughput(const char *name, double ms, double bytes) {
+    std::printf("%-48s %10.3f ms %10.1f MB/s\n", name, ms, bytes / (1024.0 * 1024.0) / (ms / 1000.0));
+}
@@ -0,0 +1,86 @@
+#include <cppgl.h>
+#include <cmath>
+#include <string>
+#include "bench.h"
+
+// cost per vertex / triangle of reading geometry through the virtual per-element getters compared to the bulk
+// views and the for_each visitors, for a GeometryImpl and a GeometryWrapperImpl over the same data, CPU only
+
+using namespace cppgl;
+
+static void run(const char *name, GeometryBaseImpl &geo) {
+    const size_t num_vertices = geo.positions_size(), num_triangles = geo.indices_size() / 3;
+    std::printf("%s, %zu vertices, %zu triangles:\n", name, num_vertices, num_triangles);
+    vec3 sum;
+    float area;
+    const auto report = [&](const char *what, double ms, size_t n) {
+        std::printf("  %-46s %10.3f ms %8.2f ns / element   (%g)\n", what, ms, ms * 1e6 / n, sum.sum() + area);
+    };
+
+    // per vertex: sum of all positions
+    double ms = bench_median_ms(5, [&] {
+        sum = vec3::Zero();
+        for (uint32_t i = 0; i < num_vertices; i++)
+            sum += geo.get_position(i);
+    });
+    area = 0.f;
+    report("get_position(i)", ms, num_vertices);
+    ms = bench_median_ms(5, [&] {
+        sum = vec3::Zero();
+        const AttributeView<vec3> positions = geo.positions_view();
+        for (uint32_t i = 0; i < positions.size; i++)
+            sum += positions[i];
+    });
+    report("positions_view()[i]", ms, num_vertices);
+    ms = bench_median_ms(5, [&] {
+        sum = vec3::Zero();
+        for_each_vertex(geo, [&](uint32_t, const vec3 &p) { sum += p; });
+    });
+    report("for_each_vertex", ms, num_vertices);
+
+    // per triangle: total area
+    sum = vec3::Zero();
+    ms = bench_median_ms(5, [&] {
+        area = 0.f;
+        for (uint32_t f = 0; f < num_triangles; f++) {
+            const vec3 p0 = geo.get_position(geo.get_index(3 * f + 0));
+            const vec3 p1 = geo.get_position(geo.get_index(3 * f + 1));
+            const vec3 p2 = geo.get_position(geo.get_index(3 * f + 2));
+            area += 0.5f * (p1 - p0).cross(p2 - p0).norm();
+        }
+    });
+    report("get_index(i) + get_position(i)", ms, num_triangles);
+    ms = bench_median_ms(5, [&] {
+        area = 0.f;
+        const AttributeView<vec3> positions = geo.positions_view();
+        for_each_triangle(geo, [&](uint32_t, uint32_t i0, uint32_t i1, uint32_t i2) {
+            area += 0.5f * (positions[i1] - positions[i0]).cross(positions[i2] - positions[i0]).norm();
+        });
+    });
+    report("for_each_triangle + positions_view", ms, num_triangles);
+}
+
+int main(int argc, char **argv) {
+    const uint32_t res = argc > 1 ? uint32_t(std::stoul(argv[1])) : 1024;
+
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+    for (uint32_t y = 0; y <= res; y++)
+        for (uint32_t x = 0; x <= res; x++) {
+            const float u = float(x) / res, v = float(y) / res;
+            positions.insert(positions.end(), {u, 0.05f * std::sin(40.f * u) * std::cos(31.f * v), v});
+        }
+    for (uint32_t y = 0; y < res; y++)
+        for (uint32_t x = 0; x < res; x++) {
+            const uint32_t i = y * (res + 1) + x;
+            indices.insert(indices.end(), {i, i + res + 1, i + 1, i + 1, i + res + 1, i + res + 2});
+        }
+
+    // held as GeometryBase, so the getters are called like the library's algorithms call them
+    GeometryBase geometry = Geometry("bench_geometry", positions, indices);
+    GeometryBase wrapper = GeometryWrapper("bench_wrapper", positions.data(), positions.size() / 3,
+                                           indices.data(), indices.size());
+    run("Geometry", *geometry);
+    run("GeometryWrapper", *wrapper);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <cppgl.h>
+#include <functional>
+#include <random>
+#include <string>
+#include "bench.h"
+
+// CPU cost of submitting many drawelements: all transforms as plain uniforms looked up and uploaded per draw
+// (like DrawelementImpl::bind before FrameUniforms), the same shader through DrawelementImpl with uniform handles
+// and redundant-upload skipping, and a shader reading the FrameUniforms blocks
+
+using namespace cppgl;
+
+int main(int argc, char **argv) {
+    const uint32_t num_elements = argc > 1 ? uint32_t(std::stoul(argv[1])) : 10000;
+    const uint32_t frames = 20;
+
+    ContextParameters params;
+    params.title = "bench_frame_uniforms";
+    params.visible = GLFW_FALSE;
+    params.swap_interval = 0;
+    params.gl_debug_context = GLFW_FALSE;
+    Context::init(params);
+    ShaderImpl::add_shader_search_path(CPPGL_BENCH_SHADER_DIR);
+
+    Camera cam("bench_cam");
+    cam->from_lookat(vec3(0, 0, -60), vec3(0, 0, 0));
+    cam->update();
+    make_camera_current(cam);
+
+    const std::vector<vec3> positions = {vec3(-.5f, -.5f, -.5f), vec3(.5f, -.5f, -.5f), vec3(.5f, .5f, -.5f),
+                                         vec3(-.5f, .5f, -.5f), vec3(-.5f, -.5f, .5f), vec3(.5f, -.5f, .5f),
+                                         vec3(.5f, .5f, .5f), vec3(-.5f, .5f, .5f)};
+    const std::vector<uint32_t> indices = {0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+                                           3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5};
+    Mesh cube = MeshImpl::from_geometry("bench_cube", false, positions, indices);
+    Shader uniforms("bench_uniforms", "uniforms.vs", "color.fs");
+    Shader object_block("bench_object_block", "object_block.vs", "color.fs");
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coord(-20.f, 20.f);
+    std::vector<Drawelement> elements;
+    elements.reserve(num_elements);
+    for (uint32_t i = 0; i < num_elements; i++) {
+        mat4 model = mat4::Identity();
+        model.block<3, 1>(0, 3) = vec3(coord(rng), coord(rng), coord(rng));
+        elements.push_back(Drawelement("bench_element_" + std::to_string(i), uniforms, cube, model));
+    }
+    std::printf("%u drawelements, %u frames\n", num_elements, frames);
+
+    // CPU time of the submission loop and the time until the GPU finished it, per frame
+    const auto run = [&](const char *name, const std::function<void()> &submit) {
+        double cpu_ms = 0.0, total_ms = 0.0;
+        // one warm-up frame, the ring buffer of FrameUniforms holds a single frame's draws
+        for (uint32_t f = 0; f <= frames; f++) {
+            const double ms = bench_time_ms([&] {
+                const double submit_ms = bench_time_ms(submit);
+                if (f > 0)
+                    cpu_ms += submit_ms;
+                glFinish();
+            });
+            if (f > 0)
+                total_ms += ms;
+            if (FrameUniforms *frame_uniforms = FrameUniforms::instance())
+                frame_uniforms->next_frame();
+        }
+        std::printf("%-48s %10.3f ms CPU %10.3f ms total %8.1f ns / draw\n", name, cpu_ms / frames,
+                    total_ms / frames, cpu_ms / frames * 1e6 / num_elements);
+    };
+
+    run("uniform lookup + upload per draw", [&] {
+        uniforms->bind();
+        for (const auto &elem: elements) {
+            const mat4 model_normal = transpose(inverse(elem->model));
+            glUniformMatrix4fv(glGetUniformLocation(uniforms->id, "model"), 1, GL_FALSE, elem->model.data());
+            glUniformMatrix4fv(glGetUniformLocation(uniforms->id, "model_normal"), 1, GL_FALSE, model_normal.data());
+            glUniformMatrix4fv(glGetUniformLocation(uniforms->id, "view"), 1, GL_FALSE, cam->view.data());
+            glUniformMatrix4fv(glGetUniformLocation(uniforms->id, "view_normal"), 1, GL_FALSE,
+                               cam->view_normal.data());
+            glUniformMatrix4fv(glGetUniformLocation(uniforms->id, "proj"), 1, GL_FALSE, cam->proj.data());
+            cube->bind(uniforms);
+            cube->draw();
+            cube->unbind();
+        }
+        uniforms->unbind();
+    });
+
+    run("DrawelementImpl, uniforms", [&] {
+        for (const auto &elem: elements) {
+            elem->bind();
+            elem->draw();
+            elem->unbind();
+        }
+    });
+
+    for (auto &elem: elements)
+        elem->shader = object_block;
+    run("DrawelementImpl, FrameUniforms blocks", [&] {
+        for (const auto &elem: elements) {
+            elem->bind();
+            elem->draw();
+            elem->unbind();
+        }
+    });
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <cppgl.h>
+#include <utils/parallel.h>
+#include <cmath>
+#include <random>
+#include <string>
+#include "bench.h"
+
+// throughput in vertices per second of the geometry transform kernels (GeometryImpl and GeometryWrapperImpl) next
+// to the scalar per-vertex loops they replaced (checked to agree, exit code 1 otherwise), CPU only
+
+using namespace cppgl;
+
+// former GeometryImpl::transform followed by recompute_aabb: one Eigen mat4 * vec4 per vertex, separate bbox pass
+static void transform_per_vertex(std::vector<vec3> &positions, std::vector<vec3> &normals, const mat4 &trans,
+                                 vec3 &bb_min, vec3 &bb_max) {
+    const mat3 normal_matrix = trans.block<3, 3>(0, 0).inverse().transpose();
+    for (uint32_t i = 0; i < positions.size(); ++i)
+        positions[i] = make_vec3(trans * make_vec4(positions[i], 1));
+    for (uint32_t i = 0; i < normals.size(); ++i)
+        normals[i] = (normal_matrix * normals[i]).normalized();
+    bb_min = vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                  std::numeric_limits<float>::max());
+    bb_max = vec3(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+                  std::numeric_limits<float>::lowest());
+    for (const auto &pos: positions) {
+        bb_min = min(bb_min, pos);
+        bb_max = max(bb_max, pos);
+    }
+}
+
+static void report_vertices(const char *name, double ms, size_t num_vertices) {
+    std::printf("  %-46s %10.3f ms %8.1f M vertices/s\n", name, ms, num_vertices / (ms * 1000.0));
+}
+
+static void run(const char *name, GeometryBaseImpl &geo) {
+    const size_t n = geo.positions_size();
+    std::printf("%s, %zu vertices with normals:\n", name, n);
+    // alternating, so repeated runs keep the coordinates in range
+    const mat4 rotation = rotate(radians(10.f), vec3(0.3f, 1.f, 0.2f).normalized());
+    const mat4 rotation_back = rotate(radians(-10.f), vec3(0.3f, 1.f, 0.2f).normalized());
+    bool forward = true;
+    report_vertices("transform (rotation, normals)", bench_median_ms(11, [&] {
+        geo.transform(forward ? rotation : rotation_back);
+        forward = !forward;
+    }), n);
+    report_vertices("translate", bench_median_ms(11, [&] {
+        geo.translate(forward ? vec3(1, 2, 3) : vec3(-1, -2, -3));
+        forward = !forward;
+    }), n);
+    report_vertices("scale (uniform, normals untouched)", bench_median_ms(11, [&] {
+        geo.scale(vec3::Constant(forward ? 2.f : 0.5f));
+        forward = !forward;
+    }), n);
+    report_vertices("fit_into_aabb", bench_median_ms(11, [&] {
+        geo.fit_into_aabb(vec3(-1, -1, -1), vec3(1, 1, 1));
+    }), n);
+    report_vertices("recompute_aabb", bench_median_ms(11, [&] { geo.recompute_aabb(); }), n);
+}
+
+int main(int argc, char **argv) {
+    const uint32_t n = argc > 1 ? uint32_t(std::stoul(argv[1])) : 4000000;
+    std::printf("%u threads\n", parallel_num_threads());
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coord(-10.f, 10.f);
+    std::vector<vec3> positions(n), normals(n);
+    for (uint32_t i = 0; i < n; i++) {
+        positions[i] = vec3(coord(rng), coord(rng), coord(rng));
+        normals[i] = vec3(coord(rng), coord(rng), coord(rng)).normalized();
+    }
+
+    // one affine transform with a shear, so the normal matrix is not just the rotation: both paths have to agree
+    mat4 affine = rotate(radians(30.f), vec3(1.f, 0.5f, 0.2f).normalized());
+    affine(0, 1) += 0.4f;
+    affine.block<3, 1>(0, 3) = vec3(3, -2, 1);
+    std::vector<vec3> reference_positions = positions, reference_normals = normals;
+    vec3 reference_min, reference_max;
+    transform_per_vertex(reference_positions, reference_normals, affine, reference_min, reference_max);
+    Geometry check("bench_check", positions, std::vector<uint32_t>(), normals);
+    check->transform(affine);
+    float max_diff = std::max((check->bb_min - reference_min).cwiseAbs().maxCoeff(),
+                              (check->bb_max - reference_max).cwiseAbs().maxCoeff());
+    for (uint32_t i = 0; i < n; i++) {
+        max_diff = std::max(max_diff, (check->get_position(i) - reference_positions[i]).cwiseAbs().maxCoeff());
+        max_diff = std::max(max_diff, (check->get_normal(i) - reference_normals[i]).cwiseAbs().maxCoeff());
+    }
+    check.free(true);
+    const bool ok = max_diff < 1e-4f;
+    std::printf("%-48s max difference %g: %s\n", "transform matches the former implementation", max_diff,
+                ok ? "ok" : "FAILED");
+
+    std::printf("scalar per-vertex loops (former implementation), %u vertices with normals:\n", n);
+    {
+        std::vector<vec3> p = positions, nrm = normals;
+        vec3 bb_min, bb_max;
+        const mat4 rotation = rotate(radians(10.f), vec3(0.3f, 1.f, 0.2f).normalized());
+        report_vertices("transform + recompute_aabb", bench_median_ms(11, [&] {
+            transform_per_vertex(p, nrm, rotation, bb_min, bb_max);
+        }), n);
+    }
+
+    GeometryBase geometry = Geometry("bench_geometry", positions, std::vector<uint32_t>(), normals);
+    run("Geometry", *geometry);
+
+    std::vector<float> flat_positions(3 * size_t(n)), flat_normals(3 * size_t(n));
+    for (uint32_t i = 0; i < n; i++)
+        for (int c = 0; c < 3; c++) {
+            flat_positions[3 * i + c] = positions[i][c];
+            flat_normals[3 * i + c] = normals[i][c];
+        }
+    GeometryBase wrapper = GeometryWrapper("bench_wrapper", flat_positions.data(), n, nullptr, 0,
+                                           flat_normals.data(), n);
+    run("GeometryWrapper", *wrapper);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+#include <cppgl.h>
+#include <functional>
+#include <random>
+#include <string>
+#include "bench.h"
+
+// many identical cubes: one Cuboid + Drawelement per copy compared to a single InstancedDrawelement,
+// GPU memory and CPU submission / frame time in a hidden window
+
+using namespace cppgl;
+
+static size_t mesh_memory(const Mesh &mesh) {
+    return mesh->vertex_memory() + (mesh->ibo ? mesh->ibo->size_bytes : 0);
+}
+
+int main(int argc, char **argv) {
+    const uint32_t num_instances = argc > 1 ? uint32_t(std::stoul(argv[1])) : 10000;
+    const uint32_t frames = 20;
+
+    ContextParameters params;
+    params.title = "bench_instancing";
+    params.visible = GLFW_FALSE;
+    params.swap_interval = 0;
+    params.gl_debug_context = GLFW_FALSE;
+    Context::init(params);
+    ShaderImpl::add_shader_search_path(CPPGL_BENCH_SHADER_DIR);
+
+    Camera cam("bench_cam");
+    cam->from_lookat(vec3(0, 0, -60), vec3(0, 0, 0));
+    cam->update();
+    make_camera_current(cam);
+
+    Shader uniforms("bench_uniforms", "uniforms.vs", "color.fs");
+    Shader instanced_shader("bench_instanced", "instanced.vs", "color.fs");
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coord(-20.f, 20.f);
+    std::vector<mat4> transforms(num_instances, mat4::Identity());
+    for (auto &transform: transforms)
+        transform.block<3, 1>(0, 3) = vec3(coord(rng), coord(rng), coord(rng));
+
+    // one object per copy, like the mesh templates are used without instancing
+    std::vector<Drawelement> elements;
+    size_t separate_bytes = 0;
+    for (uint32_t i = 0; i < num_instances; i++) {
+        const std::string name = "bench_cube_" + std::to_string(i);
+        Mesh cube = Cuboid(name, 1.f, 1.f, 1.f);
+        separate_bytes += mesh_memory(cube);
+        elements.push_back(Drawelement(name, uniforms, cube, transforms[i]));
+    }
+
+    Mesh shared = Cuboid("bench_shared_cube", 1.f, 1.f, 1.f);
+    InstancedDrawelement instanced("bench_instanced", instanced_shader, shared);
+    for (const auto &transform: transforms)
+        instanced->add_instance(transform);
+    instanced->bind();
+    instanced->draw();
+    instanced->unbind();
+    glFinish();
+
+    std::printf("%u cubes, %u frames\n", num_instances, frames);
+    std::printf("%-48s %10.2f MB\n", "GPU memory, one mesh per copy", separate_bytes / 1e6);
+    std::printf("%-48s %10.2f MB (mesh %zu bytes)\n", "GPU memory, instanced",
+                (mesh_memory(shared) + instanced->instance_memory()) / 1e6, mesh_memory(shared));
+
+    // CPU time of the submission loop and the time until the GPU finished it, per frame
+    const auto run = [&](const char *name, const std::function<void()> &submit) {
+        double cpu_ms = 0.0, total_ms = 0.0;
+        // one warm-up frame, the ring buffer of FrameUniforms holds a single frame's draws
+        for (uint32_t f = 0; f <= frames; f++) {
+            const double ms = bench_time_ms([&] {
+                const double submit_ms = bench_time_ms(submit);
+                if (f > 0)
+                    cpu_ms += submit_ms;
+                glFinish();
+            });
+            if (f > 0)
+                total_ms += ms;
+            if (FrameUniforms *frame_uniforms = FrameUniforms::instance())
+                frame_uniforms->next_frame();
+        }
+        std::printf("%-48s %10.3f ms CPU %10.3f ms total\n", name, cpu_ms / frames, total_ms / frames);
+    };
+
+    run("one drawelement per copy", [&] {
+        for (const auto &elem: elements) {
+            elem->bind();
+            elem->draw();
+            elem->unbind();
+        }
+    });
+
+    run("InstancedDrawelement", [&] {
+        instanced->bind();
+        instanced->draw();
+        instanced->unbind();
+    });
+
+    // in-place updates: a tenth of the instances move every frame, only their range is uploaded again
+    uint32_t frame = 0;
+    run("InstancedDrawelement, 10% moved per frame", [&] {
+        for (uint32_t i = frame++ % 10; i < num_instances; i += 10) {
+            transforms[i](1, 3) += 0.01f;
+            instanced->set_instance_transform(i, transforms[i]);
+        }
+        instanced->bind();
+        instanced->draw();
+        instanced->unbind();
+    });
+
+    return 0;
+}
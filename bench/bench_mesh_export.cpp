@@ -0,0 +1,49 @@
+#include <cppgl.h>
+#include <utils/parallel.h>
+#include <cmath>
+#include <string>
+#include "bench.h"
+
+// write throughput of the streaming OBJ / binary PLY writers and of the former aiScene round trip (ASSIMP_OBJ)
+// for a large height field with normals and texcoords, into a temporary directory, CPU only
+
+using namespace cppgl;
+
+int main(int argc, char **argv) {
+    const uint32_t res = argc > 1 ? uint32_t(std::stoul(argv[1])) : 1024;
+
+    std::vector<vec3> positions;
+    std::vector<vec2> texcoords;
+    std::vector<uint32_t> indices;
+    for (uint32_t y = 0; y <= res; y++)
+        for (uint32_t x = 0; x <= res; x++) {
+            const float u = float(x) / res, v = float(y) / res;
+            positions.emplace_back(u, 0.05f * std::sin(40.f * u) * std::cos(31.f * v), v);
+            texcoords.emplace_back(u, v);
+        }
+    for (uint32_t y = 0; y < res; y++)
+        for (uint32_t x = 0; x < res; x++) {
+            const uint32_t i = y * (res + 1) + x;
+            indices.insert(indices.end(), {i, i + res + 1, i + 1, i + 1, i + res + 1, i + res + 2});
+        }
+    const std::vector<vec3> normals = generate_vertex_normals(positions, indices);
+    GeometryBase geometry = Geometry("bench_export", positions, indices, normals, texcoords);
+    const std::vector<std::pair<GeometryBase, Material>> meshes = {std::make_pair(geometry, Material())};
+    std::printf("%zu vertices, %zu faces, %u threads\n", positions.size(), indices.size() / 3,
+                parallel_num_threads());
+
+    const fs::path dir = fs::temp_directory_path() / "cppgl_bench_mesh_export";
+    fs::create_directories(dir);
+    const auto run = [&](const char *name, const fs::path &path, MeshFileFormat format, uint32_t runs) {
+        const double ms = bench_median_ms(runs, [&] { save_meshes_cpu(meshes, path, dir, false, format); });
+        bench_report_throughput(name, ms, double(fs::file_size(path)));
+        std::printf("%-48s %10.2f M faces/s\n", "", indices.size() / 3 / (ms * 1000.0));
+        fs::remove(path);
+    };
+    run("OBJ, streaming writer", dir / "bench.obj", MeshFileFormat::OBJ, 5);
+    run("binary PLY, streaming writer", dir / "bench.ply", MeshFileFormat::PLY, 5);
+    run("OBJ, aiScene + Assimp exporter", dir / "bench_assimp.obj", MeshFileFormat::ASSIMP_OBJ, 1);
+
+    fs::remove_all(dir);
+    return 0;
+}
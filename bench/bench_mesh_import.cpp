@@ -0,0 +1,72 @@
+#include <cppgl.h>
+#include <utils/parallel.h>
+#include <cmath>
+#include <string>
+#include "bench.h"
+
+// startup time of a scene made of many OBJ files in a hidden window (use a software context with
+// LIBGL_ALWAYS_SOFTWARE=1 for comparable runs): one load_meshes_gpu call per file compared to the batch import.
+// the files are written to a temporary directory first, each variant reads its own copy so both see the same
+// page cache state
+
+using namespace cppgl;
+
+int main(int argc, char **argv) {
+    const uint32_t num_files = argc > 1 ? uint32_t(std::stoul(argv[1])) : 200;
+    const uint32_t res = argc > 2 ? uint32_t(std::stoul(argv[2])) : 96;
+
+    ContextParameters params;
+    params.title = "bench_mesh_import";
+    params.visible = GLFW_FALSE;
+    params.swap_interval = 0;
+    params.gl_debug_context = GLFW_FALSE;
+    Context::init(params);
+
+    // one height field per file, with normals and texcoords like a scanned asset
+    const fs::path dir = fs::temp_directory_path() / "cppgl_bench_mesh_import";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::vector<fs::path> serial_paths, batch_paths;
+    for (uint32_t f = 0; f < num_files; f++) {
+        std::vector<vec3> positions, normals;
+        std::vector<vec2> texcoords;
+        std::vector<uint32_t> indices;
+        for (uint32_t y = 0; y <= res; y++)
+            for (uint32_t x = 0; x <= res; x++) {
+                const float u = float(x) / res, v = float(y) / res;
+                positions.emplace_back(u, 0.05f * std::sin((10.f + f) * u) * std::cos(7.f * v), v);
+                texcoords.emplace_back(u, v);
+            }
+        for (uint32_t y = 0; y < res; y++)
+            for (uint32_t x = 0; x < res; x++) {
+                const uint32_t i = y * (res + 1) + x;
+                indices.insert(indices.end(), {i, i + res + 1, i + 1, i + 1, i + res + 1, i + res + 2});
+            }
+        normals = generate_vertex_normals(positions, indices);
+        const std::string name = "bench_import_" + std::to_string(f);
+        GeometryBase geometry = Geometry(name, positions, indices, normals, texcoords);
+        serial_paths.push_back(dir / ("serial_" + std::to_string(f) + ".obj"));
+        batch_paths.push_back(dir / ("batch_" + std::to_string(f) + ".obj"));
+        save_meshes_cpu({std::make_pair(geometry, Material())}, serial_paths.back(), dir);
+        fs::copy_file(serial_paths.back(), batch_paths.back());
+        geometry.free(true);
+    }
+    std::printf("%u files, %u faces each, %u threads\n", num_files, 2 * res * res, parallel_num_threads());
+
+    // until the last mesh is on the GPU
+    const double serial_ms = bench_time_ms([&] {
+        for (const auto &path: serial_paths)
+            load_meshes_gpu(path);
+        glFinish();
+    });
+    bench_report("load_meshes_gpu per file", serial_ms);
+    const double batch_ms = bench_time_ms([&] {
+        load_meshes_gpu(batch_paths);
+        glFinish();
+    });
+    bench_report("load_meshes_gpu(paths), batch import", batch_ms);
+    std::printf("%-48s %10.2f x\n", "speedup", serial_ms / batch_ms);
+
+    fs::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <cppgl.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "bench.h"
+
+// concurrent create / find / free on the NamedHandle registry with an increasing number of threads, CPU only
+
+using namespace cppgl;
+
+struct BenchObjectImpl {
+    BenchObjectImpl(const std::string &name, uint32_t value) : name(name), value(value) {}
+
+    static inline std::string type_to_str() { return "BenchObjectImpl"; }
+
+    const std::string name;
+    const uint32_t value;
+};
+
+using BenchObject = NamedHandle<BenchObjectImpl>;
+
+// calls f(i) for i in [0, n), interleaved over num_threads threads
+template<typename F>
+static double run_threads(uint32_t num_threads, uint32_t n, F &&f) {
+    return bench_time_ms([&] {
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < num_threads; t++)
+            threads.emplace_back([&, t] {
+                for (uint32_t i = t; i < n; i += num_threads)
+                    f(i);
+            });
+        for (auto &thread: threads)
+            thread.join();
+    });
+}
+
+int main(int argc, char **argv) {
+    const uint32_t n = argc > 1 ? uint32_t(std::stoul(argv[1])) : 100000;
+    const uint32_t finds_per_handle = 10;
+
+    // names like the ones meshes give their buffers
+    std::vector<std::string> names(n);
+    for (uint32_t i = 0; i < n; i++)
+        names[i] = "mesh_" + std::to_string(i) + "_vertex_buffer_0";
+
+    const uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        const double create_ms = run_threads(num_threads, n, [&](uint32_t i) { BenchObject handle(names[i], i); });
+        std::atomic<uint64_t> sum(0);
+        const double find_ms = run_threads(num_threads, n, [&](uint32_t i) {
+            uint64_t local = 0;
+            for (uint32_t r = 0; r < finds_per_handle; r++)
+                local += BenchObject::find(names[(i * 7 + r) % n])->value;
+            sum += local;
+        });
+        const double free_ms = run_threads(num_threads, n, [&](uint32_t i) {
+            BenchObject handle = BenchObject::find(names[i]);
+            handle.free();
+        });
+        if (!BenchObject::map.empty())
+            std::printf("WARN: %zu handles left in the registry\n", BenchObject::map.size());
+
+        std::printf("%u threads, %u handles:\n", num_threads, n);
+        bench_report("  create", create_ms);
+        bench_report("  find (x10)", find_ms);
+        bench_report("  free", free_ms);
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <cppgl.h>
+#include <utils/parallel.h>
+#include <cmath>
+#include <string>
+#include "bench.h"
+
+// vertex normal generation on 1M and 10M triangle height fields: the former per-vertex face lists compared to
+// generate_vertex_normals (CSR adjacency, parallel), CPU only
+
+using namespace cppgl;
+
+// the implementation generate_vertex_normals replaced: face normals pushed back one by one, then one heap allocated
+// face list per vertex
+static std::vector<vec3> vertex_normals_per_vertex_lists(const std::vector<vec3> &positions,
+                                                         const std::vector<uint32_t> &indices) {
+    std::vector<vec3> face_normals;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        const vec3 e1 = positions[indices[i + 1]] - positions[indices[i + 0]];
+        const vec3 e2 = positions[indices[i + 2]] - positions[indices[i + 1]];
+        face_normals.push_back(e1.cross(e2).normalized());
+    }
+    std::vector<std::vector<uint32_t>> vertex_appearance(positions.size());
+    for (size_t i = 0; i < indices.size(); i++)
+        vertex_appearance[indices[i]].push_back(uint32_t(i / 3));
+    std::vector<vec3> vertex_normals;
+    for (const auto &faces: vertex_appearance) {
+        vec3 n(0, 0, 0);
+        for (uint32_t f: faces)
+            n += face_normals[f];
+        vertex_normals.push_back((n / float(faces.size())).normalized());
+    }
+    return vertex_normals;
+}
+
+static void run(uint32_t num_triangles) {
+    // res x res quads, two triangles each
+    const uint32_t res = uint32_t(std::sqrt(num_triangles / 2.0));
+    std::vector<vec3> positions;
+    std::vector<uint32_t> indices;
+    positions.reserve(size_t(res + 1) * (res + 1));
+    indices.reserve(size_t(res) * res * 6);
+    for (uint32_t y = 0; y <= res; y++)
+        for (uint32_t x = 0; x <= res; x++) {
+            const float u = float(x) / res, v = float(y) / res;
+            positions.emplace_back(u, 0.05f * std::sin(40.f * u) * std::cos(31.f * v), v);
+        }
+    for (uint32_t y = 0; y < res; y++)
+        for (uint32_t x = 0; x < res; x++) {
+            const uint32_t i = y * (res + 1) + x;
+            indices.insert(indices.end(), {i, i + res + 1, i + 1, i + 1, i + res + 1, i + res + 2});
+        }
+    std::printf("%zu vertices, %zu triangles:\n", positions.size(), indices.size() / 3);
+
+    std::vector<vec3> old_normals, new_normals;
+    const double old_ms =
+            bench_median_ms(3, [&] { old_normals = vertex_normals_per_vertex_lists(positions, indices); });
+    bench_report("  per-vertex face lists (old)", old_ms);
+    const double new_ms = bench_median_ms(3, [&] { new_normals = generate_vertex_normals(positions, indices); });
+    bench_report("  generate_vertex_normals", new_ms);
+    float max_diff = 0.f;
+    for (size_t i = 0; i < positions.size(); i++)
+        max_diff = std::max(max_diff, (old_normals[i] - new_normals[i]).cwiseAbs().maxCoeff());
+    std::printf("%-48s %10.2f x, max difference %g\n", "  speedup", old_ms / new_ms, max_diff);
+    for (NormalWeighting weighting: {NormalWeighting::AREA, NormalWeighting::ANGLE}) {
+        const double ms = bench_median_ms(3, [&] { generate_vertex_normals(positions, indices, weighting); });
+        bench_report(weighting == NormalWeighting::AREA ? "  generate_vertex_normals, area weighted"
+                                                        : "  generate_vertex_normals, angle weighted", ms);
+    }
+}
+
+int main(int argc, char **argv) {
+    // the largest run, e.g. 1000000 to skip the 10M triangle mesh
+    const uint32_t max_triangles = argc > 1 ? uint32_t(std::stoul(argv[1])) : 10000000;
+    std::printf("%u threads\n", parallel_num_threads());
+    for (uint32_t num_triangles: {1000000u, 10000000u})
+        if (num_triangles <= max_triangles)
+            run(num_triangles);
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <cppgl.h>
+#include <cstring>
+#include <string>
+#include "bench.h"
+
+// GPUReadback round trips in a hidden window (checked, exit code 1 on a mismatch): known texture, storage buffer
+// and framebuffer contents read back through the pixel pack buffers via callbacks and futures, then the cost of
+// an asynchronous framebuffer read compared to glReadPixels into client memory.
+// runs on a software context as well, e.g. LIBGL_ALWAYS_SOFTWARE=1 ./bench_readback
+
+using namespace cppgl;
+
+static bool report_check(const std::string &name, const std::vector<uint8_t> &expected,
+                         const std::vector<uint8_t> &actual) {
+    size_t first_mismatch = 0;
+    while (first_mismatch < std::min(expected.size(), actual.size()) &&
+           expected[first_mismatch] == actual[first_mismatch])
+        first_mismatch++;
+    const bool ok = expected.size() == actual.size() && first_mismatch == expected.size();
+    if (ok)
+        std::printf("%-48s %zu bytes: ok\n", name.c_str(), actual.size());
+    else
+        std::printf("%-48s %zu / %zu bytes, first mismatch at %zu: FAILED\n", name.c_str(), actual.size(),
+                    expected.size(), first_mismatch);
+    return ok;
+}
+
+// paints the four quadrants of the bound framebuffer with different colors and returns the expected RGB bytes of
+// the region (x, y, w, h), rows bottom to top and tightly packed
+static std::vector<uint8_t> paint_quadrants(int width, int height, int x, int y, int w, int h) {
+    const uint8_t colors[4][3] = {{255, 0, 0}, {0, 255, 0}, {0, 0, 255}, {255, 255, 0}};
+    glEnable(GL_SCISSOR_TEST);
+    for (int q = 0; q < 4; q++) {
+        glScissor(q % 2 ? width / 2 : 0, q / 2 ? height / 2 : 0, width / 2 + width % 2, height / 2 + height % 2);
+        glClearColor(colors[q][0] / 255.f, colors[q][1] / 255.f, colors[q][2] / 255.f, 1.f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(0.f, 0.f, 0.f, 1.f);
+    std::vector<uint8_t> expected;
+    for (int py = y; py < y + h; py++)
+        for (int px = x; px < x + w; px++) {
+            const int q = (px >= width / 2 ? 1 : 0) + (py >= height / 2 ? 2 : 0);
+            expected.insert(expected.end(), colors[q], colors[q] + 3);
+        }
+    return expected;
+}
+
+int main(int argc, char **argv) {
+    const uint32_t reads = argc > 1 ? uint32_t(std::stoul(argv[1])) : 100;
+
+    ContextParameters params;
+    params.title = "bench_readback";
+    params.visible = GLFW_FALSE;
+    params.swap_interval = 0;
+    params.gl_debug_context = GLFW_FALSE;
+    Context::init(params);
+    GPUReadback &readback = GPUReadback::global();
+    bool ok = true;
+
+    // RGBA8 texture with an odd width, every byte different from its neighbours
+    const uint32_t tw = 257, th = 131;
+    std::vector<uint8_t> texels(tw * th * 4);
+    for (size_t i = 0; i < texels.size(); i++)
+        texels[i] = uint8_t(i * 7 + i / 251);
+    Texture2D texture("bench_readback_texture", tw, th, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    std::vector<uint8_t> from_callback;
+    readback.read(texture, GL_RGBA, GL_UNSIGNED_BYTE, [&](const uint8_t *data, size_t size_bytes) {
+        from_callback.assign(data, data + size_bytes);
+    });
+    readback.finish();
+    ok &= report_check("Texture2D RGBA8, callback", texels, from_callback);
+
+    // the same texture as RGB: three bytes per texel, rows not a multiple of four bytes
+    std::vector<uint8_t> texels_rgb;
+    for (size_t i = 0; i < texels.size(); i += 4)
+        texels_rgb.insert(texels_rgb.end(), texels.begin() + i, texels.begin() + i + 3);
+    auto rgb = readback.read(texture, GL_RGB, GL_UNSIGNED_BYTE);
+    readback.finish();
+    ok &= report_check("Texture2D as RGB, future", texels_rgb, rgb.get());
+
+    // float 3D texture
+    const uint32_t vw = 17, vh = 9, vd = 5;
+    std::vector<float> voxels(vw * vh * vd);
+    for (size_t i = 0; i < voxels.size(); i++)
+        voxels[i] = float(i) * 0.25f - 100.f;
+    Texture3D volume("bench_readback_volume", vw, vh, vd, GL_R32F, GL_RED, GL_FLOAT, voxels.data());
+    auto volume_bytes = readback.read(volume, GL_RED, GL_FLOAT);
+    readback.finish();
+    std::vector<uint8_t> expected_voxels(voxels.size() * sizeof(float));
+    std::memcpy(expected_voxels.data(), voxels.data(), expected_voxels.size());
+    ok &= report_check("Texture3D R32F, future", expected_voxels, volume_bytes.get());
+
+    // storage buffer range starting at an unaligned offset
+    std::vector<uint8_t> buffer_data(4096);
+    for (size_t i = 0; i < buffer_data.size(); i++)
+        buffer_data[i] = uint8_t(255 - i % 253);
+    SSBO ssbo("bench_readback_ssbo");
+    ssbo->upload_data(buffer_data.data(), buffer_data.size());
+    auto range = readback.read(ssbo, 13, 1000);
+    readback.finish();
+    ok &= report_check("SSBO range [13, 1013), future",
+                       std::vector<uint8_t>(buffer_data.begin() + 13, buffer_data.begin() + 1013), range.get());
+
+    // framebuffer object with a color texture, odd region across all four quadrants
+    const int fw = 200, fh = 120, rx = 37, ry = 21, rw = 101, rh = 77;
+    Framebuffer fbo("bench_readback_fbo", fw, fh);
+    fbo->attach_colorbuffer(Texture2D("bench_readback_fbo_color", fw, fh, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE));
+    fbo->attach_depthbuffer();
+    fbo->check();
+    fbo->bind();
+    const std::vector<uint8_t> expected_fbo = paint_quadrants(fw, fh, rx, ry, rw, rh);
+    auto fbo_region = readback.read_framebuffer(rx, ry, rw, rh, GL_RGB, GL_UNSIGNED_BYTE);
+    fbo->unbind();
+    readback.finish();
+    ok &= report_check("Framebuffer region RGB, future", expected_fbo, fbo_region.get());
+
+    // default framebuffer, delivered by Context::swap_buffers instead of finish()
+    const ivec2 res = Context::resolution();
+    const std::vector<uint8_t> expected_default = paint_quadrants(res.x(), res.y(), 0, 0, res.x(), res.y());
+    std::vector<uint8_t> default_fb;
+    readback.read_framebuffer(0, 0, res.x(), res.y(), GL_RGB, GL_UNSIGNED_BYTE,
+                              [&](const uint8_t *data, size_t size_bytes) {
+                                  default_fb.assign(data, data + size_bytes);
+                              });
+    for (uint32_t frame = 0; frame < 100 && default_fb.empty(); frame++)
+        Context::swap_buffers();
+    ok &= report_check("default framebuffer RGB, polled by swap_buffers", expected_default, default_fb);
+
+    // more requests in flight than pack buffers: the oldest ones are waited for, all arrive in request order
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < 10; i++)
+        readback.read(ssbo, size_t(i), size_t(4), [&order, i](const uint8_t *, size_t) { order.push_back(i); });
+    readback.finish();
+    bool in_order = order.size() == 10;
+    for (uint32_t i = 0; i < order.size(); i++)
+        in_order &= order[i] == i;
+    std::printf("%-48s %s\n", "10 requests on 3 pack buffers, in order", in_order ? "ok" : "FAILED");
+    ok &= in_order;
+
+    // CPU time spent in the call: glReadPixels waits for the GPU, the asynchronous request does not
+    std::vector<uint8_t> pixels(size_t(res.x()) * res.y() * 4);
+    const double sync_ms = bench_median_ms(reads, [&] {
+        glClear(GL_COLOR_BUFFER_BIT);
+        glReadPixels(0, 0, res.x(), res.y(), GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    });
+    bench_report("glReadPixels into client memory", sync_ms);
+    const double async_ms = bench_median_ms(reads, [&] {
+        glClear(GL_COLOR_BUFFER_BIT);
+        readback.read_framebuffer(0, 0, res.x(), res.y(), GL_RGBA, GL_UNSIGNED_BYTE, [](const uint8_t *, size_t) {});
+        readback.poll();
+    });
+    readback.finish();
+    bench_report("GPUReadback::read_framebuffer + poll", async_ms);
+
+    return ok ? 0 : 1;
+}
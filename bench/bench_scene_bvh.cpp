@@ -0,0 +1,79 @@
+#include <cppgl.h>
+#include <random>
+#include <string>
+#include "bench.h"
+
+// frustum culling of many small drawelements: brute force box tests compared to SceneBVH::cull,
+// and the refit after a few elements moved. defaults to 1M elements, the scale the culling was designed for
+
+using namespace cppgl;
+
+int main(int argc, char **argv) {
+    const uint32_t num_elements = argc > 1 ? uint32_t(std::stoul(argv[1])) : 1000000;
+
+    ContextParameters params;
+    params.title = "bench_scene_bvh";
+    params.visible = GLFW_FALSE;
+    params.swap_interval = 0;
+    params.gl_debug_context = GLFW_FALSE;
+    Context::init(params);
+
+    // one unit cube shared by all elements, scattered in a box around the camera
+    const std::vector<vec3> positions = {vec3(-.5f, -.5f, -.5f), vec3(.5f, -.5f, -.5f), vec3(.5f, .5f, -.5f),
+                                         vec3(-.5f, .5f, -.5f), vec3(-.5f, -.5f, .5f), vec3(.5f, -.5f, .5f),
+                                         vec3(.5f, .5f, .5f), vec3(-.5f, .5f, .5f)};
+    const std::vector<uint32_t> indices = {0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+                                           3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5};
+    Mesh cube = MeshImpl::from_geometry("bench_cube", false, positions, indices);
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> coord(-500.f, 500.f);
+    std::vector<Drawelement> elements;
+    elements.reserve(num_elements);
+    SceneBVH bvh;
+    for (uint32_t i = 0; i < num_elements; i++) {
+        mat4 model = mat4::Identity();
+        model.block<3, 1>(0, 3) = vec3(coord(rng), coord(rng), coord(rng));
+        elements.push_back(Drawelement("bench_element_" + std::to_string(i), Shader(), cube, model));
+        bvh.insert(elements.back());
+    }
+
+    Camera cam("bench_cam");
+    cam->from_lookat(vec3(0, 0, 0), vec3(0, 0, 1));
+    cam->far = 400.f;
+    cam->update();
+    const FrustumPlanes frustum(cam);
+    std::printf("%u elements, %zu visible\n", num_elements, bvh.cull(frustum).size());
+
+    std::vector<uint32_t> visible;
+    const double brute_ms = bench_median_ms(11, [&] {
+        visible.clear();
+        const vec3 &local_min = cube->geometry->bb_min, &local_max = cube->geometry->bb_max;
+        for (uint32_t i = 0; i < num_elements; i++) {
+            const vec3 t = elements[i]->model.block<3, 1>(0, 3);
+            if (frustum.intersects(local_min + t, local_max + t))
+                visible.push_back(i);
+        }
+    });
+    bench_report("brute force cull", brute_ms);
+
+    const double cull_ms = bench_median_ms(11, [&] { bvh.cull(frustum); });
+    bench_report("SceneBVH::cull", cull_ms);
+
+    // 1% of the elements move per frame
+    const uint32_t moving = std::max(1u, num_elements / 100);
+    const double refit_ms = bench_median_ms(11, [&] {
+        for (uint32_t i = 0; i < moving; i++)
+            elements[rng() % num_elements]->set_model_translation(vec3(coord(rng), coord(rng), coord(rng)));
+        bvh.cull(frustum);
+    });
+    bench_report("SceneBVH refit (1% moved) + cull", refit_ms);
+
+    const double build_ms = bench_median_ms(5, [&] {
+        bvh.rebuild();
+        bvh.cull(frustum);
+    });
+    bench_report("SceneBVH rebuild + cull", build_ms);
+
+    bvh.clear();
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include <cppgl.h>
+#include <algorithm>
+#include <string>
+#include "bench.h"
+
+// records a frame sequence (1000 frames by default) in a hidden window through Context::screenshot and the global
+// ImageWriter (Policy::BLOCK), then through a small private writer with Policy::DROP. reports the recording rate,
+// the time wait_all takes afterwards and the peak bytes in flight, checks that the budget holds and every frame
+// that was not dropped is on disk (exit code 1 otherwise). frames are written to a temporary directory.
+// runs on a software context as well, e.g. LIBGL_ALWAYS_SOFTWARE=1 ./bench_screen_recording 1000 1920 1080
+
+using namespace cppgl;
+
+// a different clear color and a moving square per frame, so every image has to be encoded
+static void draw_frame(uint32_t frame, const ivec2 &res) {
+    glClearColor((frame % 256) / 255.f, 0.3f, 1.f - (frame % 256) / 255.f, 1.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(int(frame * 7) % std::max(1, res.x() - 64), int(frame * 3) % std::max(1, res.y() - 64), 64, 64);
+    glClearColor(1.f, 1.f, 1.f, 1.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
+}
+
+static uint32_t count_files(const fs::path &dir) {
+    uint32_t n = 0;
+    for (const auto &entry: fs::directory_iterator(dir))
+        n += entry.is_regular_file() && fs::file_size(entry.path()) > 0 ? 1 : 0;
+    return n;
+}
+
+static std::string frame_name(uint32_t frame, const std::string &extension) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%05u", frame);
+    return name + extension;
+}
+
+int main(int argc, char **argv) {
+    const uint32_t frames = argc > 1 ? uint32_t(std::stoul(argv[1])) : 1000;
+    const uint32_t width = argc > 2 ? uint32_t(std::stoul(argv[2])) : 1920;
+    const uint32_t height = argc > 3 ? uint32_t(std::stoul(argv[3])) : 1080;
+    const std::string extension = argc > 4 ? argv[4] : ".png";
+
+    ContextParameters params;
+    params.title = "bench_screen_recording";
+    params.width = width;
+    params.height = height;
+    params.visible = GLFW_FALSE;
+    params.swap_interval = 0;
+    params.gl_debug_context = GLFW_FALSE;
+    Context::init(params);
+    const ivec2 res = Context::resolution();
+    const size_t frame_bytes = size_t(res.x()) * res.y() * 3;
+    std::printf("%u frames of %dx%d RGB (%.1f MB), %s\n", frames, res.x(), res.y(),
+                frame_bytes / (1024.0 * 1024.0), extension.c_str());
+    bool ok = true;
+
+    const fs::path dir = fs::temp_directory_path() / "cppgl_bench_screen_recording";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    // Context::screenshot, blocking when the global writer is over budget
+    {
+        ImageWriter &writer = ImageWriter::global();
+        size_t peak_bytes = 0;
+        const double record_ms = bench_time_ms([&] {
+            for (uint32_t frame = 0; frame < frames; frame++) {
+                draw_frame(frame, res);
+                Context::screenshot(dir / frame_name(frame, extension));
+                Context::swap_buffers();
+                peak_bytes = std::max(peak_bytes, writer.bytes_in_flight());
+            }
+            GPUReadback::global().finish();
+        });
+        const double drain_ms = bench_time_ms([&] { writer.wait_all(); });
+        std::printf("%-48s %10.3f ms %10.1f frames/s\n", "Context::screenshot, Policy::BLOCK", record_ms,
+                    frames / (record_ms / 1000.0));
+        bench_report("  wait_all after the last frame", drain_ms);
+        std::printf("%-48s %10.1f MB\n", "  peak bytes in flight", peak_bytes / (1024.0 * 1024.0));
+        const uint32_t written = count_files(dir);
+        const bool complete = written == frames && writer.num_dropped() == 0;
+        std::printf("%-48s %u / %u: %s\n", "  frames on disk", written, frames, complete ? "ok" : "FAILED");
+        ok &= complete;
+    }
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    // private writer with room for four frames that drops instead of stalling the render loop
+    {
+        const size_t budget = 4 * frame_bytes;
+        ImageWriter writer(2, budget, ImageWriter::Policy::DROP);
+        size_t peak_bytes = 0;
+        const double record_ms = bench_time_ms([&] {
+            for (uint32_t frame = 0; frame < frames; frame++) {
+                draw_frame(frame, res);
+                const fs::path path = dir / frame_name(frame, extension);
+                GPUReadback::global().read_framebuffer(0, 0, res.x(), res.y(), GL_RGB, GL_UNSIGNED_BYTE,
+                                                       [&writer, path, res](const uint8_t *data, size_t size_bytes) {
+                                                           std::vector<uint8_t> pixels = writer.acquire(size_bytes);
+                                                           std::copy(data, data + size_bytes, pixels.begin());
+                                                           writer.store_ldr(path, std::move(pixels), res.x(),
+                                                                            res.y(), 3, true);
+                                                       });
+                Context::swap_buffers();
+                peak_bytes = std::max(peak_bytes, writer.bytes_in_flight());
+            }
+            GPUReadback::global().finish();
+        });
+        const double drain_ms = bench_time_ms([&] { writer.wait_all(); });
+        std::printf("%-48s %10.3f ms %10.1f frames/s\n", "4 frame budget, Policy::DROP", record_ms,
+                    frames / (record_ms / 1000.0));
+        bench_report("  wait_all after the last frame", drain_ms);
+        std::printf("%-48s %10.1f MB\n", "  peak bytes in flight", peak_bytes / (1024.0 * 1024.0));
+        const bool bounded = peak_bytes <= budget;
+        std::printf("%-48s %.1f MB: %s\n", "  within the budget", budget / (1024.0 * 1024.0),
+                    bounded ? "ok" : "FAILED");
+        const uint32_t written = count_files(dir);
+        const bool complete = written + writer.num_dropped() == frames;
+        std::printf("%-48s %u written, %llu dropped: %s\n", "  frames accounted for", written,
+                    (unsigned long long) writer.num_dropped(), complete ? "ok" : "FAILED");
+        ok &= bounded && complete;
+    }
+
+    fs::remove_all(dir);
+    return ok ? 0 : 1;
+}
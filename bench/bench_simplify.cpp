@@ -0,0 +1,99 @@
+#include <cppgl.h>
+#include <cmath>
+#include <string>
+#include "bench.h"
+
+// quadric error metric simplification of a procedural height field to several face ratios, and the frame time of
+// a row of copies drawn at full resolution vs. through a LODMesh in a hidden window
+
+using namespace cppgl;
+
+int main(int argc, char **argv) {
+    const uint32_t res = argc > 1 ? uint32_t(std::stoul(argv[1])) : 512;
+
+    // (res + 1)^2 vertices, 2 * res^2 faces with texcoords, so the uv seams stay out of the picture
+    std::vector<vec3> positions;
+    std::vector<vec2> texcoords;
+    std::vector<uint32_t> indices;
+    positions.reserve(size_t(res + 1) * (res + 1));
+    texcoords.reserve(size_t(res + 1) * (res + 1));
+    indices.reserve(size_t(res) * res * 6);
+    for (uint32_t y = 0; y <= res; y++)
+        for (uint32_t x = 0; x <= res; x++) {
+            const float u = float(x) / res, v = float(y) / res;
+            const float h = 0.05f * std::sin(12.f * u) * std::cos(9.f * v) + 0.01f * std::sin(61.f * u + 47.f * v);
+            positions.emplace_back(u, h, v);
+            texcoords.emplace_back(u, v);
+        }
+    for (uint32_t y = 0; y < res; y++)
+        for (uint32_t x = 0; x < res; x++) {
+            const uint32_t i = y * (res + 1) + x;
+            indices.insert(indices.end(), {i, i + res + 1, i + 1, i + 1, i + res + 1, i + res + 2});
+        }
+    Geometry grid("bench_grid", positions, indices, std::vector<vec3>(), texcoords);
+    std::printf("%zu vertices, %zu faces\n", positions.size(), indices.size() / 3);
+
+    for (float ratio: {0.5f, 0.25f, 0.05f}) {
+        SimplifyOptions options;
+        options.target_ratio = ratio;
+        SimplifyStats stats;
+        const double ms = bench_median_ms(3, [&] { simplify_indices(grid, options, &stats); });
+        const std::string name = "simplify_indices to " + std::to_string(int(ratio * 100)) + "% (" +
+                                 std::to_string(stats.faces_out) + " faces, " + std::to_string(stats.passes) +
+                                 " passes)";
+        bench_report(name.c_str(), ms);
+        std::printf("%-48s %10.2f M faces/s\n", "", stats.faces_per_second() / 1e6);
+    }
+
+    // LOD: copies along the view direction from close up to far away, each frame draws all of them
+    const uint32_t num_copies = argc > 2 ? uint32_t(std::stoul(argv[2])) : 32;
+    const uint32_t frames = 10;
+    ContextParameters params;
+    params.title = "bench_simplify";
+    params.visible = GLFW_FALSE;
+    params.swap_interval = 0;
+    params.gl_debug_context = GLFW_FALSE;
+    Context::init(params);
+    ShaderImpl::add_shader_search_path(CPPGL_BENCH_SHADER_DIR);
+    Shader shader("bench_simplify", "uniforms.vs", "color.fs");
+    Camera cam("bench_cam");
+    cam->from_lookat(vec3(0.5f, 1.f, 0.f), vec3(0.5f, 0.f, -4.f));
+    cam->update();
+    make_camera_current(cam);
+
+    Mesh base("bench_grid_mesh", grid);
+    LODMesh lod("bench_grid_lod", base, 6);
+    std::vector<Drawelement> elements;
+    for (uint32_t i = 0; i < num_copies; i++) {
+        mat4 model = mat4::Identity();
+        model(2, 3) = -1.f - 1.5f * float(i) * float(i) / float(num_copies);
+        elements.push_back(Drawelement("bench_lod_" + std::to_string(i), shader, base, model));
+    }
+    std::printf("%u copies, %u LOD levels, %u x %ux%u frames\n", num_copies, lod->num_levels(), frames,
+                Context::resolution().x(), Context::resolution().y());
+
+    const auto frame = [&](bool use_lod) {
+        uint64_t faces = 0;
+        const double ms = bench_median_ms(frames, [&] {
+            faces = 0;
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            for (auto &elem: elements) {
+                elem->mesh = use_lod ? lod->select(elem->model) : base;
+                faces += elem->mesh->num_indices / 3;
+                elem->bind();
+                elem->draw();
+                elem->unbind();
+            }
+            glFinish();
+        });
+        const std::string name = std::string(use_lod ? "frame, LODMesh::select" : "frame, full resolution") +
+                                 " (" + std::to_string(faces) + " faces)";
+        bench_report(name.c_str(), ms);
+        return ms;
+    };
+    glEnable(GL_DEPTH_TEST);
+    const double full_ms = frame(false);
+    const double lod_ms = frame(true);
+    std::printf("%-48s %10.2f x\n", "speedup from LOD", full_ms / lod_ms);
+    return 0;
+}
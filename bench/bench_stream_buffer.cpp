@@ -0,0 +1,53 @@
+#include <cppgl.h>
+#include <cstring>
+#include "bench.h"
+
+// per-draw uniform writes through a persistently mapped StreamUBO compared to glBufferSubData into a UBO
+
+using namespace cppgl;
+
+static const size_t CHUNK_BYTES = 256;                 // one draw's uniforms
+static const size_t FRAME_BYTES = 4 * 1024 * 1024;
+static const uint32_t FRAMES = 64;
+
+int main(int argc, char **argv) {
+    ContextParameters params;
+    params.title = "bench_stream_buffer";
+    params.visible = GLFW_FALSE;
+    params.swap_interval = 0;
+    params.gl_debug_context = GLFW_FALSE;
+    Context::init(params);
+
+    std::vector<uint8_t> payload(CHUNK_BYTES, 0x5a);
+    const size_t chunks = FRAME_BYTES / CHUNK_BYTES;
+    const double bytes = double(chunks * CHUNK_BYTES) * FRAMES;
+
+    StreamUBO stream("bench_stream", FRAME_BYTES);
+    const double stream_ms = bench_median_ms(5, [&] {
+        for (uint32_t f = 0; f < FRAMES; f++) {
+            for (size_t c = 0; c < chunks; c++) {
+                const auto allocation = stream->upload(payload.data(), CHUNK_BYTES);
+                if (!allocation)
+                    break;
+                stream->bind_range(0, allocation);
+            }
+            stream->next_frame();
+        }
+        glFinish();
+    });
+    bench_report_throughput("StreamUBO upload + bind_range", stream_ms, bytes);
+
+    UBO ubo("bench_ubo");
+    ubo->upload_data(nullptr, FRAME_BYTES);
+    const double subdata_ms = bench_median_ms(5, [&] {
+        for (uint32_t f = 0; f < FRAMES; f++)
+            for (size_t c = 0; c < chunks; c++) {
+                ubo->upload_subdata(payload.data(), c * CHUNK_BYTES, CHUNK_BYTES);
+                glBindBufferRange(GL_UNIFORM_BUFFER, 0, ubo->id, c * CHUNK_BYTES, CHUNK_BYTES);
+            }
+        glFinish();
+    });
+    bench_report_throughput("UBO glBufferSubData + bind_range", subdata_ms, bytes);
+
+    return 0;
+}
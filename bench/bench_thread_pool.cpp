@@ -0,0 +1,130 @@
+#include <cppgl.h>
+#include <utils/parallel.h>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include "bench.h"
+
+// ThreadPool / TaskGroup scaling over 1..N workers, plus checks (exit code 1 on failure) for nested parallel_for,
+// exception propagation out of a TaskGroup, a bounded queue and shutdown, CPU only
+
+using namespace cppgl;
+
+// some floating point work per element, so the tasks are not just scheduling overhead
+static float work(uint32_t i) {
+    float x = float(i);
+    for (uint32_t k = 0; k < 16; k++)
+        x = std::sqrt(x + 1.f) * 1.0001f;
+    return x;
+}
+
+static bool report_check(const char *name, bool ok) {
+    std::printf("%-48s %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const uint32_t n = argc > 1 ? uint32_t(std::stoul(argv[1])) : 4000000;
+    // more workers than hardware threads are allowed, to check the scheduling under oversubscription
+    const uint32_t max_threads = argc > 2 ? uint32_t(std::stoul(argv[2]))
+                                          : std::max(1u, std::thread::hardware_concurrency());
+    const uint32_t grain = 16384;
+    bool ok = true;
+
+    // scaling: the same chunked loop as a TaskGroup on pools with 1, 2, 4, ... workers
+    std::vector<float> out(n);
+    for (uint32_t num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        ThreadPool pool(num_threads);
+        const double ms = bench_median_ms(3, [&] {
+            TaskGroup group(pool);
+            for (uint32_t begin = 0; begin < n; begin += grain)
+                group.run([&out, begin, end = std::min(n, begin + grain)]() {
+                    for (uint32_t i = begin; i < end; i++)
+                        out[i] = work(i);
+                });
+            group.wait();
+        });
+        const std::string name = std::to_string(num_threads) + " threads, " + std::to_string(n) + " elements";
+        bench_report(name.c_str(), ms);
+        std::printf("%-48s %10.1f M elements/s\n", "", double(n) / (ms * 1000.0));
+    }
+    const double serial_ms = bench_median_ms(3, [&] {
+        for (uint32_t i = 0; i < n; i++)
+            out[i] = work(i);
+    });
+    bench_report("serial loop", serial_ms);
+
+    // nested parallel_for: inner loops run from inside pool tasks and must neither deadlock nor lose ranges
+    {
+        const uint32_t outer = 64, inner = 100000;
+        std::vector<std::atomic<uint32_t>> hits(outer);
+        const double ms = bench_median_ms(1, [&] {
+            for (auto &h: hits)
+                h = 0;
+            parallel_for(0, outer, [&](uint32_t ob, uint32_t oe) {
+                for (uint32_t o = ob; o < oe; o++)
+                    parallel_for(0, inner, [&](uint32_t ib, uint32_t ie) { hits[o] += ie - ib; }, 4096);
+            }, 1);
+        });
+        bool complete = true;
+        for (const auto &h: hits)
+            complete &= h == inner;
+        bench_report("nested parallel_for (64 x 100000)", ms);
+        ok &= report_check("  every inner range visited once", complete);
+    }
+
+    // exceptions: wait() rethrows the first one, every other task of the group still runs
+    {
+        std::atomic<uint32_t> finished(0);
+        bool caught = false;
+        try {
+            TaskGroup group;
+            for (uint32_t t = 0; t < 256; t++)
+                group.run([&finished, t]() {
+                    finished++;
+                    if (t % 16 == 3)
+                        throw std::runtime_error("bench task " + std::to_string(t));
+                });
+            group.wait();
+        } catch (const std::runtime_error &e) {
+            caught = std::string(e.what()).rfind("bench task ", 0) == 0;
+        }
+        ok &= report_check("TaskGroup rethrows a task exception", caught && finished == 256);
+
+        // a throwing parallel_for chunk has to surface on the calling thread as well
+        bool caught_parallel_for = false;
+        try {
+            parallel_for(0, 1u << 20, [](uint32_t begin, uint32_t) {
+                if (begin > 0)
+                    throw std::runtime_error("bench chunk");
+            }, 1024);
+        } catch (const std::runtime_error &) {
+            caught_parallel_for = true;
+        }
+        ok &= report_check("parallel_for rethrows a chunk exception", caught_parallel_for ||
+                                                                       parallel_num_threads() == 1);
+    }
+
+    // bounded queue: producers block instead of growing the queue past max_queued, all tasks still run
+    {
+        ThreadPool pool(2, 8);
+        std::atomic<uint32_t> sum(0);
+        std::vector<std::future<uint32_t>> results;
+        bool bounded = true;
+        for (uint32_t t = 0; t < 1000; t++) {
+            results.push_back(pool.submit([t]() { return t; }));
+            bounded &= pool.num_queued() <= 8;
+        }
+        for (auto &r: results)
+            sum += r.get();
+        ok &= report_check("bounded queue (8), 1000 futures", bounded && sum == 999 * 1000 / 2);
+
+        pool.shutdown();
+        std::atomic<bool> ran(false);
+        pool.enqueue([&ran]() { ran = true; });
+        ok &= report_check("shutdown: 0 threads, later tasks run inline", pool.num_threads() == 0 && ran);
+    }
+
+    return ok ? 0 : 1;
+}
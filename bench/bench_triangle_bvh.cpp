@@ -0,0 +1,92 @@
+#include <cppgl.h>
+#include <cmath>
+#include <string>
+#include "bench.h"
+
+// TriangleBVH on degenerate inputs (checked, exit code 1 on a wrong hit or a too deep tree) and rays per second
+// on a regular grid, CPU only
+
+using namespace cppgl;
+
+// small triangles in the xz plane at y = 0, with the lower left corner at 'corner'
+static void add_triangle(std::vector<vec3> &positions, const vec3 &corner, float size) {
+    positions.push_back(corner);
+    positions.push_back(corner + vec3(size, 0, 0));
+    positions.push_back(corner + vec3(0, 0, size));
+}
+
+// rays straight down onto every triangle have to hit one of them
+static bool check(const char *name, const std::vector<vec3> &positions) {
+    GeometryBase soup = Geometry(std::string("bench_") + name, positions);
+    TriangleBVH bvh(soup);
+    uint32_t misses = 0;
+    for (size_t f = 0; f < positions.size() / 3; f++) {
+        const vec3 &p0 = positions[3 * f], &p1 = positions[3 * f + 1], &p2 = positions[3 * f + 2];
+        const vec3 center = (p0 + p1 + p2) / 3.f;
+        const Ray ray(center + vec3(0, std::max(1.f, std::abs(center.y())), 0), vec3(0, -1, 0));
+        if (!bvh.intersect(ray) || !bvh.occluded(ray))
+            misses++;
+    }
+    const bool ok = misses == 0 && bvh.depth() <= 60;
+    std::printf("%-48s %u faces, depth %u, %u misses: %s\n", name, bvh.num_triangles(), bvh.depth(), misses,
+                ok ? "ok" : "FAILED");
+    bvh.clear();
+    soup.free(true);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    bool ok = true;
+
+    // all faces on top of each other: no split plane separates them
+    std::vector<vec3> coincident;
+    for (uint32_t i = 0; i < 20000; i++)
+        add_triangle(coincident, vec3(0, 0, 0), 1.f);
+    ok &= check("coincident", coincident);
+
+    // faces along a line
+    std::vector<vec3> collinear;
+    for (uint32_t i = 0; i < 20000; i++)
+        add_triangle(collinear, vec3(float(i), 0, 0), 0.5f);
+    ok &= check("collinear", collinear);
+
+    // a large cluster plus outliers at exponentially growing distances along all three axes: every split cuts off
+    // a few outliers and leaves the cluster on the side that is built as a separate task, 90+ levels without the
+    // depth limit
+    std::vector<vec3> chain;
+    for (uint32_t i = 0; i < 5000; i++)
+        add_triangle(chain, vec3(0, 0, 0), 1e-30f);
+    for (int i = -150; i <= 150; i++)
+        for (int a = 0; a < 3; a++) {
+            const float x = std::pow(1.3f, float(i));
+            vec3 corner = vec3::Zero();
+            corner[a] = -x;
+            add_triangle(chain, corner, 0.01f * x);
+        }
+    ok &= check("cluster with exponential outliers", chain);
+
+    // throughput: closest hits on a height field seen from above
+    const uint32_t res = argc > 1 ? uint32_t(std::stoul(argv[1])) : 512;
+    std::vector<vec3> grid;
+    for (uint32_t y = 0; y < res; y++)
+        for (uint32_t x = 0; x < res; x++) {
+            const vec3 corner(float(x), std::sin(0.1f * x) * std::cos(0.07f * y), float(y));
+            add_triangle(grid, corner, 1.f);
+        }
+    Geometry grid_geometry("bench_grid", grid);
+    TriangleBVH bvh;
+    const double build_ms = bench_median_ms(3, [&] { bvh.build(grid_geometry); });
+    bench_report(("build (" + std::to_string(bvh.num_triangles()) + " faces)").c_str(), build_ms);
+
+    std::vector<Ray> rays;
+    for (uint32_t i = 0; i < 1000000; i++) {
+        const float x = float(i % 1000) / 1000.f * res, z = float(i / 1000) / 1000.f * res;
+        rays.emplace_back(vec3(x, 10.f, z), vec3(0.1f, -1.f, 0.05f));
+    }
+    std::vector<RayHit> hits;
+    const double trace_ms = bench_median_ms(3, [&] { bvh.intersect(rays, hits); });
+    bench_report("intersect (1M rays)", trace_ms);
+    std::printf("%-48s %10.1f Mrays/s\n", "", double(rays.size()) / (trace_ms * 1000.0));
+
+    return ok ? 0 : 1;
+}
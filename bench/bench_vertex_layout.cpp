@@ -0,0 +1,96 @@
+#include <cppgl.h>
+#include <cmath>
+#include <string>
+#include "bench.h"
+
+// upload_gpu time, buffer objects and vertex memory of a scene of many meshes with normals, texcoords and two
+// extra attributes, for each VertexLayout kind, in a hidden window (use a software context with
+// LIBGL_ALWAYS_SOFTWARE=1 for comparable runs). checks the expected buffer count per mesh (exit code 1 otherwise)
+
+using namespace cppgl;
+
+static GeometryBase make_height_field(const std::string &name, uint32_t res, uint32_t seed) {
+    std::vector<vec3> positions, tangents;
+    std::vector<vec2> texcoords;
+    std::vector<vec4> colors;
+    std::vector<uint32_t> indices;
+    for (uint32_t y = 0; y <= res; y++)
+        for (uint32_t x = 0; x <= res; x++) {
+            const float u = float(x) / res, v = float(y) / res;
+            positions.emplace_back(u, 0.05f * std::sin((10.f + seed) * u) * std::cos(7.f * v), v);
+            texcoords.emplace_back(u, v);
+            tangents.emplace_back(1.f, 0.f, 0.f);
+            colors.emplace_back(u, v, 0.5f, 1.f);
+        }
+    for (uint32_t y = 0; y < res; y++)
+        for (uint32_t x = 0; x < res; x++) {
+            const uint32_t i = y * (res + 1) + x;
+            indices.insert(indices.end(), {i, i + res + 1, i + 1, i + 1, i + res + 1, i + res + 2});
+        }
+    const std::vector<vec3> normals = generate_vertex_normals(positions, indices);
+    GeometryBase geometry = Geometry(name, positions, indices, normals, texcoords);
+    geometry->add_attribute_vec3("tangent", tangents);
+    geometry->add_attribute_vec4("color", colors);
+    return geometry;
+}
+
+int main(int argc, char **argv) {
+    const uint32_t num_meshes = argc > 1 ? uint32_t(std::stoul(argv[1])) : 500;
+    const uint32_t res = argc > 2 ? uint32_t(std::stoul(argv[2])) : 128;
+    const uint32_t num_attributes = 5;
+
+    ContextParameters params;
+    params.title = "bench_vertex_layout";
+    params.visible = GLFW_FALSE;
+    params.swap_interval = 0;
+    params.gl_debug_context = GLFW_FALSE;
+    Context::init(params);
+
+    std::vector<GeometryBase> geometries;
+    for (uint32_t m = 0; m < num_meshes; m++)
+        geometries.push_back(make_height_field("bench_layout_" + std::to_string(m), res, m));
+    std::printf("%u meshes, %u vertices and %u attributes each\n", num_meshes, (res + 1) * (res + 1),
+                num_attributes);
+    bool ok = true;
+
+    const auto run = [&](const char *name, const VertexLayout &layout, uint32_t expected_buffers) {
+        std::vector<Mesh> meshes;
+        // the first upload happens in the constructor
+        const double create_ms = bench_time_ms([&] {
+            for (uint32_t m = 0; m < num_meshes; m++)
+                meshes.push_back(Mesh(std::string(name) + "_" + std::to_string(m), geometries[m], Material(),
+                                      GL_STATIC_DRAW, layout));
+            glFinish();
+        });
+        const double upload_ms = bench_median_ms(3, [&] {
+            for (auto &mesh: meshes)
+                mesh->upload_gpu();
+            glFinish();
+        });
+        uint32_t buffers = 0;
+        size_t bytes = 0;
+        for (const auto &mesh: meshes) {
+            buffers += mesh->num_vertex_buffers();
+            bytes += mesh->vertex_memory();
+        }
+        std::printf("%s:\n", name);
+        bench_report("  construction (first upload_gpu)", create_ms);
+        bench_report_throughput("  upload_gpu, all meshes", upload_ms, double(bytes));
+        const bool expected = buffers == expected_buffers * num_meshes;
+        std::printf("  %-46s %10u (%u per mesh): %s\n", "vertex buffer objects", buffers, buffers / num_meshes,
+                    expected ? "ok" : "FAILED");
+        std::printf("  %-46s %10.2f MB\n", "vertex memory", bytes / (1024.0 * 1024.0));
+        ok &= expected;
+        for (auto &mesh: meshes)
+            mesh.free(true);
+    };
+
+    run("SEPARATE", VertexLayout(VertexLayout::SEPARATE), num_attributes);
+    run("INTERLEAVED", VertexLayout(VertexLayout::INTERLEAVED), 1);
+    run("POSITIONS_SEPARATE", VertexLayout(VertexLayout::POSITIONS_SEPARATE), 2);
+    // hybrid: positions and normals for the depth and shading passes, everything else in a second buffer
+    run("custom: position + normal, rest", VertexLayout(VertexLayout::INTERLEAVED).assign("texcoord", 1)
+            .assign("tangent", 1).assign("color", 1), 2);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+#include <cppgl.h>
+#include <cmath>
+#include <string>
+#include "bench.h"
+
+// GPU bytes per vertex and encoding error of each AttributeEncoding, uploaded interleaved for a height field with
+// normals and texcoords in a hidden window. checks that UNORM16 positions are encoded relative to the geometry's
+// bounding box and that the compact layout at least halves the float one (exit code 1 otherwise)
+
+using namespace cppgl;
+
+int main(int argc, char **argv) {
+    const uint32_t res = argc > 1 ? uint32_t(std::stoul(argv[1])) : 512;
+
+    ContextParameters params;
+    params.title = "bench_vertex_quantization";
+    params.visible = GLFW_FALSE;
+    params.swap_interval = 0;
+    params.gl_debug_context = GLFW_FALSE;
+    Context::init(params);
+
+    std::vector<vec3> positions;
+    std::vector<vec2> texcoords;
+    std::vector<uint32_t> indices;
+    for (uint32_t y = 0; y <= res; y++)
+        for (uint32_t x = 0; x <= res; x++) {
+            const float u = float(x) / res, v = float(y) / res;
+            positions.emplace_back(10.f * u, 0.5f * std::sin(40.f * u) * std::cos(31.f * v), 10.f * v);
+            texcoords.emplace_back(u, v);
+        }
+    for (uint32_t y = 0; y < res; y++)
+        for (uint32_t x = 0; x < res; x++) {
+            const uint32_t i = y * (res + 1) + x;
+            indices.insert(indices.end(), {i, i + res + 1, i + 1, i + 1, i + res + 1, i + res + 2});
+        }
+    const std::vector<vec3> normals = generate_vertex_normals(positions, indices);
+    GeometryBase geometry = Geometry("bench_quantization", positions, indices, normals, texcoords);
+    std::printf("%zu vertices, interleaved\n", positions.size());
+    bool ok = true;
+
+    // vertex bytes per vertex of the whole layout, printed per attribute with the encoding error
+    const auto run = [&](const std::string &name, const VertexLayout &layout) {
+        Mesh mesh(name, geometry, Material(), GL_STATIC_DRAW, layout);
+        const double bytes_per_vertex = double(mesh->vertex_memory()) / mesh->num_vertices;
+        std::printf("%-48s %10.1f bytes / vertex\n", name.c_str(), bytes_per_vertex);
+        for (const auto &[id, quant]: mesh->quantization)
+            std::printf("  %-46s %4u -> %2u bytes, error max %g mean %g%s\n",
+                        (quant.name + " " + encoding_to_str(quant.encoding)).c_str(), quant.float_bytes, quant.bytes,
+                        quant.error.max, quant.error.mean, quant.name == "normal" ? " degrees" : "");
+        const auto position = mesh->quantization.find(0);
+        if (position != mesh->quantization.end() && position->second.encoding == AttributeEncoding::UNORM16) {
+            const vec3 min = position->second.min.head<3>();
+            const vec3 max = min + position->second.extent.head<3>();
+            const float diff = std::max((min - geometry->bb_min).cwiseAbs().maxCoeff(),
+                                        (max - geometry->bb_max).cwiseAbs().maxCoeff());
+            const bool box = diff < 1e-5f;
+            std::printf("  %-46s %s\n", "position range is the geometry's bounding box", box ? "ok" : "FAILED");
+            ok &= box;
+        }
+        mesh.free(true);
+        return bytes_per_vertex;
+    };
+
+    const double float_bytes = run("FLOAT", VertexLayout(VertexLayout::INTERLEAVED));
+    run("position UNORM16", VertexLayout(VertexLayout::INTERLEAVED).encode("position", AttributeEncoding::UNORM16));
+    run("position HALF", VertexLayout(VertexLayout::INTERLEAVED).encode("position", AttributeEncoding::HALF));
+    run("normal OCT_SNORM16", VertexLayout(VertexLayout::INTERLEAVED).encode("normal", AttributeEncoding::OCT_SNORM16));
+    run("normal SNORM_10_10_10_2",
+        VertexLayout(VertexLayout::INTERLEAVED).encode("normal", AttributeEncoding::SNORM_10_10_10_2));
+    run("texcoord HALF", VertexLayout(VertexLayout::INTERLEAVED).encode("texcoord", AttributeEncoding::HALF));
+    run("texcoord UNORM16", VertexLayout(VertexLayout::INTERLEAVED).encode("texcoord", AttributeEncoding::UNORM16));
+    const double compact_bytes = run("UNORM16 / SNORM_10_10_10_2 / HALF",
+                                     VertexLayout(VertexLayout::INTERLEAVED)
+                                             .encode("position", AttributeEncoding::UNORM16)
+                                             .encode("normal", AttributeEncoding::SNORM_10_10_10_2)
+                                             .encode("texcoord", AttributeEncoding::HALF));
+    const bool halved = compact_bytes * 2.0 <= float_bytes;
+    std::printf("%-48s %10.2f x: %s\n", "compact layout vs float", float_bytes / compact_bytes,
+                halved ? "ok" : "FAILED");
+    ok &= halved;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,7 @@
+#version 330
+in vec3 norm_wc;
+out vec4 out_col;
+
+void main() {
+    out_col = vec4(normalize(norm_wc) * 0.5 + 0.5, 1.0);
+}
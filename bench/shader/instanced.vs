@@ -0,0 +1,14 @@
+#version 330
+layout (location = 0) in vec3 in_pos;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 proj;
+
+out vec3 norm_wc;
+
+void main() {
+    mat4 instance_model = model * cppgl_instance_model;
+    norm_wc = mat3(instance_model) * normalize(in_pos);
+    gl_Position = proj * view * instance_model * vec4(in_pos, 1.0);
+}
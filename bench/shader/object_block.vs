@@ -0,0 +1,10 @@
+#version 330
+layout (location = 0) in vec3 in_pos;
+
+out vec3 norm_wc;
+
+// cppgl_frame and cppgl_object are declared by cppgl
+void main() {
+    norm_wc = mat3(cppgl_object.model_normal) * normalize(in_pos);
+    gl_Position = cppgl_frame.view_proj * cppgl_object.model * vec4(in_pos, 1.0);
+}
@@ -0,0 +1,15 @@
+#version 330
+layout (location = 0) in vec3 in_pos;
+
+uniform mat4 model;
+uniform mat4 model_normal;
+uniform mat4 view;
+uniform mat4 view_normal;
+uniform mat4 proj;
+
+out vec3 norm_wc;
+
+void main() {
+    norm_wc = mat3(model_normal) * normalize(in_pos);
+    gl_Position = proj * view * model * vec4(in_pos, 1.0);
+}
@@ -66,7 +66,18 @@ int main(int argc, char** argv) {
     //Context::set_keyboard_callback(keyboard_callback);
     //Context::set_mouse_button_callback(mouse_button_callback);
     static bool doGreyscaleComputeShaderExample = false;
-    gui_add_callback("example_gui_callback", [] { ImGui::ShowMetricsWindow(); ImGui::Checkbox("compute shader example: convert to greyscale", &doGreyscaleComputeShaderExample); });
+    static RenderQueue render_queue;
+    gui_add_callback("example_gui_callback", [] {
+        ImGui::ShowMetricsWindow();
+        ImGui::Checkbox("compute shader example: convert to greyscale", &doGreyscaleComputeShaderExample);
+        // binds of the sorted queue vs. bind / draw / unbind per drawelement
+        const RenderQueue::Stats &s = render_queue.stats, &u = render_queue.unsorted_stats;
+        ImGui::Text("draws: %u", s.draws);
+        ImGui::Text("program binds: %u (unsorted: %u)", s.program_binds, u.program_binds);
+        ImGui::Text("VAO binds: %u (unsorted: %u)", s.vao_binds, u.vao_binds);
+        ImGui::Text("material binds: %u (unsorted: %u)", s.material_binds, u.material_binds);
+        ImGui::Text("texture binds: %u (unsorted: %u)", s.texture_binds, u.texture_binds);
+    });
 
     // parse cmd line args
     for (int i = 1; i < argc; ++i) {
@@ -113,11 +124,10 @@ int main(int argc, char** argv) {
             Quad::draw();
             fallbackShader->unbind();
         } else {
-            for (const auto& [key, drawelement] : Drawelement::map) {
-                drawelement->bind();
-                drawelement->draw();
-                drawelement->unbind();
-            }
+            for (const auto& [key, drawelement] : Drawelement::map)
+                render_queue.push(drawelement);
+            render_queue.submit();
+            render_queue.clear();
         }
         fbo->unbind();
 
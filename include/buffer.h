@@ -1,5 +1,9 @@
 #pragma once
 
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include "named_handle.h"
@@ -85,6 +89,12 @@ CPPGL_NAMESPACE_BEGIN
             return glMapBuffer(GL_TEMPLATE_BUFFER, access);
         }
 
+        // map only a byte range, with GL_MAP_WRITE_BIT alone the rest of the range keeps its contents
+        void *map_range(size_t offset_bytes, size_t size_bytes, GLbitfield access) const {
+            bind();
+            return glMapBufferRange(GL_TEMPLATE_BUFFER, offset_bytes, size_bytes, access);
+        }
+
         void unmap() const {
             glUnmapBuffer(GL_TEMPLATE_BUFFER);
             unbind();
@@ -96,6 +106,140 @@ CPPGL_NAMESPACE_BEGIN
         size_t size_bytes;
     };
 
+// ----------------------------------------------------
+// StreamBufferImpl
+// per-frame dynamic data without reallocation or driver copies: immutable storage (glBufferStorage) that stays
+// mapped persistent and coherent, split into num_frames regions. allocate() suballocates from the current
+// region, next_frame() fences it and moves on, waiting only if the GPU still reads the region it returns to
+
+    template<GLenum GL_TEMPLATE_BUFFER>
+    class StreamBufferImpl {
+    public:
+        struct Allocation {
+            explicit inline operator bool() const { return ptr != nullptr; }
+
+            void *ptr;      // write-only, visible to the GPU without flushing
+            size_t offset;  // byte offset into the whole buffer, e.g. for bind_range or glVertexAttribPointer
+            size_t size;
+        };
+
+        StreamBufferImpl(const std::string &name, size_t frame_size_bytes, uint32_t num_frames = 3)
+                : name(name), frame_size_bytes(frame_size_bytes), num_frames(std::max(1u, num_frames)), frame(0),
+                  head(0), fences(this->num_frames, nullptr) {
+            if (!GLEW_VERSION_4_4 && !GLEW_ARB_buffer_storage)
+                throw std::runtime_error("StreamBuffer " + name + ": glBufferStorage (GL 4.4) is not available");
+            // UBO / SSBO ranges must start at an implementation defined alignment
+            GLint offset_alignment = 16;
+            if (GL_TEMPLATE_BUFFER == GL_UNIFORM_BUFFER)
+                glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+            else if (GL_TEMPLATE_BUFFER == GL_SHADER_STORAGE_BUFFER)
+                glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+            min_alignment = std::max<size_t>(16, offset_alignment);
+            // every frame region starts aligned, so offsets aligned within a region are aligned in the buffer
+            this->frame_size_bytes = (frame_size_bytes + min_alignment - 1) / min_alignment * min_alignment;
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            size_bytes = this->frame_size_bytes * this->num_frames;
+            glGenBuffers(1, &id);
+            bind();
+            glBufferStorage(GL_TEMPLATE_BUFFER, size_bytes, nullptr, flags);
+            mapped = static_cast<uint8_t *>(glMapBufferRange(GL_TEMPLATE_BUFFER, 0, size_bytes, flags));
+            unbind();
+            if (!mapped)
+                throw std::runtime_error("StreamBuffer " + name + ": persistent mapping failed");
+        }
+
+        virtual ~StreamBufferImpl() {
+            for (GLsync fence: fences)
+                if (fence)
+                    glDeleteSync(fence);
+            bind();
+            glUnmapBuffer(GL_TEMPLATE_BUFFER);
+            unbind();
+            glDeleteBuffers(1, &id);
+        }
+
+        // prevent copies and moves, since GL buffers aren't reference counted
+        StreamBufferImpl(const StreamBufferImpl &) = delete;
+
+        StreamBufferImpl &operator=(const StreamBufferImpl &) = delete;
+
+        StreamBufferImpl &operator=(const StreamBufferImpl &&) = delete;
+
+        explicit inline operator bool() const { return glIsBuffer(id) && mapped != nullptr; }
+
+        inline operator GLuint() const { return id; }
+
+        // bind/unbind to/from OpenGL
+        void bind() const {
+            glBindBuffer(GL_TEMPLATE_BUFFER, id);
+        }
+
+        void unbind() const {
+            glBindBuffer(GL_TEMPLATE_BUFFER, 0);
+        }
+
+        void bind_base(uint32_t unit) const {
+            glBindBufferBase(GL_TEMPLATE_BUFFER, unit, id);
+        }
+
+        void bind_range(uint32_t unit, const Allocation &allocation) const {
+            glBindBufferRange(GL_TEMPLATE_BUFFER, unit, id, allocation.offset, allocation.size);
+        }
+
+        void unbind_base(uint32_t unit) const {
+            glBindBufferBase(GL_TEMPLATE_BUFFER, unit, 0);
+        }
+
+        // suballocate from the current frame region, returns an empty allocation if the region is exhausted
+        // alignment 0: the minimum offset alignment of the buffer type (at least 16 bytes)
+        Allocation allocate(size_t size, size_t alignment = 0) {
+            alignment = std::max(alignment, min_alignment);
+            // aligned in the whole buffer, larger alignments need not divide the region size
+            const size_t base = frame * frame_size_bytes;
+            const size_t begin = (base + head + alignment - 1) / alignment * alignment - base;
+            if (begin + size > frame_size_bytes)
+                return Allocation{nullptr, 0, 0};
+            head = begin + size;
+            const size_t offset = base + begin;
+            return Allocation{mapped + offset, offset, size};
+        }
+
+        // allocate and copy in one go
+        Allocation upload(const void *data, size_t size, size_t alignment = 0) {
+            const Allocation allocation = allocate(size, alignment);
+            if (allocation)
+                std::memcpy(allocation.ptr, data, size);
+            return allocation;
+        }
+
+        // call once all draws reading this frame's allocations are issued (e.g. before Context::swap_buffers)
+        void next_frame() {
+            fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            frame = (frame + 1) % num_frames;
+            head = 0;
+            if (fences[frame]) {
+                glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(fences[frame]);
+                fences[frame] = nullptr;
+            }
+        }
+
+        // bytes still available in the current frame region
+        inline size_t available() const { return frame_size_bytes - std::min(head, frame_size_bytes); }
+
+        // data
+        const std::string name;
+        GLuint id;
+        size_t size_bytes;
+        size_t frame_size_bytes;    // rounded up to min_alignment
+        const uint32_t num_frames;
+        uint32_t frame;
+        size_t head;
+        size_t min_alignment;
+        uint8_t *mapped;
+        std::vector<GLsync> fences;
+    };
+
 // ----------------------------------------------------
 // Specialized GL buffers
 
@@ -114,6 +258,12 @@ CPPGL_NAMESPACE_BEGIN
     using CRBO = NamedHandle<GLBufferImpl<GL_COPY_READ_BUFFER>>;
     using CWBO = NamedHandle<GLBufferImpl<GL_COPY_WRITE_BUFFER>>;
 
+    using StreamVBO = NamedHandle<StreamBufferImpl<GL_ARRAY_BUFFER>>;
+    using StreamIBO = NamedHandle<StreamBufferImpl<GL_ELEMENT_ARRAY_BUFFER>>;
+    using StreamUBO = NamedHandle<StreamBufferImpl<GL_UNIFORM_BUFFER>>;
+    using StreamSSBO = NamedHandle<StreamBufferImpl<GL_SHADER_STORAGE_BUFFER>>;
+    using StreamDIBO = NamedHandle<StreamBufferImpl<GL_DRAW_INDIRECT_BUFFER>>;
+
 // explicit instanciation needed for Windows DLL export
     template
     class GLBufferImpl<GL_ARRAY_BUFFER>;
@@ -157,6 +307,21 @@ CPPGL_NAMESPACE_BEGIN
     template
     class GLBufferImpl<GL_COPY_WRITE_BUFFER>;
 
+    template
+    class StreamBufferImpl<GL_ARRAY_BUFFER>;
+
+    template
+    class StreamBufferImpl<GL_ELEMENT_ARRAY_BUFFER>;
+
+    template
+    class StreamBufferImpl<GL_UNIFORM_BUFFER>;
+
+    template
+    class StreamBufferImpl<GL_SHADER_STORAGE_BUFFER>;
+
+    template
+    class StreamBufferImpl<GL_DRAW_INDIRECT_BUFFER>;
+
 // needed for Windows DLL export
     template
     class _API NamedHandle<GLBufferImpl<GL_ARRAY_BUFFER>>;
@@ -200,4 +365,19 @@ CPPGL_NAMESPACE_BEGIN
     template
     class _API NamedHandle<GLBufferImpl<GL_COPY_WRITE_BUFFER>>;
 
+    template
+    class _API NamedHandle<StreamBufferImpl<GL_ARRAY_BUFFER>>;
+
+    template
+    class _API NamedHandle<StreamBufferImpl<GL_ELEMENT_ARRAY_BUFFER>>;
+
+    template
+    class _API NamedHandle<StreamBufferImpl<GL_UNIFORM_BUFFER>>;
+
+    template
+    class _API NamedHandle<StreamBufferImpl<GL_SHADER_STORAGE_BUFFER>>;
+
+    template
+    class _API NamedHandle<StreamBufferImpl<GL_DRAW_INDIRECT_BUFFER>>;
+
 CPPGL_NAMESPACE_END
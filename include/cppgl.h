@@ -24,4 +24,17 @@
 #include "shader.h"
 #include "texture.h"
 #include "mesh_utils.h"
-#include "mesh_templates.h"
\ No newline at end of file
+#include "mesh_templates.h"
+#include "mesh_adjacency.h"
+#include "mesh_cache.h"
+#include "mesh_export.h"
+#include "thread_pool.h"
+#include "readback.h"
+#include "frame_uniforms.h"
+#include "render_queue.h"
+#include "draw_batch.h"
+#include "scene_bvh.h"
+#include "triangle_bvh.h"
+#include "mesh_simplify.h"
+#include "mesh_optimize.h"
+#include "vertex_quantization.h"
\ No newline at end of file
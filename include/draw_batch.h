@@ -0,0 +1,84 @@
+#pragma once
+#ifndef CPPGL_DRAW_BATCH_H
+#define CPPGL_DRAW_BATCH_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include "mesh.h"
+#include "buffer.h"
+#include "platform.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// DrawBatch
+// meshes with identical vertex layout, primitive type and material copied into shared vertex / index buffers and
+// drawn with a single glMultiDrawElementsIndirect. command i is drawn with base instance i, so the per-instance
+// attribute cppgl_draw_id yields the index of its transforms in the CppglDraws storage buffer.
+// shaders (GLSL >= 430) that reference cppgl_draw get the declarations injected (see ShaderImpl):
+//     struct CppglDraw { mat4 model; mat4 model_normal; };
+//     buffer CppglDraws { CppglDraw cppgl_draws[]; };
+//     in uint cppgl_draw_id; // vertex shader only
+// e.g. gl_Position = cppgl_frame.view_proj * cppgl_draws[cppgl_draw_id].model * vec4(in_pos, 1);
+
+    class DrawBatch {
+    public:
+        // storage buffer binding of CppglDraws and attribute location of cppgl_draw_id
+        static constexpr uint32_t DRAWS_BINDING = 15;
+        static constexpr uint32_t DRAW_ID_LOCATION = 15;
+
+        static const char *const GLSL_DECLARATION;
+        static const char *const GLSL_VERTEX_DECLARATION;
+
+        // layout of a glMultiDrawElementsIndirect command
+        struct Command {
+            uint32_t count;
+            uint32_t instance_count;
+            uint32_t first_index;
+            int32_t base_vertex;
+            uint32_t base_instance;
+        };
+
+        // meshes[i] is drawn with the transforms at draw_ids[i], all meshes have to be compatible with meshes[0]
+        DrawBatch(const std::string &name, const std::vector<const MeshImpl *> &meshes,
+                  const std::vector<uint32_t> &draw_ids);
+
+        ~DrawBatch();
+
+        DrawBatch(const DrawBatch &) = delete;
+
+        DrawBatch &operator=(const DrawBatch &) = delete;
+
+        // hidden commands keep their place but draw zero instances
+        void set_visible(uint32_t command, bool visible);
+
+        // material of the batch has to be bound by the caller, CppglDraws as well
+        void draw();
+
+        // uploaded, has an index or vertex count and a vertex array, no UNORM16 attributes
+        static bool packable(const MeshImpl &mesh);
+
+        // same attribute types, dimensions and vertex buffer layout, same primitive type and material
+        static bool compatible(const MeshImpl &a, const MeshImpl &b);
+
+        // data
+        const std::string name;
+        GLuint vao;
+        std::vector<VBO> vbos;  // per vertex buffer of the meshes' layout
+        VBO draw_id_buffer;
+        IBO ibo;
+        DIBO commands;
+        GLenum primitive_type;
+        Material material;
+        uint32_t num_draws;
+        std::vector<Command> cpu_commands;
+        bool commands_dirty;
+    };
+
+CPPGL_NAMESPACE_END
+
+#endif
@@ -4,9 +4,13 @@
 #include "mesh.h"
 #include "shader.h"
 #include "data_types.h"
+#include "draw_batch.h"
+#include "frame_uniforms.h"
 
 CPPGL_NAMESPACE_BEGIN
 
+    class SceneBVH;
+
 // -----------------------------------------------
 // Drawelement (object instance for rendering)
 
@@ -70,6 +74,9 @@ CPPGL_NAMESPACE_BEGIN
 
         void bind() const;
 
+        // camera and model transforms for the bound shader, part of bind()
+        void upload_transforms() const;
+
         void draw() const;
 
         void draw_wireframe() const;
@@ -88,6 +95,9 @@ CPPGL_NAMESPACE_BEGIN
 
         void set_model_rotation(const mat3 &rot);
 
+        // transpose(inverse(model)), only recomputed after model changed
+        const mat4 &model_normal() const;
+
         void set_wireframe_mode(bool mode);
 
         void set_disable_render(bool mode);
@@ -112,11 +122,15 @@ CPPGL_NAMESPACE_BEGIN
         // data
         const std::string name;
         mat4 model;
+        mutable mat4 normal_model;  // model the cached normal matrix belongs to
+        mutable mat4 normal_matrix;
         Shader shader;
         Mesh mesh;
         bool wireframe_mode;
         bool disable_render;
         bool is_grouped; // only used for imgui
+        SceneBVH *scene_bvh; // notified by set_model_*, see SceneBVH
+        uint32_t scene_bvh_index;
     };
 
     using Drawelement = NamedHandle<DrawelementImpl>;
@@ -152,6 +166,14 @@ CPPGL_NAMESPACE_BEGIN
 
         void set_disable_render(bool mode);
 
+        // bind_draw_unbind packs the meshes of elements whose shader reads cppgl_draws (see DrawBatch) into shared
+        // buffers and draws each set of compatible meshes with one glMultiDrawElementsIndirect, other elements
+        // (incompatible shader, pre / post draw funcs) are drawn one by one as before
+        void set_batching(bool mode);
+
+        // rebuild the batches before the next draw, needed after meshes, shaders or draw funcs of elements changed
+        void invalidate_batches();
+
         std::map<std::string, std::function<void()>> pre_draw_funcs;
         std::map<std::string, std::function<void()>> post_draw_funcs;
 
@@ -173,8 +195,118 @@ CPPGL_NAMESPACE_BEGIN
         std::vector<Drawelement> elems;
         bool wireframe_mode;
         bool disable_render;
+        bool batching;
+
+    private:
+        struct Batch {
+            Shader shader;
+            std::unique_ptr<DrawBatch> batch;
+        };
+
+        void build_batches() const;
+
+        void draw_batched() const;
+
+        // element i: batch index (-1 if drawn one by one) and command index
+        mutable std::vector<std::pair<int32_t, uint32_t>> element_batch;
+        mutable std::vector<Batch> batches;
+        mutable std::vector<FrameUniforms::Object> draw_transforms;  // same layout as CppglDraw
+        mutable SSBO draw_transforms_buffer;
+        mutable bool batches_valid;
     };
 
     using GroupedDrawelements = NamedHandle<GroupedDrawelementsImpl>;
 
+// -----------------------------------------------
+// InstancedDrawelement (one mesh drawn many times with glDrawElementsInstanced)
+// instead of one mesh + drawelement per copy, a single per-instance vertex buffer holds transform, color and
+// optional user attributes of all instances. vertex shaders (GLSL >= 330) referencing cppgl_instance get
+//     layout(location = 8) in mat4 cppgl_instance_model;   // locations 8..11
+//     layout(location = 12) in vec4 cppgl_instance_color;
+// declared, user attribute k is at location USER_LOCATION + k and has to be declared by the shader.
+// the model uniform / cppgl_object.model holds the transform of the whole set.
+
+    class _API InstancedDrawelementImpl {
+    public:
+        static constexpr uint32_t MODEL_LOCATION = 8;
+        static constexpr uint32_t COLOR_LOCATION = 12;
+        static constexpr uint32_t USER_LOCATION = 13;
+        static constexpr uint32_t MAX_USER_ATTRIBUTES = 2;  // location 15 is cppgl_draw_id
+
+        static const char *const GLSL_VERTEX_DECLARATION;
+
+        // user_attribute_dims: float components (1..4) of each user attribute
+        InstancedDrawelementImpl(const std::string &name, const Shader &shader, const Mesh &mesh,
+                                 const std::vector<uint32_t> &user_attribute_dims = {});
+
+        virtual ~InstancedDrawelementImpl();
+
+        static inline std::string type_to_str() { return "InstancedDrawelementImpl"; }
+
+        // returns an id that stays valid until the instance is removed
+        uint32_t add_instance(const mat4 &transform, const vec4 &color = vec4(1, 1, 1, 1));
+
+        // O(1): the last instance moves into the freed slot
+        void remove_instance(uint32_t id);
+
+        void clear_instances();
+
+        void set_instance_transform(uint32_t id, const mat4 &transform);
+
+        void set_instance_color(uint32_t id, const vec4 &color);
+
+        // user_attribute_dims[attribute] floats
+        void set_instance_attribute(uint32_t id, uint32_t attribute, const float *data);
+
+        mat4 instance_transform(uint32_t id) const;
+
+        inline uint32_t num_instances() const { return uint32_t(slot_to_id.size()); }
+
+        // bytes of the per-instance vertex buffer on the GPU, grown by doubling so it may exceed the records
+        size_t instance_memory() const;
+
+        void bind() const;
+
+        void draw() const;
+
+        void unbind() const;
+
+        void destroy_handles();
+
+        void set_disable_render(bool mode);
+
+        // data
+        const std::string name;
+        mat4 model;
+        Shader shader;
+        Mesh mesh;
+        bool disable_render;
+
+    private:
+        float *record(uint32_t id);
+
+        void mark_dirty(uint32_t slot);
+
+        // instance vertex attributes, mesh attributes are set up like in MeshImpl.
+        // rebuilt when the mesh replaces its buffers (MeshImpl::buffer_generation)
+        void setup_vao() const;
+
+        // records on the GPU, grown by doubling
+        void upload() const;
+
+        const std::vector<uint32_t> user_attribute_dims;
+        const uint32_t stride_floats;
+        std::vector<float> records;          // num_instances * stride_floats
+        std::vector<uint32_t> slot_to_id;
+        std::vector<uint32_t> id_to_slot;    // ~0u for free ids
+        std::vector<uint32_t> free_ids;
+        mutable GLuint vao;
+        mutable uint32_t vao_generation;     // mesh->buffer_generation the vao was set up with
+        mutable VBO instance_buffer;
+        mutable uint32_t capacity;           // instances the GPU buffer can hold
+        mutable uint32_t dirty_begin, dirty_end;  // slot range changed since the last upload
+    };
+
+    using InstancedDrawelement = NamedHandle<InstancedDrawelementImpl>;
+
 CPPGL_NAMESPACE_END
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef CPPGL_FRAME_UNIFORMS_H
+#define CPPGL_FRAME_UNIFORMS_H
+
+#include <memory>
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include "buffer.h"
+#include "camera.h"
+#include "platform.h"
+#include "data_types.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// FrameUniforms
+// camera and per-draw transforms as std140 uniform blocks instead of per-draw glUniform calls:
+// the frame block is written once per frame (and whenever the current camera changes), the per-draw block is
+// packed into a persistently mapped ring buffer and bound by range. shaders with GLSL >= 140 that mention
+// cppgl_frame or cppgl_object get the matching declaration injected (see ShaderImpl), so they can read e.g.
+// cppgl_frame.view_proj and cppgl_object.model. the classic model / view / proj uniforms keep working for shaders
+// that declare them, those do not pay for the per-draw block (std140 blocks stay active even when unused).
+// all functions have to be called on the GL thread
+
+    class FrameUniforms {
+    public:
+        // uniform buffer binding points reserved for the two blocks
+        static constexpr uint32_t FRAME_BINDING = 14;
+        static constexpr uint32_t OBJECT_BINDING = 15;
+
+        // layout of 'uniform CppglFrame', mirrors GLSL_DECLARATION
+        struct Frame {
+            mat4 view;
+            mat4 view_normal;
+            mat4 proj;
+            mat4 view_proj;
+            mat4 inv_view;
+            vec4 camera_pos;    // xyz: world space position
+            vec4 camera_dir;    // xyz: world space view direction
+            vec4 near_far_res;  // near, far, resolution x, resolution y
+            vec4 time;          // time in ms, last frame time in ms, frame index, 0
+        };
+
+        // layout of 'uniform CppglObject', mirrors GLSL_OBJECT_DECLARATION
+        struct Object {
+            mat4 model;
+            mat4 model_normal;
+        };
+
+        static const char *const GLSL_DECLARATION;
+        static const char *const GLSL_OBJECT_DECLARATION;
+
+        // object_capacity draws per frame go through the ring buffer, further draws fall back to buffer updates
+        explicit FrameUniforms(uint32_t object_capacity = 16384);
+
+        ~FrameUniforms();
+
+        FrameUniforms(const FrameUniforms &) = delete;
+
+        FrameUniforms &operator=(const FrameUniforms &) = delete;
+
+        // write and bind the frame block unless it already holds this camera's state for the current frame
+        void update(const Camera &cam);
+
+        // write and bind the per-draw block
+        void bind_object(const mat4 &model, const mat4 &model_normal);
+
+        // fence the current frame's data, called by Context::swap_buffers
+        void next_frame();
+
+        inline uint64_t frame_index() const { return frame_counter; }
+
+        // used by DrawelementImpl::bind, created on first use
+        static FrameUniforms &global();
+
+        // the global instance if it was created, nullptr otherwise
+        static FrameUniforms *instance();
+
+        // destroy the global buffers while the GL context is still alive, called by Context::~Context
+        static void shutdown_global();
+
+    private:
+        // into the ring buffer if possible, else into 'fallback'
+        void write(uint32_t binding, const void *data, size_t size_bytes, UBO &fallback);
+
+        // data
+        const uint32_t id;
+        StreamUBO stream;     // empty without GL 4.4 / ARB_buffer_storage
+        UBO frame_ubo, object_ubo;
+        Frame frame;
+        bool frame_valid;
+        uint64_t frame_counter;
+        uint64_t frame_written;
+        bool warned_exhausted;
+    };
+
+CPPGL_NAMESPACE_END
+
+#endif
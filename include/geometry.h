@@ -7,7 +7,11 @@
 #include "data_types.h"
 #include "math/eigen_glm_interface.h"
 #include "cassert.h"
+#include "mesh_adjacency.h"
+#include <memory>
+#include <limits>
 #include <numeric>
+#include <algorithm>
 
 CPPGL_NAMESPACE_BEGIN
 
@@ -16,6 +20,13 @@ CPPGL_NAMESPACE_BEGIN
 
     class MeshImpl;
 
+    // weighting of the incident face normals when averaging them to vertex normals
+    enum class NormalWeighting {
+        UNIFORM, // plain average of the unit face normals
+        AREA,    // faces weighted by their area
+        ANGLE    // faces weighted by their interior angle at the vertex
+    };
+
     std::vector<vec3> face2vertex_normals(const std::vector<vec3> &face_normals,
                                           const uint32_t position_size,
                                           const std::vector<uint32_t> &indices);
@@ -39,17 +50,68 @@ CPPGL_NAMESPACE_BEGIN
                                             const uint32_t indices_size);
 
     std::vector<vec3> generate_vertex_normals(const std::vector<vec3> &positions,
-                                              const std::vector<uint32_t> &indices);
+                                              const std::vector<uint32_t> &indices,
+                                              NormalWeighting weighting = NormalWeighting::UNIFORM);
 
     std::vector<vec3> generate_vertex_normals(const float *positions,
                                               const uint32_t position_size,
                                               const uint32_t *indices,
-                                              const uint32_t indices_size);
+                                              const uint32_t indices_size,
+                                              NormalWeighting weighting = NormalWeighting::UNIFORM);
+
+    // write per-vertex normals of an indexed triangle mesh to 'normals' (3 * position_size floats)
+    // uses the vertex->face relation of 'adjacency' if given, otherwise builds just that relation
+    // runs in parallel over faces and vertices, vertices not referenced by any face get a zero normal
+    void compute_vertex_normals(const float *positions,
+                                const uint32_t position_size,
+                                const uint32_t *indices,
+                                const uint32_t indices_size,
+                                float *normals,
+                                NormalWeighting weighting = NormalWeighting::UNIFORM,
+                                const MeshAdjacency *adjacency = nullptr);
 
     class GeometryImpl;
 
     class GeometryWrapperImpl;
 
+    // non-owning view of 'size' elements of type T that are 'stride' bytes apart
+    template<typename T>
+    struct AttributeView {
+        AttributeView() : data(nullptr), size(0), stride(sizeof(T)) {}
+
+        AttributeView(T *ptr, size_t size, size_t stride = sizeof(T))
+                : data(reinterpret_cast<uint8_t *>(ptr)), size(size), stride(stride) {}
+
+        inline T &operator[](size_t i) const {
+            _CPPGL_ASSERT_LT(i, size);
+            return *reinterpret_cast<T *>(data + i * stride);
+        }
+
+        inline bool empty() const { return size == 0; }
+
+        // tightly packed, i.e. usable as a plain T array
+        inline bool contiguous() const { return stride == sizeof(T); }
+
+        inline T *ptr() const { return reinterpret_cast<T *>(data); }
+
+        uint8_t *data;
+        size_t size;
+        size_t stride;
+    };
+
+    // elements [begin, end) of an attribute written since the last update_meshes, one merged range per attribute
+    struct DirtyRange {
+        uint32_t begin = std::numeric_limits<uint32_t>::max();
+        uint32_t end = 0;
+
+        inline void add(uint32_t first, uint32_t last) {
+            begin = std::min(begin, first);
+            end = std::max(end, last);
+        }
+
+        inline bool empty() const { return begin >= end; }
+    };
+
     template<typename T>
     struct AttributePtr {
         T *ptr;
@@ -82,6 +144,15 @@ CPPGL_NAMESPACE_BEGIN
 
         virtual size_t indices_size() const;
 
+        // bulk access, resolves the storage with a single virtual call instead of one per element
+        AttributeView<vec3> positions_view();
+
+        AttributeView<vec3> normals_view();
+
+        AttributeView<vec2> texcoords_view();
+
+        AttributeView<uint32_t> indices_view();
+
         virtual vec3 get_position(unsigned int index) const;
 
         virtual vec3 get_normal(unsigned int index) const;
@@ -106,10 +177,11 @@ CPPGL_NAMESPACE_BEGIN
 
         // automatically generate normals from vertex positions
         virtual void auto_generate_normals(
-                const mat4 &initial_transform = mat4::Identity());
+                const mat4 &initial_transform = mat4::Identity(),
+                NormalWeighting weighting = NormalWeighting::UNIFORM);
 
         // convert per-face normals to per-vertex normals
-        virtual void convert_normals_perface2vertex();
+        virtual void convert_normals_perface2vertex(NormalWeighting weighting = NormalWeighting::UNIFORM);
 
         virtual void clear();
 
@@ -171,10 +243,41 @@ CPPGL_NAMESPACE_BEGIN
                                std::vector<int32_t> &attribute, uint32_t dim,
                                bool external = false, bool overwrite = false);
 
+        // vertex/edge/face connectivity, built on first use and cached until the indices change
+        const MeshAdjacency &adjacency();
+
+        // drop the cached adjacency, needed after writing through indices_ptr() directly
+        void invalidate_adjacency();
+
+        bool has_adjacency() const { return adjacency_ != nullptr; }
+
+        // bytes held by the cached adjacency, 0 if there is none
+        size_t adjacency_memory_usage() const;
+
+        // dirty tracking for update_meshes, attribute names as in VertexLayout and "index" for the indices.
+        // the setters and geometry operations mark what they write, writes through the pointers or views have to
+        // be marked by the caller. without any mark update_meshes uploads all data, as if mark_dirty() was called
+        void mark_dirty(const std::string &attribute, uint32_t begin, uint32_t end);
+
+        void mark_dirty(const std::string &attribute);  // the whole attribute
+
+        void mark_dirty();  // all attributes, the buffers are still reused
+
+        // the number of vertices or indices or the set of attributes changed, the meshes reallocate their buffers
+        inline void mark_layout_dirty() { layout_dirty = true; }
+
+        // whole attributes as [0, max) ranges, empty if unchanged
+        DirtyRange dirty_range(const std::string &attribute) const;
+
+        bool has_dirty_marks() const;
+
+        void clear_dirty();
+
         // data
         const std::string name;
         vec3 bb_min, bb_max;
         bool auto_normals_;
+        std::shared_ptr<MeshAdjacency> adjacency_;
 
         std::vector<std::vector<vec4>> vec4_storage;
         std::vector<std::vector<vec3>> vec3_storage;
@@ -190,6 +293,11 @@ CPPGL_NAMESPACE_BEGIN
         std::map<std::string, AttributePtr<uint32_t>> uint_map;
         std::map<std::string, AttributePtr<int32_t>> int_map;
 
+        DirtyRange dirty_positions, dirty_normals, dirty_texcoords, dirty_indices;
+        std::map<std::string, DirtyRange> dirty_attributes;
+        bool all_dirty = false;
+        bool layout_dirty = false;
+
         // list of meshes that use this geometry
         // this is necessary to trigger updates to GPU memory in case
         // the underlying geometry changes
@@ -204,7 +312,9 @@ CPPGL_NAMESPACE_BEGIN
 
         void clear_mesh_gpu_memory();
 
-        void update_meshes();
+        // push the dirty ranges into the meshes' buffers, or re-upload meshes whose layout changed.
+        // returns the bytes uploaded, also counted in MeshUploadStats
+        size_t update_meshes();
     };
 
     class _API GeometryImpl : public GeometryBaseImpl {
@@ -238,9 +348,10 @@ CPPGL_NAMESPACE_BEGIN
 
         // automatically generate normals from vertex positions
         void auto_generate_normals(
-                const mat4 &initial_transform = mat4::Identity()) override;
+                const mat4 &initial_transform = mat4::Identity(),
+                NormalWeighting weighting = NormalWeighting::UNIFORM) override;
 
-        void convert_normals_perface2vertex() override;
+        void convert_normals_perface2vertex(NormalWeighting weighting = NormalWeighting::UNIFORM) override;
 
         void add(const aiMesh *mesh_ai);
 
@@ -334,21 +445,26 @@ CPPGL_NAMESPACE_BEGIN
         void set_position(unsigned int index, const vec3 &position) override {
             _CPPGL_ASSERT_LT(index, positions.size());
             positions.at(index) = position;
+            dirty_positions.add(index, index + 1);
         }
 
         void set_normal(unsigned int index, const vec3 &normal) override {
             _CPPGL_ASSERT_LT(index, normals.size());
             normals.at(index) = normal;
+            dirty_normals.add(index, index + 1);
         }
 
         void set_texcoord(unsigned int index, const vec2 &texcoord) override {
             _CPPGL_ASSERT_LT(index, texcoords.size());
             texcoords.at(index) = texcoord;
+            dirty_texcoords.add(index, index + 1);
         }
 
         void set_index(unsigned int index, uint32_t index_value) override {
             _CPPGL_ASSERT_LT(index, indices.size());
             indices.at(index) = index_value;
+            dirty_indices.add(index, index + 1);
+            invalidate_adjacency();
         }
 
     private:
@@ -441,6 +557,7 @@ CPPGL_NAMESPACE_BEGIN
             positions_ptr_[index * 3 + 0] = position.x();
             positions_ptr_[index * 3 + 1] = position.y();
             positions_ptr_[index * 3 + 2] = position.z();
+            dirty_positions.add(index, index + 1);
         }
 
         void set_normal(unsigned int index, const vec3 &normal) override {
@@ -448,23 +565,31 @@ CPPGL_NAMESPACE_BEGIN
             normals_ptr_[index * 3 + 0] = normal.x();
             normals_ptr_[index * 3 + 1] = normal.y();
             normals_ptr_[index * 3 + 2] = normal.z();
+            dirty_normals.add(index, index + 1);
         }
 
         void set_texcoord(unsigned int index, const vec2 &texcoord) override {
             _CPPGL_ASSERT_LT(index, texcoords_size_);
             texcoords_ptr_[index * 2 + 0] = texcoord.x();
             texcoords_ptr_[index * 2 + 1] = texcoord.y();
+            dirty_texcoords.add(index, index + 1);
         }
 
         void set_index(unsigned int index, uint32_t index_value) override {
             _CPPGL_ASSERT_LT(index, indices_size_);
             indices_ptr_[index] = index_value;
+            dirty_indices.add(index, index + 1);
+            invalidate_adjacency();
         }
 
         void auto_generate_normals(
-                const mat4 &initial_transform = mat4::Identity()) override;
+                const mat4 &initial_transform = mat4::Identity(),
+                NormalWeighting weighting = NormalWeighting::UNIFORM) override;
+
+        void convert_normals_perface2vertex(NormalWeighting weighting = NormalWeighting::UNIFORM) override;
 
-        void convert_normals_perface2vertex() override;
+        // keeps the memory behind the wrapped pointers alive, e.g. a mapped mesh cache file
+        std::shared_ptr<void> backing;
 
         // data
     private:
@@ -490,6 +615,28 @@ CPPGL_NAMESPACE_BEGIN
     private:
     };
 
+    // call func(index, position) for every vertex
+    template<typename Func>
+    void for_each_vertex(GeometryBaseImpl &geo, Func &&func) {
+        const AttributeView<vec3> positions = geo.positions_view();
+        if (positions.contiguous()) {
+            vec3 *p = positions.ptr();
+            for (uint32_t i = 0; i < positions.size; i++)
+                func(i, p[i]);
+        } else {
+            for (uint32_t i = 0; i < positions.size; i++)
+                func(i, positions[i]);
+        }
+    }
+
+    // call func(face, i0, i1, i2) for every triangle
+    template<typename Func>
+    void for_each_triangle(GeometryBaseImpl &geo, Func &&func) {
+        const AttributeView<uint32_t> indices = geo.indices_view();
+        for (uint32_t f = 0; f < indices.size / 3; f++)
+            func(f, indices[f * 3 + 0], indices[f * 3 + 1], indices[f * 3 + 2]);
+    }
+
     using GeometryBase = NamedHandle<GeometryBaseImpl>;
     using Geometry = NamedHandle<GeometryImpl>;
     using GeometryWrapper = NamedHandle<GeometryWrapperImpl>;
@@ -1,7 +1,14 @@
 #pragma once
 
+#include <set>
+#include <deque>
+#include <mutex>
+#include <tuple>
+#include <thread>
 #include <vector>
+#include <cstdint>
 #include <filesystem>
+#include <condition_variable>
 #include "platform.h"
 
 CPPGL_NAMESPACE_BEGIN
@@ -11,12 +18,112 @@ CPPGL_NAMESPACE_BEGIN
 // Note: if is_hdr is set, image data is of type float stored as byte array
     std::tuple<std::vector<uint8_t>, int, int, int, bool> image_load(const std::filesystem::path &path);
 
+// Decoded image as returned by image_load
+    using ImageData = std::tuple<std::vector<uint8_t>, int, int, int, bool>;
+
 // Write LDR image to disk, supported file formats: .png, .jpg/.jpeg, .tga, .bmp
+// async: the image is copied and written by ImageWriter::global()
     void image_store_ldr(const std::filesystem::path &path, const uint8_t *image_data, int w, int h, int channels,
                          bool flip = true, bool async = false);
 
 // Write HDR image to disk, supported file formats: .hdr
+// async: the image is copied and written by ImageWriter::global()
     void image_store_hdr(const std::filesystem::path &path, const float *image_data, int w, int h, int channels,
                          bool flip = true, bool async = false);
 
+// ------------------------------------------
+// ImageWriter
+// background image encoding with a fixed number of worker threads and a budget for the bytes of all images
+// that are queued or being written. pixel memory comes from a pool of reusable frame buffers, so recording
+// a frame sequence settles at a constant number of allocations
+
+    class ImageWriter {
+    public:
+        enum class Policy {
+            BLOCK, // store_* waits until enough queued images are written
+            DROP   // store_* discards the image and returns false
+        };
+
+        explicit ImageWriter(uint32_t num_workers = 2, size_t max_bytes_in_flight = size_t(512) << 20,
+                             Policy policy = Policy::BLOCK);
+
+        // writes everything still queued, then joins the workers
+        ~ImageWriter();
+
+        ImageWriter(const ImageWriter &) = delete;
+
+        ImageWriter &operator=(const ImageWriter &) = delete;
+
+        // pooled buffer of (at least) 'bytes' bytes to render or read back into, hand it to store_* when filled
+        std::vector<uint8_t> acquire(size_t bytes);
+
+        // return a buffer that was acquired but not stored
+        void release(std::vector<uint8_t> &&buffer);
+
+        // queue an image, the buffer versions take ownership of 'pixels' and avoid the copy
+        // returns false if the image was dropped (Policy::DROP and over budget)
+        bool store_ldr(const std::filesystem::path &path, const uint8_t *image_data, int w, int h, int channels,
+                       bool flip = true);
+
+        bool store_ldr(const std::filesystem::path &path, std::vector<uint8_t> &&pixels, int w, int h, int channels,
+                       bool flip = true);
+
+        bool store_hdr(const std::filesystem::path &path, const float *image_data, int w, int h, int channels,
+                       bool flip = true);
+
+        // 'pixels' holds w * h * channels floats
+        bool store_hdr(const std::filesystem::path &path, std::vector<uint8_t> &&pixels, int w, int h, int channels,
+                       bool flip = true);
+
+        // wait until every image queued before this call is on disk
+        void flush();
+
+        // wait until no image is queued or being written, including images queued by other threads meanwhile
+        void wait_all();
+
+        // write everything still queued and join the workers, later stores are written on the calling thread
+        void shutdown();
+
+        size_t bytes_in_flight() const;
+
+        uint64_t num_dropped() const;
+
+        // writer used by image_store_ldr/hdr(..., async = true), Context::screenshot and Texture2D::save_ldr
+        static ImageWriter &global();
+
+        // flush and join the global writer, called by Context::~Context
+        static void shutdown_global();
+
+    private:
+        struct Job {
+            std::filesystem::path path;
+            std::vector<uint8_t> pixels;
+            int w, h, channels;
+            bool flip, hdr;
+            uint64_t ticket;
+        };
+
+        bool submit(Job &&job);
+
+        void write(const Job &job) const;
+
+        void worker_loop();
+
+        // data
+        const size_t max_bytes_in_flight;
+        const Policy policy;
+        std::vector<std::thread> workers;
+        mutable std::mutex mutex;
+        std::condition_variable work_available;
+        std::condition_variable job_done;
+        std::deque<Job> jobs;
+        std::set<uint64_t> in_flight;          // tickets of queued and running jobs
+        std::vector<std::vector<uint8_t>> free_buffers;
+        size_t in_flight_bytes;
+        size_t free_bytes;
+        uint64_t next_ticket;
+        uint64_t dropped;
+        bool stopped;
+    };
+
 CPPGL_NAMESPACE_END
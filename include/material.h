@@ -2,6 +2,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include <memory>
 #include <filesystem>
 
@@ -24,7 +25,9 @@ CPPGL_NAMESPACE_BEGIN
     public:
         MaterialImpl(const std::string &name);
 
-        MaterialImpl(const std::string &name, const fs::path &base_path, const aiMaterial *mat_ai);
+        // textures found in 'images' (keyed by file path) are created from the decoded data instead of read from disk
+        MaterialImpl(const std::string &name, const fs::path &base_path, const aiMaterial *mat_ai,
+                     const std::map<fs::path, ImageData> *images = nullptr);
 
         virtual ~MaterialImpl();
 
@@ -49,6 +52,9 @@ CPPGL_NAMESPACE_BEGIN
         std::map<std::string, Texture2D> texture_map;
     };
 
+    // image files the MaterialImpl constructor loads for 'mat_ai', e.g. to decode them in advance
+    std::vector<fs::path> material_texture_paths(const fs::path &base_path, const aiMaterial *mat_ai);
+
     using Material = NamedHandle<MaterialImpl>;
 
     template
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <map>
 #include <memory>
 #include <vector>
 #include <filesystem>
@@ -13,9 +14,93 @@ namespace fs = std::filesystem;
 #include "geometry.h"
 #include "material.h"
 #include "data_types.h"
+#include "mesh_export.h"
+#include "mesh_optimize.h"
+#include "vertex_quantization.h"
 
 CPPGL_NAMESPACE_BEGIN
 
+// ------------------------------------------
+// VertexLayout
+// assigns the attributes of a geometry to vertex buffers, attributes in the same buffer are interleaved in upload
+// order. attribute names are "position", "normal", "texcoord" and the keys of the geometry's attribute maps.
+// the attribute ids (= shader locations) do not depend on the layout.
+// float attributes can be stored in a compact encoding (see vertex_quantization.h), e.g.
+//     VertexLayout(VertexLayout::INTERLEAVED).encode("position", AttributeEncoding::UNORM16)
+//                                            .encode("normal", AttributeEncoding::SNORM_10_10_10_2)
+// shaders read UNORM16 positions and texcoords through cppgl_dequantize_position / cppgl_dequantize_texcoord,
+// which are the identity for float meshes, so one shader draws both
+
+    struct VertexLayout {
+        enum Kind {
+            SEPARATE,           // one buffer per attribute (SoA)
+            INTERLEAVED,        // all attributes in one buffer
+            POSITIONS_SEPARATE  // positions alone for position-only passes (depth, shadows), the rest interleaved
+        };
+
+        VertexLayout(Kind kind = SEPARATE) : kind(kind) {}
+
+        // put an attribute into buffer 'group', overrides the kind for this attribute
+        inline VertexLayout &assign(const std::string &attribute, uint32_t group) {
+            groups[attribute] = group;
+            return *this;
+        }
+
+        // store a float attribute in a compact encoding
+        inline VertexLayout &encode(const std::string &attribute, AttributeEncoding encoding) {
+            encodings[attribute] = encoding;
+            return *this;
+        }
+
+        // buffer group of the attribute with the given id and name, only equality between groups matters
+        uint32_t group(uint32_t attribute, const std::string &name) const;
+
+        AttributeEncoding encoding(const std::string &name) const;
+
+        // dequantization uniforms and decoders, injected into shaders that call them (see ShaderImpl):
+        //     vec3 cppgl_dequantize_position(vec3 p);
+        //     vec2 cppgl_dequantize_texcoord(vec2 t);
+        //     vec3 cppgl_oct_decode(vec2 e);
+        static const char *const GLSL_DECLARATION;
+
+        // data
+        Kind kind;
+        std::map<std::string, uint32_t> groups;
+        std::map<std::string, AttributeEncoding> encodings;
+    };
+
+    // one attribute of an interleaved vertex buffer, data is tightly packed
+    struct VertexAttribute {
+        GLenum type;
+        uint32_t element_dim;
+        const void *data;
+        bool normalized = false;  // integer data read as floats in [0, 1] or [-1, 1]
+    };
+
+    // encoding of an uploaded attribute
+    struct AttributeQuantization {
+        std::string name;
+        AttributeEncoding encoding;
+        vec4 min, extent;               // UNORM16: value = min + stored * extent
+        QuantizationError error;
+        uint32_t float_bytes, bytes;    // per vertex, as float and encoded
+        std::string min_uniform, extent_uniform;  // cppgl_<name>_min / _extent
+    };
+
+    // bytes written to vertex and index buffers by mesh uploads and updates, counted per frame
+    struct MeshUploadStats {
+        size_t bytes = 0;               // current frame
+        uint32_t full_uploads = 0;      // upload_gpu calls of the current frame
+        uint32_t partial_updates = 0;   // update_gpu calls that reused the buffers
+        size_t last_frame_bytes = 0;
+        uint32_t last_frame_full_uploads = 0, last_frame_partial_updates = 0;
+
+        static MeshUploadStats &global();
+
+        // called by Context::swap_buffers
+        void next_frame();
+    };
+
 // ------------------------------------------
 // Mesh
 
@@ -28,7 +113,8 @@ CPPGL_NAMESPACE_BEGIN
         MeshImpl(const std::string &name,
                  const GeometryBase &geometry = GeometryBase(),
                  const Material &material = Material(),
-                 GLenum hint = GL_STATIC_DRAW);
+                 GLenum hint = GL_STATIC_DRAW,
+                 const VertexLayout &layout = VertexLayout());
 
         virtual ~MeshImpl();
 
@@ -92,12 +178,19 @@ CPPGL_NAMESPACE_BEGIN
         MeshImpl &operator=(const MeshImpl &&) = delete;
 
         void clear_gpu();  // free gpu resources
-        void upload_gpu(); // cpu -> gpu transfer
+        void upload_gpu(); // cpu -> gpu transfer, with the buffers given by 'layout'
+        // only the dirty ranges of the geometry into the existing buffers, upload_gpu if the vertex or index count
+        // or the attributes changed. returns the bytes uploaded
+        size_t update_gpu();
         void destroy_handles();
 
         // call in this order to draw
         void bind(const Shader &shader) const;
 
+        // dequantization uniforms of the UNORM16 attributes (identity for position and texcoord if they are floats),
+        // part of bind()
+        void bind_quantization(const ShaderImpl &shader) const;
+
         void draw() const;
 
         void draw_index(uint32_t index) const;
@@ -109,24 +202,59 @@ CPPGL_NAMESPACE_BEGIN
                                    uint32_t num_vertices, const void *data,
                                    GLenum hint = GL_STATIC_DRAW);
 
+        // one buffer with the attributes interleaved, returns the id of the first one, the others follow
+        uint32_t add_vertex_buffer(const std::vector<VertexAttribute> &attributes, uint32_t num_vertices,
+                                   GLenum hint = GL_STATIC_DRAW);
+
+        // stored as 16 bit indices (index_type GL_UNSIGNED_SHORT) if the vertex count allows it,
+        // so add the vertex buffers first
         void add_index_buffer(uint32_t num_indices, const uint32_t *data,
                               GLenum hint = GL_STATIC_DRAW);
 
         void update_vertex_buffer(
-                uint32_t buf_id, const void *data); // assumes matching size for buffer
+                uint32_t buf_id, const void *data); // assumes matching size for buffer, tightly packed data.
+        // quantized attributes take float data and are encoded like on upload, UNORM16 data leaving the box of the
+        // upload is re-encoded as a whole with new bounds
         // buf_id from add_vertex_buffer()
+
+        // elements [begin, end) of the tightly packed 'data', which starts at element 0. interleaved buffers are
+        // written through a mapped range, returns the bytes written
+        size_t update_vertex_buffer(uint32_t buf_id, const void *data, uint32_t begin, uint32_t end);
+
+        // indices [begin, end) of 'data', which starts at index 0, converted to index_type
+        size_t update_index_buffer(const uint32_t *data, uint32_t begin, uint32_t end);
+
         void set_primitive_type(GLenum type);   // default: GL_TRIANGLES
 
         // map/unmap from GPU mem
         // (https://www.seas.upenn.edu/~pcozzi/OpenGLInsights/OpenGLInsights-AsynchronousBufferTransfers.pdf)
+        // points to the first element of the attribute, consecutive elements are vbo_strides[buf_id] bytes apart.
+        // quantized attributes are mapped in their encoding.
+        // interleaved attributes share their buffer, so only one of them can be mapped at a time
         void *map_vbo(uint32_t buf_id, GLenum access = GL_READ_WRITE) const;
 
         void unmap_vbo(uint32_t buf_id) const;
 
+        // distinct GL buffer objects holding the vertex attributes
+        uint32_t num_vertex_buffers() const;
+
+        // bytes of GPU memory held by the vertex buffers
+        size_t vertex_memory() const;
+
+        // elements are of index_type
         void *map_ibo(GLenum access = GL_READ_WRITE) const;
 
         void unmap_ibo() const;
 
+        // buffer with the attributes interleaved, 'offsets' and 'stride' receive their placement
+        static VBO upload_vertex_buffer(const std::string &buffer_name, const std::vector<VertexAttribute> &attributes,
+                                        uint32_t num_vertices, GLenum hint, std::vector<uint32_t> &offsets,
+                                        uint32_t &stride);
+
+        // point attribute 'buf_id' of the vertex array to 'buffer'
+        void set_vertex_attribute(uint32_t buf_id, const VBO &buffer, const VertexAttribute &attribute,
+                                  uint32_t stride, uint32_t offset);
+
         // CPU data
         const std::string name;
         GeometryBase geometry;
@@ -136,11 +264,19 @@ CPPGL_NAMESPACE_BEGIN
         IBO ibo;
         uint32_t num_vertices;
         uint32_t num_indices;
-        std::vector<VBO> vbos;
+        GLenum index_type;  // GL_UNSIGNED_INT or GL_UNSIGNED_SHORT
+        std::vector<VBO> vbos;              // per attribute, interleaved attributes share the handle
         std::vector<GLenum> vbo_types;
         std::vector<uint32_t> vbo_dims;
+        std::vector<uint32_t> vbo_strides;  // bytes between two vertices
+        std::vector<uint32_t> vbo_offsets;  // bytes from the start of the buffer to the first element
+        std::vector<uint8_t> vbo_normalized;
+        std::map<uint32_t, AttributeQuantization> quantization;  // attribute id -> encoding, only quantized ones
+        std::vector<std::string> attribute_names;  // geometry attributes of upload_gpu, by id
         GLenum primitive_type;
         GLenum bufHint;
+        VertexLayout layout;
+        uint32_t buffer_generation;  // bumped whenever vbos or ibo are replaced, VAOs of other owners rebuild on change
     };
 
     using Mesh = NamedHandle<MeshImpl>;
@@ -148,22 +284,43 @@ CPPGL_NAMESPACE_BEGIN
     template
     class _API NamedHandle<MeshImpl>; // needed for Windows DLL export
 
+    // attribute pointer for the bound GL_ARRAY_BUFFER: integer types stay integers unless normalized,
+    // doubles stay doubles
+    void vertex_attrib_pointer(GLuint index, uint32_t element_dim, GLenum type, GLsizei stride = 0,
+                               size_t offset_bytes = 0, bool normalized = false);
+
 // ------------------------------------------
 // Mesh loader (Ass-Imp)
 
+    // Assimp post-processing flags used by load_meshes_cpu
+    uint32_t mesh_import_flags();
+
+    // passes of optimize_mesh run on every imported geometry before it is registered, set all of them to false to
+    // keep the order of the file. with 'verbose' the load functions print the resulting ACMR/ATVR
+    MeshOptimizeOptions &mesh_import_optimize_options();
+
     std::vector<std::pair<Geometry, Material>>
     load_meshes_cpu(const fs::path &path, bool normalize = false, const std::string &mesh_name = "");
 
     std::vector<Mesh> load_meshes_gpu(const fs::path &path, bool normalize = false);
 
-// save meshes as .obj
+    // batch import: Assimp imports, aiMesh -> geometry conversion and texture decoding of all files run concurrently
+    // on worker threads, GL objects are created on the calling thread as soon as a file is ready
+    // results are in the order of 'paths', mesh names are derived from the file names
+    std::vector<std::vector<std::pair<Geometry, Material>>>
+    load_meshes_cpu(const std::vector<fs::path> &paths, bool normalize = false);
+
+    std::vector<std::vector<Mesh>> load_meshes_gpu(const std::vector<fs::path> &paths, bool normalize = false);
+
+// save meshes as .obj or .ply, see MeshFileFormat
     void save_meshes_cpu(const std::vector<std::pair<GeometryBase, Material>> &meshes, const fs::path &path,
-                         const fs::path &texture_base_path, bool export_material = false);
+                         const fs::path &texture_base_path, bool export_material = false,
+                         MeshFileFormat format = MeshFileFormat::AUTO);
 
     void save_meshes_cpu(const std::vector<Mesh> &meshes, const fs::path &path, const fs::path &texture_base_path,
-                         bool export_material = false);
+                         bool export_material = false, MeshFileFormat format = MeshFileFormat::AUTO);
 
     void save_mesh_cpu(const Mesh &meshes, const fs::path &path, const fs::path &texture_base_path,
-                       bool export_material = false);
+                       bool export_material = false, MeshFileFormat format = MeshFileFormat::AUTO);
 
 CPPGL_NAMESPACE_END
@@ -0,0 +1,81 @@
+#pragma once
+#ifndef CPPGL_MESH_ADJACENCY_H
+#define CPPGL_MESH_ADJACENCY_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "platform.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// MeshAdjacency
+// topology of an indexed triangle mesh stored in flat CSR (compressed sparse row) arrays:
+// the entries belonging to element i of a relation are data[offsets[i]] ... data[offsets[i + 1] - 1]
+
+    class MeshAdjacency {
+    public:
+        MeshAdjacency();
+
+        MeshAdjacency(uint32_t num_vertices, const uint32_t *indices, uint32_t indices_size);
+
+        // (re-)build all relations, runs in parallel over vertices and faces
+        void build(uint32_t num_vertices, const uint32_t *indices, uint32_t indices_size);
+
+        void clear();
+
+        // only the vertex -> face relation, used by algorithms that need nothing else
+        static void build_vertex_faces(uint32_t num_vertices, const uint32_t *indices, uint32_t indices_size,
+                                       std::vector<uint32_t> &offsets, std::vector<uint32_t> &faces);
+
+        // index of the undirected edge (a, b), or INVALID if a and b are not connected
+        uint32_t edge_id(uint32_t a, uint32_t b) const;
+
+        inline uint32_t num_neighbors(uint32_t v) const {
+            return vertex_neighbor_offsets[v + 1] - vertex_neighbor_offsets[v];
+        }
+
+        inline uint32_t num_vertex_faces(uint32_t v) const {
+            return vertex_face_offsets[v + 1] - vertex_face_offsets[v];
+        }
+
+        inline uint32_t num_edge_faces(uint32_t e) const { return edge_face_offsets[e + 1] - edge_face_offsets[e]; }
+
+        inline bool is_boundary_edge(uint32_t e) const { return num_edge_faces(e) == 1; }
+
+        bool is_boundary_vertex(uint32_t v) const;
+
+        inline uint32_t num_edges() const { return uint32_t(edges.size() / 2); }
+
+        // memory held by all arrays in bytes
+        size_t memory_usage() const;
+
+        // human readable breakdown of memory_usage()
+        std::string memory_report() const;
+
+        static constexpr uint32_t INVALID = ~0u;
+
+        // data
+        uint32_t num_vertices;
+        uint32_t num_faces;
+        // vertex -> vertex (one-ring, sorted ascending) and the edge id of every one-ring entry
+        std::vector<uint32_t> vertex_neighbor_offsets;
+        std::vector<uint32_t> vertex_neighbors;
+        std::vector<uint32_t> vertex_neighbor_edges;
+        // vertex -> face
+        std::vector<uint32_t> vertex_face_offsets;
+        std::vector<uint32_t> vertex_faces;
+        // edges as vertex pairs (edges[2 * e] < edges[2 * e + 1]), edge ids are grouped by the smaller vertex
+        std::vector<uint32_t> vertex_edge_offsets;
+        std::vector<uint32_t> edges;
+        // edge -> face
+        std::vector<uint32_t> edge_face_offsets;
+        std::vector<uint32_t> edge_faces;
+        // face -> edge, face_edges[3 * f + k] connects corner k and corner (k + 1) % 3
+        std::vector<uint32_t> face_edges;
+    };
+
+CPPGL_NAMESPACE_END
+
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+#include "geometry.h"
+#include "material.h"
+#include "mesh_optimize.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Binary mesh cache
+//
+// Geometry, attribute maps and material parameters of an imported asset are stored in a versioned binary
+// file whose arrays are 16 byte aligned. Loading maps the file copy-on-write into memory and hands out
+// GeometryWrappers that point directly into the mapped pages, so no vertex data is parsed or copied.
+
+    // 2: geometry is stored after the import optimization, see MeshCacheKey::optimize_options
+    static constexpr uint32_t MESH_CACHE_VERSION = 2;
+
+    // read-only file mapping, private copy-on-write pages so wrapped geometry can still be modified in memory
+    class MappedFile {
+    public:
+        MappedFile(const fs::path &path);
+
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        explicit inline operator bool() const { return data != nullptr; }
+
+        // data
+        const fs::path path;
+        uint8_t *data;
+        size_t size;
+#ifdef _WIN32
+        void *file_handle;
+        void *mapping_handle;
+#endif
+    };
+
+    // everything a cache file depends on, a mismatch in any field triggers a re-import
+    struct MeshCacheKey {
+        MeshCacheKey(const fs::path &source, uint32_t import_flags, bool normalize,
+                     const MeshOptimizeOptions &optimize);
+
+        std::string source_path;    // absolute path of the imported asset
+        int64_t source_mtime;       // last write time of the imported asset
+        uint32_t import_flags;      // Assimp post-processing flags
+        uint32_t normalize;
+        uint64_t optimize_options;  // passes and parameters of the import optimization, they change the data order
+    };
+
+    // default cache location: next to the source with an additional ".cppglcache" extension
+    fs::path mesh_cache_path(const fs::path &source);
+
+    // write meshes to 'cache_path', names are stored relative to 'base_name'
+    // returns false (and leaves no partial file behind) if the file could not be written
+    bool save_mesh_cache(const std::vector<std::pair<GeometryBase, Material>> &meshes, const fs::path &cache_path,
+                         const MeshCacheKey &key, const std::string &base_name);
+
+    // map 'cache_path' and wrap its contents, returns an empty vector if the file is missing, stale or corrupt
+    std::vector<std::pair<GeometryWrapper, Material>>
+    load_mesh_cache(const fs::path &cache_path, const MeshCacheKey &key, const std::string &base_name);
+
+    // load_meshes_cpu through the cache: the first call imports with Assimp and writes the cache,
+    // later calls return GeometryWrappers backed by the mapped cache file
+    std::vector<std::pair<GeometryBase, Material>>
+    load_meshes_cached(const fs::path &path, bool normalize = false, const std::string &mesh_name = "",
+                       const fs::path &cache_path = fs::path());
+
+CPPGL_NAMESPACE_END
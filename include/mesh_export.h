@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+#include "geometry.h"
+#include "material.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Native mesh writers
+//
+// Geometry is serialized straight from the attribute views in chunks. Chunks are formatted in parallel and
+// appended to the file in order, so peak memory is a few chunks per thread instead of a copy of the scene.
+
+    enum class MeshFileFormat {
+        AUTO,       // chosen by the file extension: ".ply" -> PLY, everything else -> OBJ
+        OBJ,        // Wavefront OBJ, plus a .mtl file next to it when materials are exported
+        PLY,        // binary little endian PLY, all meshes merged into one vertex and one face list
+        ASSIMP_OBJ  // OBJ written by building an aiScene and handing it to Assimp's exporter
+    };
+
+    // resolve MeshFileFormat::AUTO for 'path', other formats are returned unchanged
+    MeshFileFormat mesh_file_format(const fs::path &path, MeshFileFormat format = MeshFileFormat::AUTO);
+
+    // texture paths in the .mtl file are stored relative to 'texture_base_path'
+    // throws std::runtime_error if a file cannot be written
+    void save_meshes_obj(const std::vector<std::pair<GeometryBase, Material>> &meshes, const fs::path &path,
+                         const fs::path &texture_base_path, bool export_material = false);
+
+    // PLY has no materials, only positions, normals and texcoords are written
+    // normals and texcoords are only written if every mesh has them
+    // throws std::runtime_error if the file cannot be written
+    void save_meshes_ply(const std::vector<std::pair<GeometryBase, Material>> &meshes, const fs::path &path);
+
+CPPGL_NAMESPACE_END
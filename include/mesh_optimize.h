@@ -0,0 +1,73 @@
+#pragma once
+#ifndef CPPGL_MESH_OPTIMIZE_H
+#define CPPGL_MESH_OPTIMIZE_H
+
+#include <vector>
+#include <cstdint>
+
+#include "platform.h"
+#include "geometry.h"
+#include "data_types.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Mesh optimization
+// reorders triangles and vertices of indexed triangle meshes for the GPU without changing the rendered result:
+// - vertex cache: Tipsify (Sander et al. 2007), fans around recently used vertices to keep them in the
+//   post-transform cache, linear in the number of triangles
+// - overdraw: splits the cache optimized order into clusters where the cache starts over and where a cluster
+//   already reaches the target cache efficiency, then draws outward facing clusters first to occlude the rest
+// - vertex fetch: renumbers vertices in the order of their first use, so the vertex shader reads the attributes
+//   sequentially. positions, normals, texcoords and all per-vertex attribute maps are permuted in place.
+
+    struct VertexCacheStats {
+        float acmr = 0.f;           // average cache miss ratio: transformed vertices per triangle, 0.5 ... 3
+        float atvr = 0.f;           // average transformed vertex ratio: transformed per referenced vertex, 1 is ideal
+        uint32_t transformed = 0;   // cache misses
+    };
+
+    struct MeshOptimizeOptions {
+        bool vertex_cache = true;
+        bool overdraw = true;
+        bool vertex_fetch = true;
+        float overdraw_threshold = 1.05f;   // allowed ACMR increase of the overdraw pass
+        uint32_t cache_size = 16;           // FIFO entries of the simulated post-transform cache
+        bool verbose = false;               // print ACMR/ATVR before and after, e.g. for every import
+    };
+
+    struct MeshOptimizeReport {
+        VertexCacheStats before, after;
+        double seconds = 0.0;
+    };
+
+    // FIFO cache simulation of the indexed triangle list
+    VertexCacheStats analyze_vertex_cache(const uint32_t *indices, size_t indices_size, uint32_t num_vertices,
+                                          uint32_t cache_size = 16);
+
+    void optimize_vertex_cache(uint32_t *indices, size_t indices_size, uint32_t num_vertices,
+                               uint32_t cache_size = 16);
+
+    // expects indices from optimize_vertex_cache, positions are xyz floats.
+    // the ACMR grows by at most 'threshold', 1 keeps the cache efficiency and only sorts the existing clusters
+    void optimize_overdraw(uint32_t *indices, size_t indices_size, const float *positions, uint32_t num_vertices,
+                           float threshold = 1.05f, uint32_t cache_size = 16);
+
+    // vertex order of the first use in 'indices', remap[old] = new, unreferenced vertices keep their relative order
+    // at the end. the indices are rewritten
+    std::vector<uint32_t> optimize_vertex_fetch_remap(uint32_t *indices, size_t indices_size, uint32_t num_vertices);
+
+    // apply a remap from optimize_vertex_fetch_remap to all per-vertex data of a geometry, also external buffers
+    void remap_vertices(GeometryBaseImpl &geometry, const std::vector<uint32_t> &remap);
+
+    // all enabled passes, does nothing for geometries without indices
+    MeshOptimizeReport optimize_mesh(GeometryBaseImpl &geometry,
+                                     const MeshOptimizeOptions &options = MeshOptimizeOptions());
+
+    // same for a registered geometry, meshes using it are updated
+    MeshOptimizeReport optimize_mesh(GeometryBase &geometry,
+                                     const MeshOptimizeOptions &options = MeshOptimizeOptions());
+
+CPPGL_NAMESPACE_END
+
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+#ifndef CPPGL_MESH_SIMPLIFY_H
+#define CPPGL_MESH_SIMPLIFY_H
+
+#include <limits>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "mesh.h"
+#include "camera.h"
+#include "platform.h"
+#include "geometry.h"
+#include "data_types.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Mesh simplification
+// quadric error metric edge collapses (Garland / Heckbert) restricted to half-edge collapses: every output vertex is
+// an input vertex, so normals, texcoords and all custom attributes are carried over unchanged.
+// vertices sharing their position with differently attributed twins (uv / normal seams) only collapse along the
+// seam and together with their twin, open borders only along the border. both are held in place by extra quadrics.
+// every pass evaluates all edges in parallel and collapses an independent set of the cheapest ones.
+
+    struct SimplifyOptions {
+        float target_ratio = 0.25f;    // fraction of the faces to keep
+        uint32_t target_faces = 0;     // absolute target, overrides target_ratio if > 0
+        float max_error = std::numeric_limits<float>::infinity(); // object space distance
+        bool lock_border = false;      // keep open borders completely in place
+    };
+
+    struct SimplifyStats {
+        inline double faces_per_second() const { return seconds > 0.0 ? double(faces_in) / seconds : 0.0; }
+
+        // data
+        uint32_t faces_in = 0, faces_out = 0;
+        uint32_t vertices_in = 0, vertices_out = 0;
+        uint32_t passes = 0;
+        float error = 0.f;             // object space distance of the worst collapse
+        double seconds = 0.0;
+    };
+
+    // simplified triangle indices referring to the vertices of 'geometry'
+    std::vector<uint32_t> simplify_indices(const GeometryBase &geometry,
+                                           const SimplifyOptions &options = SimplifyOptions(),
+                                           SimplifyStats *stats = nullptr);
+
+    // new geometry holding only the vertices the simplified faces reference, including all custom attributes
+    Geometry simplify(const GeometryBase &geometry, const std::string &name,
+                      const SimplifyOptions &options = SimplifyOptions(), SimplifyStats *stats = nullptr);
+
+// ------------------------------------------
+// LODMesh
+// chain of simplified versions of a mesh, level 0 is the mesh itself and every further level keeps 'ratio' of the
+// faces of the previous one. select() picks the coarsest level whose accumulated geometric error projects to at most
+// 'pixel_error' pixels, e.g. elem->mesh = lod->select(elem->model) once per frame.
+
+    class LODMeshImpl {
+    public:
+        LODMeshImpl(const std::string &name, const Mesh &base, uint32_t num_levels = 4, float ratio = 0.5f,
+                    float pixel_error = 1.f);
+
+        // frees the generated levels
+        virtual ~LODMeshImpl();
+
+        static inline std::string type_to_str() { return "LODMeshImpl"; }
+
+        LODMeshImpl(const LODMeshImpl &) = delete;
+
+        LODMeshImpl &operator=(const LODMeshImpl &) = delete;
+
+        // screen space error of a level in pixels, placed with 'model' and seen from 'cam'
+        float projected_error(uint32_t level, const mat4 &model, const Camera &cam = current_camera()) const;
+
+        uint32_t select_level(const mat4 &model, const Camera &cam = current_camera()) const;
+
+        const Mesh &select(const mat4 &model, const Camera &cam = current_camera()) const;
+
+        inline uint32_t num_levels() const { return uint32_t(levels.size()); }
+
+        // data
+        const std::string name;
+        float pixel_error;
+        std::vector<Mesh> levels;
+        std::vector<float> errors;           // object space error of every level, 0 for the base mesh
+        std::vector<uint32_t> num_faces;     // per level
+        std::vector<SimplifyStats> stats;    // per generated level
+        vec3 center;                         // object space bounding sphere of the base mesh
+        float radius;
+    };
+
+    using LODMesh = NamedHandle<LODMeshImpl>;
+
+    template
+    class _API NamedHandle<LODMeshImpl>; // needed for Windows DLL export
+
+CPPGL_NAMESPACE_END
+
+#endif
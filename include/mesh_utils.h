@@ -13,6 +13,38 @@ CPPGL_NAMESPACE_BEGIN
         Laplacian() : sum(0, 0, 0), count(0) {};
     };
 
+    // Jacobi laplacian smoothing on structure-of-arrays copies of a vertex attribute
+    // every step reads one buffer and writes the other, so the result does not depend on the
+    // vertex order and vertex ranges can be processed in parallel
+    // neighbors are weighted by the number of faces sharing their edge
+    class LaplacianSmoother {
+    public:
+        LaplacianSmoother(const MeshAdjacency &adjacency);
+
+        // copy interleaved xyz data (3 * num_vertices floats) into the SoA buffers
+        void load(const float *data);
+
+        // copy the current SoA buffers back to interleaved xyz data
+        void store(float *data) const;
+
+        // p += lambda * (laplacian_center - p)
+        void step(float lambda);
+
+        // move p towards the laplacian center only along the ray from 'view_pos' through p
+        void depth_step(const vec3 &view_pos, float contribution);
+
+        void smooth(uint32_t iter, float lambda = 1.f);
+
+        // alternating shrink (lambda > 0) and inflate (mu < -lambda) steps, avoids the shrinkage of plain smoothing
+        void taubin(uint32_t iter, float lambda = 0.5f, float mu = -0.53f);
+
+        const MeshAdjacency &adjacency;
+        std::vector<float> weights;         // per one-ring entry
+        std::vector<float> inv_weight_sum;  // per vertex, 0 for isolated vertices
+        std::vector<float> x[2], y[2], z[2];
+        uint32_t current;
+    };
+
     void laplacian_smoothing(GeometryBase &geo, uint32_t iter = 1);
 
     void laplacian_depth_smoothing(GeometryBase &geo,
@@ -20,6 +52,9 @@ CPPGL_NAMESPACE_BEGIN
                                    vec3 view_pos = vec3(0, 0, 0),
                                    float contribution = 1.f);
 
+    // Taubin lambda/mu smoothing, keeps the volume of the mesh close to the original
+    void taubin_smoothing(GeometryBase &geo, uint32_t iter = 1, float lambda = 0.5f, float mu = -0.53f);
+
 #if WITH_CUDA
     namespace cuda
     {
@@ -1,13 +1,18 @@
 #pragma once
 
 #include <map>
+#include <array>
 #include <mutex>
 #include <memory>
 #include <string>
 #include <cassert>
+#include <iterator>
 #include <iostream>
 #include <stdexcept>
+#include <functional>
 #include <type_traits>
+#include <shared_mutex>
+#include <unordered_map>
 #include "platform.h"
 #include "data_types.h"
 #include "utils/utils.h"
@@ -21,6 +26,191 @@ CPPGL_NAMESPACE_BEGIN
     struct HasName<T, decltype((void) T::name, 0)> : std::true_type {
     };
 
+    // ------------------------------------------
+    // NamedHandleRegistry
+    // name -> handle map behind NamedHandle<T>::map. a name is hashed once per operation, the hash selects one of
+    // SHARDS independently locked tables and is stored with the entry, so lookups compare hashes before names.
+    // lookups lock their shard shared and mutations exclusively, threads working on different names rarely wait.
+    // handles replaced or removed by a mutation are released after the lock, their destructors may use the
+    // registry again. iteration visits all entries in no particular order and must not overlap with mutations
+
+    template<typename H>
+    class NamedHandleRegistry {
+    private:
+        struct PrehashedHash {
+            inline size_t operator()(size_t hash) const { return hash; }
+        };
+
+    public:
+        static constexpr uint32_t SHARD_BITS = 4;
+        static constexpr uint32_t SHARDS = 1u << SHARD_BITS;
+
+        using value_type = std::pair<const std::string, H>;
+        using Table = std::unordered_multimap<size_t, value_type, PrehashedHash>;
+
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = NamedHandleRegistry::value_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = value_type *;
+            using reference = value_type &;
+
+            iterator(NamedHandleRegistry *registry, uint32_t shard) : registry(registry), shard(shard) {
+                if (shard < SHARDS) {
+                    inner = registry->shards[shard].table.begin();
+                    skip_empty();
+                }
+            }
+
+            inline reference operator*() const { return inner->second; }
+
+            inline pointer operator->() const { return &inner->second; }
+
+            inline iterator &operator++() {
+                ++inner;
+                skip_empty();
+                return *this;
+            }
+
+            inline iterator operator++(int) {
+                iterator it = *this;
+                ++*this;
+                return it;
+            }
+
+            inline bool operator==(const iterator &other) const {
+                return shard == other.shard && (shard == SHARDS || inner == other.inner);
+            }
+
+            inline bool operator!=(const iterator &other) const { return !(*this == other); }
+
+        private:
+            void skip_empty() {
+                while (inner == registry->shards[shard].table.end()) {
+                    if (++shard == SHARDS)
+                        return;
+                    inner = registry->shards[shard].table.begin();
+                }
+            }
+
+            NamedHandleRegistry *registry;
+            uint32_t shard;
+            typename Table::iterator inner;
+        };
+
+        static inline size_t hash(const std::string &name) { return std::hash<std::string>()(name); }
+
+        // true if the name was mapped before, its handle is replaced
+        bool insert_or_assign(const std::string &name, const H &handle) {
+            const size_t h = hash(name);
+            Shard &s = shard(h);
+            H previous;
+            {
+                const std::unique_lock<std::shared_mutex> lock(s.mutex);
+                const auto it = locate(s.table, name, h);
+                if (it == s.table.end()) {
+                    s.table.emplace(h, value_type(name, handle));
+                    return false;
+                }
+                previous = std::move(it->second.second);
+                it->second.second = handle;
+            }
+            return true;
+        }
+
+        // copy of the mapped handle to 'handle', false if the name is not mapped
+        bool find(const std::string &name, H &handle) const {
+            const size_t h = hash(name);
+            const Shard &s = shard(h);
+            const std::shared_lock<std::shared_mutex> lock(s.mutex);
+            const auto it = locate(s.table, name, h);
+            if (it == s.table.end())
+                return false;
+            handle = it->second.second;
+            return true;
+        }
+
+        bool contains(const std::string &name) const {
+            const size_t h = hash(name);
+            const Shard &s = shard(h);
+            const std::shared_lock<std::shared_mutex> lock(s.mutex);
+            return locate(s.table, name, h) != s.table.end();
+        }
+
+        inline size_t count(const std::string &name) const { return contains(name) ? 1 : 0; }
+
+        bool erase(const std::string &name) {
+            return erase_if(name, [](const H &) { return true; });
+        }
+
+        // erase the mapping if pred(handle) holds, checked under the lock. false if the name is not mapped
+        template<typename Pred>
+        bool erase_if(const std::string &name, Pred pred) {
+            const size_t h = hash(name);
+            Shard &s = shard(h);
+            H removed;
+            {
+                const std::unique_lock<std::shared_mutex> lock(s.mutex);
+                const auto it = locate(s.table, name, h);
+                if (it == s.table.end())
+                    return false;
+                if (pred(it->second.second)) {
+                    removed = std::move(it->second.second);
+                    s.table.erase(it);
+                }
+            }
+            return true;
+        }
+
+        void clear() {
+            for (Shard &s: shards) {
+                Table removed;
+                {
+                    const std::unique_lock<std::shared_mutex> lock(s.mutex);
+                    removed.swap(s.table);
+                }
+            }
+        }
+
+        size_t size() const {
+            size_t size = 0;
+            for (const Shard &s: shards) {
+                const std::shared_lock<std::shared_mutex> lock(s.mutex);
+                size += s.table.size();
+            }
+            return size;
+        }
+
+        inline bool empty() const { return size() == 0; }
+
+        inline iterator begin() { return iterator(this, 0); }
+
+        inline iterator end() { return iterator(this, SHARDS); }
+
+    private:
+        // own cache line each, so readers of one shard do not invalidate the lock of the next
+        struct alignas(64) Shard {
+            mutable std::shared_mutex mutex;
+            Table table;
+        };
+
+        inline Shard &shard(size_t hash) { return shards[hash >> (8 * sizeof(size_t) - SHARD_BITS)]; }
+
+        inline const Shard &shard(size_t hash) const { return shards[hash >> (8 * sizeof(size_t) - SHARD_BITS)]; }
+
+        template<typename TableType>
+        static auto locate(TableType &table, const std::string &name, size_t hash) -> decltype(table.end()) {
+            auto range = table.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it)
+                if (it->second.first == name)
+                    return it;
+            return table.end();
+        }
+
+        std::array<Shard, SHARDS> shards;
+    };
+
     template<typename T>
     class NamedHandle {
     public:
@@ -33,12 +223,7 @@ CPPGL_NAMESPACE_BEGIN
             static_assert(HasName<T>::value, "Template type T is required to have a member \"name\"!");
             static_assert(std::is_same<decltype(T::name), std::string>::value ||
                           std::is_same<decltype(T::name), const std::string>::value, "bad type bro");
-#ifndef NDEBUG
-            if (map.count(ptr->name))
-                std::cerr << "Warning: Name \"" << ptr->name << "\" is not unique!" << std::endl;
-#endif
-            const std::lock_guard<std::mutex> lock(mutex);
-            map[ptr->name] = *this;
+            insert(*this);
         }
 
         template<typename S>
@@ -49,17 +234,12 @@ CPPGL_NAMESPACE_BEGIN
 
             ptr = other.ptr;
             other.erase(ptr->name);
-            map[ptr->name] = *this;
+            map.insert_or_assign(ptr->name, *this);
         }
 
         //Assume the pointer doesn't belong to another namedhandle
         NamedHandle(const std::shared_ptr<T>& other):ptr(other){
-#ifndef NDEBUG
-            if (map.count(ptr->name))
-                std::cerr << "Warning: Name \"" << ptr->name << "\" is not unique!" << std::endl;
-#endif
-            const std::lock_guard<std::mutex> lock(mutex);
-            map[ptr->name] = *this;
+            insert(*this);
         }
 
         template<typename S>
@@ -67,11 +247,7 @@ CPPGL_NAMESPACE_BEGIN
             static_assert(
                     std::is_base_of<T, S>::value,
                     "[ERROR] in NamedHandle constructor: S must be derived from T");
-#ifndef NDEBUG
-            if (map.count(ptr->name))
-                std::cerr << "Warning: Name \"" << ptr->name << "\" is not unique!" << std::endl;
-#endif
-            map[ptr->name] = *this;
+            insert(*this);
         }
 
         virtual ~NamedHandle() {}
@@ -110,22 +286,23 @@ CPPGL_NAMESPACE_BEGIN
 
         // check if mapping for given name exists
         static bool valid(const std::string &name) {
-            const std::lock_guard<std::mutex> lock(mutex);
-            return map.count(name);
+            return map.contains(name);
         }
 
         // return mapped handle for given name
         static NamedHandle<T> find(const std::string &name) {
+            NamedHandle<T> handle;
+            const bool found = map.find(name, handle);
 #ifndef NDEBUG
-            if (!valid(name))
+            if (!found)
             {
                 std::cout << "[ERROR] NamedHandle<" << T::type_to_str() << "> of name '"
                           << name << "' does not exist." << std::endl;
             }
 #endif
-            assert(valid(name));
-            const std::lock_guard<std::mutex> lock(mutex);
-            return map[name];
+            assert(found);
+            (void) found;
+            return handle;
         }
 
         // remove element from map for given name
@@ -135,43 +312,46 @@ CPPGL_NAMESPACE_BEGIN
 
         // clear saved handles and free unsused memory
         static void clear() {
-            const std::lock_guard<std::mutex> lock(mutex);
             map.clear();
         }
 
         // erase the element from the map and free the
         // underlying pointer
         void free(bool force = false) {
-            const std::lock_guard<std::mutex> lock(mutex);
             if (!initialized())
                 return;
 
-            if (map.count(ptr->name) && (ptr.use_count() <= 2 || force)) {
-                map.erase(ptr->name);
-            } else if (map.count(ptr->name) == 0) {
+            // the registry's copy and this one, checked under the registry's lock
+            const bool mapped = map.erase_if(ptr->name, [&](const NamedHandle<T> &) {
+                return ptr.use_count() <= 2 || force;
+            });
+            if (!mapped)
                 throw std::runtime_error("Namedhandle " + ptr->name +
                                          " was erased from map before free.");
-            } else {
-                // std::cout << "do not free " << ptr->name
-                //           << " as still used: " << ptr.use_count() << std::endl;
-            }
             ptr.reset();
         }
 
         // iterators to iterate over all entries
-        static typename std::map<std::string, NamedHandle<T>>::iterator begin() { return map.begin(); }
+        static typename NamedHandleRegistry<NamedHandle<T>>::iterator begin() { return map.begin(); }
 
-        static typename std::map<std::string, NamedHandle<T>>::iterator end() { return map.end(); }
+        static typename NamedHandleRegistry<NamedHandle<T>>::iterator end() { return map.end(); }
 
         std::shared_ptr<T> ptr;
-        static std::mutex mutex;
-        static std::map<std::string, NamedHandle<T>> map;
+        static NamedHandleRegistry<NamedHandle<T>> map;
+
+    private:
+        static void insert(const NamedHandle<T> &handle) {
+            const bool replaced = map.insert_or_assign(handle.ptr->name, handle);
+#ifndef NDEBUG
+            if (replaced)
+                std::cerr << "Warning: Name \"" << handle.ptr->name << "\" is not unique!" << std::endl;
+#endif
+            (void) replaced;
+        }
     };
 
 // definition of static members (compiler magic)
     template<typename T>
-    std::mutex NamedHandle<T>::mutex;
-    template<typename T>
-    std::map<std::string, NamedHandle<T>> NamedHandle<T>::map;
+    NamedHandleRegistry<NamedHandle<T>> NamedHandle<T>::map;
 
 CPPGL_NAMESPACE_END
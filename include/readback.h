@@ -0,0 +1,108 @@
+#pragma once
+#ifndef CPPGL_READBACK_H
+#define CPPGL_READBACK_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <future>
+#include <cstdint>
+#include <functional>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include "buffer.h"
+#include "texture.h"
+#include "platform.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// GPUReadback
+// GPU -> CPU transfers without pipeline stalls: every request is copied into one of several pixel pack buffers
+// and guarded by a fence. poll() (called once per frame by Context::swap_buffers) hands the data of all
+// finished requests to their callbacks in request order.
+// all functions have to be called on the GL thread, callbacks also run there
+
+    class GPUReadback {
+    public:
+        // data is the mapped pack buffer and only valid during the call
+        using Callback = std::function<void(const uint8_t *data, size_t size_bytes)>;
+
+        // num_buffers pack buffers are cycled, a request that finds none free waits for the oldest one
+        explicit GPUReadback(uint32_t num_buffers = 3);
+
+        // delivers outstanding requests, then frees the pack buffers
+        ~GPUReadback();
+
+        GPUReadback(const GPUReadback &) = delete;
+
+        GPUReadback &operator=(const GPUReadback &) = delete;
+
+        // mip level 0 of a texture, converted to format / type, rows are tightly packed
+        void read(const Texture2D &texture, GLenum format, GLenum type, const Callback &callback);
+
+        void read(const Texture3D &texture, GLenum format, GLenum type, const Callback &callback);
+
+        // [offset_bytes, offset_bytes + size_bytes) of a storage buffer
+        void read(const SSBO &buffer, size_t offset_bytes, size_t size_bytes, const Callback &callback);
+
+        // mip level 0 of any texture object with 'num_texels' texels
+        void read_texture(GLenum target, GLuint texture, size_t num_texels, GLenum format, GLenum type,
+                          const Callback &callback);
+
+        // region of the currently bound read framebuffer (the default framebuffer unless one is bound)
+        void read_framebuffer(int x, int y, int w, int h, GLenum format, GLenum type, const Callback &callback);
+
+        // future variants, fulfilled by poll() / finish() on the GL thread
+        // XXX: waiting for the future on the GL thread itself blocks forever, call finish() before
+        std::future<std::vector<uint8_t>> read(const Texture2D &texture, GLenum format, GLenum type);
+
+        std::future<std::vector<uint8_t>> read(const Texture3D &texture, GLenum format, GLenum type);
+
+        std::future<std::vector<uint8_t>> read(const SSBO &buffer, size_t offset_bytes, size_t size_bytes);
+
+        std::future<std::vector<uint8_t>> read_framebuffer(int x, int y, int w, int h, GLenum format, GLenum type);
+
+        // deliver all finished requests, never blocks
+        void poll();
+
+        // wait for and deliver all outstanding requests
+        void finish();
+
+        inline size_t num_pending() const { return pending.size(); }
+
+        // readback service used by Context (screenshot) and Texture2D::save_ldr
+        static GPUReadback &global();
+
+        // finish and destroy the global service while the GL context is still alive, called by Context::~Context
+        static void shutdown_global();
+
+    private:
+        struct Slot {
+            PPBO buffer;
+            GLsync fence = 0;
+            size_t size_bytes = 0;
+            Callback callback;
+        };
+
+        // pack buffer of at least 'size_bytes' bound to GL_PIXEL_PACK_BUFFER
+        uint32_t begin_request(size_t size_bytes);
+
+        void end_request(uint32_t slot, const Callback &callback);
+
+        void deliver(uint32_t slot);
+
+        // data
+        const uint32_t id;
+        std::vector<Slot> slots;
+        std::deque<uint32_t> pending;  // in request order
+        std::vector<uint32_t> free_slots;
+    };
+
+    // bytes of one pixel with the given pixel transfer format / type
+    size_t pixel_size_bytes(GLenum format, GLenum type);
+
+CPPGL_NAMESPACE_END
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+#ifndef CPPGL_RENDER_QUEUE_H
+#define CPPGL_RENDER_QUEUE_H
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include "camera.h"
+#include "platform.h"
+#include "drawelement.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// RenderQueue
+// collects drawelements, sorts them by a 64 bit key (shader | material | mesh | depth) and draws them,
+// binding programs, VAOs, material uniforms and textures only when they differ from the previous draw.
+// queued drawelements have to stay alive until submit(), all functions have to be called on the GL thread
+
+    class RenderQueue {
+    public:
+        enum class SortMode {
+            STATE,         // opaque geometry: minimal state changes, front to back within equal state
+            BACK_TO_FRONT  // blended geometry: depth first, state only breaks ties
+        };
+
+        // GL calls issued by submit(), and the ones bind() / draw() / unbind() per element would have issued
+        struct Stats {
+            uint32_t draws = 0;
+            uint32_t program_binds = 0;
+            uint32_t vao_binds = 0;
+            uint32_t material_binds = 0;
+            uint32_t texture_binds = 0;
+        };
+
+        explicit RenderQueue(SortMode mode = SortMode::STATE);
+
+        // queue one drawelement, disabled ones are skipped
+        void push(const Drawelement &elem);
+
+        // queue all enabled elements of a group
+        void push(const GroupedDrawelements &group);
+
+        // build keys with the given camera and sort, submit() does that if it was not called before
+        void sort(const Camera &cam = current_camera());
+
+        // draw everything queued, leaves no program, VAO or texture bound
+        void submit();
+
+        // empty the queue (does not reset the stats of the last submit)
+        void clear();
+
+        inline size_t size() const { return items.size(); }
+
+        // counts of the last submit()
+        Stats stats;
+        Stats unsorted_stats;
+        SortMode mode;
+
+    private:
+        struct Item {
+            uint64_t key;
+            const DrawelementImpl *elem;
+        };
+
+        void bind_material(const ShaderImpl *shader, const MaterialImpl *material);
+
+        // dense id of a state object for the current sort, wraps around if there are more than fit the key
+        static uint32_t state_id(std::unordered_map<const void *, uint32_t> &ids, const void *state);
+
+        // data
+        std::vector<Item> items, sort_buffer;
+        bool sorted;
+        std::unordered_map<const void *, uint32_t> shader_ids, material_ids, mesh_ids;
+        std::vector<GLuint> bound_textures;  // per texture unit, during submit()
+    };
+
+CPPGL_NAMESPACE_END
+
+#endif
@@ -0,0 +1,123 @@
+#pragma once
+#ifndef CPPGL_SCENE_BVH_H
+#define CPPGL_SCENE_BVH_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+
+#include "camera.h"
+#include "platform.h"
+#include "data_types.h"
+#include "drawelement.h"
+#include "render_queue.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// FrustumPlanes
+// planes (xyz: normal pointing inside, w: distance) extracted from proj * view
+
+    struct FrustumPlanes {
+        explicit FrustumPlanes(const mat4 &view_proj);
+
+        explicit FrustumPlanes(const Camera &cam = current_camera());
+
+        // false if the box is completely outside, conservative near the corners of the frustum
+        bool intersects(const vec3 &bb_min, const vec3 &bb_max) const;
+
+        std::array<vec4, 6> planes;
+    };
+
+// ------------------------------------------
+// SceneBVH
+// bounding volume hierarchy over the world space bounds of drawelements for frustum culling.
+// elements report model changes through DrawelementImpl::set_model_*, the affected leaves and their ancestors are
+// refit before the next cull. assigning DrawelementImpl::model directly has to be followed by mark_dirty().
+// leaves store the boxes of their elements as separate coordinate arrays, so the plane tests of a leaf are
+// branch-free loops the compiler vectorizes. large scenes are traversed in parallel on the global ThreadPool.
+
+    class SceneBVH {
+    public:
+        SceneBVH();
+
+        ~SceneBVH();
+
+        SceneBVH(const SceneBVH &) = delete;
+
+        SceneBVH &operator=(const SceneBVH &) = delete;
+
+        // an element can be part of one SceneBVH at a time, changes of the element set rebuild on the next cull
+        void insert(const Drawelement &elem);
+
+        void remove(const Drawelement &elem);
+
+        // replace the element set with all registered drawelements
+        void insert_all();
+
+        void clear();
+
+        // model of the element was changed without DrawelementImpl::set_model_*
+        void mark_dirty(const Drawelement &elem);
+
+        void mark_dirty(uint32_t index);
+
+        // rebuild instead of refit, e.g. after most elements moved far
+        void rebuild();
+
+        // indices (see element()) of the elements intersecting the frustum, in traversal order.
+        // elements without CPU geometry are always visible, disabled elements never
+        const std::vector<uint32_t> &cull(const FrustumPlanes &frustum);
+
+        const std::vector<uint32_t> &cull(const Camera &cam = current_camera());
+
+        // cull and queue the visible elements
+        void cull(RenderQueue &queue, const Camera &cam = current_camera());
+
+        inline const Drawelement &element(uint32_t index) const { return elements[index]; }
+
+        inline uint32_t size() const { return uint32_t(elements.size()); }
+
+        // scenes with fewer elements are culled on the calling thread
+        uint32_t parallel_threshold;
+
+    private:
+        struct Node {
+            float bb_min[3];
+            float bb_max[3];
+            uint32_t first;  // leaf: first slot, inner: left child (the right one follows)
+            uint32_t count;  // leaf: number of slots, 0 for inner nodes
+        };
+
+        // world space box of element i into the slot arrays
+        void compute_bounds(uint32_t slot);
+
+        void build();
+
+        void refit();
+
+        void refit_node(uint32_t node);
+
+        void cull_subtree(const FrustumPlanes &frustum, uint32_t node, std::vector<uint32_t> &visible) const;
+
+        void cull_leaf(const FrustumPlanes &frustum, const Node &leaf, bool inside,
+                       std::vector<uint32_t> &visible) const;
+
+        // data
+        std::vector<Drawelement> elements;
+        std::vector<uint32_t> unbounded;      // elements without geometry
+        std::vector<Node> nodes;
+        std::vector<uint32_t> parents;
+        std::vector<uint32_t> slot_element;   // slot -> element index, slots are in leaf order
+        std::vector<uint32_t> element_slot;   // element index -> slot, ~0u for unbounded elements
+        std::vector<uint32_t> slot_leaf;
+        std::vector<float> slot_min[3], slot_max[3];
+        std::vector<uint32_t> dirty;
+        std::vector<uint8_t> dirty_flags;
+        std::vector<uint32_t> visible;
+        bool needs_build;
+    };
+
+CPPGL_NAMESPACE_END
+
+#endif
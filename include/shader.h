@@ -8,6 +8,8 @@ namespace fs = std::filesystem;
 #include <map>
 #include <memory>
 #include <vector>
+#include <cstdint>
+#include <unordered_map>
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include "named_handle.h"
@@ -19,6 +21,11 @@ CPPGL_NAMESPACE_BEGIN
 // ------------------------------------------
 // Shader
 
+    // pre-resolved uniform of a ShaderImpl (see ShaderImpl::uniform_handle), stays valid when the shader is reloaded
+    struct UniformHandle {
+        uint32_t slot;
+    };
+
     class ShaderImpl {
     public:
         ShaderImpl(const std::string &name);
@@ -72,6 +79,9 @@ CPPGL_NAMESPACE_BEGIN
                               GLbitfield memory_barrier_bits = GL_ALL_BARRIER_BITS) const;
 
         // uniform upload handling
+        // locations come from the reflection table built by compile(), values equal to the last upload to the same
+        // location are skipped (counted in skipped_uploads). this assumes uniforms of the program are only set
+        // through these functions
         void uniform(const std::string &name, int val) const;
 
         void uniform(const std::string &name, int *val, uint32_t count) const;
@@ -110,6 +120,61 @@ CPPGL_NAMESPACE_BEGIN
 
         void uniform(const std::string &name, const Texture3D &tex, uint32_t unit) const;
 
+        // resolve once, then upload without string hashing or driver lookups
+        // unknown names resolve to an inactive handle that ignores uploads until a reload makes the uniform active
+        UniformHandle uniform_handle(const std::string &name) const;
+
+        void uniform(UniformHandle handle, int val) const;
+
+        void uniform(UniformHandle handle, int *val, uint32_t count) const;
+
+        void uniform(UniformHandle handle, uint32_t val) const;
+
+        void uniform(UniformHandle handle, uint32_t *val, uint32_t count) const;
+
+        void uniform(UniformHandle handle, float val) const;
+
+        void uniform(UniformHandle handle, float *val, uint32_t count) const;
+
+        void uniform(UniformHandle handle, const vec2 &val) const;
+
+        void uniform(UniformHandle handle, const vec3 &val) const;
+
+        void uniform(UniformHandle handle, const vec4 &val) const;
+
+        void uniform(UniformHandle handle, const ivec2 &val) const;
+
+        void uniform(UniformHandle handle, const ivec3 &val) const;
+
+        void uniform(UniformHandle handle, const ivec4 &val) const;
+
+        void uniform(UniformHandle handle, const uvec2 &val) const;
+
+        void uniform(UniformHandle handle, const uvec3 &val) const;
+
+        void uniform(UniformHandle handle, const uvec4 &val) const;
+
+        void uniform(UniformHandle handle, const mat3 &val) const;
+
+        void uniform(UniformHandle handle, const mat4 &val) const;
+
+        void uniform(UniformHandle handle, const Texture2D &tex, uint32_t unit) const;
+
+        void uniform(UniformHandle handle, const Texture3D &tex, uint32_t unit) const;
+
+        // handles of the transforms set by DrawelementImpl::bind, registered in every shader
+        static constexpr UniformHandle MODEL{0}, MODEL_NORMAL{1}, VIEW{2}, VIEW_NORMAL{3}, PROJ{4};
+
+        // dequantization ranges set by MeshImpl::bind_quantization, see VertexLayout::GLSL_DECLARATION
+        static constexpr UniformHandle POSITION_MIN{5}, POSITION_EXTENT{6}, TEXCOORD_MIN{7}, TEXCOORD_EXTENT{8};
+
+        // reflection, -1 if the program has no such uniform / block
+        GLint uniform_location(const std::string &name) const;
+
+        GLint uniform_block_binding(const std::string &name) const;
+
+        GLint storage_block_binding(const std::string &name) const;
+
         // clear shader
         void clear();
 
@@ -119,14 +184,64 @@ CPPGL_NAMESPACE_BEGIN
         // set default paths to search for shader source files
         static void add_shader_search_path(fs::path path);
 
+        // active uniform (or array element looked up by name)
+        struct UniformSlot {
+            std::string name;
+            GLint location;    // -1: not active in the current program
+            GLenum type;       // GL type from reflection, 0 if resolved through glGetUniformLocation
+            GLint array_size;
+        };
+
+        // value last uploaded to a location, array uploads cover 'count' consecutive locations
+        struct UniformShadow {
+            uint32_t count;
+            std::vector<uint8_t> bytes;
+        };
+
+        struct BlockInfo {
+            GLuint index;
+            GLint binding;
+            GLint size_bytes;
+        };
+
         // data
         const std::string name;
         GLuint id;
+        ivec3 work_group_size;  // compute shaders only
+        bool object_block;      // reads the per-draw block of FrameUniforms
+        bool draws_block;       // reads the transforms of a DrawBatch
+        bool dequantizes;       // has active cppgl_*_min / cppgl_*_extent uniforms
+        mutable std::vector<UniformSlot> uniform_slots;
+        mutable std::unordered_map<std::string, uint32_t> uniform_table;
+        // by location, so aliases like "name" and "name[0]" share one entry. entries never overlap
+        mutable std::map<GLint, UniformShadow> uniform_shadows;
+        std::unordered_map<std::string, BlockInfo> uniform_blocks;
+        std::unordered_map<std::string, BlockInfo> storage_blocks;
+        mutable uint64_t skipped_uploads;
         std::map<GLenum, fs::path> source_files;
         std::map<GLenum, fs::file_time_type> timestamps;
         std::map<fs::path, fs::file_time_type> include_timestamps;
 
         static std::vector<fs::path> shader_search_paths;
+
+    private:
+        // rebuild the reflection tables for the current program
+        void reflect();
+
+        // true if the value differs from the last upload to the location of 'handle', updates the shadow copy.
+        // count: array elements written, i.e. consecutive locations
+        bool needs_upload(UniformHandle handle, const void *data, size_t size_bytes, uint32_t count = 1) const;
+
+        // registers "name[0]" also under "name"
+        void set_uniform_slot(const std::string &name, GLint location, GLenum type, GLint array_size);
+
+        // program resource queries (GL 4.3 / GL_ARB_program_interface_query)
+        void reflect_resources();
+
+        // glGetActiveUniform / glGetActiveUniformBlockName for older contexts, no shader storage blocks
+        void reflect_legacy();
+
+        inline GLint location(UniformHandle handle) const { return uniform_slots[handle.slot].location; }
     };
 
     using Shader = NamedHandle<ShaderImpl>;
@@ -9,6 +9,7 @@ namespace fs = std::filesystem;
 #include <GL/gl.h>
 #include "named_handle.h"
 #include "data_types.h"
+#include "image_load_store.h"
 
 CPPGL_NAMESPACE_BEGIN
 
@@ -20,6 +21,9 @@ CPPGL_NAMESPACE_BEGIN
         // construct from image on disk
         Texture2DImpl(const std::string &name, const fs::path &path, bool mipmap = true);
 
+        // construct from an image that was already decoded from 'path' (as returned by image_load)
+        Texture2DImpl(const std::string &name, const fs::path &path, const ImageData &image, bool mipmap = true);
+
         // construct empty texture or from raw data
         Texture2DImpl(const std::string &name, uint32_t w, uint32_t h, GLint internal_format, GLenum format,
                       GLenum type,
@@ -50,9 +54,9 @@ CPPGL_NAMESPACE_BEGIN
 
         void unbind_image(uint32_t unit) const;
 
-        // TODO CPU <-> GPU data transfers
+        // GPU -> CPU transfers without stalling: see GPUReadback (readback.h)
 
-        // save to disk
+        // save to disk, async: read back through GPUReadback and written by ImageWriter, the call does not stall
         void save_ldr(const fs::path &path, bool flip = true, bool async = false) const;
 
         // data
@@ -104,7 +108,7 @@ CPPGL_NAMESPACE_BEGIN
 
         void unbind_image(uint32_t unit) const;
 
-        // TODO CPU <-> GPU data transfers
+        // GPU -> CPU transfers without stalling: see GPUReadback (readback.h)
 
         // data
         const std::string name;
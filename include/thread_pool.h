@@ -0,0 +1,150 @@
+#pragma once
+#ifndef CPPGL_THREAD_POOL_H
+#define CPPGL_THREAD_POOL_H
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <future>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+#include "platform.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// ThreadPool
+// work-stealing pool: every worker owns a task deque, it pops its own tasks LIFO and steals FIFO from the others
+// tasks submitted from outside the pool are distributed round-robin over the worker deques
+
+    class ThreadPool {
+    public:
+        // num_threads = 0: one worker per hardware thread
+        // max_queued > 0: submissions from non-worker threads block while that many tasks are waiting (back-pressure),
+        // submissions from inside a task never block, so nested parallelism cannot deadlock
+        explicit ThreadPool(uint32_t num_threads = 0, size_t max_queued = 0);
+
+        // runs all queued tasks and joins the workers
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        // queue a task without a result, exceptions escaping it are reported and dropped
+        void enqueue(std::function<void()> task);
+
+        // queue a task and get its result (or exception) through a future
+        // XXX: do not block on the future from inside a task, use a TaskGroup there
+        template<typename Func>
+        auto submit(Func &&func) -> std::future<std::invoke_result_t<std::decay_t<Func>>> {
+            using Result = std::invoke_result_t<std::decay_t<Func>>;
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+            std::future<Result> result = task->get_future();
+            enqueue([task]() { (*task)(); });
+            return result;
+        }
+
+        // run one queued task on the calling thread, returns false if there was none
+        bool try_run_one();
+
+        // finish all queued tasks and join the workers, later submissions run directly on the calling thread
+        void shutdown();
+
+        // number of worker threads, 0 after shutdown
+        uint32_t num_threads() const;
+
+        // tasks waiting to be picked up by a worker
+        size_t num_queued() const;
+
+        // true if the calling thread is one of this pool's workers
+        bool is_worker() const;
+
+        // pool shared by all cppgl subsystems (parallel_for, async image stores, batch mesh loading)
+        static ThreadPool &global();
+
+        // finish and join the global pool, called by Context::~Context
+        static void shutdown_global();
+
+    private:
+        struct WorkerQueue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        void worker_loop(uint32_t index);
+
+        bool pop_task(int self, std::function<void()> &task);
+
+        int worker_index() const;
+
+        // data
+        const size_t max_queued;
+        // fixed at construction, 'workers' itself is only touched by the thread running shutdown()
+        const uint32_t worker_count;
+        std::vector<std::unique_ptr<WorkerQueue>> queues;
+        std::vector<std::thread> workers;
+        mutable std::mutex mutex;
+        std::condition_variable work_available;
+        std::condition_variable not_full;
+        size_t queued;
+        bool stopped;
+        std::atomic<uint32_t> next_queue;
+    };
+
+// ------------------------------------------
+// TaskGroup
+// fork-join on top of a ThreadPool: wait() helps executing queued tasks until every task of the group finished
+// and rethrows the first exception thrown by one of them
+
+    class TaskGroup {
+    public:
+        explicit TaskGroup(ThreadPool &pool = ThreadPool::global());
+
+        // waits for outstanding tasks, exceptions are dropped
+        ~TaskGroup();
+
+        TaskGroup(const TaskGroup &) = delete;
+
+        TaskGroup &operator=(const TaskGroup &) = delete;
+
+        template<typename Func>
+        void run(Func &&func) {
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                unfinished++;
+            }
+            pool.enqueue([this, func = std::forward<Func>(func)]() mutable {
+                try {
+                    func();
+                } catch (...) {
+                    const std::lock_guard<std::mutex> lock(mutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+                finish();
+            });
+        }
+
+        void wait();
+
+    private:
+        void finish();
+
+        // data
+        ThreadPool &pool;
+        std::mutex mutex;
+        std::condition_variable done;
+        uint32_t unfinished;
+        std::exception_ptr error;
+    };
+
+CPPGL_NAMESPACE_END
+
+#endif
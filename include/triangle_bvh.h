@@ -0,0 +1,153 @@
+#pragma once
+#ifndef CPPGL_TRIANGLE_BVH_H
+#define CPPGL_TRIANGLE_BVH_H
+
+#include <limits>
+#include <vector>
+#include <cstdint>
+
+#include "camera.h"
+#include "platform.h"
+#include "geometry.h"
+#include "data_types.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Ray queries
+
+    struct Ray {
+        Ray(const vec3 &origin, const vec3 &dir, float t_min = 0.f,
+            float t_max = std::numeric_limits<float>::infinity())
+                : origin(origin), dir(dir), t_min(t_min), t_max(t_max) {}
+
+        inline vec3 at(float t) const { return origin + t * dir; }
+
+        // data
+        vec3 origin, dir;   // dir does not have to be normalized, t is measured in multiples of it
+        float t_min, t_max;
+    };
+
+    struct RayHit {
+        static constexpr uint32_t NO_HIT = ~0u;
+
+        explicit inline operator bool() const { return face != NO_HIT; }
+
+        // weights of the face's three vertices
+        inline vec3 barycentric() const { return vec3(1.f - u - v, u, v); }
+
+        // data
+        uint32_t face = NO_HIT;
+        float t = std::numeric_limits<float>::infinity();
+        float u = 0.f, v = 0.f;
+    };
+
+// ------------------------------------------
+// TriangleBVH
+// bounding volume hierarchy over the triangles of a geometry, built with a binned SAH on the global ThreadPool.
+// nodes are 32 bytes, leaves reference blocks of four triangles stored as separate coordinate arrays
+// (first vertex and two edges), so the ray-triangle tests of a block are fixed-width loops the compiler vectorizes.
+// after positions changed without changing the indices (laplacian_smoothing, GeometryBaseImpl::transform, ...)
+// refit() updates the blocks and bounds in place, build() is only needed for new topology or large deformations.
+// geometries without indices are treated as triangle soups.
+
+    class TriangleBVH {
+    public:
+        TriangleBVH();
+
+        explicit TriangleBVH(const GeometryBase &geometry);
+
+        TriangleBVH(const TriangleBVH &) = delete;
+
+        TriangleBVH &operator=(const TriangleBVH &) = delete;
+
+        void build(const GeometryBase &geometry);
+
+        void build();
+
+        // falls back to build() if the number of triangles changed
+        void refit();
+
+        void clear();
+
+        // closest hit in [ray.t_min, ray.t_max]
+        RayHit intersect(const Ray &ray) const;
+
+        // any hit in [ray.t_min, ray.t_max], for shadow and visibility rays
+        bool occluded(const Ray &ray) const;
+
+        // batched queries, run in parallel
+        void intersect(const std::vector<Ray> &rays, std::vector<RayHit> &hits) const;
+
+        void occluded(const std::vector<Ray> &rays, std::vector<uint8_t> &results) const;
+
+        // index of the k-th vertex of a face
+        uint32_t vertex_index(uint32_t face, uint32_t k) const;
+
+        inline uint32_t num_triangles() const { return num_faces; }
+
+        inline bool empty() const { return nodes.empty(); }
+
+        // memory held by nodes and triangle blocks in bytes
+        size_t memory_usage() const;
+
+        // levels below the root of the deepest leaf, at most 60
+        uint32_t depth() const;
+
+        // data
+        GeometryBase geometry;
+
+    private:
+        struct Node {
+            float bb_min[3];
+            uint32_t first;  // leaf: first block, inner: left child (the right one follows)
+            float bb_max[3];
+            uint32_t count;  // leaf: number of blocks, 0 for inner nodes
+        };
+
+        struct Block {
+            float v0[3][4];
+            float e1[3][4];
+            float e2[3][4];
+            uint32_t face[4];  // NO_HIT for padding lanes
+        };
+
+        struct BuildContext;
+
+        // depth of 'node' in the whole tree
+        void build_node(BuildContext &ctx, uint32_t node, uint32_t first, uint32_t count, uint32_t depth);
+
+        template<bool ANY_HIT>
+        bool traverse(const Ray &ray, RayHit &hit) const;
+
+        // data
+        std::vector<Node> nodes;
+        std::vector<Block> blocks;
+        uint32_t num_faces;
+    };
+
+// ------------------------------------------
+// Picking
+
+    // ray through 'pixel' (window coordinates, origin top left) of a window with size 'window_size'
+    Ray camera_ray(const vec2 &pixel, const vec2 &window_size, const Camera &cam = current_camera());
+
+    struct PickResult {
+        explicit inline operator bool() const { return bool(hit); }
+
+        // data
+        RayHit hit;
+        vec3 position = vec3::Zero();     // world space
+        uint32_t vertex = RayHit::NO_HIT; // vertex of the hit face closest to the hit position
+    };
+
+    // pick the geometry of 'bvh' placed with 'model' under the mouse cursor (Context::mouse_pos)
+    PickResult pick(const TriangleBVH &bvh, const mat4 &model = mat4::Identity(),
+                    const Camera &cam = current_camera());
+
+    // pick along an arbitrary world space ray
+    PickResult pick(const TriangleBVH &bvh, const Ray &ray, const mat4 &model = mat4::Identity());
+
+CPPGL_NAMESPACE_END
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef CPPGL_UTILS_PARALLEL_H
+#define CPPGL_UTILS_PARALLEL_H
+
+#include <thread>
+#include <cstdint>
+#include <algorithm>
+#include "platform.h"
+#include "thread_pool.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+    // number of threads the parallel cpu kernels distribute their work to
+    inline uint32_t parallel_num_threads() {
+        static const uint32_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+        return num_threads;
+    }
+
+    // split [begin, end) into contiguous ranges and call func(range_begin, range_end) once per range,
+    // the ranges run as a TaskGroup on the global ThreadPool with the calling thread taking the first one.
+    // ranges are never smaller than 'grain' elements, so small inputs simply run on the calling thread
+    template<typename Func>
+    void parallel_for(uint32_t begin, uint32_t end, Func &&func, uint32_t grain = 4096) {
+        if (end <= begin)
+            return;
+        const uint32_t n = end - begin;
+        const uint32_t num_chunks = std::min(parallel_num_threads(), std::max(1u, n / std::max(1u, grain)));
+        if (num_chunks <= 1) {
+            func(begin, end);
+            return;
+        }
+        const uint32_t chunk_size = (n + num_chunks - 1) / num_chunks;
+        TaskGroup group;
+        for (uint32_t c = 1; c < num_chunks; c++) {
+            const uint32_t chunk_begin = begin + c * chunk_size;
+            const uint32_t chunk_end = std::min(end, chunk_begin + chunk_size);
+            if (chunk_begin < chunk_end)
+                group.run([&func, chunk_begin, chunk_end]() { func(chunk_begin, chunk_end); });
+        }
+        func(begin, std::min(end, begin + chunk_size));
+        group.wait();
+    }
+
+CPPGL_NAMESPACE_END
+
+#endif
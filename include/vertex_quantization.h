@@ -0,0 +1,84 @@
+#pragma once
+#ifndef CPPGL_VERTEX_QUANTIZATION_H
+#define CPPGL_VERTEX_QUANTIZATION_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+#include "platform.h"
+#include "data_types.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+// ------------------------------------------
+// Vertex quantization
+// compact GPU encodings of float vertex attributes, selected per attribute with VertexLayout::encode.
+// the encoders run in parallel over plain loops the compiler vectorizes (F16C for half floats if available).
+// - UNORM16: 16 bit per component relative to a box, value = min + stored * extent. positions use the geometry's
+//   bounding box, shaders read them with cppgl_dequantize_position(in_pos) (see VertexLayout::GLSL_DECLARATION)
+// - HALF: 16 bit floats, readable as floats without shader changes
+// - OCT_SNORM16: normals mapped onto an octahedron, two 16 bit components, read as vec2 and decoded with
+//   cppgl_oct_decode(in_norm)
+// - SNORM_10_10_10_2: normals with 10 bit per component, read as vec3 without shader changes
+
+    enum class AttributeEncoding : uint8_t {
+        FLOAT,
+        UNORM16,
+        HALF,
+        OCT_SNORM16,
+        SNORM_10_10_10_2
+    };
+
+    std::string encoding_to_str(AttributeEncoding encoding);
+
+    // distance between original and decoded elements in the units of the attribute, degrees for normals
+    struct QuantizationError {
+        float max = 0.f;
+        float mean = 0.f;
+    };
+
+    // encoded copy of a float attribute, ready for upload
+    struct QuantizedAttribute {
+        AttributeEncoding encoding = AttributeEncoding::FLOAT;
+        GLenum type = GL_FLOAT;
+        uint32_t element_dim = 0;
+        bool normalized = false;
+        vec4 min = vec4::Zero(), extent = vec4::Ones();  // UNORM16 only
+        std::vector<uint8_t> data;
+        QuantizationError error;
+    };
+
+    // encode 'count' elements of 'dim' floats. UNORM16 uses the box [min, max] if given, the bounding box of the
+    // data otherwise, OCT_SNORM16 and SNORM_10_10_10_2 need dim 3. the error is measured with the matching decoder
+    QuantizedAttribute quantize_attribute(AttributeEncoding encoding, const float *data, uint32_t dim, uint32_t count,
+                                          const float *min = nullptr, const float *max = nullptr);
+
+    // encoders and decoders for single values, the bulk versions behind quantize_attribute use the same rounding
+    uint16_t float_to_half(float value);
+
+    float half_to_float(uint16_t value);
+
+    void encode_oct_snorm16(const float *normal, int16_t *encoded);
+
+    vec3 decode_oct_snorm16(const int16_t *encoded);
+
+    uint32_t encode_snorm_10_10_10_2(const float *normal);
+
+    vec3 decode_snorm_10_10_10_2(uint32_t encoded);
+
+    // bulk encoders of 'count' elements, encode_half counts single floats
+    void encode_unorm16(const float *src, uint32_t count, uint32_t dim, const float *min, const float *extent,
+                        uint16_t *dst);
+
+    void encode_half(const float *src, uint32_t count, uint16_t *dst);
+
+    void encode_oct_snorm16(const float *normals, uint32_t count, int16_t *dst);
+
+    void encode_snorm_10_10_10_2(const float *normals, uint32_t count, uint32_t *dst);
+
+CPPGL_NAMESPACE_END
+
+#endif
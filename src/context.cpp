@@ -1,4 +1,5 @@
 #include "context.h"
+#include <cstring>
 #include "debug.h"
 #include "camera.h"
 #include "shader.h"
@@ -7,13 +8,17 @@
 #include "material.h"
 #include "geometry.h"
 #include "drawelement.h"
+#include "mesh.h"
 #include "anim.h"
+#include "thread_pool.h"
 #include "query.h"
 #include "gui.h"
 #include "imgui/imgui.h"
 #include "imgui/imgui_impl_glfw.h"
 #include "imgui/imgui_impl_opengl3.h"
 #include "image_load_store.h"
+#include "readback.h"
+#include "frame_uniforms.h"
 #include <iostream>
 
 CPPGL_NAMESPACE_BEGIN
@@ -197,6 +202,11 @@ CPPGL_NAMESPACE_BEGIN
     }
 
     Context::~Context() {
+        // finish pending background work before the process tears down
+        GPUReadback::shutdown_global();
+        FrameUniforms::shutdown_global();
+        ImageWriter::shutdown_global();
+        ThreadPool::shutdown_global();
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
         ImGui::DestroyContext();
@@ -229,7 +239,14 @@ CPPGL_NAMESPACE_BEGIN
         instance().gpu_timer->end();
         instance().prim_count->end();
         instance().frag_count->end();
+        // all draws of this frame are issued, the next one writes its uniforms to a fresh region.
+        // apps that never bind a drawelement don't get the ring buffer allocated here
+        if (FrameUniforms *frame_uniforms = FrameUniforms::instance())
+            frame_uniforms->next_frame();
+        MeshUploadStats::global().next_frame();
         glfwSwapBuffers(instance().glfw_window);
+        // hand finished async readbacks (screenshots etc.) to their callbacks
+        GPUReadback::global().poll();
         instance().frame_timer->end();
         instance().frame_timer->begin();
         instance().cpu_timer->begin();
@@ -248,14 +265,17 @@ CPPGL_NAMESPACE_BEGIN
 
     void Context::screenshot(const std::filesystem::path &path) {
         const ivec2 size = resolution();
-        std::vector<uint8_t> pixels(size_t(size.x()) * size.y() * 3);
-        // glReadPixels can align the first pixel in each row at 1-, 2-, 4- and 8-byte boundaries. We
-        // have allocated the exact size needed for the image so we have to use 1-byte alignment
-        // (otherwise glReadPixels would write out of bounds)
-        glPixelStorei(GL_PACK_ALIGNMENT, 1);
-        glReadPixels(0, 0, size.x(), size.y(), GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
-        // write ldr image to disk (async)
-        image_store_ldr(path, pixels.data(), size.x(), size.y(), 3, true, true);
+        // read back through a pack buffer, the image is handed to the async writer once the GPU caught up
+        GPUReadback::global().read_framebuffer(0, 0, size.x(), size.y(), GL_RGB, GL_UNSIGNED_BYTE,
+                                               [path, size](const uint8_t *data, size_t size_bytes) {
+                                                   if (!data)
+                                                       return;
+                                                   std::vector<uint8_t> pixels = ImageWriter::global().acquire(
+                                                           size_bytes);
+                                                   std::memcpy(pixels.data(), data, size_bytes);
+                                                   ImageWriter::global().store_ldr(path, std::move(pixels), size.x(),
+                                                                                   size.y(), 3, true);
+                                               });
     }
 
     void Context::show() { glfwShowWindow(instance().glfw_window); }
@@ -0,0 +1,163 @@
+#include "draw_batch.h"
+#include <numeric>
+
+CPPGL_NAMESPACE_BEGIN
+
+    const char *const DrawBatch::GLSL_DECLARATION =
+            "struct CppglDraw {\n"
+            "    mat4 model;\n"
+            "    mat4 model_normal;\n"
+            "};\n"
+            "layout(std430) readonly buffer CppglDraws {\n"
+            "    CppglDraw cppgl_draws[];\n"
+            "};\n";
+
+    const char *const DrawBatch::GLSL_VERTEX_DECLARATION =
+            "layout(location = 15) in uint cppgl_draw_id;\n";
+
+    static_assert(sizeof(DrawBatch::Command) == 5 * sizeof(uint32_t), "DrawBatch::Command has to be tightly packed");
+
+    // copy 'size_bytes' from the start of 'src' to 'dst' at 'offset_bytes', all on the GPU
+    static void copy_buffer(GLuint src, GLuint dst, size_t offset_bytes, size_t size_bytes) {
+        glBindBuffer(GL_COPY_READ_BUFFER, src);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset_bytes, size_bytes);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    // first attribute stored in the same buffer as 'attribute'
+    static uint32_t buffer_owner(const MeshImpl &mesh, uint32_t attribute) {
+        uint32_t owner = 0;
+        while (mesh.vbos[owner].ptr != mesh.vbos[attribute].ptr)
+            owner++;
+        return owner;
+    }
+
+    DrawBatch::DrawBatch(const std::string &name, const std::vector<const MeshImpl *> &meshes,
+                         const std::vector<uint32_t> &draw_ids)
+            : name(name), vao(0), primitive_type(GL_TRIANGLES), num_draws(uint32_t(meshes.size())),
+              commands_dirty(false) {
+        if (meshes.empty() || meshes.size() != draw_ids.size())
+            throw std::runtime_error("DrawBatch " + name + ": need one draw id per mesh");
+        const MeshImpl &first = *meshes[0];
+        primitive_type = first.primitive_type;
+        material = first.material;
+
+        // offsets of every mesh in the shared buffers
+        std::vector<Command> &cmds = cpu_commands;
+        cmds.resize(meshes.size());
+        size_t num_vertices = 0, num_indices = 0;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            if (!compatible(first, *meshes[i]))
+                throw std::runtime_error("DrawBatch " + name + ": " + meshes[i]->name + " has a different layout");
+            const uint32_t count = meshes[i]->ibo ? meshes[i]->num_indices : meshes[i]->num_vertices;
+            cmds[i] = Command{count, 1, uint32_t(num_indices), int32_t(num_vertices), uint32_t(i)};
+            num_vertices += meshes[i]->num_vertices;
+            num_indices += count;
+        }
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        // one buffer per vertex buffer of the layout, interleaved attributes are copied with their buffer
+        std::vector<uint32_t> attribute_buffer(first.vbos.size());
+        for (size_t a = 0; a < first.vbos.size(); a++) {
+            const uint32_t owner = buffer_owner(first, uint32_t(a));
+            if (owner == a) {
+                const size_t vertex_bytes = first.vbo_strides[a];
+                attribute_buffer[a] = uint32_t(vbos.size());
+                vbos.emplace_back(name + "_vertex_buffer_" + std::to_string(a), vertex_bytes * num_vertices);
+                for (size_t i = 0; i < meshes.size(); i++)
+                    copy_buffer(meshes[i]->vbos[a]->id, vbos.back()->id, vertex_bytes * cmds[i].base_vertex,
+                                vertex_bytes * meshes[i]->num_vertices);
+            } else
+                attribute_buffer[a] = attribute_buffer[owner];
+            vbos[attribute_buffer[a]]->bind();
+            glEnableVertexAttribArray(GLuint(a));
+            vertex_attrib_pointer(GLuint(a), first.vbo_dims[a], first.vbo_types[a], GLsizei(first.vbo_strides[a]),
+                                  first.vbo_offsets[a], first.vbo_normalized[a]);
+        }
+
+        // transforms index per command, advanced once per instance and offset by the base instance
+        draw_id_buffer = VBO(name + "_draw_ids");
+        draw_id_buffer->upload_data(draw_ids.data(), sizeof(uint32_t) * draw_ids.size(), GL_STATIC_DRAW);
+        draw_id_buffer->bind();
+        glEnableVertexAttribArray(DRAW_ID_LOCATION);
+        glVertexAttribIPointer(DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, 0, 0);
+        glVertexAttribDivisor(DRAW_ID_LOCATION, 1);
+        draw_id_buffer->unbind();
+
+        // meshes without index buffer draw their vertices in order, 16 bit indices are widened
+        ibo = IBO(name + "_index_buffer", sizeof(uint32_t) * num_indices);
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const size_t offset_bytes = sizeof(uint32_t) * cmds[i].first_index;
+            if (meshes[i]->ibo && meshes[i]->index_type == GL_UNSIGNED_INT)
+                copy_buffer(meshes[i]->ibo->id, ibo->id, offset_bytes, sizeof(uint32_t) * cmds[i].count);
+            else if (meshes[i]->ibo) {
+                const uint16_t *short_indices = (const uint16_t *) meshes[i]->map_ibo(GL_READ_ONLY);
+                const std::vector<uint32_t> indices(short_indices, short_indices + cmds[i].count);
+                meshes[i]->unmap_ibo();
+                ibo->upload_subdata(indices.data(), offset_bytes, sizeof(uint32_t) * indices.size());
+            } else {
+                std::vector<uint32_t> indices(cmds[i].count);
+                std::iota(indices.begin(), indices.end(), 0u);
+                ibo->upload_subdata(indices.data(), offset_bytes, sizeof(uint32_t) * indices.size());
+            }
+        }
+        ibo->bind();
+        glBindVertexArray(0);
+        ibo->unbind();
+
+        commands = DIBO(name + "_commands");
+        commands->upload_data(cmds.data(), sizeof(Command) * cmds.size(), GL_STATIC_DRAW);
+    }
+
+    DrawBatch::~DrawBatch() {
+        for (auto &vbo: vbos)
+            vbo.free(true);
+        draw_id_buffer.free(true);
+        ibo.free(true);
+        commands.free(true);
+        glDeleteVertexArrays(1, &vao);
+    }
+
+    void DrawBatch::set_visible(uint32_t command, bool visible) {
+        const uint32_t instance_count = visible ? 1 : 0;
+        if (cpu_commands[command].instance_count != instance_count) {
+            cpu_commands[command].instance_count = instance_count;
+            commands_dirty = true;
+        }
+    }
+
+    void DrawBatch::draw() {
+        if (commands_dirty) {
+            commands->upload_subdata(cpu_commands.data(), 0, sizeof(Command) * cpu_commands.size());
+            commands_dirty = false;
+        }
+        glBindVertexArray(vao);
+        commands->bind();
+        glMultiDrawElementsIndirect(primitive_type, GL_UNSIGNED_INT, nullptr, GLsizei(num_draws), 0);
+        commands->unbind();
+        glBindVertexArray(0);
+    }
+
+    bool DrawBatch::packable(const MeshImpl &mesh) {
+        // UNORM16 ranges are per-mesh uniforms, a batch has only one set
+        for (const auto &[id, q]: mesh.quantization)
+            if (q.encoding == AttributeEncoding::UNORM16)
+                return false;
+        return mesh.vao != 0 && mesh.num_vertices > 0 && !mesh.vbos.empty() && mesh.vbos.size() <= DRAW_ID_LOCATION;
+    }
+
+    bool DrawBatch::compatible(const MeshImpl &a, const MeshImpl &b) {
+        if (a.primitive_type != b.primitive_type || a.vbo_types != b.vbo_types || a.vbo_dims != b.vbo_dims ||
+            a.vbo_strides != b.vbo_strides || a.vbo_offsets != b.vbo_offsets ||
+            a.vbo_normalized != b.vbo_normalized || a.material.ptr != b.material.ptr)
+            return false;
+        for (uint32_t attribute = 0; attribute < a.vbos.size(); attribute++)
+            if (buffer_owner(a, attribute) != buffer_owner(b, attribute))
+                return false;
+        return true;
+    }
+
+CPPGL_NAMESPACE_END
@@ -1,11 +1,29 @@
 #include "drawelement.h"
 #include "camera.h"
+#include "frame_uniforms.h"
+#include "scene_bvh.h"
+#include <cstring>
 #include <iostream>
 #include "math/eigen_glm_interface.h"
 #include "mesh_templates.h"
 
 CPPGL_NAMESPACE_BEGIN
 
+    // camera and model transforms for the bound shader
+    static void upload_transforms_to(const Shader &shader, const mat4 &model, const mat4 &model_normal) {
+        const Camera cam = current_camera();
+        FrameUniforms &frame_uniforms = FrameUniforms::global();
+        frame_uniforms.update(cam);
+        if (shader->object_block)
+            frame_uniforms.bind_object(model, model_normal);
+        // shaders declaring the classic uniforms; uploads of unchanged or inactive uniforms are skipped
+        shader->uniform(ShaderImpl::MODEL, model);
+        shader->uniform(ShaderImpl::MODEL_NORMAL, model_normal);
+        shader->uniform(ShaderImpl::VIEW, cam->view);
+        shader->uniform(ShaderImpl::VIEW_NORMAL, cam->view_normal);
+        shader->uniform(ShaderImpl::PROJ, cam->proj);
+    }
+
 // -------------------------------------------------------
 // DrawelementImpl
 // -------------------------------------------------------
@@ -16,11 +34,15 @@ CPPGL_NAMESPACE_BEGIN
                                      const mat4 &model)
             : name(name),
               model(model),
+              normal_model(model),
+              normal_matrix(transpose(inverse(model))),
               shader(shader),
               mesh(mesh),
               wireframe_mode(false),
               disable_render(false),
-              is_grouped(false) {}
+              is_grouped(false),
+              scene_bvh(nullptr),
+              scene_bvh_index(0) {}
 
     DrawelementImpl::~DrawelementImpl() {}
 
@@ -37,14 +59,29 @@ CPPGL_NAMESPACE_BEGIN
 
     void DrawelementImpl::set_model_transform(const mat4 &trans) {
         model = trans;
+        if (scene_bvh)
+            scene_bvh->mark_dirty(scene_bvh_index);
     }
 
     void DrawelementImpl::set_model_translation(const vec3 &trans) {
         model.block<3, 1>(0, 3) = trans;
+        if (scene_bvh)
+            scene_bvh->mark_dirty(scene_bvh_index);
     }
 
     void DrawelementImpl::set_model_rotation(const mat3 &rot) {
         model.block<3, 3>(0, 0) = rot;
+        if (scene_bvh)
+            scene_bvh->mark_dirty(scene_bvh_index);
+    }
+
+    const mat4 &DrawelementImpl::model_normal() const {
+        // model is public and may be assigned directly, comparing is still much cheaper than inverting
+        if (normal_model != model) {
+            normal_model = model;
+            normal_matrix = transpose(inverse(model));
+        }
+        return normal_matrix;
     }
 
     void DrawelementImpl::bind() const {
@@ -55,14 +92,15 @@ CPPGL_NAMESPACE_BEGIN
             shader->bind();
             if (mesh)
                 mesh->bind(shader);
-            shader->uniform("model", model);
-            shader->uniform("model_normal", (mat4) transpose(inverse(model)));
-            shader->uniform("view", current_camera()->view);
-            shader->uniform("view_normal", current_camera()->view_normal);
-            shader->uniform("proj", current_camera()->proj);
+            upload_transforms();
         }
     }
 
+    void DrawelementImpl::upload_transforms() const {
+        if (shader)
+            upload_transforms_to(shader, model, model_normal());
+    }
+
     void DrawelementImpl::unbind() const {
         if (disable_render)
             return;
@@ -158,26 +196,127 @@ CPPGL_NAMESPACE_BEGIN
     GroupedDrawelementsImpl::GroupedDrawelementsImpl(
             const std::string &name,
             const std::vector<Drawelement> &elems)
-            : name(name), elems(elems), wireframe_mode(false), disable_render(false) {
+            : name(name), elems(elems), wireframe_mode(false), disable_render(false), batching(false),
+              batches_valid(false) {
         for (unsigned int i = 0; i < elems.size(); i++) {
             this->elems[i]->is_grouped = true;
         }
     }
 
-    GroupedDrawelementsImpl::~GroupedDrawelementsImpl() {}
+    GroupedDrawelementsImpl::~GroupedDrawelementsImpl() {
+        invalidate_batches();
+    }
 
     void GroupedDrawelementsImpl::add_drawelement(Drawelement &d) {
         elems.push_back(d);
         d->is_grouped = true;
+        invalidate_batches();
     }
 
     void GroupedDrawelementsImpl::destroy_handles() {
+        invalidate_batches();
         for (unsigned int i = 0; i < elems.size(); i++) {
             elems[i]->is_grouped = false;
             elems[i]->destroy_handles();
         }
     }
 
+    void GroupedDrawelementsImpl::set_batching(bool mode) {
+        batching = mode;
+        if (!batching)
+            invalidate_batches();
+    }
+
+    void GroupedDrawelementsImpl::invalidate_batches() {
+        batches.clear();
+        element_batch.clear();
+        if (draw_transforms_buffer)
+            draw_transforms_buffer.free(true);
+        draw_transforms_buffer = SSBO();
+        batches_valid = false;
+    }
+
+    void GroupedDrawelementsImpl::build_batches() const {
+        batches.clear();
+        element_batch.assign(elems.size(), std::make_pair(-1, 0u));
+        std::vector<std::vector<const MeshImpl *>> meshes;
+        std::vector<std::vector<uint32_t>> draw_ids;
+        for (uint32_t i = 0; i < elems.size(); i++) {
+            const DrawelementImpl &elem = *elems[i];
+            if (!elem.shader || !elem.shader->draws_block || !elem.mesh || !DrawBatch::packable(*elem.mesh) ||
+                !elem.pre_draw_funcs.empty() || !elem.post_draw_funcs.empty())
+                continue;
+            // first batch with the same shader and a compatible layout, linear search is fine for a few batches
+            uint32_t b = 0;
+            while (b < batches.size() && (batches[b].shader.ptr != elem.shader.ptr ||
+                                          !DrawBatch::compatible(*meshes[b][0], *elem.mesh)))
+                b++;
+            if (b == batches.size()) {
+                batches.push_back(Batch{elem.shader, nullptr});
+                meshes.emplace_back();
+                draw_ids.emplace_back();
+            }
+            element_batch[i] = std::make_pair(int32_t(b), uint32_t(meshes[b].size()));
+            meshes[b].push_back(&*elem.mesh);
+            draw_ids[b].push_back(i);
+        }
+        for (uint32_t b = 0; b < batches.size(); b++)
+            batches[b].batch = std::make_unique<DrawBatch>(name + "_batch_" + std::to_string(b), meshes[b],
+                                                           draw_ids[b]);
+        draw_transforms.resize(elems.size());
+        draw_transforms_buffer = SSBO(name + "_draw_transforms", sizeof(FrameUniforms::Object) * elems.size());
+        batches_valid = true;
+    }
+
+    void GroupedDrawelementsImpl::draw_batched() const {
+        if (!batches_valid)
+            build_batches();
+        // transforms of all elements, drawn one by one or batched; orphaning avoids waiting for the last frame
+        for (uint32_t i = 0; i < elems.size(); i++) {
+            draw_transforms[i].model = elems[i]->model;
+            draw_transforms[i].model_normal = elems[i]->model_normal();
+        }
+        draw_transforms_buffer->upload_data(draw_transforms.data(),
+                                            sizeof(FrameUniforms::Object) * draw_transforms.size());
+        draw_transforms_buffer->bind_base(DrawBatch::DRAWS_BINDING);
+
+        // elements hidden or switched to wireframe since the batches were built stay in place with zero instances
+        std::vector<uint32_t> single;
+        for (uint32_t i = 0; i < elems.size(); i++) {
+            const auto [b, command] = element_batch[i];
+            if (b >= 0)
+                batches[b].batch->set_visible(command, !elems[i]->disable_render && !elems[i]->wireframe_mode);
+            if (b < 0 || (elems[i]->wireframe_mode && !elems[i]->disable_render))
+                single.push_back(i);
+        }
+
+        const Camera cam = current_camera();
+        FrameUniforms::global().update(cam);
+        for (const Batch &batch: batches) {
+            const Shader &shader = batch.shader;
+            shader->bind();
+            shader->uniform(ShaderImpl::VIEW, cam->view);
+            shader->uniform(ShaderImpl::VIEW_NORMAL, cam->view_normal);
+            shader->uniform(ShaderImpl::PROJ, cam->proj);
+            if (batch.batch->material)
+                batch.batch->material->bind(shader);
+            batch.batch->draw();
+            if (batch.batch->material)
+                batch.batch->material->unbind();
+            shader->unbind();
+        }
+
+        for (uint32_t i: single) {
+            const Drawelement &elem = elems[i];
+            elem->bind();
+            // drawn from the element's own VAO, where cppgl_draw_id is a constant attribute
+            if (elem->shader && elem->shader->draws_block)
+                glVertexAttribI1ui(DrawBatch::DRAW_ID_LOCATION, i);
+            elem->draw();
+            elem->unbind();
+        }
+    }
+
     void GroupedDrawelementsImpl::set_model_transform(const mat4 &trans) {
         for (unsigned int i = 0; i < elems.size(); i++) {
             elems[i]->set_model_transform(trans);
@@ -215,6 +354,10 @@ CPPGL_NAMESPACE_BEGIN
     void GroupedDrawelementsImpl::bind_draw_unbind() const {
         if (disable_render)
             return;
+        if (batching) {
+            draw_batched();
+            return;
+        }
         for (unsigned int i = 0; i < elems.size(); i++) {
             elems[i]->bind();
             elems[i]->draw();
@@ -241,4 +384,254 @@ CPPGL_NAMESPACE_BEGIN
         }
     }
 
+// -------------------------------------------------------
+// InstancedDrawelementImpl
+// -------------------------------------------------------
+
+    const char *const InstancedDrawelementImpl::GLSL_VERTEX_DECLARATION =
+            "layout(location = 8) in mat4 cppgl_instance_model;\n"
+            "layout(location = 12) in vec4 cppgl_instance_color;\n";
+
+    static const uint32_t NO_SLOT = ~0u;
+
+    static uint32_t instance_stride_floats(const std::vector<uint32_t> &user_attribute_dims) {
+        if (user_attribute_dims.size() > InstancedDrawelementImpl::MAX_USER_ATTRIBUTES)
+            throw std::runtime_error("InstancedDrawelement: at most " +
+                                     std::to_string(InstancedDrawelementImpl::MAX_USER_ATTRIBUTES) +
+                                     " user attributes are supported");
+        uint32_t stride = 16 + 4;
+        for (uint32_t dim: user_attribute_dims) {
+            if (dim < 1 || dim > 4)
+                throw std::runtime_error("InstancedDrawelement: user attributes have 1 to 4 components");
+            stride += dim;
+        }
+        return stride;
+    }
+
+    InstancedDrawelementImpl::InstancedDrawelementImpl(const std::string &name, const Shader &shader,
+                                                       const Mesh &mesh,
+                                                       const std::vector<uint32_t> &user_attribute_dims)
+            : name(name),
+              model(mat4::Identity()),
+              shader(shader),
+              mesh(mesh),
+              disable_render(false),
+              user_attribute_dims(user_attribute_dims),
+              stride_floats(instance_stride_floats(user_attribute_dims)),
+              vao(0),
+              vao_generation(0),
+              capacity(0),
+              dirty_begin(0),
+              dirty_end(0) {}
+
+    InstancedDrawelementImpl::~InstancedDrawelementImpl() {
+        if (vao)
+            glDeleteVertexArrays(1, &vao);
+        if (instance_buffer)
+            instance_buffer.free(true);
+    }
+
+    void InstancedDrawelementImpl::destroy_handles() {
+        if (this->mesh.initialized()) {
+            this->mesh->destroy_handles();
+            if (Mesh::valid(mesh->name)) {
+                auto elem = Mesh::find(mesh->name);
+                this->mesh = Mesh();
+                elem.free();
+            }
+        }
+    }
+
+    void InstancedDrawelementImpl::set_disable_render(bool mode) {
+        disable_render = mode;
+    }
+
+    float *InstancedDrawelementImpl::record(uint32_t id) {
+        if (id >= id_to_slot.size() || id_to_slot[id] == NO_SLOT)
+            throw std::runtime_error("InstancedDrawelement " + name + ": invalid instance id " + std::to_string(id));
+        return records.data() + size_t(id_to_slot[id]) * stride_floats;
+    }
+
+    void InstancedDrawelementImpl::mark_dirty(uint32_t slot) {
+        if (dirty_begin >= dirty_end) {
+            dirty_begin = slot;
+            dirty_end = slot + 1;
+        } else {
+            dirty_begin = std::min(dirty_begin, slot);
+            dirty_end = std::max(dirty_end, slot + 1);
+        }
+    }
+
+    uint32_t InstancedDrawelementImpl::add_instance(const mat4 &transform, const vec4 &color) {
+        uint32_t id;
+        if (!free_ids.empty()) {
+            id = free_ids.back();
+            free_ids.pop_back();
+        } else {
+            id = uint32_t(id_to_slot.size());
+            id_to_slot.push_back(NO_SLOT);
+        }
+        const uint32_t slot = uint32_t(slot_to_id.size());
+        id_to_slot[id] = slot;
+        slot_to_id.push_back(id);
+        records.resize(records.size() + stride_floats, 0.f);
+        float *data = record(id);
+        std::memcpy(data, transform.data(), sizeof(float) * 16);
+        std::memcpy(data + 16, color.data(), sizeof(float) * 4);
+        mark_dirty(slot);
+        return id;
+    }
+
+    void InstancedDrawelementImpl::remove_instance(uint32_t id) {
+        float *data = record(id);
+        const uint32_t slot = id_to_slot[id], last = uint32_t(slot_to_id.size()) - 1;
+        if (slot != last) {
+            std::memcpy(data, records.data() + size_t(last) * stride_floats, sizeof(float) * stride_floats);
+            slot_to_id[slot] = slot_to_id[last];
+            id_to_slot[slot_to_id[slot]] = slot;
+            mark_dirty(slot);
+        }
+        slot_to_id.pop_back();
+        records.resize(records.size() - stride_floats);
+        id_to_slot[id] = NO_SLOT;
+        free_ids.push_back(id);
+    }
+
+    void InstancedDrawelementImpl::clear_instances() {
+        records.clear();
+        slot_to_id.clear();
+        id_to_slot.clear();
+        free_ids.clear();
+        dirty_begin = dirty_end = 0;
+    }
+
+    void InstancedDrawelementImpl::set_instance_transform(uint32_t id, const mat4 &transform) {
+        std::memcpy(record(id), transform.data(), sizeof(float) * 16);
+        mark_dirty(id_to_slot[id]);
+    }
+
+    void InstancedDrawelementImpl::set_instance_color(uint32_t id, const vec4 &color) {
+        std::memcpy(record(id) + 16, color.data(), sizeof(float) * 4);
+        mark_dirty(id_to_slot[id]);
+    }
+
+    void InstancedDrawelementImpl::set_instance_attribute(uint32_t id, uint32_t attribute, const float *data) {
+        if (attribute >= user_attribute_dims.size())
+            throw std::runtime_error("InstancedDrawelement " + name + ": invalid user attribute");
+        uint32_t offset = 16 + 4;
+        for (uint32_t a = 0; a < attribute; a++)
+            offset += user_attribute_dims[a];
+        std::memcpy(record(id) + offset, data, sizeof(float) * user_attribute_dims[attribute]);
+        mark_dirty(id_to_slot[id]);
+    }
+
+    mat4 InstancedDrawelementImpl::instance_transform(uint32_t id) const {
+        if (id >= id_to_slot.size() || id_to_slot[id] == NO_SLOT)
+            throw std::runtime_error("InstancedDrawelement " + name + ": invalid instance id " + std::to_string(id));
+        // records are not necessarily aligned for mat4
+        return Eigen::Map<const mat4>(records.data() + size_t(id_to_slot[id]) * stride_floats);
+    }
+
+    void InstancedDrawelementImpl::setup_vao() const {
+        // locations from MODEL_LOCATION on hold the instance attributes
+        if (mesh->vbos.size() > MODEL_LOCATION)
+            throw std::runtime_error("InstancedDrawelement " + name + ": mesh " + mesh->name + " has " +
+                                     std::to_string(mesh->vbos.size()) + " attributes, at most " +
+                                     std::to_string(MODEL_LOCATION) + " are supported");
+        if (vao)
+            glDeleteVertexArrays(1, &vao);
+        vao_generation = mesh->buffer_generation;
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        // the mesh's attributes, its own VAO stays untouched for regular drawelements sharing the mesh
+        for (uint32_t a = 0; a < mesh->vbos.size(); a++) {
+            mesh->vbos[a]->bind();
+            glEnableVertexAttribArray(a);
+            vertex_attrib_pointer(a, mesh->vbo_dims[a], mesh->vbo_types[a], GLsizei(mesh->vbo_strides[a]),
+                                  mesh->vbo_offsets[a], mesh->vbo_normalized[a]);
+        }
+        if (mesh->ibo)
+            mesh->ibo->bind();
+        // the instance buffer survives rebuilds, only the mesh's buffers change
+        if (!instance_buffer)
+            instance_buffer = VBO(name + "_instances");
+        instance_buffer->bind();
+        const GLsizei stride = GLsizei(sizeof(float) * stride_floats);
+        for (uint32_t c = 0; c < 4; c++) {
+            glEnableVertexAttribArray(MODEL_LOCATION + c);
+            vertex_attrib_pointer(MODEL_LOCATION + c, 4, GL_FLOAT, stride, sizeof(float) * 4 * c);
+            glVertexAttribDivisor(MODEL_LOCATION + c, 1);
+        }
+        glEnableVertexAttribArray(COLOR_LOCATION);
+        vertex_attrib_pointer(COLOR_LOCATION, 4, GL_FLOAT, stride, sizeof(float) * 16);
+        glVertexAttribDivisor(COLOR_LOCATION, 1);
+        uint32_t offset = 16 + 4;
+        for (uint32_t a = 0; a < user_attribute_dims.size(); a++) {
+            glEnableVertexAttribArray(USER_LOCATION + a);
+            vertex_attrib_pointer(USER_LOCATION + a, user_attribute_dims[a], GL_FLOAT, stride, sizeof(float) * offset);
+            glVertexAttribDivisor(USER_LOCATION + a, 1);
+            offset += user_attribute_dims[a];
+        }
+        glBindVertexArray(0);
+        instance_buffer->unbind();
+        if (mesh->ibo)
+            mesh->ibo->unbind();
+    }
+
+    void InstancedDrawelementImpl::upload() const {
+        const uint32_t count = num_instances();
+        const size_t record_bytes = sizeof(float) * stride_floats;
+        if (count > capacity) {
+            // reallocation keeps the buffer object, so the attribute pointers of the VAO stay valid
+            capacity = std::max(64u, std::max(count, 2 * capacity));
+            instance_buffer->upload_data(nullptr, record_bytes * capacity);
+            dirty_begin = 0;
+            dirty_end = count;
+        }
+        dirty_end = std::min(dirty_end, count);
+        if (dirty_begin < dirty_end)
+            instance_buffer->upload_subdata(records.data() + size_t(dirty_begin) * stride_floats,
+                                            record_bytes * dirty_begin, record_bytes * (dirty_end - dirty_begin));
+        dirty_begin = dirty_end = 0;
+    }
+
+    size_t InstancedDrawelementImpl::instance_memory() const {
+        return instance_buffer ? instance_buffer->size_bytes : 0;
+    }
+
+    void InstancedDrawelementImpl::bind() const {
+        if (disable_render || !shader)
+            return;
+        shader->bind();
+        if (mesh && mesh->material)
+            mesh->material->bind(shader);
+        if (mesh)
+            mesh->bind_quantization(*shader);
+        upload_transforms_to(shader, model, transpose(inverse(model)));
+    }
+
+    void InstancedDrawelementImpl::draw() const {
+        if (disable_render || !mesh || slot_to_id.empty())
+            return;
+        if (!vao || vao_generation != mesh->buffer_generation)
+            setup_vao();
+        upload();
+        glBindVertexArray(vao);
+        if (mesh->ibo)
+            glDrawElementsInstanced(mesh->primitive_type, mesh->num_indices, mesh->index_type, 0,
+                                    GLsizei(num_instances()));
+        else
+            glDrawArraysInstanced(mesh->primitive_type, 0, mesh->num_vertices, GLsizei(num_instances()));
+        glBindVertexArray(0);
+    }
+
+    void InstancedDrawelementImpl::unbind() const {
+        if (disable_render)
+            return;
+        if (mesh && mesh->material)
+            mesh->material->unbind();
+        if (shader)
+            shader->unbind();
+    }
+
 CPPGL_NAMESPACE_END
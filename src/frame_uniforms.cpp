@@ -0,0 +1,120 @@
+#include "frame_uniforms.h"
+#include "context.h"
+#include <atomic>
+#include <iostream>
+
+CPPGL_NAMESPACE_BEGIN
+
+    static_assert(sizeof(FrameUniforms::Frame) == 5 * 64 + 4 * 16, "FrameUniforms::Frame does not match std140");
+    static_assert(sizeof(FrameUniforms::Object) == 2 * 64, "FrameUniforms::Object does not match std140");
+
+    const char *const FrameUniforms::GLSL_DECLARATION =
+            "layout(std140) uniform CppglFrame {\n"
+            "    mat4 view;\n"
+            "    mat4 view_normal;\n"
+            "    mat4 proj;\n"
+            "    mat4 view_proj;\n"
+            "    mat4 inv_view;\n"
+            "    vec4 camera_pos;\n"
+            "    vec4 camera_dir;\n"
+            "    vec4 near_far_res;\n"
+            "    vec4 time;\n"
+            "} cppgl_frame;\n";
+
+    const char *const FrameUniforms::GLSL_OBJECT_DECLARATION =
+            "layout(std140) uniform CppglObject {\n"
+            "    mat4 model;\n"
+            "    mat4 model_normal;\n"
+            "} cppgl_object;\n";
+
+    static std::atomic<uint32_t> frame_uniforms_counter(0);
+
+    FrameUniforms::FrameUniforms(uint32_t object_capacity) : id(frame_uniforms_counter++), frame_valid(false),
+                                                             frame_counter(0), frame_written(0),
+                                                             warned_exhausted(false) {
+        const std::string prefix = "frame_uniforms_" + std::to_string(id);
+        if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+            // per-draw ranges are aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT (up to 256 bytes)
+            GLint alignment = 256;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            const size_t stride = (sizeof(Object) + alignment - 1) / alignment * alignment;
+            stream = StreamUBO(prefix + "_stream", (size_t(object_capacity) + 8) * stride);
+        }
+        frame_ubo = UBO(prefix + "_frame", sizeof(Frame));
+        object_ubo = UBO(prefix + "_object", sizeof(Object));
+    }
+
+    FrameUniforms::~FrameUniforms() {
+        if (stream)
+            stream.free(true);
+        frame_ubo.free(true);
+        object_ubo.free(true);
+    }
+
+    void FrameUniforms::write(uint32_t binding, const void *data, size_t size_bytes, UBO &fallback) {
+        if (stream) {
+            const auto allocation = stream->upload(data, size_bytes);
+            if (allocation) {
+                stream->bind_range(binding, allocation);
+                return;
+            }
+            if (!warned_exhausted) {
+                std::cerr << "WARN: FrameUniforms: per-frame ring buffer exhausted, falling back to buffer updates"
+                          << std::endl;
+                warned_exhausted = true;
+            }
+        }
+        // the driver has to synchronize with draws still reading the buffer, slow but correct
+        fallback->upload_subdata(data, 0, size_bytes);
+        fallback->bind_base(binding);
+    }
+
+    void FrameUniforms::update(const Camera &cam) {
+        // the comparison is far cheaper than the upload, and catches cameras switched or moved mid-frame
+        if (frame_valid && frame_written == frame_counter && frame.view == cam->view && frame.proj == cam->proj)
+            return;
+        const ivec2 res = Context::resolution();
+        frame.view = cam->view;
+        frame.view_normal = cam->view_normal;
+        frame.proj = cam->proj;
+        frame.view_proj = cam->proj * cam->view;
+        frame.inv_view = cam->view.inverse();
+        frame.camera_pos = vec4(cam->pos.x(), cam->pos.y(), cam->pos.z(), 1.f);
+        frame.camera_dir = vec4(cam->dir.x(), cam->dir.y(), cam->dir.z(), 0.f);
+        frame.near_far_res = vec4(cam->near, cam->far, float(res.x()), float(res.y()));
+        frame.time = vec4(float(Context::instance().curr_t), float(Context::frame_time()), float(frame_counter), 0.f);
+        write(FRAME_BINDING, &frame, sizeof(Frame), frame_ubo);
+        frame_valid = true;
+        frame_written = frame_counter;
+    }
+
+    void FrameUniforms::bind_object(const mat4 &model, const mat4 &model_normal) {
+        Object object;
+        object.model = model;
+        object.model_normal = model_normal;
+        write(OBJECT_BINDING, &object, sizeof(Object), object_ubo);
+    }
+
+    void FrameUniforms::next_frame() {
+        if (stream)
+            stream->next_frame();
+        frame_counter++;
+    }
+
+    static std::unique_ptr<FrameUniforms> global_frame_uniforms;
+
+    FrameUniforms &FrameUniforms::global() {
+        if (!global_frame_uniforms)
+            global_frame_uniforms = std::make_unique<FrameUniforms>();
+        return *global_frame_uniforms;
+    }
+
+    FrameUniforms *FrameUniforms::instance() {
+        return global_frame_uniforms.get();
+    }
+
+    void FrameUniforms::shutdown_global() {
+        global_frame_uniforms.reset();
+    }
+
+CPPGL_NAMESPACE_END
@@ -2,44 +2,37 @@
 #include "mesh.h"
 #include <iostream>
 #include "cassert.h"
+#include "utils/parallel.h"
+#include <mutex>
 
 
 CPPGL_NAMESPACE_BEGIN
 
+    // average the face normals around every vertex, face_normal(f) returns the normal of face f
+    template<typename FaceNormal>
+    static std::vector<vec3> face2vertex_normals_csr(FaceNormal face_normal,
+                                                     const uint32_t position_size,
+                                                     const uint32_t *indices,
+                                                     const uint32_t indices_size) {
+        std::vector<uint32_t> offsets, faces;
+        MeshAdjacency::build_vertex_faces(position_size, indices, indices_size, offsets, faces);
+
+        std::vector<vec3> vertex_normals(position_size);
+        parallel_for(0, position_size, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t v = begin; v < end; v++) {
+                vec3 n(0, 0, 0);
+                for (uint32_t k = offsets[v]; k < offsets[v + 1]; k++)
+                    n += face_normal(faces[k]);
+                vertex_normals[v] = n.normalized();
+            }
+        });
+        return vertex_normals;
+    }
+
     std::vector<vec3> face2vertex_normals(const std::vector<vec3> &face_normals,
                                           const uint32_t position_size,
                                           const std::vector<uint32_t> &indices) {
-        _CPPGL_ASSERT_GE(indices.size(), position_size);
-        _CPPGL_ASSERT_EQ(face_normals.size(), indices.size() / 3);
-
-        std::vector<std::vector<uint32_t>> vertex_appearance(position_size);
-        std::vector<vec3> vertex_normals;
-
-        // std::cout << "Face normals" << std::endl;
-        // for (unsigned int i = 0; i < face_normals.size(); i++) {
-        //   std::cout << "[" << i << "," << i + 3 << "]: " << face_normals[i]
-        //             << std::endl;
-        // }
-
-        // this assumes that the same vertex is referenced within multiple faces
-        // it does not work in cases in which the same vertex is in the vertex buffer
-        // multiple times
-        for (unsigned int i = 0; i < indices.size(); i++) {
-            vertex_appearance[indices[i]].push_back(i / 3);
-
-            // std::cout << "vertex_appearance " << indices[i] << ": " << i / 3
-            //           << " normal: " << face_normals[i / 3] << std::endl;
-        }
-        for (unsigned int i = 0; i < vertex_appearance.size(); i++) {
-            vec3 n(0, 0, 0);
-            unsigned int c = 0;
-            for (unsigned int j = 0; j < vertex_appearance[i].size(); j++) {
-                n += face_normals[vertex_appearance[i][j]];
-                c++;
-            }
-            vertex_normals.push_back((n / c).normalized());
-        }
-        return vertex_normals;
+        return face2vertex_normals(face_normals, position_size, indices.data(), indices.size());
     }
 
     std::vector<vec3> face2vertex_normals(const float *face_normals,
@@ -50,25 +43,9 @@ CPPGL_NAMESPACE_BEGIN
         _CPPGL_ASSERT_GE(indices_size, position_size);
         _CPPGL_ASSERT_EQ(normal_size, indices_size / 3);
 
-        std::vector<std::vector<uint32_t>> vertex_appearance(position_size);
-        std::vector<vec3> vertex_normals;
-
-        for (unsigned int i = 0; i < indices_size; i++) {
-            vertex_appearance[indices[i]].push_back(i / 3);
-        }
-
-        for (unsigned int i = 0; i < vertex_appearance.size(); i++) {
-            vec3 n(0, 0, 0);
-            unsigned int c = 0;
-            for (unsigned int j = 0; j < vertex_appearance[i].size(); j++) {
-                n += vec3(face_normals[vertex_appearance[i][j] * 3 + 0],
-                          face_normals[vertex_appearance[i][j] * 3 + 1],
-                          face_normals[vertex_appearance[i][j] * 3 + 2]);
-                c++;
-            }
-            vertex_normals.push_back((n / c).normalized());
-        }
-        return vertex_normals;
+        return face2vertex_normals_csr(
+                [face_normals](uint32_t f) { return Eigen::Map<const vec3>(&face_normals[f * 3]); },
+                position_size, indices, indices_size);
     }
 
     std::vector<vec3> face2vertex_normals(const std::vector<vec3> &face_normals,
@@ -78,79 +55,193 @@ CPPGL_NAMESPACE_BEGIN
         _CPPGL_ASSERT_GE(indices_size, position_size);
         _CPPGL_ASSERT_EQ(face_normals.size(), indices_size / 3);
 
-        std::vector<std::vector<uint32_t>> vertex_appearance(position_size);
-        std::vector<vec3> vertex_normals;
-
-        for (unsigned int i = 0; i < indices_size; i++) {
-            vertex_appearance[indices[i]].push_back(i / 3);
-        }
-        for (unsigned int i = 0; i < vertex_appearance.size(); i++) {
-            vec3 n(0, 0, 0);
-            unsigned int c = 0;
-            for (unsigned int j = 0; j < vertex_appearance[i].size(); j++) {
-                n += face_normals[vertex_appearance[i][j]];
-                c++;
-            }
-            vertex_normals.push_back((n / c).normalized());
-        }
-        return vertex_normals;
+        return face2vertex_normals_csr(
+                [&face_normals](uint32_t f) -> const vec3 & { return face_normals[f]; },
+                position_size, indices, indices_size);
     }
 
     std::vector<vec3> generate_face_normals(const std::vector<vec3> &positions,
                                             const std::vector<uint32_t> &indices) {
-        std::vector<vec3> face_normals;
-
-        for (unsigned int i = 0; i < indices.size(); i = i + 3) {
-            vec3 e1 = positions[indices[i + 1]] - positions[indices[i + 0]];
-            vec3 e2 = positions[indices[i + 2]] - positions[indices[i + 1]];
-            vec3 n = (e1.cross(e2)).normalized();
-            face_normals.push_back(n);
-        }
-
-        return face_normals;
+        return generate_face_normals(positions.empty() ? nullptr : positions[0].data(), indices.data(),
+                                     indices.size());
     }
 
     std::vector<vec3> generate_face_normals(const float *positions,
                                             const uint32_t *indices,
                                             const uint32_t indices_size) {
-        std::vector<vec3> face_normals;
-
-        for (unsigned int i = 0; i < indices_size; i = i + 3) {
-            vec3 p0(positions[indices[i + 0] * 3 + 0],
-                    positions[indices[i + 0] * 3 + 1],
-                    positions[indices[i + 0] * 3 + 2]);
-
-            vec3 p1(positions[indices[i + 1] * 3 + 0],
-                    positions[indices[i + 1] * 3 + 1],
-                    positions[indices[i + 1] * 3 + 2]);
-
-            vec3 p2(positions[indices[i + 2] * 3 + 0],
-                    positions[indices[i + 2] * 3 + 1],
-                    positions[indices[i + 2] * 3 + 2]);
-
-            vec3 e1 = p1 - p0;
-            vec3 e2 = p2 - p1;
-            vec3 n = (e1.cross(e2)).normalized();
-            face_normals.push_back(n);
-        }
+        std::vector<vec3> face_normals(indices_size / 3);
+
+        parallel_for(0, indices_size / 3, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t f = begin; f < end; f++) {
+                const Eigen::Map<const vec3> p0(&positions[indices[f * 3 + 0] * 3]);
+                const Eigen::Map<const vec3> p1(&positions[indices[f * 3 + 1] * 3]);
+                const Eigen::Map<const vec3> p2(&positions[indices[f * 3 + 2] * 3]);
+                face_normals[f] = ((p1 - p0).cross(p2 - p1)).normalized();
+            }
+        });
 
         return face_normals;
     }
 
+    void compute_vertex_normals(const float *positions,
+                                const uint32_t position_size,
+                                const uint32_t *indices,
+                                const uint32_t indices_size,
+                                float *normals,
+                                NormalWeighting weighting,
+                                const MeshAdjacency *adjacency) {
+        const uint32_t num_faces = indices_size / 3;
+
+        std::vector<uint32_t> local_offsets, local_faces;
+        if (!adjacency)
+            MeshAdjacency::build_vertex_faces(position_size, indices, indices_size, local_offsets, local_faces);
+        const std::vector<uint32_t> &offsets = adjacency ? adjacency->vertex_face_offsets : local_offsets;
+        const std::vector<uint32_t> &faces = adjacency ? adjacency->vertex_faces : local_faces;
+        _CPPGL_ASSERT_EQ(offsets.size(), size_t(position_size) + 1);
+
+        // unit face normals, or area weighted: |e1 x e2| is twice the triangle area
+        std::vector<vec3> face_normals(num_faces);
+        parallel_for(0, num_faces, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t f = begin; f < end; f++) {
+                const Eigen::Map<const vec3> p0(&positions[indices[f * 3 + 0] * 3]);
+                const Eigen::Map<const vec3> p1(&positions[indices[f * 3 + 1] * 3]);
+                const Eigen::Map<const vec3> p2(&positions[indices[f * 3 + 2] * 3]);
+                const vec3 n = (p1 - p0).cross(p2 - p1);
+                face_normals[f] = weighting == NormalWeighting::AREA ? n : n.normalized();
+            }
+        });
+
+        // gather per vertex, no two threads write the same normal
+        parallel_for(0, position_size, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t v = begin; v < end; v++) {
+                vec3 n(0, 0, 0);
+                for (uint32_t k = offsets[v]; k < offsets[v + 1]; k++) {
+                    const uint32_t f = faces[k];
+                    if (weighting == NormalWeighting::ANGLE) {
+                        const uint32_t corner = indices[f * 3] == v ? 0 : (indices[f * 3 + 1] == v ? 1 : 2);
+                        const Eigen::Map<const vec3> p(&positions[v * 3]);
+                        const vec3 e1 = Eigen::Map<const vec3>(&positions[indices[f * 3 + (corner + 1) % 3] * 3]) - p;
+                        const vec3 e2 = Eigen::Map<const vec3>(&positions[indices[f * 3 + (corner + 2) % 3] * 3]) - p;
+                        const float cos_angle = e1.normalized().dot(e2.normalized());
+                        n += std::acos(std::max(-1.f, std::min(1.f, cos_angle))) * face_normals[f];
+                    } else {
+                        n += face_normals[f];
+                    }
+                }
+                Eigen::Map<vec3> normal(&normals[v * 3]);
+                normal = n.normalized();
+            }
+        });
+    }
+
     std::vector<vec3> generate_vertex_normals(
-            const std::vector<vec3> &positions, const std::vector<uint32_t> &indices) {
-        std::vector<vec3> face_normals = generate_face_normals(positions, indices);
-        return face2vertex_normals(face_normals, positions.size(), indices);
+            const std::vector<vec3> &positions, const std::vector<uint32_t> &indices,
+            NormalWeighting weighting) {
+        return generate_vertex_normals(positions.empty() ? nullptr : positions[0].data(), positions.size(),
+                                       indices.data(), indices.size(), weighting);
     }
 
     std::vector<vec3> generate_vertex_normals(const float *positions,
                                               const uint32_t position_size,
                                               const uint32_t *indices,
-                                              const uint32_t indices_size) {
-        std::vector<vec3> face_normals =
-                generate_face_normals(positions, indices, indices_size);
-        return face2vertex_normals(face_normals, position_size, indices,
-                                   indices_size);
+                                              const uint32_t indices_size,
+                                              NormalWeighting weighting) {
+        std::vector<vec3> vertex_normals(position_size);
+        if (position_size > 0)
+            compute_vertex_normals(positions, position_size, indices, indices_size, vertex_normals[0].data(),
+                                   weighting);
+        return vertex_normals;
+    }
+
+    // merge the bounding box of one parallel range into the result
+    static void merge_aabb(std::mutex &mutex, const vec3 &local_min, const vec3 &local_max,
+                           vec3 &bb_min, vec3 &bb_max) {
+        std::lock_guard<std::mutex> lock(mutex);
+        bb_min = bb_min.cwiseMin(local_min);
+        bb_max = bb_max.cwiseMax(local_max);
+    }
+
+    // bounding box of n xyz positions, parallel min/max reduction
+    static void compute_aabb(const float *positions, uint32_t n, vec3 &bb_min, vec3 &bb_max) {
+        bb_min = vec3::Constant(std::numeric_limits<float>::max());
+        bb_max = vec3::Constant(std::numeric_limits<float>::lowest());
+        std::mutex mutex;
+        parallel_for(0, n, [&](uint32_t begin, uint32_t end) {
+            float min_x = bb_min.x(), min_y = bb_min.y(), min_z = bb_min.z();
+            float max_x = bb_max.x(), max_y = bb_max.y(), max_z = bb_max.z();
+            for (uint32_t i = begin; i < end; i++) {
+                min_x = std::min(min_x, positions[i * 3 + 0]);
+                min_y = std::min(min_y, positions[i * 3 + 1]);
+                min_z = std::min(min_z, positions[i * 3 + 2]);
+                max_x = std::max(max_x, positions[i * 3 + 0]);
+                max_y = std::max(max_y, positions[i * 3 + 1]);
+                max_z = std::max(max_z, positions[i * 3 + 2]);
+            }
+            merge_aabb(mutex, vec3(min_x, min_y, min_z), vec3(max_x, max_y, max_z), bb_min, bb_max);
+        }, 16384);
+    }
+
+    // p = linear * p + offset for n xyz positions in one parallel pass that also yields the new bounding box
+    // normals are transformed by the inverse transpose of 'linear' and renormalized, which is skipped
+    // for uniform scales since they do not change normal directions
+    static void affine_transform(float *positions, uint32_t n, float *normals, uint32_t normals_n,
+                                 const mat3 &linear, const vec3 &offset, vec3 &bb_min, vec3 &bb_max) {
+        bb_min = vec3::Constant(std::numeric_limits<float>::max());
+        bb_max = vec3::Constant(std::numeric_limits<float>::lowest());
+        std::mutex mutex;
+        const float a00 = linear(0, 0), a01 = linear(0, 1), a02 = linear(0, 2);
+        const float a10 = linear(1, 0), a11 = linear(1, 1), a12 = linear(1, 2);
+        const float a20 = linear(2, 0), a21 = linear(2, 1), a22 = linear(2, 2);
+        const float tx = offset.x(), ty = offset.y(), tz = offset.z();
+        parallel_for(0, n, [&](uint32_t begin, uint32_t end) {
+            float min_x = bb_min.x(), min_y = bb_min.y(), min_z = bb_min.z();
+            float max_x = bb_max.x(), max_y = bb_max.y(), max_z = bb_max.z();
+            for (uint32_t i = begin; i < end; i++) {
+                const float x = positions[i * 3 + 0], y = positions[i * 3 + 1], z = positions[i * 3 + 2];
+                const float rx = a00 * x + a01 * y + a02 * z + tx;
+                const float ry = a10 * x + a11 * y + a12 * z + ty;
+                const float rz = a20 * x + a21 * y + a22 * z + tz;
+                positions[i * 3 + 0] = rx;
+                positions[i * 3 + 1] = ry;
+                positions[i * 3 + 2] = rz;
+                min_x = std::min(min_x, rx);
+                min_y = std::min(min_y, ry);
+                min_z = std::min(min_z, rz);
+                max_x = std::max(max_x, rx);
+                max_y = std::max(max_y, ry);
+                max_z = std::max(max_z, rz);
+            }
+            merge_aabb(mutex, vec3(min_x, min_y, min_z), vec3(max_x, max_y, max_z), bb_min, bb_max);
+        }, 16384);
+
+        const bool uniform_scale = linear.isDiagonal() && linear(0, 0) > 0.f &&
+                                   linear(0, 0) == linear(1, 1) && linear(0, 0) == linear(2, 2);
+        if (!normals || normals_n == 0 || uniform_scale)
+            return;
+        const mat3 normal_matrix = linear.inverse().transpose();
+        // scalar copies of the matrix, so the compiler does not reload it after every store through 'normals'
+        const float n00 = normal_matrix(0, 0), n01 = normal_matrix(0, 1), n02 = normal_matrix(0, 2);
+        const float n10 = normal_matrix(1, 0), n11 = normal_matrix(1, 1), n12 = normal_matrix(1, 2);
+        const float n20 = normal_matrix(2, 0), n21 = normal_matrix(2, 1), n22 = normal_matrix(2, 2);
+        parallel_for(0, normals_n, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                const float x = normals[i * 3 + 0], y = normals[i * 3 + 1], z = normals[i * 3 + 2];
+                const float rx = n00 * x + n01 * y + n02 * z;
+                const float ry = n10 * x + n11 * y + n12 * z;
+                const float rz = n20 * x + n21 * y + n22 * z;
+                const float length = std::sqrt(rx * rx + ry * ry + rz * rz);
+                const float inv_length = length > 0.f ? 1.f / length : 0.f;
+                normals[i * 3 + 0] = rx * inv_length;
+                normals[i * 3 + 1] = ry * inv_length;
+                normals[i * 3 + 2] = rz * inv_length;
+            }
+        }, 16384);
+    }
+
+    // scale factor of fit_into_aabb, the geometry keeps its aspect ratio
+    static float fit_scale(const vec3 &bb_min, const vec3 &bb_max, const vec3 &aabb_min, const vec3 &aabb_max) {
+        const vec3 scale_v = (aabb_max - aabb_min).cwiseQuotient(bb_max - bb_min);
+        return std::min(scale_v.x(), std::min(scale_v.y(), scale_v.z()));
     }
 
 // -------------------------------------------------------------------
@@ -209,6 +300,26 @@ CPPGL_NAMESPACE_BEGIN
         return 0;
     };
 
+    AttributeView<vec3> GeometryBaseImpl::positions_view() {
+        const size_t size = positions_size();
+        return size > 0 ? AttributeView<vec3>(reinterpret_cast<vec3 *>(positions_ptr()), size) : AttributeView<vec3>();
+    }
+
+    AttributeView<vec3> GeometryBaseImpl::normals_view() {
+        const size_t size = normals_size();
+        return size > 0 ? AttributeView<vec3>(reinterpret_cast<vec3 *>(normals_ptr()), size) : AttributeView<vec3>();
+    }
+
+    AttributeView<vec2> GeometryBaseImpl::texcoords_view() {
+        const size_t size = texcoords_size();
+        return size > 0 ? AttributeView<vec2>(reinterpret_cast<vec2 *>(texcoords_ptr()), size) : AttributeView<vec2>();
+    }
+
+    AttributeView<uint32_t> GeometryBaseImpl::indices_view() {
+        const size_t size = indices_size();
+        return size > 0 ? AttributeView<uint32_t>(indices_ptr(), size) : AttributeView<uint32_t>();
+    }
+
     vec3 GeometryBaseImpl::get_position(unsigned int index) const {
         assert(false);
         return vec3(0, 0, 0);
@@ -265,14 +376,77 @@ CPPGL_NAMESPACE_BEGIN
     };
 
     void GeometryBaseImpl::auto_generate_normals(
-            const mat4 &initial_transform) {
+            const mat4 &initial_transform, NormalWeighting weighting) {
         assert(false);
     }
 
-    void GeometryBaseImpl::convert_normals_perface2vertex() {
+    void GeometryBaseImpl::convert_normals_perface2vertex(NormalWeighting weighting) {
         assert(false);
     }
 
+    const MeshAdjacency &GeometryBaseImpl::adjacency() {
+        const uint32_t num_vertices = positions_size();
+        const uint32_t num_indices = indices_size();
+        if (!adjacency_ || adjacency_->num_vertices != num_vertices || adjacency_->num_faces != num_indices / 3)
+            adjacency_ = std::make_shared<MeshAdjacency>(num_vertices, indices_ptr(), num_indices);
+        return *adjacency_;
+    }
+
+    void GeometryBaseImpl::invalidate_adjacency() {
+        adjacency_.reset();
+    }
+
+    size_t GeometryBaseImpl::adjacency_memory_usage() const {
+        return adjacency_ ? adjacency_->memory_usage() : 0;
+    }
+
+    void GeometryBaseImpl::mark_dirty(const std::string &attribute, uint32_t begin, uint32_t end) {
+        if (attribute == "position")
+            dirty_positions.add(begin, end);
+        else if (attribute == "normal")
+            dirty_normals.add(begin, end);
+        else if (attribute == "texcoord")
+            dirty_texcoords.add(begin, end);
+        else if (attribute == "index")
+            dirty_indices.add(begin, end);
+        else
+            dirty_attributes[attribute].add(begin, end);
+    }
+
+    void GeometryBaseImpl::mark_dirty(const std::string &attribute) {
+        mark_dirty(attribute, 0, std::numeric_limits<uint32_t>::max());
+    }
+
+    void GeometryBaseImpl::mark_dirty() {
+        all_dirty = true;
+    }
+
+    DirtyRange GeometryBaseImpl::dirty_range(const std::string &attribute) const {
+        if (all_dirty)
+            return DirtyRange{0, std::numeric_limits<uint32_t>::max()};
+        if (attribute == "position")
+            return dirty_positions;
+        if (attribute == "normal")
+            return dirty_normals;
+        if (attribute == "texcoord")
+            return dirty_texcoords;
+        if (attribute == "index")
+            return dirty_indices;
+        const auto it = dirty_attributes.find(attribute);
+        return it != dirty_attributes.end() ? it->second : DirtyRange();
+    }
+
+    bool GeometryBaseImpl::has_dirty_marks() const {
+        return all_dirty || layout_dirty || !dirty_positions.empty() || !dirty_normals.empty() ||
+               !dirty_texcoords.empty() || !dirty_indices.empty() || !dirty_attributes.empty();
+    }
+
+    void GeometryBaseImpl::clear_dirty() {
+        dirty_positions = dirty_normals = dirty_texcoords = dirty_indices = DirtyRange();
+        dirty_attributes.clear();
+        all_dirty = layout_dirty = false;
+    }
+
     void GeometryBaseImpl::register_mesh(
             const NamedHandle<MeshImpl> &mesh) {
         used_by.emplace(mesh->name, mesh);
@@ -290,10 +464,13 @@ CPPGL_NAMESPACE_BEGIN
         }
     }
 
-    void GeometryBaseImpl::update_meshes() {
+    size_t GeometryBaseImpl::update_meshes() {
+        size_t bytes = 0;
         for (auto iter = used_by.begin(); iter != used_by.end(); iter++) {
-            iter->second->upload_gpu();
+            bytes += iter->second->update_gpu();
         }
+        clear_dirty();
+        return bytes;
     }
 
     void GeometryBaseImpl::clear() { _CPPGL_ASSERT(false); }
@@ -346,6 +523,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute;
         }
         vec3_map[name] = ptr;
+        mark_layout_dirty();
     }
 
     void GeometryBaseImpl::add_attribute_vec3(
@@ -366,6 +544,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute.data();
         }
         vec3_map[name] = ptr;
+        mark_layout_dirty();
     }
 
     void GeometryBaseImpl::add_attribute_vec4(
@@ -389,6 +568,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute;
         }
         vec4_map[name] = ptr;
+        mark_layout_dirty();
     }
 
     void GeometryBaseImpl::add_attribute_vec4(
@@ -409,6 +589,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute.data();
         }
         vec4_map[name] = ptr;
+        mark_layout_dirty();
     }
 
     void GeometryBaseImpl::add_attribute_vec2(
@@ -432,6 +613,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute;
         }
         vec2_map[name] = ptr;
+        mark_layout_dirty();
     }
 
     void GeometryBaseImpl::add_attribute_vec2(
@@ -452,6 +634,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute.data();
         }
         vec2_map[name] = ptr;
+        mark_layout_dirty();
     }
 
     void GeometryBaseImpl::add_attribute_float(
@@ -476,6 +659,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute;
         }
         float_map[name] = ptr;
+        mark_layout_dirty();
     }
 
     void GeometryBaseImpl::add_attribute_float(
@@ -497,6 +681,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute.data();
         }
         float_map[name] = ptr;
+        mark_layout_dirty();
     }
 
     void GeometryBaseImpl::add_attribute_uint(
@@ -521,6 +706,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute;
         }
         uint_map[name] = ptr;
+        mark_layout_dirty();
     }
 
     void GeometryBaseImpl::add_attribute_uint(
@@ -542,6 +728,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute.data();
         }
         uint_map[name] = ptr;
+        mark_layout_dirty();
     }
 
     void GeometryBaseImpl::add_attribute_int(
@@ -566,6 +753,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute;
         }
         int_map[name] = ptr;
+        mark_layout_dirty();
     }
 
     void GeometryBaseImpl::add_attribute_int(
@@ -587,6 +775,7 @@ CPPGL_NAMESPACE_BEGIN
             ptr.ptr = attribute.data();
         }
         int_map[name] = ptr;
+        mark_layout_dirty();
     }
 
 // -------------------------------------------------------------------
@@ -665,6 +854,8 @@ CPPGL_NAMESPACE_BEGIN
     GeometryImpl::~GeometryImpl() {}
 
     void GeometryImpl::add(const aiMesh *mesh_ai) {
+        invalidate_adjacency();
+        mark_layout_dirty();
         // conversion helper
         const auto to_eigen = [](const aiVector3D &v) { return vec3(v.x, v.y, v.z); };
         // extract vertices, normals and texture coords
@@ -721,6 +912,8 @@ CPPGL_NAMESPACE_BEGIN
         _CPPGL_ASSERT(normals.size() == 0 || positions.size() == normals.size());
         _CPPGL_ASSERT(texcoords.size() == 0 || positions.size() == texcoords.size());
         _CPPGL_ASSERT(indices.size() == 0 || indices.size() >= positions.size());
+        invalidate_adjacency();
+        mark_layout_dirty();
 
         // add vertices, normals and texture coords
         this->positions.reserve(this->positions.size() + positions.size());
@@ -763,6 +956,8 @@ CPPGL_NAMESPACE_BEGIN
         _CPPGL_ASSERT(texcoords.size() == 0 ||
                       positions.size() / 3 == texcoords.size() / 2);
         _CPPGL_ASSERT(indices.size() == 0 || indices.size() >= positions.size() / 3);
+        invalidate_adjacency();
+        mark_layout_dirty();
 
         // add vertices, normals and texture coords
         this->positions.reserve(this->positions.size() + (positions.size() / 3));
@@ -874,6 +1069,8 @@ CPPGL_NAMESPACE_BEGIN
         _CPPGL_ASSERT(normals_size_ == 0 || pos_size == normals_size_);
         _CPPGL_ASSERT(texcoords_size_ == 0 || pos_size == texcoords_size_);
         _CPPGL_ASSERT(indices_size == 0 || indices_size >= pos_size);
+        invalidate_adjacency();
+        mark_layout_dirty();
 
         // add vertices, normals and texture coords
         this->positions.reserve(this->positions.size() + (pos_size));
@@ -921,43 +1118,42 @@ CPPGL_NAMESPACE_BEGIN
         }
     }
 
+    // rotate freshly generated normals by the upper 3x3 of 'initial_transform'
+    static void transform_normals(float *normals, uint32_t normals_size, const mat4 &initial_transform) {
+        if (initial_transform.block<3, 3>(0, 0).isIdentity())
+            return;
+        const mat3 rot = initial_transform.block<3, 3>(0, 0);
+        parallel_for(0, normals_size, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                Eigen::Map<vec3> n(&normals[i * 3]);
+                n = (rot * n).normalized();
+            }
+        });
+    }
+
     void GeometryImpl::auto_generate_normals(
-            const mat4 &initial_transform) {
+            const mat4 &initial_transform, NormalWeighting weighting) {
         _CPPGL_ASSERT_EQ(normals.size(), 0);
         auto_normals_ = true;
+        if (positions.empty())
+            return;
 
-        std::vector<vec3> vertex_normals =
-                generate_vertex_normals(positions, indices);
-        for (unsigned int i = 0; i < vertex_normals.size(); i++) {
-            vertex_normals[i] =
-                    (initial_transform.block<3, 3>(0, 0) * vertex_normals[i]).normalized();
-        }
-
-        this->normals.insert(this->normals.end(), vertex_normals.begin(),
-                             vertex_normals.end());
+        normals.resize(positions.size());
+        mark_layout_dirty();
+        compute_vertex_normals(positions[0].data(), positions.size(), indices.data(), indices.size(),
+                               normals[0].data(), weighting, &adjacency());
+        transform_normals(normals[0].data(), normals.size(), initial_transform);
     }
 
-    void GeometryImpl::convert_normals_perface2vertex() {
+    void GeometryImpl::convert_normals_perface2vertex(NormalWeighting weighting) {
         _CPPGL_ASSERT_EQ(normals.size(), positions.size());
         this->normals.clear();
-        auto_generate_normals();
-        // auto_normals_ = true;
-
-        // std::vector<vec3> updated_normals;
-        // for (unsigned int i = 0; i < normals.size(); i = i + 3) {
-        //   // updated_normals.push_back(normals[indices[i]]);
-        //   updated_normals.push_back(normals[indices[i]]);
-        // }
-
-        // std::vector<vec3> vertex_normals =
-        //     face2vertex_normals(updated_normals, positions.size(), indices);
-
-        // this->normals.clear();
-        // this->normals.insert(this->normals.end(), vertex_normals.begin(),
-        //                      vertex_normals.end());
+        auto_generate_normals(mat4::Identity(), weighting);
     }
 
     void GeometryImpl::clear() {
+        invalidate_adjacency();
+        mark_layout_dirty();
         bb_min =
                 vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
                      std::numeric_limits<float>::max());
@@ -979,73 +1175,37 @@ CPPGL_NAMESPACE_BEGIN
     }
 
     void GeometryImpl::recompute_aabb() {
-        bb_min =
-                vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
-                     std::numeric_limits<float>::max());
-        bb_max =
-                vec3(std::numeric_limits<float>::min(), std::numeric_limits<float>::min(),
-                     std::numeric_limits<float>::min());
-
-        for (const auto &pos: positions) {
-            bb_min = min(bb_min, pos);
-            bb_max = max(bb_max, pos);
-        }
+        compute_aabb(positions.empty() ? nullptr : positions[0].data(), positions.size(), bb_min, bb_max);
     }
 
     void GeometryImpl::fit_into_aabb(const vec3 &aabb_min,
                                      const vec3 &aabb_max) {
-        // compute offset to origin and scale factor
+        // offset to origin and scale factor, applied in one pass
         const vec3 center = (bb_min + bb_max) * .5f;
-        const vec3 scale_v = (aabb_max - aabb_min) / (bb_max - bb_min);
-        const float scale_f =
-                std::min(scale_v.x(), std::min(scale_v.y(), scale_v.z()));
-        // apply
-        for (uint32_t i = 0; i < positions.size(); ++i)
-            positions[i] = (positions[i] - center) * scale_f;
+        const float scale_f = fit_scale(bb_min, bb_max, aabb_min, aabb_max);
+        transform(cppgl::scale(mat4::Identity(), vec3::Constant(scale_f)) *
+                  cppgl::translate(mat4::Identity(), -center));
     }
 
     void GeometryImpl::translate(const vec3 &by) {
-        for (uint32_t i = 0; i < positions.size(); ++i)
-            positions[i] += by;
+        transform(cppgl::translate(mat4::Identity(), by));
     }
 
     void GeometryImpl::scale(const vec3 &by) {
-        const mat4 s = cppgl::scale(mat4::Identity(), by);
-        const mat4 s_inv = cppgl::inverse(s);
-        const mat4 mat_norm = cppgl::transpose(s_inv);
-
-        // scale positions
-        for (uint32_t i = 0; i < positions.size(); ++i)
-            positions[i] = positions[i].cwiseProduct(by);
-        // scale normals
-        for (uint32_t i = 0; i < normals.size(); ++i)
-            normals[i] = cppgl::normalize(
-                    cppgl::make_vec3(mat_norm * cppgl::make_vec4(normals[i], 0)));
+        transform(cppgl::scale(mat4::Identity(), by));
     }
 
     void GeometryImpl::rotate(float angle_degrees,
                               const vec3 &axis) {
-        const mat4 rot = cppgl::rotate(cppgl::radians(angle_degrees), axis);
-        const mat4 rot_inv_tra = cppgl::transpose(cppgl::inverse(rot));
-
-        // rotate positions
-        for (uint32_t i = 0; i < positions.size(); ++i)
-            positions[i] = cppgl::make_vec3(rot * cppgl::make_vec4(positions[i], 1));
-        // rotate normals
-        for (uint32_t i = 0; i < normals.size(); ++i)
-            normals[i] = cppgl::normalize(
-                    cppgl::make_vec3(rot_inv_tra * cppgl::make_vec4(normals[i], 0)));
+        transform(cppgl::rotate(cppgl::radians(angle_degrees), axis));
     }
 
     void GeometryImpl::transform(const mat4 &trans) {
-        mat3 rot_inv_tra = trans.block<3, 3>(0, 0).inverse().transpose();
-        // rotate positions
-        for (uint32_t i = 0; i < positions.size(); ++i)
-            positions[i] =
-                    cppgl::make_vec3(trans * cppgl::make_vec4(positions[i], 1));
-        // rotate normals
-        for (uint32_t i = 0; i < normals.size(); ++i)
-            normals[i] = (rot_inv_tra * normals[i]).normalized();
+        affine_transform(positions.empty() ? nullptr : positions[0].data(), positions.size(),
+                         normals.empty() ? nullptr : normals[0].data(), normals.size(),
+                         trans.block<3, 3>(0, 0), trans.block<3, 1>(0, 3), bb_min, bb_max);
+        mark_dirty("position");
+        mark_dirty("normal");
     }
 
 // -------------------------------------------------------------------
@@ -1122,53 +1282,33 @@ CPPGL_NAMESPACE_BEGIN
     }
 
     void GeometryWrapperImpl::auto_generate_normals(
-            const mat4 &initial_transform) {
+            const mat4 &initial_transform, NormalWeighting weighting) {
         _CPPGL_ASSERT_EQ(normals.size(), 0);
         auto_normals_ = true;
+        if (positions_size_ == 0)
+            return;
 
-        this->normals.reserve(this->normals.size() + this->positions_size_);
-
-        std::vector<vec3> vertex_normals = generate_vertex_normals(
-                positions_ptr_, positions_size_, indices_ptr_, indices_size_);
-        for (unsigned int i = 0; i < vertex_normals.size(); i++) {
-            vertex_normals[i] =
-                    (initial_transform.block<3, 3>(0, 0) * vertex_normals[i]).normalized();
-        }
-
-        this->normals.insert(this->normals.end(), vertex_normals.begin(),
-                             vertex_normals.end());
+        this->normals.resize(this->positions_size_);
+        mark_layout_dirty();
+        compute_vertex_normals(positions_ptr_, positions_size_, indices_ptr_, indices_size_,
+                               this->normals[0].data(), weighting, &adjacency());
+        transform_normals(this->normals[0].data(), this->normals.size(), initial_transform);
 
         this->normals_ptr_ = this->normals[0].data();
         this->normals_size_ = this->normals.size();
     }
 
-    void GeometryWrapperImpl::convert_normals_perface2vertex() {
+    void GeometryWrapperImpl::convert_normals_perface2vertex(NormalWeighting weighting) {
         _CPPGL_ASSERT_EQ(normals_size_, positions_size_);
         this->normals_ptr_ = nullptr;
         this->normals.clear();
         this->normals_size_ = 0;
-        auto_generate_normals();
-        // auto_normals_ = true;
-
-        // std::vector<vec3> updated_normals;
-        // for (unsigned int i = 0; i < normals.size(); i = i + 3) {
-        //   updated_normals.push_back(get_normal(get_index(i)));
-        // }
-
-        // std::vector<vec3> vertex_normals =
-        //     face2vertex_normals(updated_normals[0].data(), updated_normals.size(),
-        //                         positions_size_, indices_ptr_, indices_size_);
-
-        // this->normals.clear();
-        // this->normals.reserve(this->normals.size() + this->positions_size_);
-        // this->normals.insert(this->normals.end(), vertex_normals.begin(),
-        //                      vertex_normals.end());
-
-        // this->normals_ptr_ = this->normals[0].data();
-        // this->normals_size_ = this->normals.size();
+        auto_generate_normals(mat4::Identity(), weighting);
     }
 
     void GeometryWrapperImpl::clear() {
+        invalidate_adjacency();
+        mark_layout_dirty();
         bb_min.x() = std::numeric_limits<float>::max();
         bb_min.y() = std::numeric_limits<float>::max();
         bb_min.z() = std::numeric_limits<float>::max();
@@ -1196,115 +1336,35 @@ CPPGL_NAMESPACE_BEGIN
     }
 
     void GeometryWrapperImpl::recompute_aabb() {
-        bb_min =
-                vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
-                     std::numeric_limits<float>::max());
-        bb_max =
-                vec3(std::numeric_limits<float>::min(), std::numeric_limits<float>::min(),
-                     std::numeric_limits<float>::min());
-
-        for (unsigned int i = 0; i < positions_size_; i++) {
-            bb_min =
-                    min(bb_min, vec3(positions_ptr_[i * 3 + 0], positions_ptr_[i * 3 + 1],
-                                     positions_ptr_[i * 3 + 2]));
-            bb_max =
-                    max(bb_max, vec3(positions_ptr_[i * 3 + 0], positions_ptr_[i * 3 + 1],
-                                     positions_ptr_[i * 3 + 2]));
-        }
+        compute_aabb(positions_ptr_, positions_size_, bb_min, bb_max);
     }
 
     void GeometryWrapperImpl::fit_into_aabb(const vec3 &aabb_min,
                                             const vec3 &aabb_max) {
-        // compute offset to origin and scale factor
+        // offset to origin and scale factor, applied in one pass
         const vec3 center = (bb_min + bb_max) * .5f;
-        const vec3 scale_v = (aabb_max - aabb_min) / (bb_max - bb_min);
-        const float scale_f =
-                std::min(scale_v.x(), std::min(scale_v.y(), scale_v.z()));
-        // apply
-
-        for (uint32_t i = 0; i < positions_size_; ++i) {
-            positions_ptr_[i * 3 + 0] =
-                    (positions_ptr_[i * 3 + 0] - center.x()) * scale_f;
-            positions_ptr_[i * 3 + 1] =
-                    (positions_ptr_[i * 3 + 1] - center.y()) * scale_f;
-            positions_ptr_[i * 3 + 2] =
-                    (positions_ptr_[i * 3 + 2] - center.z()) * scale_f;
-        }
+        const float scale_f = fit_scale(bb_min, bb_max, aabb_min, aabb_max);
+        transform(cppgl::scale(mat4::Identity(), vec3::Constant(scale_f)) *
+                  cppgl::translate(mat4::Identity(), -center));
     }
 
     void GeometryWrapperImpl::translate(const vec3 &by) {
-        for (uint32_t i = 0; i < positions_size_; ++i) {
-            positions_ptr_[i * 3 + 0] = (positions_ptr_[i * 3 + 0] + by.x());
-            positions_ptr_[i * 3 + 1] = (positions_ptr_[i * 3 + 1] + by.y());
-            positions_ptr_[i * 3 + 2] = (positions_ptr_[i * 3 + 2] + by.z());
-        }
+        transform(cppgl::translate(mat4::Identity(), by));
     }
 
     void GeometryWrapperImpl::scale(const vec3 &by) {
-        const mat4 s = cppgl::scale(mat4::Identity(), by);
-        const mat4 s_inv = cppgl::inverse(s);
-        const mat4 mat_norm = cppgl::transpose(s_inv);
-
-        for (uint32_t i = 0; i < positions_size_; ++i) {
-            positions_ptr_[i * 3 + 0] = (positions_ptr_[i * 3 + 0] * by.x());
-            positions_ptr_[i * 3 + 1] = (positions_ptr_[i * 3 + 1] * by.y());
-            positions_ptr_[i * 3 + 2] = (positions_ptr_[i * 3 + 2] * by.z());
-        }
-
-        for (uint32_t i = 0; i < normals_size_; ++i) {
-            normals_ptr_[i * 3 + 0] = (mat_norm(0, 0) * normals_ptr_[i * 3 + 0] +
-                                       mat_norm(0, 1) * normals_ptr_[i * 3 + 1] +
-                                       mat_norm(0, 2) * normals_ptr_[i * 3 + 2]);
-            normals_ptr_[i * 3 + 1] = (mat_norm(1, 0) * normals_ptr_[i * 3 + 0] +
-                                       mat_norm(1, 1) * normals_ptr_[i * 3 + 1] +
-                                       mat_norm(1, 2) * normals_ptr_[i * 3 + 2]);
-            normals_ptr_[i * 3 + 2] = (mat_norm(2, 0) * normals_ptr_[i * 3 + 0] +
-                                       mat_norm(2, 1) * normals_ptr_[i * 3 + 1] +
-                                       mat_norm(2, 2) * normals_ptr_[i * 3 + 2]);
-
-            float norm =
-                    sqrt(pow(normals_ptr_[i * 3 + 0], 2) + pow(normals_ptr_[i * 3 + 1], 2) +
-                         pow(normals_ptr_[i * 3 + 2], 2));
-
-            normals_ptr_[i * 3 + 0] /= norm;
-            normals_ptr_[i * 3 + 1] /= norm;
-            normals_ptr_[i * 3 + 2] /= norm;
-        }
+        transform(cppgl::scale(mat4::Identity(), by));
     }
 
     void GeometryWrapperImpl::rotate(float angle_degrees,
                                      const vec3 &axis) {
-        const mat4 rot = cppgl::rotate(cppgl::radians(angle_degrees), axis);
-        const mat4 rot_inv_tra = cppgl::transpose(cppgl::inverse(rot));
-
-        for (uint32_t i = 0; i < positions_size_; ++i) {
-            vec3 pos_copy = cppgl::make_vec3(&(positions_ptr_[i * 3 + 0]));
-            Eigen::Map<vec3> pos(&(positions_ptr_[i * 3 + 0]));
-            pos = (rot * pos_copy.homogeneous()).head<3>();
-        }
-
-        for (uint32_t i = 0; i < normals_size_; ++i) {
-            vec3 norm_copy = cppgl::make_vec3(&(normals_ptr_[i * 3 + 0]));
-            Eigen::Map<vec3> norm(&(normals_ptr_[i * 3 + 0]));
-            norm = (rot_inv_tra * norm_copy.homogeneous()).head<3>();
-            norm.normalize();
-        }
+        transform(cppgl::rotate(cppgl::radians(angle_degrees), axis));
     }
 
     void GeometryWrapperImpl::transform(const mat4 &trans) {
-        mat3 rot_inv_tra = trans.block<3, 3>(0, 0).inverse().transpose();
-
-        for (uint32_t i = 0; i < positions_size_; ++i) {
-            vec3 pos_copy = cppgl::make_vec3(&(positions_ptr_[i * 3 + 0]));
-            Eigen::Map<vec3> pos(&(positions_ptr_[i * 3 + 0]));
-            pos = (trans * pos_copy.homogeneous()).head<3>();
-        }
-
-        for (uint32_t i = 0; i < normals_size_; ++i) {
-            vec3 norm_copy = cppgl::make_vec3(&(normals_ptr_[i * 3 + 0]));
-            Eigen::Map<vec3> norm(&(normals_ptr_[i * 3 + 0]));
-            norm = rot_inv_tra * norm_copy;
-            norm.normalize();
-        }
+        affine_transform(positions_ptr_, positions_size_, normals_ptr_, normals_size_,
+                         trans.block<3, 3>(0, 0), trans.block<3, 1>(0, 3), bb_min, bb_max);
+        mark_dirty("position");
+        mark_dirty("normal");
     }
 CPPGL_NAMESPACE_END
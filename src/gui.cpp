@@ -133,6 +133,9 @@ CPPGL_NAMESPACE_BEGIN
         if (gui_show_geometries) {
             if (ImGui::Begin(std::string("Geometries (" + std::to_string(Geometry::map.size()) + ")").c_str(),
                              &gui_show_geometries)) {
+                const MeshUploadStats &uploads = MeshUploadStats::global();
+                ImGui::Text("Uploaded last frame: %.1f KB (%u full, %u partial)", uploads.last_frame_bytes / 1024.0,
+                            uploads.last_frame_full_uploads, uploads.last_frame_partial_updates);
                 for (const auto &[name, geom]: Geometry::map)
                     if (ImGui::CollapsingHeader(name.c_str()))
                         gui_display_geometry(geom);
@@ -7,8 +7,9 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 
 #include "stbi/stb_image_write.h"
+#include <cstring>
+#include <iostream>
 #include <algorithm>
-#include <thread>
 
 
 CPPGL_NAMESPACE_BEGIN
@@ -64,24 +65,12 @@ CPPGL_NAMESPACE_BEGIN
             throw std::runtime_error("save_image_ldr: unsupported image format: " + path.extension().string());
     }
 
-    void
-    image_store_ldr_thread(const std::filesystem::path &path, const std::shared_ptr<std::vector<uint8_t>> &image_data,
-                           int w, int h, int channels, bool flip) {
-        image_store_ldr_impl(path, image_data->data(), w, h, channels, flip);
-    }
-
     void
     image_store_ldr(const std::filesystem::path &path, const uint8_t *image_data, int w, int h, int channels, bool flip,
                     bool async) {
-        if (async) {
-            std::shared_ptr<std::vector<uint8_t>> image_data_vector = std::make_shared<std::vector<uint8_t>>(image_data,
-                                                                                                             image_data +
-                                                                                                             size_t(w) *
-                                                                                                             h *
-                                                                                                             channels);
-            std::thread worker(image_store_ldr_thread, path, image_data_vector, w, h, channels, flip);
-            worker.detach();
-        } else
+        if (async)
+            ImageWriter::global().store_ldr(path, image_data, w, h, channels, flip);
+        else
             image_store_ldr_impl(path, image_data, w, h, channels, flip);
     }
 
@@ -95,24 +84,208 @@ CPPGL_NAMESPACE_BEGIN
             throw std::runtime_error("save_image_hdr: unsupported image format: " + path.extension().string());
     }
 
-    void
-    image_store_hdr_thread(const std::filesystem::path &path, const std::shared_ptr<std::vector<float>> &image_data,
-                           int w, int h, int channels, bool flip) {
-        image_store_hdr_impl(path, image_data->data(), w, h, channels, flip);
-    }
-
     void
     image_store_hdr(const std::filesystem::path &path, const float *image_data, int w, int h, int channels, bool flip,
                     bool async) {
-        if (async) {
-            std::shared_ptr<std::vector<float>> image_data_vector = std::make_shared<std::vector<float>>(image_data,
-                                                                                                         image_data +
-                                                                                                         size_t(w) * h *
-                                                                                                         channels);
-            std::thread worker(image_store_hdr_thread, path, image_data_vector, w, h, channels, flip);
-            worker.detach();
-        } else
+        if (async)
+            ImageWriter::global().store_hdr(path, image_data, w, h, channels, flip);
+        else
             image_store_hdr_impl(path, image_data, w, h, channels, flip);
     }
 
+///////////////////////
+//ImageWriter
+
+    ImageWriter::ImageWriter(uint32_t num_workers, size_t max_bytes_in_flight, Policy policy)
+            : max_bytes_in_flight(max_bytes_in_flight), policy(policy), in_flight_bytes(0), free_bytes(0),
+              next_ticket(0), dropped(0), stopped(false) {
+        for (uint32_t i = 0; i < std::max(1u, num_workers); i++)
+            workers.emplace_back(&ImageWriter::worker_loop, this);
+    }
+
+    ImageWriter::~ImageWriter() {
+        shutdown();
+    }
+
+    std::vector<uint8_t> ImageWriter::acquire(size_t bytes) {
+        std::vector<uint8_t> buffer;
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            // smallest free buffer that fits
+            auto best = free_buffers.end();
+            for (auto it = free_buffers.begin(); it != free_buffers.end(); it++)
+                if (it->capacity() >= bytes && (best == free_buffers.end() || it->capacity() < best->capacity()))
+                    best = it;
+            if (best != free_buffers.end()) {
+                free_bytes -= best->capacity();
+                buffer = std::move(*best);
+                free_buffers.erase(best);
+            }
+        }
+        buffer.resize(bytes);
+        return buffer;
+    }
+
+    void ImageWriter::release(std::vector<uint8_t> &&buffer) {
+        const std::lock_guard<std::mutex> lock(mutex);
+        // the pool never holds more than the in-flight budget, drop the smallest buffers first
+        free_bytes += buffer.capacity();
+        free_buffers.push_back(std::move(buffer));
+        while (free_bytes > max_bytes_in_flight && !free_buffers.empty()) {
+            const auto smallest = std::min_element(free_buffers.begin(), free_buffers.end(),
+                                                   [](const auto &a, const auto &b) {
+                                                       return a.capacity() < b.capacity();
+                                                   });
+            free_bytes -= smallest->capacity();
+            free_buffers.erase(smallest);
+        }
+    }
+
+    bool ImageWriter::store_ldr(const std::filesystem::path &path, const uint8_t *image_data, int w, int h,
+                                int channels, bool flip) {
+        const size_t bytes = size_t(w) * h * channels;
+        std::vector<uint8_t> pixels = acquire(bytes);
+        std::memcpy(pixels.data(), image_data, bytes);
+        return store_ldr(path, std::move(pixels), w, h, channels, flip);
+    }
+
+    bool ImageWriter::store_ldr(const std::filesystem::path &path, std::vector<uint8_t> &&pixels, int w, int h,
+                                int channels, bool flip) {
+        return submit(Job{path, std::move(pixels), w, h, channels, flip, false, 0});
+    }
+
+    bool ImageWriter::store_hdr(const std::filesystem::path &path, const float *image_data, int w, int h,
+                                int channels, bool flip) {
+        const size_t bytes = size_t(w) * h * channels * sizeof(float);
+        std::vector<uint8_t> pixels = acquire(bytes);
+        std::memcpy(pixels.data(), image_data, bytes);
+        return store_hdr(path, std::move(pixels), w, h, channels, flip);
+    }
+
+    bool ImageWriter::store_hdr(const std::filesystem::path &path, std::vector<uint8_t> &&pixels, int w, int h,
+                                int channels, bool flip) {
+        return submit(Job{path, std::move(pixels), w, h, channels, flip, true, 0});
+    }
+
+    bool ImageWriter::submit(Job &&job) {
+        const size_t bytes = job.pixels.size();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // an image larger than the whole budget is still accepted once nothing else is in flight
+            const auto has_room = [&]() {
+                return in_flight_bytes == 0 || in_flight_bytes + bytes <= max_bytes_in_flight;
+            };
+            if (!stopped && !has_room()) {
+                if (policy == Policy::DROP) {
+                    dropped++;
+                    lock.unlock();
+                    release(std::move(job.pixels));
+                    return false;
+                }
+                job_done.wait(lock, [&]() { return stopped || has_room(); });
+            }
+            if (!stopped) {
+                job.ticket = next_ticket++;
+                in_flight.insert(job.ticket);
+                in_flight_bytes += bytes;
+                jobs.push_back(std::move(job));
+                lock.unlock();
+                work_available.notify_one();
+                return true;
+            }
+        }
+        // shut down: write on the calling thread
+        write(job);
+        release(std::move(job.pixels));
+        return true;
+    }
+
+    void ImageWriter::write(const Job &job) const {
+        try {
+            if (job.hdr)
+                image_store_hdr_impl(job.path, reinterpret_cast<const float *>(job.pixels.data()), job.w, job.h,
+                                     job.channels, job.flip);
+            else
+                image_store_ldr_impl(job.path, job.pixels.data(), job.w, job.h, job.channels, job.flip);
+        } catch (const std::exception &e) {
+            std::cerr << "WARN: ImageWriter: " << e.what() << std::endl;
+        }
+    }
+
+    void ImageWriter::worker_loop() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                work_available.wait(lock, [this]() { return stopped || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            write(job);
+            const size_t bytes = job.pixels.size();
+            release(std::move(job.pixels));
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                in_flight.erase(job.ticket);
+                in_flight_bytes -= bytes;
+            }
+            job_done.notify_all();
+        }
+    }
+
+    void ImageWriter::flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        const uint64_t last = next_ticket;
+        job_done.wait(lock, [&]() { return in_flight.empty() || *in_flight.begin() >= last; });
+    }
+
+    void ImageWriter::wait_all() {
+        std::unique_lock<std::mutex> lock(mutex);
+        job_done.wait(lock, [this]() { return in_flight.empty(); });
+    }
+
+    void ImageWriter::shutdown() {
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            if (stopped)
+                return;
+            stopped = true;
+        }
+        // workers drain the queue before they exit
+        work_available.notify_all();
+        job_done.notify_all();
+        for (auto &worker: workers)
+            worker.join();
+        workers.clear();
+    }
+
+    size_t ImageWriter::bytes_in_flight() const {
+        const std::lock_guard<std::mutex> lock(mutex);
+        return in_flight_bytes;
+    }
+
+    uint64_t ImageWriter::num_dropped() const {
+        const std::lock_guard<std::mutex> lock(mutex);
+        return dropped;
+    }
+
+    static std::mutex global_writer_mutex;
+    static std::unique_ptr<ImageWriter> global_writer;
+
+    ImageWriter &ImageWriter::global() {
+        const std::lock_guard<std::mutex> lock(global_writer_mutex);
+        if (!global_writer)
+            global_writer = std::make_unique<ImageWriter>();
+        return *global_writer;
+    }
+
+    void ImageWriter::shutdown_global() {
+        const std::lock_guard<std::mutex> lock(global_writer_mutex);
+        // the writer object stays alive, so references handed out by global() remain valid
+        if (global_writer)
+            global_writer->shutdown();
+    }
+
 CPPGL_NAMESPACE_END
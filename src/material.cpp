@@ -5,8 +5,36 @@ CPPGL_NAMESPACE_BEGIN
 
     MaterialImpl::MaterialImpl(const std::string &name) : name(name) {}
 
-    MaterialImpl::MaterialImpl(const std::string &name, const fs::path &base_path, const aiMaterial *mat_ai) : name(
-            name) {
+    // texture types parsed by the MaterialImpl constructor
+    static const aiTextureType material_texture_types[] = {
+            aiTextureType_DIFFUSE, aiTextureType_SPECULAR, aiTextureType_AMBIENT, aiTextureType_EMISSIVE,
+            aiTextureType_HEIGHT, aiTextureType_OPACITY, aiTextureType_SHININESS, aiTextureType_DISPLACEMENT,
+            aiTextureType_LIGHTMAP};
+
+    std::vector<fs::path> material_texture_paths(const fs::path &base_path, const aiMaterial *mat_ai) {
+        std::vector<fs::path> paths;
+        for (aiTextureType type: material_texture_types) {
+            if (mat_ai->GetTextureCount(type) > 0) {
+                aiString path_ai;
+                mat_ai->GetTexture(type, 0, &path_ai);
+                paths.push_back(base_path / path_ai.C_Str());
+            }
+        }
+        return paths;
+    }
+
+    MaterialImpl::MaterialImpl(const std::string &name, const fs::path &base_path, const aiMaterial *mat_ai,
+                               const std::map<fs::path, ImageData> *images) : name(name) {
+        // use images decoded in advance if available, otherwise load from disk
+        const auto load_texture = [images](const std::string &tex_name, const fs::path &path) {
+            if (images) {
+                const auto it = images->find(path);
+                if (it != images->end())
+                    return Texture2D(tex_name, path, it->second);
+            }
+            return Texture2D(tex_name, path);
+        };
+
         // TODO include more (useful) assimp params?
         // ambient, diffuse, specular and emissive color are handled via fallback 1x1 textures
         // parse assimp material parameters (http://assimp.sourceforge.net/lib_html/materials.html)
@@ -45,7 +73,7 @@ CPPGL_NAMESPACE_BEGIN
         if (mat_ai->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
             aiString path_ai;
             mat_ai->GetTexture(aiTextureType_DIFFUSE, 0, &path_ai);
-            texture_map["diffuse"] = Texture2D(name + "_diffuse_" + name_ai.C_Str(), base_path / path_ai.C_Str());
+            texture_map["diffuse"] = load_texture(name + "_diffuse_" + name_ai.C_Str(), base_path / path_ai.C_Str());
         } else if (mat_ai->Get(AI_MATKEY_COLOR_DIFFUSE, vec3_value) == AI_SUCCESS) {
             // 1x1 fallback texture
             texture_map["diffuse"] = Texture2D(name + "_diffuse_" + name_ai.C_Str(), 1, 1, GL_RGB32F, GL_RGB, GL_FLOAT,
@@ -55,7 +83,7 @@ CPPGL_NAMESPACE_BEGIN
         if (mat_ai->GetTextureCount(aiTextureType_SPECULAR) > 0) {
             aiString path_ai;
             mat_ai->GetTexture(aiTextureType_SPECULAR, 0, &path_ai);
-            texture_map["specular"] = Texture2D(name + "_specular_" + name_ai.C_Str(), base_path / path_ai.C_Str());
+            texture_map["specular"] = load_texture(name + "_specular_" + name_ai.C_Str(), base_path / path_ai.C_Str());
         } else if (mat_ai->Get(AI_MATKEY_COLOR_SPECULAR, vec3_value) == AI_SUCCESS) {
             // 1x1 fallback texture
             texture_map["specular"] = Texture2D(name + "_specular_" + name_ai.C_Str(), 1, 1, GL_RGB32F, GL_RGB,
@@ -65,7 +93,7 @@ CPPGL_NAMESPACE_BEGIN
         if (mat_ai->GetTextureCount(aiTextureType_AMBIENT) > 0) {
             aiString path_ai;
             mat_ai->GetTexture(aiTextureType_AMBIENT, 0, &path_ai);
-            texture_map["ambient"] = Texture2D(name + "_ambient_" + name_ai.C_Str(), base_path / path_ai.C_Str());
+            texture_map["ambient"] = load_texture(name + "_ambient_" + name_ai.C_Str(), base_path / path_ai.C_Str());
         } else if (mat_ai->Get(AI_MATKEY_COLOR_AMBIENT, vec3_value) == AI_SUCCESS) {
             // 1x1 fallback texture
             texture_map["ambient"] = Texture2D(name + "_ambient_" + name_ai.C_Str(), 1, 1, GL_RGB32F, GL_RGB, GL_FLOAT,
@@ -75,7 +103,7 @@ CPPGL_NAMESPACE_BEGIN
         if (mat_ai->GetTextureCount(aiTextureType_EMISSIVE) > 0) {
             aiString path_ai;
             mat_ai->GetTexture(aiTextureType_EMISSIVE, 0, &path_ai);
-            texture_map["emissive"] = Texture2D(name + "_emissive_" + name_ai.C_Str(), base_path / path_ai.C_Str());
+            texture_map["emissive"] = load_texture(name + "_emissive_" + name_ai.C_Str(), base_path / path_ai.C_Str());
         } else if (mat_ai->Get(AI_MATKEY_COLOR_EMISSIVE, vec3_value) == AI_SUCCESS) {
             // 1x1 fallback texture
             texture_map["emissive"] = Texture2D(name + "_emissive_" + name_ai.C_Str(), 1, 1, GL_RGB32F, GL_RGB,
@@ -86,32 +114,31 @@ CPPGL_NAMESPACE_BEGIN
         if (mat_ai->GetTextureCount(aiTextureType_HEIGHT) > 0) {
             aiString path_ai;
             mat_ai->GetTexture(aiTextureType_HEIGHT, 0, &path_ai);
-            texture_map["normalmap"] = Texture2D(name + "_normal_" + name_ai.C_Str(), base_path / path_ai.C_Str());
+            texture_map["normalmap"] = load_texture(name + "_normal_" + name_ai.C_Str(), base_path / path_ai.C_Str());
         }
         // alphamap (TODO how to handle alphamap vs opacity parameter, or alpha channel of diffuse texture such as in SMG?)
         if (mat_ai->GetTextureCount(aiTextureType_OPACITY) > 0) {
             aiString path_ai;
             mat_ai->GetTexture(aiTextureType_OPACITY, 0, &path_ai);
-            texture_map["alphamap"] = Texture2D(name + "_alpha_" + name_ai.C_Str(), base_path / path_ai.C_Str());
+            texture_map["alphamap"] = load_texture(name + "_alpha_" + name_ai.C_Str(), base_path / path_ai.C_Str());
         }
         // roughness texture (TODO do we want this, or just the static roughness param?)
         if (mat_ai->GetTextureCount(aiTextureType_SHININESS) > 0) {
             aiString path_ai;
             mat_ai->GetTexture(aiTextureType_SHININESS, 0, &path_ai);
-            texture_map["roughness"] = Texture2D(name + "_roughness_" + name_ai.C_Str(), base_path / path_ai.C_Str());
+            texture_map["roughness"] = load_texture(name + "_roughness_" + name_ai.C_Str(), base_path / path_ai.C_Str());
         }
         // displacement map
         if (mat_ai->GetTextureCount(aiTextureType_DISPLACEMENT) > 0) {
             aiString path_ai;
             mat_ai->GetTexture(aiTextureType_DISPLACEMENT, 0, &path_ai);
-            texture_map["displacement"] = Texture2D(name + "_displacement_" + name_ai.C_Str(),
-                                                    base_path / path_ai.C_Str());
+            texture_map["displacement"] = load_texture(name + "_displacement_" + name_ai.C_Str(), base_path / path_ai.C_Str());
         }
         // lightmap (baked AO or something)
         if (mat_ai->GetTextureCount(aiTextureType_LIGHTMAP) > 0) {
             aiString path_ai;
             mat_ai->GetTexture(aiTextureType_LIGHTMAP, 0, &path_ai);
-            texture_map["lightmap"] = Texture2D(name + "_light_" + name_ai.C_Str(), base_path / path_ai.C_Str());
+            texture_map["lightmap"] = load_texture(name + "_light_" + name_ai.C_Str(), base_path / path_ai.C_Str());
         }
         // whatever
         if (mat_ai->GetTextureCount(aiTextureType_UNKNOWN) > 0)
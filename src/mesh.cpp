@@ -9,7 +9,15 @@
 #include <assimp/material.h>
 
 
+#include <map>
+#include <deque>
+#include <mutex>
 #include <vector>
+#include <cstring>
+#include <functional>
+#include <condition_variable>
+#include "thread_pool.h"
+#include "utils/parallel.h"
 
 // ------------------------------------------
 // helper funcs
@@ -27,6 +35,8 @@ inline uint32_t type_to_bytes(GLenum type) {
         case GL_FIXED:
         case GL_INT:
         case GL_UNSIGNED_INT:
+        case GL_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_2_10_10_10_REV:
             return 4;
         case GL_DOUBLE:
             return 8;
@@ -35,6 +45,98 @@ inline uint32_t type_to_bytes(GLenum type) {
     }
 }
 
+// bytes of one element, the packed 2_10_10_10 types hold all four components in one word
+inline uint32_t attribute_bytes(GLenum type, uint32_t element_dim) {
+    if (type == GL_INT_2_10_10_10_REV || type == GL_UNSIGNED_INT_2_10_10_10_REV)
+        return 4;
+    return type_to_bytes(type) * element_dim;
+}
+
+// a vertex attribute of a geometry, in location order as uploaded by MeshImpl::upload_gpu
+struct GeometryAttribute {
+    std::string name;
+    cppgl::VertexAttribute attribute;
+    size_t size;
+    GLenum hint;
+};
+
+static std::vector<GeometryAttribute> geometry_attributes(cppgl::GeometryBaseImpl &geometry, GLenum hint) {
+    std::vector<GeometryAttribute> attributes;
+    attributes.push_back({"position", {GL_FLOAT, 3, geometry.positions_ptr()}, geometry.positions_size(), hint});
+    if (geometry.has_normals())
+        attributes.push_back({"normal", {GL_FLOAT, 3, geometry.normals_ptr()}, geometry.normals_size(), hint});
+    if (geometry.has_texcoords())
+        attributes.push_back({"texcoord", {GL_FLOAT, 2, geometry.texcoords_ptr()}, geometry.texcoords_size(),
+                              GL_STATIC_DRAW});
+    for (const auto &[attr_name, attr]: geometry.vec3_map)
+        attributes.push_back({attr_name, {GL_FLOAT, 3, attr.ptr->data()}, attr.size, GL_STATIC_DRAW});
+    for (const auto &[attr_name, attr]: geometry.vec4_map)
+        attributes.push_back({attr_name, {GL_FLOAT, 4, attr.ptr->data()}, attr.size, hint});
+    for (const auto &[attr_name, attr]: geometry.vec2_map)
+        attributes.push_back({attr_name, {GL_FLOAT, 2, attr.ptr->data()}, attr.size, GL_STATIC_DRAW});
+    for (const auto &[attr_name, attr]: geometry.float_map)
+        attributes.push_back({attr_name, {GL_FLOAT, attr.dim, attr.ptr}, attr.size, GL_STATIC_DRAW});
+    for (const auto &[attr_name, attr]: geometry.uint_map)
+        attributes.push_back({attr_name, {GL_UNSIGNED_INT, attr.dim, attr.ptr}, attr.size, GL_STATIC_DRAW});
+    for (const auto &[attr_name, attr]: geometry.int_map)
+        attributes.push_back({attr_name, {GL_INT, attr.dim, attr.ptr}, attr.size, GL_STATIC_DRAW});
+    return attributes;
+}
+
+// true if all 'count' elements of 'dim' floats lie in [min, min + extent]
+static bool inside_box(const float *values, uint32_t dim, uint32_t count, const cppgl::vec4 &min,
+                       const cppgl::vec4 &extent) {
+    for (size_t i = 0; i < size_t(count) * dim; i++) {
+        const uint32_t c = uint32_t(i % dim);
+        if (values[i] < min[c] || values[i] > min[c] + extent[c])
+            return false;
+    }
+    return true;
+}
+
+// 'size' rounded up to a multiple of 4 bytes, the alignment GL expects of vertex attribute offsets and strides
+inline uint32_t align_attribute(uint32_t size) {
+    return (size + 3u) & ~3u;
+}
+
+// ------------------------------------------
+// VertexLayout
+
+uint32_t cppgl::VertexLayout::group(uint32_t attribute, const std::string &name) const {
+    const auto it = groups.find(name);
+    if (it != groups.end())
+        return it->second;
+    // explicit groups are numbered by the caller, keep the implicit ones apart from them
+    const uint32_t implicit = 1u << 31;
+    switch (kind) {
+        case INTERLEAVED:
+            return implicit;
+        case POSITIONS_SEPARATE:
+            return attribute == 0 ? implicit : implicit + 1;
+        default:
+            return implicit + attribute;
+    }
+}
+
+cppgl::AttributeEncoding cppgl::VertexLayout::encoding(const std::string &name) const {
+    const auto it = encodings.find(name);
+    return it != encodings.end() ? it->second : AttributeEncoding::FLOAT;
+}
+
+const char *const cppgl::VertexLayout::GLSL_DECLARATION =
+        "uniform vec3 cppgl_position_min = vec3(0.0);\n"
+        "uniform vec3 cppgl_position_extent = vec3(1.0);\n"
+        "uniform vec2 cppgl_texcoord_min = vec2(0.0);\n"
+        "uniform vec2 cppgl_texcoord_extent = vec2(1.0);\n"
+        "vec3 cppgl_dequantize_position(vec3 p) { return cppgl_position_min + p * cppgl_position_extent; }\n"
+        "vec2 cppgl_dequantize_texcoord(vec2 t) { return cppgl_texcoord_min + t * cppgl_texcoord_extent; }\n"
+        "vec3 cppgl_oct_decode(vec2 e) {\n"
+        "    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+        "    float t = max(-n.z, 0.0);\n"
+        "    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);\n"
+        "    return normalize(n);\n"
+        "}\n";
+
 // ------------------------------------------
 // MeshImpl
 
@@ -45,15 +147,19 @@ inline uint32_t type_to_bytes(GLenum type) {
 cppgl::MeshImpl::MeshImpl(const std::string &name,
                           const GeometryBase &geometry,
                           const Material &material,
-                          GLenum hint)
+                          GLenum hint,
+                          const VertexLayout &layout)
         : name(name),
           geometry(geometry),
           material(material),
           vao(0),
           num_vertices(0),
           num_indices(0),
+          index_type(GL_UNSIGNED_INT),
           primitive_type(GL_TRIANGLES),
-          bufHint(hint) {
+          bufHint(hint),
+          layout(layout),
+          buffer_generation(0) {
     glGenVertexArrays(1, &vao);
     upload_gpu();
 }
@@ -93,13 +199,25 @@ void cppgl::MeshImpl::clear_gpu() {
     }
     for (unsigned int i = 0; i < vbos.size(); i++) {
         if (vbos[i].initialized()) {
+            // interleaved attributes share the buffer, it is freed once
+            const auto buffer = vbos[i].ptr;
             vbos[i].free(true);
+            for (unsigned int j = i + 1; j < vbos.size(); j++)
+                if (vbos[j].ptr == buffer)
+                    vbos[j].ptr.reset();
         }
     }
     vbos.clear();
     vbo_types.clear();
     vbo_dims.clear();
+    vbo_strides.clear();
+    vbo_offsets.clear();
+    vbo_normalized.clear();
+    quantization.clear();
+    attribute_names.clear();
     num_vertices = num_indices = 0;
+    index_type = GL_UNSIGNED_INT;
+    buffer_generation++;
 }
 
 void cppgl::MeshImpl::upload_gpu() {
@@ -114,63 +232,158 @@ void cppgl::MeshImpl::upload_gpu() {
     //           << " normals: " << geometry->normals_size()
     //           << " texcoords: " << geometry->texcoords_size()
     //           << " indices: " << geometry->indices_size() << std::endl;
-    add_vertex_buffer(GL_FLOAT, 3, geometry->positions_size(),
-                      geometry->positions_ptr(), bufHint);
 
-    if (geometry->has_normals())
-        add_vertex_buffer(GL_FLOAT, 3, geometry->normals_size(),
-                          geometry->normals_ptr(), bufHint);
-    if (geometry->has_texcoords())
-        add_vertex_buffer(GL_FLOAT, 2, geometry->texcoords_size(),
-                          geometry->texcoords_ptr());
-
-    for (auto iter = geometry->vec3_map.begin(); iter != geometry->vec3_map.end();
-         iter++) {
-        add_vertex_buffer(GL_FLOAT, 3, iter->second.size, iter->second.ptr->data());
+    MeshUploadStats::global().full_uploads++;
+    std::vector<GeometryAttribute> attributes = geometry_attributes(*geometry, bufHint);
+
+    // attributes of a group share one buffer, in location order
+    std::map<uint32_t, std::vector<uint32_t>> buffers;
+    for (uint32_t a = 0; a < attributes.size(); a++) {
+        if (attributes[a].size != attributes[0].size)
+            throw std::runtime_error(
+                    name + " Mesh::upload_gpu: vertex buffer size mismatch! " + attributes[0].name + ": " +
+                    std::to_string(attributes[0].size) + " " + attributes[a].name + ": " +
+                    std::to_string(attributes[a].size));
+        buffers[layout.group(a, attributes[a].name)].push_back(a);
     }
-    for (auto iter = geometry->vec4_map.begin(); iter != geometry->vec4_map.end();
-         iter++) {
-        add_vertex_buffer(GL_FLOAT, 4, iter->second.size, iter->second.ptr->data(), bufHint);
+    num_vertices = uint32_t(attributes[0].size);
+    vbos.resize(attributes.size());
+    vbo_types.resize(attributes.size());
+    vbo_dims.resize(attributes.size());
+    vbo_strides.resize(attributes.size());
+    vbo_offsets.resize(attributes.size());
+    vbo_normalized.resize(attributes.size());
+    attribute_names.clear();
+    for (const GeometryAttribute &attribute: attributes)
+        attribute_names.push_back(attribute.name);
+
+    // encoded copies of the quantized attributes, alive until the upload
+    std::vector<QuantizedAttribute> encoded(attributes.size());
+    for (uint32_t a = 0; a < attributes.size(); a++) {
+        const AttributeEncoding encoding = layout.encoding(attributes[a].name);
+        if (encoding == AttributeEncoding::FLOAT)
+            continue;
+        VertexAttribute &attribute = attributes[a].attribute;
+        if (attribute.type != GL_FLOAT)
+            throw std::runtime_error(name + " Mesh::upload_gpu: cannot encode " + attributes[a].name + " as " +
+                                     encoding_to_str(encoding) + ", it is not a float attribute!");
+        // UNORM16 positions use the geometry's bounding box, other attributes the bounding box of their data
+        const bool geometry_box = encoding == AttributeEncoding::UNORM16 && attributes[a].name == "position" &&
+                                  attribute.element_dim == 3 && num_vertices > 0;
+        encoded[a] = quantize_attribute(encoding, reinterpret_cast<const float *>(attribute.data),
+                                        attribute.element_dim, num_vertices,
+                                        geometry_box ? geometry->bb_min.data() : nullptr,
+                                        geometry_box ? geometry->bb_max.data() : nullptr);
+        quantization[a] = AttributeQuantization{attributes[a].name, encoding, encoded[a].min, encoded[a].extent,
+                                                encoded[a].error, uint32_t(sizeof(float)) * attribute.element_dim,
+                                                attribute_bytes(encoded[a].type, encoded[a].element_dim),
+                                                "cppgl_" + attributes[a].name + "_min",
+                                                "cppgl_" + attributes[a].name + "_extent"};
+        attribute = VertexAttribute{encoded[a].type, encoded[a].element_dim, encoded[a].data.data(),
+                                    encoded[a].normalized};
     }
-    for (auto iter = geometry->vec2_map.begin(); iter != geometry->vec2_map.end();
-         iter++) {
-        add_vertex_buffer(GL_FLOAT, 2, iter->second.size, iter->second.ptr->data());
+
+    for (const auto &[group, ids]: buffers) {
+        std::vector<VertexAttribute> members;
+        for (uint32_t a: ids)
+            members.push_back(attributes[a].attribute);
+        // buffers of single attributes keep their usage hint, interleaved ones use the mesh's
+        const GLenum hint = ids.size() == 1 ? attributes[ids[0]].hint : bufHint;
+        std::vector<uint32_t> offsets;
+        uint32_t stride;
+        const VBO buffer = upload_vertex_buffer(name + "_vertex_buffer_" + std::to_string(ids[0]), members,
+                                                num_vertices, hint, offsets, stride);
+        for (uint32_t i = 0; i < ids.size(); i++)
+            set_vertex_attribute(ids[i], buffer, members[i], stride, offsets[i]);
     }
-    for (auto iter = geometry->float_map.begin();
-         iter != geometry->float_map.end(); iter++) {
-        add_vertex_buffer(GL_FLOAT, iter->second.dim, iter->second.size,
-                          iter->second.ptr);
+
+    add_index_buffer(geometry->indices_size(), geometry->indices_ptr());
+}
+
+size_t cppgl::MeshImpl::update_gpu() {
+    if (!geometry)
+        return 0;
+    const std::vector<GeometryAttribute> attributes = geometry_attributes(*geometry, bufHint);
+    // the buffers are reused if the vertex count, index count and attribute formats are unchanged
+    bool reuse = attributes.size() == vbos.size() && attributes[0].size == num_vertices &&
+                 geometry->indices_size() == num_indices && (num_indices == 0 || ibo);
+    for (uint32_t a = 0; reuse && a < attributes.size(); a++) {
+        const VertexAttribute &attribute = attributes[a].attribute;
+        const auto q = quantization.find(a);
+        const bool format = q != quantization.end()
+                            ? attribute.type == GL_FLOAT && q->second.float_bytes == sizeof(float) * attribute.element_dim
+                            : attribute.type == vbo_types[a] && attribute.element_dim == vbo_dims[a];
+        reuse = format && attributes[a].size == num_vertices && attributes[a].name == attribute_names[a];
     }
-    for (auto iter = geometry->uint_map.begin(); iter != geometry->uint_map.end();
-         iter++) {
-        add_vertex_buffer(GL_UNSIGNED_INT, iter->second.dim, iter->second.size,
-                          iter->second.ptr);
+    if (!reuse) {
+        const size_t before = MeshUploadStats::global().bytes;
+        upload_gpu();
+        return MeshUploadStats::global().bytes - before;
     }
-    for (auto iter = geometry->int_map.begin(); iter != geometry->int_map.end();
-         iter++) {
-        add_vertex_buffer(GL_INT, iter->second.dim, iter->second.size,
-                          iter->second.ptr);
+    MeshUploadStats::global().partial_updates++;
+    // unmarked geometries and layout changes that kept the sizes upload everything
+    const bool everything = !geometry->has_dirty_marks() || geometry->layout_dirty;
+    size_t bytes = 0;
+    for (uint32_t a = 0; a < attributes.size(); a++) {
+        DirtyRange range = everything ? DirtyRange{0, num_vertices} : geometry->dirty_range(attributes[a].name);
+        range.end = std::min(range.end, num_vertices);
+        if (!range.empty())
+            bytes += update_vertex_buffer(a, attributes[a].attribute.data, range.begin, range.end);
     }
-
-    add_index_buffer(geometry->indices_size(), geometry->indices_ptr());
+    if (num_indices) {
+        DirtyRange range = everything ? DirtyRange{0, num_indices} : geometry->dirty_range("index");
+        range.end = std::min(range.end, num_indices);
+        if (!range.empty())
+            bytes += update_index_buffer(geometry->indices_ptr(), range.begin, range.end);
+    }
+    return bytes;
 }
 
 void cppgl::MeshImpl::bind(const Shader &shader) const {
     glBindVertexArray(vao);
     if (material)
         material->bind(shader);
+    bind_quantization(*shader);
+}
+
+void cppgl::MeshImpl::bind_quantization(const ShaderImpl &shader) const {
+    if (!shader.dequantizes)
+        return;
+    // identity for float positions and texcoords, so the uniforms of the previous mesh do not linger.
+    // the shader skips values equal to its last upload, so float meshes cost four compares
+    vec3 position_min = vec3::Zero(), position_extent = vec3::Ones();
+    vec2 texcoord_min = vec2::Zero(), texcoord_extent = vec2::Ones();
+    for (const auto &[id, q]: quantization) {
+        if (q.encoding != AttributeEncoding::UNORM16)
+            continue;
+        if (id == 0) {
+            position_min = q.min.head<3>();
+            position_extent = q.extent.head<3>();
+        } else if (q.name == "texcoord") {
+            texcoord_min = q.min.head<2>();
+            texcoord_extent = q.extent.head<2>();
+        } else {
+            // custom attributes: the shader declares cppgl_<name>_min / _extent as vec4 itself
+            shader.uniform(q.min_uniform, q.min);
+            shader.uniform(q.extent_uniform, q.extent);
+        }
+    }
+    shader.uniform(ShaderImpl::POSITION_MIN, position_min);
+    shader.uniform(ShaderImpl::POSITION_EXTENT, position_extent);
+    shader.uniform(ShaderImpl::TEXCOORD_MIN, texcoord_min);
+    shader.uniform(ShaderImpl::TEXCOORD_EXTENT, texcoord_extent);
 }
 
 void cppgl::MeshImpl::draw() const {
     if (ibo)
-        glDrawElements(primitive_type, num_indices, GL_UNSIGNED_INT, 0);
+        glDrawElements(primitive_type, num_indices, index_type, 0);
     else
         glDrawArrays(primitive_type, 0, num_vertices);
 }
 
 void cppgl::MeshImpl::draw_index(uint32_t index) const {
-    glDrawElements(primitive_type, 1, GL_UNSIGNED_INT,
-                   (GLvoid *) (sizeof(uint32_t) * index));
+    glDrawElements(primitive_type, 1, index_type,
+                   (GLvoid *) (size_t(type_to_bytes(index_type)) * index));
 }
 
 void cppgl::MeshImpl::unbind() const {
@@ -179,11 +392,82 @@ void cppgl::MeshImpl::unbind() const {
         material->unbind();
 }
 
+void cppgl::vertex_attrib_pointer(GLuint index, uint32_t element_dim, GLenum type, GLsizei stride,
+                                  size_t offset_bytes, bool normalized) {
+    const GLvoid *offset = (GLvoid *) offset_bytes;
+    if (normalized)
+        glVertexAttribPointer(index, element_dim, type, GL_TRUE, stride, offset);
+    else if (type == GL_BYTE || type == GL_UNSIGNED_BYTE || type == GL_SHORT ||
+        type == GL_UNSIGNED_SHORT || type == GL_INT || type == GL_UNSIGNED_INT)
+        glVertexAttribIPointer(index, element_dim, type, stride, offset);
+    else if (type == GL_DOUBLE)
+        glVertexAttribLPointer(index, element_dim, type, stride, offset);
+    else
+        glVertexAttribPointer(index, element_dim, type, GL_FALSE, stride, offset);
+}
+
+cppgl::VBO cppgl::MeshImpl::upload_vertex_buffer(const std::string &buffer_name,
+                                                 const std::vector<VertexAttribute> &attributes,
+                                                 uint32_t num_vertices, GLenum hint,
+                                                 std::vector<uint32_t> &offsets, uint32_t &stride) {
+    offsets.resize(attributes.size());
+    stride = 0;
+    for (size_t a = 0; a < attributes.size(); a++) {
+        offsets[a] = stride;
+        stride = align_attribute(stride + attribute_bytes(attributes[a].type, attributes[a].element_dim));
+    }
+    VBO buffer(buffer_name);
+    const uint32_t packed = attribute_bytes(attributes[0].type, attributes[0].element_dim);
+    if (attributes.size() == 1 && packed == stride) {
+        // nothing to interleave, upload straight from the geometry
+        buffer->upload_data(attributes[0].data, size_t(stride) * num_vertices, hint);
+        MeshUploadStats::global().bytes += buffer->size_bytes;
+        return buffer;
+    }
+    std::vector<uint8_t> interleaved(size_t(stride) * num_vertices);
+    parallel_for(0, num_vertices, [&](uint32_t begin, uint32_t end) {
+        for (size_t a = 0; a < attributes.size(); a++) {
+            const size_t bytes = attribute_bytes(attributes[a].type, attributes[a].element_dim);
+            const uint8_t *src = reinterpret_cast<const uint8_t *>(attributes[a].data);
+            for (uint32_t v = begin; v < end; v++)
+                std::memcpy(interleaved.data() + size_t(stride) * v + offsets[a], src + bytes * v, bytes);
+        }
+    });
+    buffer->upload_data(interleaved.data(), interleaved.size(), hint);
+    MeshUploadStats::global().bytes += buffer->size_bytes;
+    return buffer;
+}
+
+void cppgl::MeshImpl::set_vertex_attribute(uint32_t buf_id, const VBO &buffer, const VertexAttribute &attribute,
+                                           uint32_t stride, uint32_t offset) {
+    vbos[buf_id] = buffer;
+    vbo_types[buf_id] = attribute.type;
+    vbo_dims[buf_id] = attribute.element_dim;
+    vbo_strides[buf_id] = stride;
+    vbo_offsets[buf_id] = offset;
+    vbo_normalized[buf_id] = attribute.normalized;
+    // setup vertex attributes
+    glBindVertexArray(vao);
+    buffer->bind();
+    glEnableVertexAttribArray(buf_id);
+    vertex_attrib_pointer(buf_id, attribute.element_dim, attribute.type, GLsizei(stride), offset,
+                          attribute.normalized);
+    glBindVertexArray(0);
+    buffer->unbind();
+}
+
 uint32_t cppgl::MeshImpl::add_vertex_buffer(GLenum type,
                                             uint32_t element_dim,
                                             uint32_t num_vertices,
                                             const void *data,
                                             GLenum hint) {
+    return add_vertex_buffer({VertexAttribute{type, element_dim, data}}, num_vertices, hint);
+}
+
+uint32_t cppgl::MeshImpl::add_vertex_buffer(const std::vector<VertexAttribute> &attributes,
+                                            uint32_t num_vertices, GLenum hint) {
+    if (attributes.empty())
+        throw std::runtime_error(name + " Mesh::add_vertex_buffer: no attributes!");
     if (this->num_vertices && this->num_vertices != num_vertices)
         throw std::runtime_error(
                 name + " Mesh::add_vertex_buffer: vertex buffer size mismatch! this: " +
@@ -193,25 +477,21 @@ uint32_t cppgl::MeshImpl::add_vertex_buffer(GLenum type,
     this->num_vertices = num_vertices;
 
     const uint32_t buf_id = vbos.size();
-
-    vbos.emplace_back(name + "_vertex_buffer_" + std::to_string(buf_id));
-    vbos[buf_id]->upload_data(
-            data, type_to_bytes(type) * element_dim * num_vertices, hint);
-    vbo_types.push_back(type);
-    vbo_dims.push_back(element_dim);
-    // setup vertex attributes
-    glBindVertexArray(vao);
-    vbos[buf_id]->bind();;
-    glEnableVertexAttribArray(buf_id);
-    if (type == GL_BYTE || type == GL_UNSIGNED_BYTE || type == GL_SHORT ||
-        type == GL_UNSIGNED_SHORT || type == GL_INT || type == GL_UNSIGNED_INT)
-        glVertexAttribIPointer(buf_id, element_dim, type, 0, 0);
-    else if (type == GL_DOUBLE)
-        glVertexAttribLPointer(buf_id, element_dim, type, 0, 0);
-    else
-        glVertexAttribPointer(buf_id, element_dim, type, GL_FALSE, 0, 0);
-    glBindVertexArray(0);
-    vbos[buf_id]->unbind();
+    const size_t num_attributes = vbos.size() + attributes.size();
+    vbos.resize(num_attributes);
+    vbo_types.resize(num_attributes);
+    vbo_dims.resize(num_attributes);
+    vbo_strides.resize(num_attributes);
+    vbo_offsets.resize(num_attributes);
+    vbo_normalized.resize(num_attributes);
+
+    std::vector<uint32_t> offsets;
+    uint32_t stride;
+    const VBO buffer = upload_vertex_buffer(name + "_vertex_buffer_" + std::to_string(buf_id), attributes,
+                                            num_vertices, hint, offsets, stride);
+    for (uint32_t i = 0; i < attributes.size(); i++)
+        set_vertex_attribute(buf_id + i, buffer, attributes[i], stride, offsets[i]);
+    buffer_generation++;
     return buf_id;
 }
 
@@ -220,7 +500,17 @@ void cppgl::MeshImpl::add_index_buffer(uint32_t num_indices,
                                        GLenum hint) {
     this->num_indices = num_indices;
     ibo = IBO(name + "_index_buffer");
-    ibo->upload_data(data, sizeof(uint32_t) * num_indices, hint);
+    buffer_generation++;
+    // halves the index memory and bandwidth of all meshes with up to 2^16 vertices
+    if (num_vertices > 0 && num_vertices <= (1u << 16)) {
+        std::vector<uint16_t> short_indices(data, data + num_indices);
+        index_type = GL_UNSIGNED_SHORT;
+        ibo->upload_data(short_indices.data(), sizeof(uint16_t) * num_indices, hint);
+    } else {
+        index_type = GL_UNSIGNED_INT;
+        ibo->upload_data(data, sizeof(uint32_t) * num_indices, hint);
+    }
+    MeshUploadStats::global().bytes += ibo->size_bytes;
     // setup vao+ibo
     glBindVertexArray(vao);
     ibo->bind();
@@ -230,12 +520,89 @@ void cppgl::MeshImpl::add_index_buffer(uint32_t num_indices,
 
 void cppgl::MeshImpl::update_vertex_buffer(uint32_t buf_id,
                                            const void *data) {
+    update_vertex_buffer(buf_id, data, 0, num_vertices);
+}
+
+size_t cppgl::MeshImpl::update_vertex_buffer(uint32_t buf_id, const void *data, uint32_t begin, uint32_t end) {
     if (buf_id >= vbos.size())
         throw std::runtime_error(
                 "Mesh::update_vertex_buffer: buffer id out of range!");
-    vbos[buf_id]->upload_subdata(
-            data, 0,
-            type_to_bytes(vbo_types[buf_id]) * vbo_dims[buf_id] * num_vertices);
+    if (end > num_vertices)
+        throw std::runtime_error(name + " Mesh::update_vertex_buffer: range [" + std::to_string(begin) + ", " +
+                                 std::to_string(end) + ") exceeds " + std::to_string(num_vertices) + " vertices!");
+    if (begin >= end)
+        return 0;
+    const uint32_t bytes = attribute_bytes(vbo_types[buf_id], vbo_dims[buf_id]);
+    QuantizedAttribute encoded;
+    const auto q = quantization.find(buf_id);
+    if (q != quantization.end()) {
+        AttributeQuantization &quant = q->second;
+        const uint32_t dim = quant.float_bytes / uint32_t(sizeof(float));
+        const float *values = reinterpret_cast<const float *>(data);
+        const bool box = quant.encoding == AttributeEncoding::UNORM16;
+        // UNORM16 ranges leaving the box of the upload would be clamped, re-encode the whole attribute instead
+        if (box && end - begin != num_vertices &&
+            !inside_box(values + size_t(dim) * begin, dim, end - begin, quant.min, quant.extent)) {
+            begin = 0;
+            end = num_vertices;
+        }
+        const bool whole = end - begin == num_vertices;
+        if (box && whole) {
+            // fresh bounds, bind_quantization uploads them with the next draw
+            encoded = quantize_attribute(quant.encoding, values, dim, num_vertices);
+            quant.min = encoded.min;
+            quant.extent = encoded.extent;
+        } else {
+            const vec4 max = quant.min + quant.extent;
+            encoded = quantize_attribute(quant.encoding, values + size_t(dim) * begin, dim, end - begin,
+                                         quant.min.data(), max.data());
+        }
+        if (whole)
+            quant.error = encoded.error;
+        else
+            quant.error.max = std::max(quant.error.max, encoded.error.max);
+    }
+    const uint32_t count = end - begin;
+    const uint8_t *src = q != quantization.end() ? encoded.data.data()
+                                                 : reinterpret_cast<const uint8_t *>(data) + size_t(bytes) * begin;
+    const uint32_t stride = vbo_strides[buf_id];
+    const size_t offset = vbo_offsets[buf_id] + size_t(stride) * begin;
+    if (stride == bytes) {
+        vbos[buf_id]->upload_subdata(src, offset, size_t(bytes) * count);
+        MeshUploadStats::global().bytes += size_t(bytes) * count;
+        return size_t(bytes) * count;
+    }
+    // scatter into the interleaved buffer, the other attributes in the mapped range keep their contents
+    const size_t range = size_t(stride) * (count - 1) + bytes;
+    uint8_t *dst = reinterpret_cast<uint8_t *>(vbos[buf_id]->map_range(offset, range, GL_MAP_WRITE_BIT));
+    parallel_for(0, count, [&](uint32_t first, uint32_t last) {
+        for (uint32_t v = first; v < last; v++)
+            std::memcpy(dst + size_t(stride) * v, src + size_t(bytes) * v, bytes);
+    });
+    vbos[buf_id]->unmap();
+    MeshUploadStats::global().bytes += range;
+    return range;
+}
+
+size_t cppgl::MeshImpl::update_index_buffer(const uint32_t *data, uint32_t begin, uint32_t end) {
+    if (!ibo || end > num_indices)
+        throw std::runtime_error(name + " Mesh::update_index_buffer: range [" + std::to_string(begin) + ", " +
+                                 std::to_string(end) + ") exceeds " + std::to_string(num_indices) + " indices!");
+    if (begin >= end)
+        return 0;
+    // the element array binding is VAO state, keep the bound one out of it
+    glBindVertexArray(0);
+    size_t bytes;
+    if (index_type == GL_UNSIGNED_SHORT) {
+        std::vector<uint16_t> short_indices(data + begin, data + end);
+        bytes = sizeof(uint16_t) * short_indices.size();
+        ibo->upload_subdata(short_indices.data(), sizeof(uint16_t) * begin, bytes);
+    } else {
+        bytes = sizeof(uint32_t) * (end - begin);
+        ibo->upload_subdata(data + begin, sizeof(uint32_t) * begin, bytes);
+    }
+    MeshUploadStats::global().bytes += bytes;
+    return bytes;
 }
 
 void cppgl::MeshImpl::set_primitive_type(GLenum primitive_type) {
@@ -245,7 +612,7 @@ void cppgl::MeshImpl::set_primitive_type(GLenum primitive_type) {
 void *cppgl::MeshImpl::map_vbo(uint32_t buf_id, GLenum access) const {
     if (buf_id >= vbos.size())
         throw std::runtime_error("Mesh::map_vbo: buffer id out of range!");
-    return vbos[buf_id]->map(access);
+    return reinterpret_cast<uint8_t *>(vbos[buf_id]->map(access)) + vbo_offsets[buf_id];
 }
 
 void cppgl::MeshImpl::unmap_vbo(uint32_t buf_id) const {
@@ -254,6 +621,42 @@ void cppgl::MeshImpl::unmap_vbo(uint32_t buf_id) const {
     vbos[buf_id]->unmap();
 }
 
+uint32_t cppgl::MeshImpl::num_vertex_buffers() const {
+    uint32_t count = 0;
+    for (size_t i = 0; i < vbos.size(); i++) {
+        size_t first = 0;
+        while (vbos[first].ptr != vbos[i].ptr)
+            first++;
+        count += first == i;
+    }
+    return count;
+}
+
+cppgl::MeshUploadStats &cppgl::MeshUploadStats::global() {
+    static MeshUploadStats stats;
+    return stats;
+}
+
+void cppgl::MeshUploadStats::next_frame() {
+    last_frame_bytes = bytes;
+    last_frame_full_uploads = full_uploads;
+    last_frame_partial_updates = partial_updates;
+    bytes = 0;
+    full_uploads = partial_updates = 0;
+}
+
+size_t cppgl::MeshImpl::vertex_memory() const {
+    size_t bytes = 0;
+    for (size_t i = 0; i < vbos.size(); i++) {
+        size_t first = 0;
+        while (vbos[first].ptr != vbos[i].ptr)
+            first++;
+        if (first == i && vbos[i].initialized())
+            bytes += vbos[i]->size_bytes;
+    }
+    return bytes;
+}
+
 void *cppgl::MeshImpl::map_ibo(GLenum access) const {
     if (!ibo)
         throw std::runtime_error("Mesh::map_ibo: no index buffer present!");
@@ -265,32 +668,42 @@ void cppgl::MeshImpl::unmap_ibo() const { ibo->unmap(); }
 // ------------------------------------------
 // Mesh loader (Ass-Imp)
 
-std::vector<std::pair<cppgl::Geometry, cppgl::Material>>
-cppgl::load_meshes_cpu(const fs::path &path, bool normalize, const std::string &mesh_name) {
-    _CPPGL_ASSERT(cppgl::Context::initialized);
+uint32_t cppgl::mesh_import_flags() {
+    return aiProcess_Triangulate | aiProcess_GenNormals; // | aiProcess_FlipUVs);
+}
+
+cppgl::MeshOptimizeOptions &cppgl::mesh_import_optimize_options() {
+    static MeshOptimizeOptions options;
+    return options;
+}
+
+// CPU side of an asset import, no GL calls and no handle registration, so it can run on any thread
+struct ImportedScene {
+    fs::path path;
+    std::string base_name;
+    std::unique_ptr<Assimp::Importer> importer;
+    const aiScene *scene_ai = nullptr;
+    std::vector<std::shared_ptr<cppgl::GeometryImpl>> geometries;
+    std::map<fs::path, cppgl::ImageData> images;
+    cppgl::MeshOptimizeReport optimize_report;  // summed over all geometries, ratios weighted by faces
+    std::exception_ptr error;
+};
+
+static void import_scene_cpu(ImportedScene &imported, bool normalize, bool decode_textures) {
+    using namespace cppgl;
     // load from disk
-    Assimp::Importer importer;
-    std::cout << "Loading: " << path << "..." << std::endl;
-    const aiScene *scene_ai = importer.ReadFile(
-            path.string(),
-            aiProcess_Triangulate | aiProcess_GenNormals); // | aiProcess_FlipUVs);
+    imported.importer = std::make_unique<Assimp::Importer>();
+    const aiScene *scene_ai = imported.importer->ReadFile(imported.path.string(), mesh_import_flags());
     if (!scene_ai)                                     // handle error
-        throw std::runtime_error("ERROR: Failed to load file: " + path.string() +
+        throw std::runtime_error("ERROR: Failed to load file: " + imported.path.string() +
                                  "!");
-
-    std::string base_name;
-    if (mesh_name.length() == 0) {
-        base_name = path.filename().replace_extension("").string();
-    } else {
-        base_name = mesh_name;
-    }
+    imported.scene_ai = scene_ai;
 
     // load geometries
-    std::vector<cppgl::Geometry> geometries;
     for (uint32_t i = 0; i < scene_ai->mNumMeshes; ++i) {
         const aiMesh *ai_mesh = scene_ai->mMeshes[i];
-        geometries.push_back(Geometry(
-                base_name + "_" + ai_mesh->mName.C_Str() + "_" + std::to_string(i),
+        imported.geometries.push_back(std::make_shared<GeometryImpl>(
+                imported.base_name + "_" + ai_mesh->mName.C_Str() + "_" + std::to_string(i),
                 ai_mesh));
     }
     // move and scale geometry to fit into [-1, 1]x3?
@@ -301,7 +714,7 @@ cppgl::load_meshes_cpu(const fs::path &path, bool normalize, const std::string &
                 bb_max(std::numeric_limits<float>::min(),
                        std::numeric_limits<float>::min(),
                        std::numeric_limits<float>::min());
-        for (const auto &geom: geometries) {
+        for (const auto &geom: imported.geometries) {
             bb_min = min(bb_min, geom->bb_min);
             bb_max = max(bb_max, geom->bb_max);
         }
@@ -310,19 +723,72 @@ cppgl::load_meshes_cpu(const fs::path &path, bool normalize, const std::string &
         const vec3 scale_v = (max - min) / (bb_max - bb_min);
         const float scale_f =
                 std::min(scale_v.x(), std::min(scale_v.y(), scale_v.z()));
-        for (auto &geom: geometries) {
-            geom->translate(-center);
-            geom->scale(vec3(scale_f, scale_f, scale_f));
+        // translation and scale fused into a single pass per geometry
+        const mat4 trans = cppgl::scale(mat4::Identity(), make_vec3(scale_f)) *
+                           cppgl::translate(mat4::Identity(), -center);
+        for (auto &geom: imported.geometries)
+            geom->transform(trans);
+    }
+
+    // triangle and vertex order for the GPU, after the transform since the overdraw pass depends on positions
+    const MeshOptimizeOptions &optimize_options = mesh_import_optimize_options();
+    if (optimize_options.vertex_cache || optimize_options.overdraw || optimize_options.vertex_fetch) {
+        MeshOptimizeReport &total = imported.optimize_report;
+        size_t num_faces = 0;
+        for (auto &geom: imported.geometries) {
+            const MeshOptimizeReport report = optimize_mesh(*geom, optimize_options);
+            const float faces = float(geom->indices_size() / 3);
+            total.before.acmr += faces * report.before.acmr;
+            total.before.atvr += faces * report.before.atvr;
+            total.before.transformed += report.before.transformed;
+            total.after.acmr += faces * report.after.acmr;
+            total.after.atvr += faces * report.after.atvr;
+            total.after.transformed += report.after.transformed;
+            total.seconds += report.seconds;
+            num_faces += geom->indices_size() / 3;
+        }
+        if (num_faces > 0) {
+            total.before.acmr /= float(num_faces);
+            total.before.atvr /= float(num_faces);
+            total.after.acmr /= float(num_faces);
+            total.after.atvr /= float(num_faces);
+        }
+    }
+
+    // decode referenced images, unreadable ones are left to the material to report
+    if (decode_textures) {
+        for (uint32_t i = 0; i < scene_ai->mNumMaterials; ++i) {
+            for (const auto &tex_path: material_texture_paths(imported.path.parent_path(), scene_ai->mMaterials[i])) {
+                if (imported.images.count(tex_path))
+                    continue;
+                try {
+                    imported.images[tex_path] = image_load(tex_path);
+                } catch (const std::exception &) {}
+            }
         }
     }
+}
+
+// GL side of an asset import: register geometries, create materials and textures
+static std::vector<std::pair<cppgl::Geometry, cppgl::Material>> finish_import(ImportedScene &imported) {
+    using namespace cppgl;
+    const aiScene *scene_ai = imported.scene_ai;
+    const MeshOptimizeReport &report = imported.optimize_report;
+    if (report.before.transformed > 0 && mesh_import_optimize_options().verbose)
+        std::cout << "Optimized " << imported.base_name << ": ACMR " << report.before.acmr << " -> "
+                  << report.after.acmr << ", ATVR " << report.before.atvr << " -> " << report.after.atvr << " ("
+                  << report.seconds * 1000 << " ms)" << std::endl;
+    std::vector<Geometry> geometries;
+    for (const auto &geom: imported.geometries)
+        geometries.push_back(Geometry(geom));
 
     // load materials
     std::vector<Material> materials;
     for (uint32_t i = 0; i < scene_ai->mNumMaterials; ++i) {
         aiString name_ai;
         scene_ai->mMaterials[i]->Get(AI_MATKEY_NAME, name_ai);
-        Material m(base_name + "_" + name_ai.C_Str(), path.parent_path(),
-                   scene_ai->mMaterials[i]);
+        Material m(imported.base_name + "_" + name_ai.C_Str(), imported.path.parent_path(),
+                   scene_ai->mMaterials[i], imported.images.empty() ? nullptr : &imported.images);
         materials.push_back(m);
     }
     // link geometry <-> material
@@ -333,6 +799,90 @@ cppgl::load_meshes_cpu(const fs::path &path, bool normalize, const std::string &
     return result;
 }
 
+static std::string import_base_name(const fs::path &path, const std::string &mesh_name) {
+    return mesh_name.empty() ? path.filename().replace_extension("").string() : mesh_name;
+}
+
+std::vector<std::pair<cppgl::Geometry, cppgl::Material>>
+cppgl::load_meshes_cpu(const fs::path &path, bool normalize, const std::string &mesh_name) {
+    _CPPGL_ASSERT(cppgl::Context::initialized);
+    std::cout << "Loading: " << path << "..." << std::endl;
+    ImportedScene imported;
+    imported.path = path;
+    imported.base_name = import_base_name(path, mesh_name);
+    import_scene_cpu(imported, normalize, false);
+    return finish_import(imported);
+}
+
+// import all files on the global thread pool and call on_ready(index, meshes) on the calling (GL) thread
+// in completion order, the first error is rethrown after all workers finished
+static void load_meshes_batch(
+        const std::vector<fs::path> &paths, bool normalize,
+        const std::function<void(uint32_t, std::vector<std::pair<cppgl::Geometry, cppgl::Material>> &&)> &on_ready) {
+    _CPPGL_ASSERT(cppgl::Context::initialized);
+    const uint32_t num_files = paths.size();
+    std::vector<ImportedScene> imported(num_files);
+    for (uint32_t i = 0; i < num_files; i++) {
+        imported[i].path = paths[i];
+        imported[i].base_name = import_base_name(paths[i], "");
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<uint32_t> ready;
+    cppgl::TaskGroup group;
+    for (uint32_t i = 0; i < num_files; i++) {
+        group.run([&, i]() {
+            try {
+                import_scene_cpu(imported[i], normalize, true);
+            } catch (...) {
+                imported[i].error = std::current_exception();
+            }
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                ready.push_back(i);
+            }
+            cv.notify_one();
+        });
+    }
+
+    std::exception_ptr error;
+    for (uint32_t done = 0; done < num_files; done++) {
+        uint32_t i;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&ready]() { return !ready.empty(); });
+            i = ready.front();
+            ready.pop_front();
+        }
+        if (!error && imported[i].error)
+            error = imported[i].error;
+        if (!error) {
+            try {
+                std::cout << "Loaded: " << imported[i].path << std::endl;
+                on_ready(i, finish_import(imported[i]));
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        // release the Assimp scene and decoded images as soon as possible
+        imported[i] = ImportedScene();
+    }
+
+    group.wait();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+std::vector<std::vector<std::pair<cppgl::Geometry, cppgl::Material>>>
+cppgl::load_meshes_cpu(const std::vector<fs::path> &paths, bool normalize) {
+    std::vector<std::vector<std::pair<Geometry, Material>>> result(paths.size());
+    load_meshes_batch(paths, normalize, [&result](uint32_t i, std::vector<std::pair<Geometry, Material>> &&meshes) {
+        result[i] = std::move(meshes);
+    });
+    return result;
+}
+
 fs::path subtract_paths(const fs::path &upper, const fs::path &lower) {
     fs::path diff_path;
     fs::path base = lower;
@@ -345,10 +895,12 @@ fs::path subtract_paths(const fs::path &upper, const fs::path &lower) {
     return diff_path;
 }
 
-void cppgl::save_meshes_cpu(
-        const std::vector<std::pair<GeometryBase, Material>> &meshes,
+// legacy exporter: copies everything into an aiScene and lets Assimp write the file
+static void save_meshes_assimp(
+        const std::vector<std::pair<cppgl::GeometryBase, cppgl::Material>> &meshes,
         const fs::path &path, const fs::path &texture_base_path,
         bool export_material) {
+    using namespace cppgl;
     std::unique_ptr<aiScene> scene(new aiScene());
 
     std::unique_ptr<aiNode> node(new aiNode());
@@ -393,34 +945,25 @@ void cppgl::save_meshes_cpu(
             if (geo->texcoords_size() > 0) {
                 m->mNumUVComponents[0] = geo->texcoords_size();
             }
-            for (unsigned int i = 0; i < geo->positions_size(); i++) {
-                m->mVertices[i].x = geo->get_position(i).x();
-                m->mVertices[i].y = geo->get_position(i).y();
-                m->mVertices[i].z = geo->get_position(i).z();
-
-                if (geo->normals_size() == geo->positions_size()) {
-                    m->mNormals[i].x = geo->get_normal(i).x();
-                    m->mNormals[i].y = geo->get_normal(i).y();
-                    m->mNormals[i].z = geo->get_normal(i).z();
-                }
-                if (geo->texcoords_size() == geo->positions_size()) {
-                    m->mTextureCoords[0][i].x = geo->get_texcoord(i).x();
-                    m->mTextureCoords[0][i].y = geo->get_texcoord(i).y();
-                    m->mTextureCoords[0][i].z = 0;
-                }
+            const AttributeView<vec3> positions = geo->positions_view();
+            const AttributeView<vec3> normals = geo->normals_view();
+            const AttributeView<vec2> texcoords = geo->texcoords_view();
+            for (unsigned int i = 0; i < positions.size; i++) {
+                m->mVertices[i] = aiVector3D(positions[i].x(), positions[i].y(), positions[i].z());
+
+                if (normals.size == positions.size)
+                    m->mNormals[i] = aiVector3D(normals[i].x(), normals[i].y(), normals[i].z());
+                if (texcoords.size == positions.size)
+                    m->mTextureCoords[0][i] = aiVector3D(texcoords[i].x(), texcoords[i].y(), 0);
             }
 
             m->mFaces = new aiFace[geo->indices_size() / 3];
             m->mNumFaces = geo->indices_size() / 3;
 
-            for (unsigned int i = 0; i < geo->indices_size(); i = i + 3) {
-                m->mFaces[i / 3].mIndices = new unsigned int[3];
-                m->mFaces[i / 3].mNumIndices = 3;
-
-                m->mFaces[i / 3].mIndices[0] = geo->get_index(i + 0);
-                m->mFaces[i / 3].mIndices[1] = geo->get_index(i + 1);
-                m->mFaces[i / 3].mIndices[2] = geo->get_index(i + 2);
-            }
+            for_each_triangle(*geo, [m](uint32_t f, uint32_t i0, uint32_t i1, uint32_t i2) {
+                m->mFaces[f].mIndices = new unsigned int[3]{i0, i1, i2};
+                m->mFaces[f].mNumIndices = 3;
+            });
         }
 
         aiMaterial *material = new aiMaterial();
@@ -573,25 +1116,44 @@ void cppgl::save_meshes_cpu(
     //std::cout << "Saved mesh to " << path << std::endl;
 }
 
+void cppgl::save_meshes_cpu(
+        const std::vector<std::pair<GeometryBase, Material>> &meshes,
+        const fs::path &path, const fs::path &texture_base_path,
+        bool export_material, MeshFileFormat format) {
+    switch (mesh_file_format(path, format)) {
+        case MeshFileFormat::PLY:
+            if (export_material)
+                std::cerr << "WARN: save_meshes_cpu: PLY does not support materials, writing geometry only" << std::endl;
+            save_meshes_ply(meshes, path);
+            break;
+        case MeshFileFormat::ASSIMP_OBJ:
+            save_meshes_assimp(meshes, path, texture_base_path, export_material);
+            break;
+        default:
+            save_meshes_obj(meshes, path, texture_base_path, export_material);
+            break;
+    }
+}
+
 void cppgl::save_meshes_cpu(const std::vector<Mesh> &meshes,
                             const fs::path &path,
                             const fs::path &texture_base_path,
-                            bool export_material) {
+                            bool export_material, MeshFileFormat format) {
     std::vector<std::pair<GeometryBase, Material>> meshes_split;
     for (unsigned int i = 0; i < meshes.size(); i++) {
         meshes_split.push_back(
                 std::make_pair(meshes[i]->geometry, meshes[i]->material));
     }
-    save_meshes_cpu(meshes_split, path, texture_base_path, export_material);
+    save_meshes_cpu(meshes_split, path, texture_base_path, export_material, format);
 }
 
 void cppgl::save_mesh_cpu(const Mesh &mesh, const fs::path &path,
                           const fs::path &texture_base_path,
-                          bool export_material) {
+                          bool export_material, MeshFileFormat format) {
     std::vector<std::pair<GeometryBase, Material>> meshes_split;
 
     meshes_split.push_back(std::make_pair(mesh->geometry, mesh->material));
-    save_meshes_cpu(meshes_split, path, texture_base_path, export_material);
+    save_meshes_cpu(meshes_split, path, texture_base_path, export_material, format);
 }
 
 std::vector<cppgl::Mesh> cppgl::load_meshes_gpu(
@@ -603,3 +1165,15 @@ std::vector<cppgl::Mesh> cppgl::load_meshes_gpu(
                               item.first, item.second));
     return meshes;
 }
+
+std::vector<std::vector<cppgl::Mesh>> cppgl::load_meshes_gpu(
+        const std::vector<fs::path> &paths, bool normalize) {
+    // upload every file as soon as its cpu data is ready, while the remaining imports continue
+    std::vector<std::vector<Mesh>> meshes(paths.size());
+    load_meshes_batch(paths, normalize, [&meshes](uint32_t i, std::vector<std::pair<Geometry, Material>> &&items) {
+        for (const auto &item: items)
+            meshes[i].push_back(Mesh(item.first->name + "/" + item.second->name,
+                                     item.first, item.second));
+    });
+    return meshes;
+}
@@ -0,0 +1,171 @@
+#include "mesh_adjacency.h"
+#include <sstream>
+#include <algorithm>
+#include "cassert.h"
+#include "utils/parallel.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+    // turn per element counts stored at offsets[i + 1] into start offsets
+    static void exclusive_scan(std::vector<uint32_t> &offsets) {
+        for (size_t i = 1; i < offsets.size(); i++)
+            offsets[i] += offsets[i - 1];
+    }
+
+    // sorted, unique one-ring of v gathered from its incident faces
+    static void gather_one_ring(uint32_t v, const uint32_t *indices,
+                                const std::vector<uint32_t> &vertex_face_offsets,
+                                const std::vector<uint32_t> &vertex_faces,
+                                std::vector<uint32_t> &ring) {
+        ring.clear();
+        for (uint32_t k = vertex_face_offsets[v]; k < vertex_face_offsets[v + 1]; k++) {
+            const uint32_t *face = &indices[vertex_faces[k] * 3];
+            for (uint32_t c = 0; c < 3; c++)
+                if (face[c] != v)
+                    ring.push_back(face[c]);
+        }
+        std::sort(ring.begin(), ring.end());
+        ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+    }
+
+    MeshAdjacency::MeshAdjacency() : num_vertices(0), num_faces(0) {}
+
+    MeshAdjacency::MeshAdjacency(uint32_t num_vertices, const uint32_t *indices, uint32_t indices_size)
+            : MeshAdjacency() {
+        build(num_vertices, indices, indices_size);
+    }
+
+    void MeshAdjacency::build_vertex_faces(uint32_t num_vertices, const uint32_t *indices, uint32_t indices_size,
+                                           std::vector<uint32_t> &offsets, std::vector<uint32_t> &faces) {
+        const uint32_t num_corners = indices_size - indices_size % 3;
+        offsets.assign(size_t(num_vertices) + 1, 0);
+        for (uint32_t i = 0; i < num_corners; i++) {
+            _CPPGL_ASSERT_LT(indices[i], num_vertices);
+            offsets[indices[i] + 1]++;
+        }
+        exclusive_scan(offsets);
+
+        // counting sort keeps the faces of every vertex in ascending order
+        faces.resize(num_corners);
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (uint32_t i = 0; i < num_corners; i++)
+            faces[cursor[indices[i]]++] = i / 3;
+    }
+
+    void MeshAdjacency::build(uint32_t num_vertices, const uint32_t *indices, uint32_t indices_size) {
+        this->num_vertices = num_vertices;
+        num_faces = indices_size / 3;
+
+        build_vertex_faces(num_vertices, indices, indices_size, vertex_face_offsets, vertex_faces);
+
+        // one-ring sizes and the number of edges owned by each vertex (neighbors with a larger index)
+        vertex_neighbor_offsets.assign(size_t(num_vertices) + 1, 0);
+        vertex_edge_offsets.assign(size_t(num_vertices) + 1, 0);
+        parallel_for(0, num_vertices, [&](uint32_t begin, uint32_t end) {
+            std::vector<uint32_t> ring;
+            for (uint32_t v = begin; v < end; v++) {
+                gather_one_ring(v, indices, vertex_face_offsets, vertex_faces, ring);
+                vertex_neighbor_offsets[v + 1] = uint32_t(ring.size());
+                vertex_edge_offsets[v + 1] = uint32_t(ring.end() - std::upper_bound(ring.begin(), ring.end(), v));
+            }
+        }, 1024);
+        exclusive_scan(vertex_neighbor_offsets);
+        exclusive_scan(vertex_edge_offsets);
+
+        // one-rings and edges, every vertex writes only its own ranges
+        vertex_neighbors.resize(vertex_neighbor_offsets.back());
+        edges.resize(size_t(vertex_edge_offsets.back()) * 2);
+        parallel_for(0, num_vertices, [&](uint32_t begin, uint32_t end) {
+            std::vector<uint32_t> ring;
+            for (uint32_t v = begin; v < end; v++) {
+                gather_one_ring(v, indices, vertex_face_offsets, vertex_faces, ring);
+                std::copy(ring.begin(), ring.end(), vertex_neighbors.begin() + vertex_neighbor_offsets[v]);
+                uint32_t e = vertex_edge_offsets[v];
+                for (auto it = std::upper_bound(ring.begin(), ring.end(), v); it != ring.end(); it++, e++) {
+                    edges[e * 2 + 0] = v;
+                    edges[e * 2 + 1] = *it;
+                }
+            }
+        }, 1024);
+
+        // edge ids of the one-ring entries and of the face sides, both need the edges above
+        vertex_neighbor_edges.resize(vertex_neighbors.size());
+        parallel_for(0, num_vertices, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t v = begin; v < end; v++)
+                for (uint32_t k = vertex_neighbor_offsets[v]; k < vertex_neighbor_offsets[v + 1]; k++)
+                    vertex_neighbor_edges[k] = edge_id(v, vertex_neighbors[k]);
+        }, 1024);
+
+        face_edges.resize(size_t(num_faces) * 3);
+        parallel_for(0, num_faces, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t f = begin; f < end; f++)
+                for (uint32_t c = 0; c < 3; c++)
+                    face_edges[f * 3 + c] = edge_id(indices[f * 3 + c], indices[f * 3 + (c + 1) % 3]);
+        });
+
+        // edge -> face by counting sort over the face sides
+        edge_face_offsets.assign(size_t(num_edges()) + 1, 0);
+        for (uint32_t e: face_edges)
+            if (e != INVALID)
+                edge_face_offsets[e + 1]++;
+        exclusive_scan(edge_face_offsets);
+        edge_faces.resize(edge_face_offsets.back());
+        std::vector<uint32_t> cursor(edge_face_offsets.begin(), edge_face_offsets.end() - 1);
+        for (uint32_t i = 0; i < face_edges.size(); i++)
+            if (face_edges[i] != INVALID)
+                edge_faces[cursor[face_edges[i]]++] = i / 3;
+    }
+
+    void MeshAdjacency::clear() {
+        *this = MeshAdjacency();
+    }
+
+    uint32_t MeshAdjacency::edge_id(uint32_t a, uint32_t b) const {
+        if (a > b)
+            std::swap(a, b);
+        if (a == b || b >= num_vertices)
+            return INVALID;
+        // the edges of a are its one-ring entries larger than a, in ascending order
+        const auto ring_begin = vertex_neighbors.begin() + vertex_neighbor_offsets[a];
+        const auto ring_end = vertex_neighbors.begin() + vertex_neighbor_offsets[a + 1];
+        const auto owned = std::upper_bound(ring_begin, ring_end, a);
+        const auto it = std::lower_bound(owned, ring_end, b);
+        if (it == ring_end || *it != b)
+            return INVALID;
+        return vertex_edge_offsets[a] + uint32_t(it - owned);
+    }
+
+    bool MeshAdjacency::is_boundary_vertex(uint32_t v) const {
+        for (uint32_t k = vertex_neighbor_offsets[v]; k < vertex_neighbor_offsets[v + 1]; k++)
+            if (num_edge_faces(vertex_neighbor_edges[k]) == 1)
+                return true;
+        return false;
+    }
+
+    size_t MeshAdjacency::memory_usage() const {
+        size_t bytes = 0;
+        for (const std::vector<uint32_t> *array: {&vertex_neighbor_offsets, &vertex_neighbors, &vertex_neighbor_edges,
+                                                  &vertex_face_offsets, &vertex_faces, &vertex_edge_offsets, &edges,
+                                                  &edge_face_offsets, &edge_faces, &face_edges})
+            bytes += array->capacity() * sizeof(uint32_t);
+        return bytes;
+    }
+
+    std::string MeshAdjacency::memory_report() const {
+        const auto kib = [](const std::vector<uint32_t> &array) {
+            return double(array.capacity() * sizeof(uint32_t)) / 1024.0;
+        };
+        std::stringstream ss;
+        ss << "MeshAdjacency: " << num_vertices << " vertices, " << num_faces << " faces, " << num_edges()
+           << " edges" << std::endl;
+        ss << "  vertex -> vertex: " << kib(vertex_neighbor_offsets) + kib(vertex_neighbors) + kib(vertex_neighbor_edges)
+           << " KiB" << std::endl;
+        ss << "  vertex -> face:   " << kib(vertex_face_offsets) + kib(vertex_faces) << " KiB" << std::endl;
+        ss << "  edges:            " << kib(vertex_edge_offsets) + kib(edges) << " KiB" << std::endl;
+        ss << "  edge -> face:     " << kib(edge_face_offsets) + kib(edge_faces) << " KiB" << std::endl;
+        ss << "  face -> edge:     " << kib(face_edges) << " KiB" << std::endl;
+        ss << "  total:            " << double(memory_usage()) / 1024.0 << " KiB";
+        return ss.str();
+    }
+
+CPPGL_NAMESPACE_END
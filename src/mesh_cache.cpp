@@ -0,0 +1,558 @@
+#include "mesh_cache.h"
+#include "mesh.h"
+#include <map>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+CPPGL_NAMESPACE_BEGIN
+
+    static const char MESH_CACHE_MAGIC[8] = {'C', 'P', 'P', 'G', 'L', 'M', 'C', '\0'};
+    static constexpr uint64_t MESH_CACHE_ALIGNMENT = 16;
+
+    enum class CacheAttribute : uint8_t {
+        VEC4, VEC3, VEC2, FLOAT, UINT, INT
+    };
+
+    enum class CacheTexture : uint8_t {
+        PATH,  // loaded from an image file
+        COLOR  // 1x1 RGB32F fallback texture
+    };
+
+// -------------------------------------------------------------------
+// MappedFile
+// -------------------------------------------------------------------
+
+#ifdef _WIN32
+
+    MappedFile::MappedFile(const fs::path &path)
+            : path(path), data(nullptr), size(0), file_handle(nullptr), mapping_handle(nullptr) {
+        HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+            CloseHandle(file);
+            return;
+        }
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (!mapping) {
+            CloseHandle(file);
+            return;
+        }
+        void *view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+        if (!view) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return;
+        }
+        file_handle = file;
+        mapping_handle = mapping;
+        data = static_cast<uint8_t *>(view);
+        size = size_t(file_size.QuadPart);
+    }
+
+    MappedFile::~MappedFile() {
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping_handle)
+            CloseHandle(mapping_handle);
+        if (file_handle)
+            CloseHandle(file_handle);
+    }
+
+#else
+
+    MappedFile::MappedFile(const fs::path &path) : path(path), data(nullptr), size(0) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *ptr = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                data = static_cast<uint8_t *>(ptr);
+                size = size_t(st.st_size);
+            }
+        }
+        // the mapping stays valid after closing the descriptor
+        close(fd);
+    }
+
+    MappedFile::~MappedFile() {
+        if (data)
+            munmap(data, size);
+    }
+
+#endif
+
+// -------------------------------------------------------------------
+// MeshCacheKey
+// -------------------------------------------------------------------
+
+    MeshCacheKey::MeshCacheKey(const fs::path &source, uint32_t import_flags, bool normalize,
+                               const MeshOptimizeOptions &optimize)
+            : source_mtime(0), import_flags(import_flags), normalize(normalize ? 1 : 0), optimize_options(0) {
+        // pass flags, cache size and threshold bits, 'verbose' does not change the data
+        uint32_t threshold_bits;
+        std::memcpy(&threshold_bits, &optimize.overdraw_threshold, sizeof(threshold_bits));
+        optimize_options = uint64_t(optimize.vertex_cache) | uint64_t(optimize.overdraw) << 1 |
+                           uint64_t(optimize.vertex_fetch) << 2 | uint64_t(optimize.cache_size & 0xffffffu) << 8 |
+                           uint64_t(threshold_bits) << 32;
+        std::error_code ec;
+        const fs::path absolute = fs::absolute(source, ec);
+        source_path = (ec ? source : absolute).lexically_normal().string();
+        const auto mtime = fs::last_write_time(source, ec);
+        if (!ec)
+            source_mtime = int64_t(mtime.time_since_epoch().count());
+    }
+
+    fs::path mesh_cache_path(const fs::path &source) {
+        fs::path path = source;
+        path += ".cppglcache";
+        return path;
+    }
+
+// -------------------------------------------------------------------
+// Writing
+// -------------------------------------------------------------------
+
+    // sequential binary writer that keeps track of the file offset for array alignment
+    struct CacheWriter {
+        CacheWriter(const fs::path &path) : out(path, std::ios::binary), offset(0) {}
+
+        void bytes(const void *data, uint64_t n) {
+            out.write(static_cast<const char *>(data), std::streamsize(n));
+            offset += n;
+        }
+
+        template<typename T>
+        void value(const T &v) { bytes(&v, sizeof(T)); }
+
+        void str(const std::string &s) {
+            value(uint32_t(s.size()));
+            bytes(s.data(), s.size());
+        }
+
+        // names below 'base_name' are stored relative, so a cache can be loaded under a different mesh name
+        void name(const std::string &s, const std::string &base_name) {
+            const std::string prefix = base_name + "_";
+            const bool relative = s.compare(0, prefix.size(), prefix) == 0;
+            value(uint8_t(relative));
+            str(relative ? s.substr(prefix.size()) : s);
+        }
+
+        void array(const void *data, uint64_t n) {
+            static const uint8_t zeros[MESH_CACHE_ALIGNMENT] = {0};
+            bytes(zeros, (MESH_CACHE_ALIGNMENT - offset % MESH_CACHE_ALIGNMENT) % MESH_CACHE_ALIGNMENT);
+            if (n > 0)
+                bytes(data, n);
+        }
+
+        template<typename Map, typename Value>
+        void material_map(const Map &map, Value value_of) {
+            value(uint32_t(map.size()));
+            for (const auto &entry: map) {
+                str(entry.first);
+                value(value_of(entry.second));
+            }
+        }
+
+        std::ofstream out;
+        uint64_t offset;
+    };
+
+    struct CacheVec2 {
+        float v[2];
+    };
+    struct CacheVec3 {
+        float v[3];
+    };
+    struct CacheVec4 {
+        float v[4];
+    };
+
+    static void write_material(CacheWriter &writer, const Material &mat, const std::string &base_name) {
+        writer.name(mat->name, base_name);
+        writer.material_map(mat->int_map, [](int v) { return int32_t(v); });
+        writer.material_map(mat->float_map, [](float v) { return v; });
+        writer.material_map(mat->vec2_map, [](const vec2 &v) { return CacheVec2{{v.x(), v.y()}}; });
+        writer.material_map(mat->vec3_map, [](const vec3 &v) { return CacheVec3{{v.x(), v.y(), v.z()}}; });
+        writer.material_map(mat->vec4_map, [](const vec4 &v) { return CacheVec4{{v.x(), v.y(), v.z(), v.w()}}; });
+
+        std::vector<std::pair<std::string, Texture2D>> textures;
+        for (const auto &entry: mat->texture_map) {
+            const Texture2D &tex = entry.second;
+            if (tex->loaded_from_path.empty() && (tex->w != 1 || tex->h != 1))
+                std::cerr << "WARN: mesh cache: skipping generated texture " << tex->name << std::endl;
+            else
+                textures.push_back(entry);
+        }
+        writer.value(uint32_t(textures.size()));
+        for (const auto &entry: textures) {
+            const Texture2D &tex = entry.second;
+            writer.str(entry.first);
+            writer.name(tex->name, base_name);
+            if (!tex->loaded_from_path.empty()) {
+                writer.value(CacheTexture::PATH);
+                writer.str(tex->loaded_from_path.string());
+            } else {
+                // read back the color of the 1x1 fallback texture
+                CacheVec3 color = {{0, 0, 0}};
+                glBindTexture(GL_TEXTURE_2D, tex->id);
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, color.v);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                writer.value(CacheTexture::COLOR);
+                writer.value(color);
+            }
+        }
+    }
+
+    template<typename T>
+    static void write_attributes(CacheWriter &writer, const std::map<std::string, AttributePtr<T>> &map,
+                                 CacheAttribute type) {
+        for (const auto &entry: map) {
+            writer.str(entry.first);
+            writer.value(type);
+            writer.value(entry.second.size);
+            writer.value(entry.second.dim);
+            writer.array(entry.second.ptr, uint64_t(entry.second.size) * entry.second.dim * sizeof(T));
+        }
+    }
+
+    static void write_geometry(CacheWriter &writer, GeometryBase geo, uint32_t material_index,
+                               const std::string &base_name) {
+        writer.name(geo->name, base_name);
+        writer.value(material_index);
+        writer.value(CacheVec3{{geo->bb_min.x(), geo->bb_min.y(), geo->bb_min.z()}});
+        writer.value(CacheVec3{{geo->bb_max.x(), geo->bb_max.y(), geo->bb_max.z()}});
+
+        const AttributeView<vec3> positions = geo->positions_view();
+        const AttributeView<uint32_t> indices = geo->indices_view();
+        const AttributeView<vec3> normals = geo->normals_view();
+        const AttributeView<vec2> texcoords = geo->texcoords_view();
+        writer.value(uint32_t(positions.size));
+        writer.value(uint32_t(indices.size));
+        writer.value(uint32_t(normals.size));
+        writer.value(uint32_t(texcoords.size));
+        writer.array(positions.ptr(), positions.size * sizeof(vec3));
+        writer.array(indices.ptr(), indices.size * sizeof(uint32_t));
+        writer.array(normals.ptr(), normals.size * sizeof(vec3));
+        writer.array(texcoords.ptr(), texcoords.size * sizeof(vec2));
+
+        writer.value(uint32_t(geo->vec4_map.size() + geo->vec3_map.size() + geo->vec2_map.size() +
+                              geo->float_map.size() + geo->uint_map.size() + geo->int_map.size()));
+        write_attributes(writer, geo->vec4_map, CacheAttribute::VEC4);
+        write_attributes(writer, geo->vec3_map, CacheAttribute::VEC3);
+        write_attributes(writer, geo->vec2_map, CacheAttribute::VEC2);
+        write_attributes(writer, geo->float_map, CacheAttribute::FLOAT);
+        write_attributes(writer, geo->uint_map, CacheAttribute::UINT);
+        write_attributes(writer, geo->int_map, CacheAttribute::INT);
+    }
+
+    bool save_mesh_cache(const std::vector<std::pair<GeometryBase, Material>> &meshes, const fs::path &cache_path,
+                         const MeshCacheKey &key, const std::string &base_name) {
+        // deduplicate materials shared by several geometries
+        std::vector<Material> materials;
+        std::map<const MaterialImpl *, uint32_t> material_indices;
+        for (const auto &mesh: meshes) {
+            if (mesh.second.initialized() && !material_indices.count(&*mesh.second)) {
+                material_indices[&*mesh.second] = materials.size();
+                materials.push_back(mesh.second);
+            }
+        }
+
+        // write to a temporary file first, so readers never see a partial cache
+        fs::path tmp_path = cache_path;
+        tmp_path += ".tmp";
+        {
+            CacheWriter writer(tmp_path);
+            if (!writer.out)
+                return false;
+            writer.bytes(MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+            writer.value(MESH_CACHE_VERSION);
+            writer.value(key.import_flags);
+            writer.value(key.source_mtime);
+            writer.value(key.normalize);
+            writer.value(key.optimize_options);
+            writer.str(key.source_path);
+
+            writer.value(uint32_t(materials.size()));
+            for (const auto &mat: materials)
+                write_material(writer, mat, base_name);
+
+            writer.value(uint32_t(meshes.size()));
+            for (const auto &mesh: meshes) {
+                const uint32_t material_index =
+                        mesh.second.initialized() ? material_indices[&*mesh.second] : ~0u;
+                write_geometry(writer, mesh.first, material_index, base_name);
+            }
+            writer.out.flush();
+            if (!writer.out)
+                return false;
+        }
+
+        std::error_code ec;
+        fs::rename(tmp_path, cache_path, ec);
+        if (ec) {
+            fs::remove(tmp_path, ec);
+            return false;
+        }
+        return true;
+    }
+
+// -------------------------------------------------------------------
+// Reading
+// -------------------------------------------------------------------
+
+    // bounds checked reader over the mapped file, 'ok' turns false on the first out of range access
+    struct CacheReader {
+        CacheReader(const MappedFile &file) : data(file.data), size(file.size), pos(0), ok(true) {}
+
+        const uint8_t *bytes(uint64_t n) {
+            if (!ok || n > size - pos) {
+                ok = false;
+                return nullptr;
+            }
+            const uint8_t *ptr = data + pos;
+            pos += n;
+            return ptr;
+        }
+
+        template<typename T>
+        T value() {
+            T v;
+            std::memset(&v, 0, sizeof(T));
+            if (const uint8_t *ptr = bytes(sizeof(T)))
+                std::memcpy(&v, ptr, sizeof(T));
+            return v;
+        }
+
+        std::string str() {
+            const uint32_t n = value<uint32_t>();
+            const uint8_t *ptr = bytes(n);
+            return ptr ? std::string(reinterpret_cast<const char *>(ptr), n) : std::string();
+        }
+
+        std::string name(const std::string &base_name) {
+            const bool relative = value<uint8_t>() != 0;
+            const std::string s = str();
+            return relative ? base_name + "_" + s : s;
+        }
+
+        // pointer into the mapped pages, no copy
+        template<typename T>
+        T *array(uint64_t count) {
+            const uint64_t pad = (MESH_CACHE_ALIGNMENT - pos % MESH_CACHE_ALIGNMENT) % MESH_CACHE_ALIGNMENT;
+            bytes(pad);
+            if (count > (size - std::min<uint64_t>(size, pos)) / sizeof(T)) {
+                ok = false;
+                return nullptr;
+            }
+            return reinterpret_cast<T *>(const_cast<uint8_t *>(bytes(count * sizeof(T))));
+        }
+
+        template<typename Value, typename Convert>
+        void material_map(Convert convert) {
+            const uint32_t n = value<uint32_t>();
+            for (uint32_t i = 0; i < n && ok; i++) {
+                const std::string key = str();
+                convert(key, value<Value>());
+            }
+        }
+
+        const uint8_t *data;
+        uint64_t size;
+        uint64_t pos;
+        bool ok;
+    };
+
+    static Material read_material(CacheReader &reader, const std::string &base_name) {
+        Material mat(reader.name(base_name));
+        reader.material_map<int32_t>([&mat](const std::string &k, int32_t v) { mat->int_map[k] = v; });
+        reader.material_map<float>([&mat](const std::string &k, float v) { mat->float_map[k] = v; });
+        reader.material_map<CacheVec2>([&mat](const std::string &k, const CacheVec2 &v) {
+            mat->vec2_map[k] = vec2(v.v[0], v.v[1]);
+        });
+        reader.material_map<CacheVec3>([&mat](const std::string &k, const CacheVec3 &v) {
+            mat->vec3_map[k] = vec3(v.v[0], v.v[1], v.v[2]);
+        });
+        reader.material_map<CacheVec4>([&mat](const std::string &k, const CacheVec4 &v) {
+            mat->vec4_map[k] = vec4(v.v[0], v.v[1], v.v[2], v.v[3]);
+        });
+
+        const uint32_t num_textures = reader.value<uint32_t>();
+        for (uint32_t i = 0; i < num_textures && reader.ok; i++) {
+            const std::string uniform_name = reader.str();
+            const std::string tex_name = reader.name(base_name);
+            const CacheTexture kind = reader.value<CacheTexture>();
+            if (kind == CacheTexture::PATH) {
+                const fs::path tex_path = reader.str();
+                if (reader.ok)
+                    mat->add_texture(uniform_name, Texture2D(tex_name, tex_path));
+            } else {
+                const CacheVec3 color = reader.value<CacheVec3>();
+                if (reader.ok)
+                    mat->add_texture(uniform_name, Texture2D(tex_name, 1, 1, GL_RGB32F, GL_RGB, GL_FLOAT, color.v));
+            }
+        }
+        return mat;
+    }
+
+    template<typename T>
+    static T *read_attribute(CacheReader &reader, uint32_t size, uint32_t dim) {
+        return reader.array<T>(uint64_t(size) * dim);
+    }
+
+    static GeometryWrapper read_geometry(CacheReader &reader, const std::string &base_name,
+                                         const std::shared_ptr<MappedFile> &file, uint32_t &material_index) {
+        const std::string name = reader.name(base_name);
+        material_index = reader.value<uint32_t>();
+        const CacheVec3 bb_min = reader.value<CacheVec3>();
+        const CacheVec3 bb_max = reader.value<CacheVec3>();
+        const uint32_t num_positions = reader.value<uint32_t>();
+        const uint32_t num_indices = reader.value<uint32_t>();
+        const uint32_t num_normals = reader.value<uint32_t>();
+        const uint32_t num_texcoords = reader.value<uint32_t>();
+        float *positions = reader.array<float>(uint64_t(num_positions) * 3);
+        uint32_t *indices = reader.array<uint32_t>(num_indices);
+        float *normals = reader.array<float>(uint64_t(num_normals) * 3);
+        float *texcoords = reader.array<float>(uint64_t(num_texcoords) * 2);
+        if (!reader.ok)
+            return GeometryWrapper();
+
+        GeometryWrapper geo(name, positions, num_positions, num_indices ? indices : nullptr, num_indices,
+                            num_normals ? normals : nullptr, num_normals, num_texcoords ? texcoords : nullptr,
+                            num_texcoords);
+        geo->backing = file;
+        geo->bb_min = vec3(bb_min.v[0], bb_min.v[1], bb_min.v[2]);
+        geo->bb_max = vec3(bb_max.v[0], bb_max.v[1], bb_max.v[2]);
+
+        const uint32_t num_attributes = reader.value<uint32_t>();
+        for (uint32_t i = 0; i < num_attributes && reader.ok; i++) {
+            const std::string attribute_name = reader.str();
+            const CacheAttribute type = reader.value<CacheAttribute>();
+            const uint32_t size = reader.value<uint32_t>();
+            const uint32_t dim = reader.value<uint32_t>();
+            switch (type) {
+                case CacheAttribute::VEC4:
+                    if (vec4 *ptr = read_attribute<vec4>(reader, size, dim))
+                        geo->add_attribute_vec4(attribute_name, ptr, size, true);
+                    break;
+                case CacheAttribute::VEC3:
+                    if (vec3 *ptr = read_attribute<vec3>(reader, size, dim))
+                        geo->add_attribute_vec3(attribute_name, ptr, size, true);
+                    break;
+                case CacheAttribute::VEC2:
+                    if (vec2 *ptr = read_attribute<vec2>(reader, size, dim))
+                        geo->add_attribute_vec2(attribute_name, ptr, size, true);
+                    break;
+                case CacheAttribute::FLOAT:
+                    if (float *ptr = read_attribute<float>(reader, size, dim))
+                        geo->add_attribute_float(attribute_name, ptr, size, dim, true);
+                    break;
+                case CacheAttribute::UINT:
+                    if (uint32_t *ptr = read_attribute<uint32_t>(reader, size, dim))
+                        geo->add_attribute_uint(attribute_name, ptr, size, dim, true);
+                    break;
+                case CacheAttribute::INT:
+                    if (int32_t *ptr = read_attribute<int32_t>(reader, size, dim))
+                        geo->add_attribute_int(attribute_name, ptr, size, dim, true);
+                    break;
+                default:
+                    reader.ok = false;
+            }
+        }
+        return geo;
+    }
+
+    // unregisters a handle created while reading a cache file
+    template<typename T>
+    static void free_cache_handle(NamedHandle<T> &handle) {
+        if (handle && NamedHandle<T>::valid(handle->name))
+            handle.free(true);
+    }
+
+    std::vector<std::pair<GeometryWrapper, Material>>
+    load_mesh_cache(const fs::path &cache_path, const MeshCacheKey &key, const std::string &base_name) {
+        std::vector<std::pair<GeometryWrapper, Material>> result;
+        auto file = std::make_shared<MappedFile>(cache_path);
+        if (!*file)
+            return result;
+
+        CacheReader reader(*file);
+        const uint8_t *magic = reader.bytes(sizeof(MESH_CACHE_MAGIC));
+        if (!magic || std::memcmp(magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0)
+            return result;
+        // stale or foreign cache files are silently ignored
+        if (reader.value<uint32_t>() != MESH_CACHE_VERSION || reader.value<uint32_t>() != key.import_flags ||
+            reader.value<int64_t>() != key.source_mtime || reader.value<uint32_t>() != key.normalize ||
+            reader.value<uint64_t>() != key.optimize_options || reader.str() != key.source_path || !reader.ok)
+            return result;
+
+        std::vector<Material> materials(reader.value<uint32_t>());
+        for (auto &mat: materials)
+            if (reader.ok)
+                mat = read_material(reader, base_name);
+
+        const uint32_t num_geometries = reader.value<uint32_t>();
+        std::vector<GeometryWrapper> geometries;  // including a partially read one
+        for (uint32_t i = 0; i < num_geometries && reader.ok; i++) {
+            uint32_t material_index = ~0u;
+            GeometryWrapper geo = read_geometry(reader, base_name, file, material_index);
+            if (geo)
+                geometries.push_back(geo);
+            if (reader.ok)
+                result.emplace_back(geo, material_index < materials.size() ? materials[material_index] : Material());
+        }
+
+        if (!reader.ok) {
+            std::cerr << "WARN: mesh cache: ignoring corrupt file " << cache_path << std::endl;
+            // the mesh is imported from the source instead, nothing read from this file may stay registered
+            for (auto &geo: geometries)
+                free_cache_handle(geo);
+            for (auto &mat: materials) {
+                if (!mat)
+                    continue;
+                for (auto &entry: mat->texture_map)
+                    free_cache_handle(entry.second);
+                free_cache_handle(mat);
+            }
+            result.clear();
+        }
+        return result;
+    }
+
+    std::vector<std::pair<GeometryBase, Material>>
+    load_meshes_cached(const fs::path &path, bool normalize, const std::string &mesh_name,
+                       const fs::path &cache_path) {
+        const fs::path cache = cache_path.empty() ? mesh_cache_path(path) : cache_path;
+        const MeshCacheKey key(path, mesh_import_flags(), normalize, mesh_import_optimize_options());
+        const std::string base_name =
+                mesh_name.empty() ? path.filename().replace_extension("").string() : mesh_name;
+
+        std::vector<std::pair<GeometryBase, Material>> result;
+        for (auto &entry: load_mesh_cache(cache, key, base_name))
+            result.emplace_back(GeometryBase(entry.first), entry.second);
+        if (!result.empty())
+            return result;
+
+        for (auto &entry: load_meshes_cpu(path, normalize, mesh_name))
+            result.emplace_back(GeometryBase(entry.first), entry.second);
+        if (!save_mesh_cache(result, cache, key, base_name))
+            std::cerr << "WARN: mesh cache: could not write " << cache << std::endl;
+        return result;
+    }
+
+CPPGL_NAMESPACE_END
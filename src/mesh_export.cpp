@@ -0,0 +1,360 @@
+#include "mesh_export.h"
+#include <set>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <stdexcept>
+#include "utils/parallel.h"
+
+CPPGL_NAMESPACE_BEGIN
+
+    // elements (vertices or faces) formatted by one task, large enough to amortize the scheduling
+    static constexpr uint32_t EXPORT_CHUNK_SIZE = 1 << 16;
+    // upper bounds of a single formatted value / text line
+    static constexpr size_t MAX_NUMBER_CHARS = 24;
+    static constexpr size_t MAX_LINE_CHARS = 128;
+
+    // output file with a large stdio buffer, every failure throws
+    class ExportFile {
+    public:
+        ExportFile(const fs::path &path) : path(path), file(std::fopen(path.string().c_str(), "wb")) {
+            if (!file)
+                throw std::runtime_error("save_meshes_cpu: cannot open " + path.string());
+            std::setvbuf(file, nullptr, _IOFBF, 1 << 22);
+        }
+
+        ~ExportFile() {
+            if (file)
+                std::fclose(file);
+        }
+
+        ExportFile(const ExportFile &) = delete;
+
+        ExportFile &operator=(const ExportFile &) = delete;
+
+        void write(const void *data, size_t size) {
+            if (size > 0 && std::fwrite(data, 1, size, file) != size)
+                throw std::runtime_error("save_meshes_cpu: write to " + path.string() + " failed");
+        }
+
+        inline void write(const std::string &str) { write(str.data(), str.size()); }
+
+        void close() {
+            const int status = std::fclose(file);
+            file = nullptr;
+            if (status != 0)
+                throw std::runtime_error("save_meshes_cpu: write to " + path.string() + " failed");
+        }
+
+        const fs::path path;
+        std::FILE *file;
+    };
+
+    // format [0, count) in chunks of EXPORT_CHUNK_SIZE on all threads and append the chunks to 'file' in order
+    // format(begin, end, buffer) appends the serialized elements [begin, end) to buffer
+    template<typename Format>
+    static void write_chunked(ExportFile &file, uint32_t count, Format &&format) {
+        const uint32_t num_chunks = (count + EXPORT_CHUNK_SIZE - 1) / EXPORT_CHUNK_SIZE;
+        const uint32_t batch_size = 2 * parallel_num_threads();
+        std::vector<std::string> buffers(std::min(num_chunks, batch_size));
+        for (uint32_t first = 0; first < num_chunks; first += batch_size) {
+            const uint32_t last = std::min(num_chunks, first + batch_size);
+            parallel_for(first, last, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t c = begin; c < end; c++) {
+                    std::string &buffer = buffers[c - first];
+                    buffer.clear();
+                    format(c * EXPORT_CHUNK_SIZE, std::min(count, (c + 1) * EXPORT_CHUNK_SIZE), buffer);
+                }
+            }, 1);
+            for (uint32_t c = first; c < last; c++)
+                file.write(buffers[c - first]);
+        }
+    }
+
+    // shortest representation that reads back to the same float
+    static inline char *put_number(char *out, float value) {
+        return std::to_chars(out, out + MAX_NUMBER_CHARS, value).ptr;
+    }
+
+    static inline char *put_number(char *out, uint64_t value) {
+        return std::to_chars(out, out + MAX_NUMBER_CHARS, value).ptr;
+    }
+
+    // append count lines of at most MAX_LINE_CHARS, line(i, out) writes line i and returns its end
+    template<typename Line>
+    static void append_lines(std::string &buffer, uint32_t begin, uint32_t end, Line &&line) {
+        const size_t offset = buffer.size();
+        buffer.resize(offset + size_t(end - begin) * MAX_LINE_CHARS);
+        char *out = &buffer[offset];
+        for (uint32_t i = begin; i < end; i++)
+            out = line(i, out);
+        buffer.resize(out - buffer.data());
+    }
+
+    MeshFileFormat mesh_file_format(const fs::path &path, MeshFileFormat format) {
+        if (format != MeshFileFormat::AUTO)
+            return format;
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        return extension == ".ply" ? MeshFileFormat::PLY : MeshFileFormat::OBJ;
+    }
+
+// -------------------------------------------------------------------
+// OBJ
+// -------------------------------------------------------------------
+
+    static std::string obj_material_name(const Material &mat, size_t i) {
+        return mat->name.empty() ? "material_" + std::to_string(i) : mat->name;
+    }
+
+    // shininess exponent for the roughness computed by MaterialImpl: roughness = sqrt(2 / (shininess + 2))
+    static float obj_shininess(float roughness) {
+        return 2.f / std::max(roughness * roughness, 1e-6f) - 2.f;
+    }
+
+    static void write_obj_material(ExportFile &file, const Material &mat, const std::string &name,
+                                   const fs::path &texture_base_path) {
+        std::string mtl = "newmtl " + name + "\n";
+        const auto color = [&](const char *key, const char *property) {
+            const auto it = mat->vec3_map.find(key);
+            if (it != mat->vec3_map.end())
+                mtl += std::string(property) + " " + std::to_string(it->second.x()) + " " +
+                       std::to_string(it->second.y()) + " " + std::to_string(it->second.z()) + "\n";
+        };
+        color("ambient_color", "Ka");
+        color("diffuse_color", "Kd");
+        color("specular_color", "Ks");
+        if (mat->float_map.count("opacity"))
+            mtl += "d " + std::to_string(mat->float_map.at("opacity")) + "\n";
+        if (mat->float_map.count("roughness"))
+            mtl += "Ns " + std::to_string(obj_shininess(mat->float_map.at("roughness"))) + "\n";
+        if (mat->float_map.count("ior"))
+            mtl += "Ni " + std::to_string(mat->float_map.at("ior")) + "\n";
+
+        // texture map names as parsed back by Assimp's OBJ importer, MTL has no lightmap slot
+        static const std::pair<const char *, const char *> texture_properties[] = {
+                {"diffuse",      "map_Kd"},
+                {"specular",     "map_Ks"},
+                {"ambient",      "map_Ka"},
+                {"emissive",     "map_Ke"},
+                {"normalmap",    "map_Bump"},
+                {"alphamap",     "map_d"},
+                {"roughness",    "map_Ns"},
+                {"displacement", "disp"}};
+        for (const auto &[key, property]: texture_properties) {
+            const auto it = mat->texture_map.find(key);
+            if (it == mat->texture_map.end() || it->second->loaded_from_path.empty())
+                continue;
+            fs::path tex_path = it->second->loaded_from_path.lexically_relative(texture_base_path);
+            if (tex_path.empty())
+                tex_path = it->second->loaded_from_path;
+            mtl += std::string(property) + " " + tex_path.generic_string() + "\n";
+        }
+        file.write(mtl + "\n");
+    }
+
+    void save_meshes_obj(const std::vector<std::pair<GeometryBase, Material>> &meshes, const fs::path &path,
+                         const fs::path &texture_base_path, bool export_material) {
+        ExportFile file(path);
+        file.write(std::string("# cppgl\n"));
+
+        // materials first, so the .mtl is complete once the geometry starts streaming
+        if (export_material) {
+            fs::path mtl_path = path;
+            mtl_path.replace_extension(".mtl");
+            ExportFile mtl_file(mtl_path);
+            std::set<std::string> written;
+            for (size_t i = 0; i < meshes.size(); i++) {
+                const Material &mat = meshes[i].second;
+                if (!mat.initialized())
+                    continue;
+                const std::string name = obj_material_name(mat, i);
+                if (written.insert(name).second)
+                    write_obj_material(mtl_file, mat, name, texture_base_path);
+            }
+            mtl_file.close();
+            file.write("mtllib " + mtl_path.filename().string() + "\n");
+        }
+
+        // OBJ indices are global and 1-based
+        uint64_t position_offset = 1, texcoord_offset = 1, normal_offset = 1;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            GeometryBase geo = meshes[i].first;
+            if (!geo.initialized())
+                continue;
+            const AttributeView<vec3> positions = geo->positions_view();
+            const AttributeView<vec3> normals = geo->normals_view();
+            const AttributeView<vec2> texcoords = geo->texcoords_view();
+            const AttributeView<uint32_t> indices = geo->indices_view();
+            const bool has_normals = !positions.empty() && normals.size == positions.size;
+            const bool has_texcoords = !positions.empty() && texcoords.size == positions.size;
+
+            file.write("o " + geo->name + "\n");
+            const auto vec3_lines = [](const AttributeView<vec3> &view, const char *prefix) {
+                return [&view, prefix](uint32_t begin, uint32_t end, std::string &buffer) {
+                    append_lines(buffer, begin, end, [&view, prefix](uint32_t v, char *out) {
+                        const vec3 &value = view[v];
+                        out = std::strcpy(out, prefix) + std::strlen(prefix);
+                        out = put_number(out, value.x());
+                        *out++ = ' ';
+                        out = put_number(out, value.y());
+                        *out++ = ' ';
+                        out = put_number(out, value.z());
+                        *out++ = '\n';
+                        return out;
+                    });
+                };
+            };
+            write_chunked(file, uint32_t(positions.size), vec3_lines(positions, "v "));
+            if (has_texcoords) {
+                write_chunked(file, uint32_t(texcoords.size), [&texcoords](uint32_t begin, uint32_t end,
+                                                                           std::string &buffer) {
+                    append_lines(buffer, begin, end, [&texcoords](uint32_t v, char *out) {
+                        *out++ = 'v';
+                        *out++ = 't';
+                        *out++ = ' ';
+                        out = put_number(out, texcoords[v].x());
+                        *out++ = ' ';
+                        out = put_number(out, texcoords[v].y());
+                        *out++ = '\n';
+                        return out;
+                    });
+                });
+            }
+            if (has_normals)
+                write_chunked(file, uint32_t(normals.size), vec3_lines(normals, "vn "));
+
+            if (export_material && meshes[i].second.initialized())
+                file.write("usemtl " + obj_material_name(meshes[i].second, i) + "\n");
+
+            // "f v/vt/vn", "f v//vn", "f v/vt" or "f v" depending on the available attributes
+            const uint32_t num_faces = uint32_t(indices.size / 3);
+            write_chunked(file, num_faces, [&](uint32_t begin, uint32_t end, std::string &buffer) {
+                append_lines(buffer, begin, end, [&](uint32_t f, char *out) {
+                    *out++ = 'f';
+                    for (uint32_t c = 0; c < 3; c++) {
+                        const uint32_t index = indices[f * 3 + c];
+                        *out++ = ' ';
+                        out = put_number(out, index + position_offset);
+                        if (has_texcoords || has_normals)
+                            *out++ = '/';
+                        if (has_texcoords)
+                            out = put_number(out, index + texcoord_offset);
+                        if (has_normals) {
+                            *out++ = '/';
+                            out = put_number(out, index + normal_offset);
+                        }
+                    }
+                    *out++ = '\n';
+                    return out;
+                });
+            });
+
+            position_offset += positions.size;
+            texcoord_offset += has_texcoords ? texcoords.size : 0;
+            normal_offset += has_normals ? normals.size : 0;
+        }
+        file.close();
+    }
+
+// -------------------------------------------------------------------
+// PLY
+// -------------------------------------------------------------------
+
+    static bool host_is_little_endian() {
+        const uint32_t probe = 1;
+        uint8_t first;
+        std::memcpy(&first, &probe, 1);
+        return first == 1;
+    }
+
+    // store a 4 byte value in little endian byte order
+    template<typename T>
+    static inline uint8_t *put_le(uint8_t *out, T value, bool swap) {
+        static_assert(sizeof(T) == 4, "PLY records only hold 4 byte values");
+        std::memcpy(out, &value, 4);
+        if (swap) {
+            std::swap(out[0], out[3]);
+            std::swap(out[1], out[2]);
+        }
+        return out + 4;
+    }
+
+    void save_meshes_ply(const std::vector<std::pair<GeometryBase, Material>> &meshes, const fs::path &path) {
+        // merged element counts, optional attributes only if every mesh provides them
+        uint64_t num_vertices = 0, num_faces = 0;
+        bool has_normals = true, has_texcoords = true;
+        for (auto [geo, mat]: meshes) {
+            if (!geo.initialized())
+                continue;
+            const uint32_t size = geo->positions_size();
+            num_vertices += size;
+            num_faces += geo->indices_size() / 3;
+            has_normals = has_normals && geo->normals_size() == size;
+            has_texcoords = has_texcoords && geo->texcoords_size() == size;
+        }
+        if (num_vertices > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("save_meshes_cpu: too many vertices for " + path.string());
+        has_normals = has_normals && num_vertices > 0;
+        has_texcoords = has_texcoords && num_vertices > 0;
+
+        ExportFile file(path);
+        std::string header = "ply\nformat binary_little_endian 1.0\ncomment cppgl\n";
+        header += "element vertex " + std::to_string(num_vertices) + "\n";
+        header += "property float x\nproperty float y\nproperty float z\n";
+        if (has_normals)
+            header += "property float nx\nproperty float ny\nproperty float nz\n";
+        if (has_texcoords)
+            header += "property float s\nproperty float t\n";
+        header += "element face " + std::to_string(num_faces) + "\n";
+        header += "property list uchar uint vertex_indices\nend_header\n";
+        file.write(header);
+
+        const bool swap = !host_is_little_endian();
+        const size_t vertex_bytes = 4 * (3 + (has_normals ? 3 : 0) + (has_texcoords ? 2 : 0));
+        for (auto [geo, mat]: meshes) {
+            if (!geo.initialized())
+                continue;
+            const AttributeView<vec3> positions = geo->positions_view();
+            const AttributeView<vec3> normals = geo->normals_view();
+            const AttributeView<vec2> texcoords = geo->texcoords_view();
+            write_chunked(file, uint32_t(positions.size), [&](uint32_t begin, uint32_t end, std::string &buffer) {
+                buffer.resize(size_t(end - begin) * vertex_bytes);
+                uint8_t *out = reinterpret_cast<uint8_t *>(&buffer[0]);
+                for (uint32_t v = begin; v < end; v++) {
+                    for (int k = 0; k < 3; k++)
+                        out = put_le(out, positions[v][k], swap);
+                    if (has_normals)
+                        for (int k = 0; k < 3; k++)
+                            out = put_le(out, normals[v][k], swap);
+                    if (has_texcoords)
+                        for (int k = 0; k < 2; k++)
+                            out = put_le(out, texcoords[v][k], swap);
+                }
+            });
+        }
+
+        // faces: one count byte and three indices, offset into the merged vertex list
+        uint32_t vertex_offset = 0;
+        for (auto [geo, mat]: meshes) {
+            if (!geo.initialized())
+                continue;
+            const AttributeView<uint32_t> indices = geo->indices_view();
+            write_chunked(file, uint32_t(indices.size / 3), [&](uint32_t begin, uint32_t end, std::string &buffer) {
+                buffer.resize(size_t(end - begin) * 13);
+                uint8_t *out = reinterpret_cast<uint8_t *>(&buffer[0]);
+                for (uint32_t f = begin; f < end; f++) {
+                    *out++ = 3;
+                    for (uint32_t c = 0; c < 3; c++)
+                        out = put_le(out, indices[f * 3 + c] + vertex_offset, swap);
+                }
+            });
+            vertex_offset += geo->positions_size();
+        }
+        file.close();
+    }
+
+CPPGL_NAMESPACE_END
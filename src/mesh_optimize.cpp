@@ -0,0 +1,318 @@
+#include "mesh_optimize.h"
+#include "mesh_adjacency.h"
+#include "utils/parallel.h"
+#include <chrono>
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+
+CPPGL_NAMESPACE_BEGIN
+
+    static const uint32_t NO_INDEX = ~0u;
+
+    // FIFO post-transform cache over per-vertex timestamps: a vertex is cached if it entered less than
+    // 'cache_size' misses ago. restarting costs no clear, only a jump of the clock
+    struct CacheSimulation {
+        CacheSimulation(uint32_t num_vertices, uint32_t cache_size)
+                : timestamps(num_vertices, 0), time(cache_size + 1), cache_size(cache_size) {}
+
+        inline uint32_t access(uint32_t v) {
+            if (time - timestamps[v] > cache_size) {
+                timestamps[v] = time++;
+                return 1;
+            }
+            return 0;
+        }
+
+        inline uint32_t access(const uint32_t *face) { return access(face[0]) + access(face[1]) + access(face[2]); }
+
+        inline void flush() { time += cache_size + 1; }
+
+        // data
+        std::vector<uint32_t> timestamps;
+        uint32_t time;
+        const uint32_t cache_size;
+    };
+
+    VertexCacheStats analyze_vertex_cache(const uint32_t *indices, size_t indices_size, uint32_t num_vertices,
+                                          uint32_t cache_size) {
+        VertexCacheStats stats;
+        const size_t num_faces = indices_size / 3;
+        if (num_faces == 0)
+            return stats;
+        CacheSimulation cache(num_vertices, cache_size);
+        std::vector<uint8_t> used(num_vertices, 0);
+        for (size_t f = 0; f < num_faces; f++)
+            stats.transformed += cache.access(&indices[3 * f]);
+        for (size_t i = 0; i < 3 * num_faces; i++)
+            used[indices[i]] = 1;
+        stats.acmr = float(stats.transformed) / float(num_faces);
+        stats.atvr = float(stats.transformed) / float(std::max<size_t>(1, std::count(used.begin(), used.end(), 1)));
+        return stats;
+    }
+
+// -------------------------------------------------------------------
+// Tipsify
+
+    void optimize_vertex_cache(uint32_t *indices, size_t indices_size, uint32_t num_vertices, uint32_t cache_size) {
+        const uint32_t num_faces = uint32_t(indices_size / 3);
+        if (num_faces == 0)
+            return;
+        std::vector<uint32_t> offsets, faces;
+        MeshAdjacency::build_vertex_faces(num_vertices, indices, 3 * num_faces, offsets, faces);
+        // faces of a vertex that are not emitted yet
+        std::vector<uint32_t> live(num_vertices);
+        for (uint32_t v = 0; v < num_vertices; v++)
+            live[v] = offsets[v + 1] - offsets[v];
+
+        CacheSimulation cache(num_vertices, cache_size);
+        std::vector<uint8_t> emitted(num_faces, 0);
+        std::vector<uint32_t> dead_end, out;
+        dead_end.reserve(3 * size_t(num_faces));
+        out.reserve(3 * size_t(num_faces));
+        uint32_t cursor = 0;
+
+        // next unfinished vertex that was recently used, the input order if there is none
+        auto skip_dead_end = [&]() -> uint32_t {
+            while (!dead_end.empty()) {
+                const uint32_t v = dead_end.back();
+                dead_end.pop_back();
+                if (live[v] > 0)
+                    return v;
+            }
+            while (cursor < num_vertices && live[cursor] == 0)
+                cursor++;
+            return cursor < num_vertices ? cursor : NO_INDEX;
+        };
+
+        uint32_t fan = skip_dead_end();
+        while (fan != NO_INDEX) {
+            // emit all remaining faces around the fanning vertex
+            const size_t candidates_begin = dead_end.size();
+            for (uint32_t k = offsets[fan]; k < offsets[fan + 1]; k++) {
+                const uint32_t f = faces[k];
+                if (emitted[f])
+                    continue;
+                emitted[f] = 1;
+                for (uint32_t c = 0; c < 3; c++) {
+                    const uint32_t v = indices[3 * f + c];
+                    out.push_back(v);
+                    dead_end.push_back(v);
+                    live[v]--;
+                    cache.access(v);
+                }
+            }
+            // continue at the vertex of the new faces that has been in the cache longest and will still be cached
+            // once its remaining faces are emitted
+            uint32_t best = NO_INDEX, best_priority = 0;
+            for (size_t i = candidates_begin; i < dead_end.size(); i++) {
+                const uint32_t v = dead_end[i];
+                if (live[v] == 0)
+                    continue;
+                const uint32_t age = cache.time - cache.timestamps[v];
+                const uint32_t priority = age + 2 * live[v] <= cache_size ? age + 1 : 1;
+                if (priority > best_priority) {
+                    best = v;
+                    best_priority = priority;
+                }
+            }
+            fan = best != NO_INDEX ? best : skip_dead_end();
+        }
+        std::copy(out.begin(), out.end(), indices);
+    }
+
+// -------------------------------------------------------------------
+// Overdraw
+
+    // first triangles of runs that start with three cache misses, i.e. where the optimizer jumped to a new region
+    static std::vector<uint32_t> hard_boundaries(const uint32_t *indices, uint32_t num_faces, uint32_t num_vertices,
+                                                 uint32_t cache_size) {
+        std::vector<uint32_t> boundaries;
+        CacheSimulation cache(num_vertices, cache_size);
+        for (uint32_t f = 0; f < num_faces; f++)
+            if (cache.access(&indices[3 * f]) == 3 || f == 0)
+                boundaries.push_back(f);
+        return boundaries;
+    }
+
+    // split hard clusters where the running ACMR already reached 'threshold' times the ACMR of the cluster,
+    // restarting the cache there costs at most that much
+    static std::vector<uint32_t> soft_boundaries(const uint32_t *indices, uint32_t num_faces, uint32_t num_vertices,
+                                                 const std::vector<uint32_t> &hard, float threshold,
+                                                 uint32_t cache_size) {
+        std::vector<uint32_t> boundaries;
+        CacheSimulation cache(num_vertices, cache_size);
+        for (size_t c = 0; c < hard.size(); c++) {
+            const uint32_t begin = hard[c], end = c + 1 < hard.size() ? hard[c + 1] : num_faces;
+            cache.flush();
+            uint32_t misses = 0;
+            for (uint32_t f = begin; f < end; f++)
+                misses += cache.access(&indices[3 * f]);
+            const float cluster_threshold = threshold * float(misses) / float(end - begin);
+
+            const size_t first = boundaries.size();
+            boundaries.push_back(begin);
+            cache.flush();
+            uint32_t running_misses = 0, running_faces = 0;
+            for (uint32_t f = begin; f < end; f++) {
+                running_misses += cache.access(&indices[3 * f]);
+                running_faces++;
+                if (float(running_misses) / float(running_faces) <= cluster_threshold) {
+                    boundaries.push_back(f + 1);
+                    cache.flush();
+                    running_misses = running_faces = 0;
+                }
+            }
+            // the remainder did not reach the threshold on its own, keep it with the previous cluster
+            if (boundaries.size() > first + 1 && boundaries.back() == end)
+                boundaries.pop_back();
+        }
+        return boundaries;
+    }
+
+    void optimize_overdraw(uint32_t *indices, size_t indices_size, const float *positions, uint32_t num_vertices,
+                           float threshold, uint32_t cache_size) {
+        const uint32_t num_faces = uint32_t(indices_size / 3);
+        if (num_faces == 0)
+            return;
+        const std::vector<uint32_t> clusters = soft_boundaries(
+                indices, num_faces, num_vertices, hard_boundaries(indices, num_faces, num_vertices, cache_size),
+                threshold, cache_size);
+        const uint32_t num_clusters = uint32_t(clusters.size());
+        auto cluster_end = [&](uint32_t c) { return c + 1 < num_clusters ? clusters[c + 1] : num_faces; };
+        auto position = [&](uint32_t v) { return vec3(positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]); };
+
+        // area weighted centroids and normals of the clusters
+        std::vector<vec3> centroids(num_clusters), normals(num_clusters);
+        std::vector<float> areas(num_clusters);
+        parallel_for(0, num_clusters, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t c = begin; c < end; c++) {
+                vec3 centroid = vec3::Zero(), normal = vec3::Zero();
+                float area = 0.f;
+                for (uint32_t f = clusters[c]; f < cluster_end(c); f++) {
+                    const vec3 p0 = position(indices[3 * f]), p1 = position(indices[3 * f + 1]),
+                            p2 = position(indices[3 * f + 2]);
+                    const vec3 n = (p1 - p0).cross(p2 - p0);
+                    const float a = n.norm();
+                    centroid += a * (p0 + p1 + p2) / 3.f;
+                    normal += n;
+                    area += a;
+                }
+                centroids[c] = area > 0.f ? vec3(centroid / area) : vec3::Zero();
+                normals[c] = normal.norm() > 0.f ? vec3(normal.normalized()) : vec3::Zero();
+                areas[c] = area;
+            }
+        }, 256);
+        vec3 mesh_centroid = vec3::Zero();
+        float mesh_area = 0.f;
+        for (uint32_t c = 0; c < num_clusters; c++) {
+            mesh_centroid += areas[c] * centroids[c];
+            mesh_area += areas[c];
+        }
+        if (mesh_area > 0.f)
+            mesh_centroid /= mesh_area;
+
+        // clusters facing away from the center are visible from most directions and occlude the inner ones
+        std::vector<float> keys(num_clusters);
+        for (uint32_t c = 0; c < num_clusters; c++)
+            keys[c] = (centroids[c] - mesh_centroid).dot(normals[c]);
+        std::vector<uint32_t> order(num_clusters);
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+        std::vector<uint32_t> out;
+        out.reserve(3 * size_t(num_faces));
+        for (uint32_t c: order)
+            out.insert(out.end(), indices + 3 * size_t(clusters[c]), indices + 3 * size_t(cluster_end(c)));
+        std::copy(out.begin(), out.end(), indices);
+    }
+
+// -------------------------------------------------------------------
+// Vertex fetch
+
+    std::vector<uint32_t> optimize_vertex_fetch_remap(uint32_t *indices, size_t indices_size, uint32_t num_vertices) {
+        std::vector<uint32_t> remap(num_vertices, NO_INDEX);
+        uint32_t next = 0;
+        for (size_t i = 0; i < indices_size; i++) {
+            uint32_t &r = remap[indices[i]];
+            if (r == NO_INDEX)
+                r = next++;
+            indices[i] = r;
+        }
+        for (uint32_t v = 0; v < num_vertices; v++)
+            if (remap[v] == NO_INDEX)
+                remap[v] = next++;
+        return remap;
+    }
+
+    // data[remap[v]] = old data[v] for 'remap.size()' elements of 'element_bytes' each
+    static void permute(void *data, size_t element_bytes, const std::vector<uint32_t> &remap) {
+        uint8_t *bytes = reinterpret_cast<uint8_t *>(data);
+        const std::vector<uint8_t> copy(bytes, bytes + element_bytes * remap.size());
+        parallel_for(0, uint32_t(remap.size()), [&](uint32_t begin, uint32_t end) {
+            for (uint32_t v = begin; v < end; v++)
+                std::memcpy(bytes + element_bytes * remap[v], copy.data() + element_bytes * v, element_bytes);
+        });
+    }
+
+    template<typename T>
+    static void permute_attributes(std::map<std::string, AttributePtr<T>> &attributes,
+                                   const std::vector<uint32_t> &remap) {
+        for (auto &[name, attr]: attributes)
+            if (attr.size == remap.size())
+                permute(attr.ptr, sizeof(T) * attr.dim, remap);
+    }
+
+    void remap_vertices(GeometryBaseImpl &geometry, const std::vector<uint32_t> &remap) {
+        if (geometry.positions_size() != remap.size())
+            throw std::runtime_error("remap_vertices: " + geometry.name + " has " +
+                                     std::to_string(geometry.positions_size()) + " vertices, the remap " +
+                                     std::to_string(remap.size()));
+        permute(geometry.positions_ptr(), sizeof(vec3), remap);
+        if (geometry.has_normals() && geometry.normals_size() == remap.size())
+            permute(geometry.normals_ptr(), sizeof(vec3), remap);
+        if (geometry.has_texcoords() && geometry.texcoords_size() == remap.size())
+            permute(geometry.texcoords_ptr(), sizeof(vec2), remap);
+        // attribute maps of another size are not per vertex and stay as they are
+        permute_attributes(geometry.vec4_map, remap);
+        permute_attributes(geometry.vec3_map, remap);
+        permute_attributes(geometry.vec2_map, remap);
+        permute_attributes(geometry.float_map, remap);
+        permute_attributes(geometry.uint_map, remap);
+        permute_attributes(geometry.int_map, remap);
+    }
+
+// -------------------------------------------------------------------
+// All passes
+
+    MeshOptimizeReport optimize_mesh(GeometryBaseImpl &geometry, const MeshOptimizeOptions &options) {
+        const auto start = std::chrono::steady_clock::now();
+        MeshOptimizeReport report;
+        const size_t indices_size = geometry.indices_size() / 3 * 3;
+        const uint32_t num_vertices = uint32_t(geometry.positions_size());
+        uint32_t *indices = geometry.indices_ptr();
+        if (indices_size == 0 || num_vertices == 0)
+            return report;
+
+        report.before = analyze_vertex_cache(indices, indices_size, num_vertices, options.cache_size);
+        if (options.vertex_cache)
+            optimize_vertex_cache(indices, indices_size, num_vertices, options.cache_size);
+        if (options.overdraw)
+            optimize_overdraw(indices, indices_size, geometry.positions_ptr(), num_vertices,
+                              options.overdraw_threshold, options.cache_size);
+        if (options.vertex_fetch)
+            remap_vertices(geometry, optimize_vertex_fetch_remap(indices, indices_size, num_vertices));
+        geometry.invalidate_adjacency();
+        geometry.mark_dirty();
+        report.after = analyze_vertex_cache(indices, indices_size, num_vertices, options.cache_size);
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return report;
+    }
+
+    MeshOptimizeReport optimize_mesh(GeometryBase &geometry, const MeshOptimizeOptions &options) {
+        MeshOptimizeReport report = optimize_mesh(*geometry.ptr, options);
+        geometry->update_meshes();
+        return report;
+    }
+
+CPPGL_NAMESPACE_END
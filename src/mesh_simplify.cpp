@@ -0,0 +1,542 @@
+#include "mesh_simplify.h"
+#include "context.h"
+#include "mesh_adjacency.h"
+#include "utils/parallel.h"
+#include <cmath>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+
+CPPGL_NAMESPACE_BEGIN
+
+    static const uint32_t NO_INDEX = ~0u;
+    // weight of the quadrics holding borders and seams in place, relative to the face quadrics
+    static const float EDGE_WEIGHT = 10.f;
+    // a pass rejects collapses more expensive than this multiple of the cost at its collapse goal
+    static const float PASS_ERROR_BOUND = 1.5f;
+    // smallest cosine between the normals of a face before and after a collapse
+    static const float MIN_NORMAL_COS = 0.25f;
+
+    enum VertexKind : uint8_t {
+        INTERIOR, // collapses into any neighbor
+        BORDER,   // on an open border, collapses along the border
+        SEAM,     // one of two twins at a position, collapses along the seam together with its twin
+        LOCKED    // complex or non-manifold, never moves
+    };
+
+    // sum of w * (n.p + d)^2 over planes (n, d) with weights w
+    struct Quadric {
+        void add_plane(const vec3 &n, float d, float w) {
+            a00 += w * n.x() * n.x();
+            a11 += w * n.y() * n.y();
+            a22 += w * n.z() * n.z();
+            a01 += w * n.x() * n.y();
+            a02 += w * n.x() * n.z();
+            a12 += w * n.y() * n.z();
+            b0 += w * n.x() * d;
+            b1 += w * n.y() * d;
+            b2 += w * n.z() * d;
+            c += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric &q) {
+            a00 += q.a00, a11 += q.a11, a22 += q.a22, a01 += q.a01, a02 += q.a02, a12 += q.a12;
+            b0 += q.b0, b1 += q.b1, b2 += q.b2, c += q.c, weight += q.weight;
+        }
+
+        // weighted mean squared distance of p to the planes
+        float error(const vec3 &p) const {
+            const float x = p.x(), y = p.y(), z = p.z();
+            const float r = a00 * x * x + a11 * y * y + a22 * z * z + 2.f * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                            2.f * (b0 * x + b1 * y + b2 * z) + c;
+            return weight > 0.f ? std::abs(r) / weight : 0.f;
+        }
+
+        float a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+        float b0 = 0, b1 = 0, b2 = 0, c = 0;
+        float weight = 0;
+    };
+
+    // state of one simplification run on positions scaled into the unit cube
+    struct Simplifier {
+        struct Collapse {
+            uint32_t from, to;
+            uint32_t twin_from, twin_to; // second collapse of seams, NO_INDEX otherwise
+            float cost;
+        };
+
+        // next[v]: cycle through all vertices at the position of v, wedge[v]: smallest vertex of that cycle
+        void weld() {
+            std::vector<uint32_t> order(num_vertices);
+            std::iota(order.begin(), order.end(), 0u);
+            std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+                const vec3 &p = positions[a], &q = positions[b];
+                return std::tie(p.x(), p.y(), p.z(), a) < std::tie(q.x(), q.y(), q.z(), b);
+            });
+            wedge.resize(num_vertices);
+            next.resize(num_vertices);
+            for (uint32_t i = 0; i < num_vertices;) {
+                uint32_t j = i + 1;
+                while (j < num_vertices && positions[order[j]] == positions[order[i]])
+                    j++;
+                for (uint32_t k = i; k < j; k++) {
+                    wedge[order[k]] = order[i];
+                    next[order[k]] = order[k + 1 < j ? k + 1 : i];
+                }
+                i = j;
+            }
+        }
+
+        inline bool is_open(uint32_t edge) const { return adjacency.num_edge_faces(edge) == 1; }
+
+        // open neighbor of v at the position of 'target', NO_INDEX if there is none
+        uint32_t open_neighbor(uint32_t v, uint32_t target) const {
+            for (uint32_t k = adjacency.vertex_neighbor_offsets[v]; k < adjacency.vertex_neighbor_offsets[v + 1]; k++)
+                if (wedge[adjacency.vertex_neighbors[k]] == wedge[target] && is_open(adjacency.vertex_neighbor_edges[k]))
+                    return adjacency.vertex_neighbors[k];
+            return NO_INDEX;
+        }
+
+        void classify(bool lock_border) {
+            kinds.resize(num_vertices);
+            parallel_for(0, num_vertices, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t v = begin; v < end; v++) {
+                    uint32_t open = 0, twinned = 0;
+                    bool manifold = true;
+                    for (uint32_t k = adjacency.vertex_neighbor_offsets[v];
+                         k < adjacency.vertex_neighbor_offsets[v + 1]; k++) {
+                        const uint32_t faces = adjacency.num_edge_faces(adjacency.vertex_neighbor_edges[k]);
+                        manifold &= faces <= 2;
+                        if (faces == 1) {
+                            open++;
+                            twinned += next[v] != v && next[next[v]] == v &&
+                                       open_neighbor(next[v], adjacency.vertex_neighbors[k]) != NO_INDEX;
+                        }
+                    }
+                    const uint32_t twins = next[v] == v ? 1 : next[next[v]] == v ? 2 : 3;
+                    if (!manifold || twins > 2)
+                        kinds[v] = LOCKED;
+                    else if (twins == 1)
+                        kinds[v] = open == 0 ? INTERIOR : open == 2 && !lock_border ? BORDER : LOCKED;
+                    else
+                        kinds[v] = open == 2 && twinned == 2 ? SEAM : LOCKED;
+                }
+            });
+            // a seam is only collapsible if both twins are
+            for (uint32_t v = 0; v < num_vertices; v++)
+                if (kinds[v] == SEAM && kinds[next[v]] != SEAM)
+                    kinds[v] = LOCKED;
+        }
+
+        // face quadrics and the edge quadrics of open edges, accumulated per position
+        void compute_quadrics() {
+            quadrics.assign(num_vertices, Quadric());
+            parallel_for(0, num_vertices, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t v = begin; v < end; v++) {
+                    if (wedge[v] != v)
+                        continue;
+                    Quadric &q = quadrics[v];
+                    uint32_t x = v;
+                    do {
+                        for (uint32_t k = adjacency.vertex_face_offsets[x]; k < adjacency.vertex_face_offsets[x + 1];
+                             k++) {
+                            const uint32_t f = adjacency.vertex_faces[k];
+                            const vec3 &p0 = positions[indices[3 * f]], &p1 = positions[indices[3 * f + 1]],
+                                    &p2 = positions[indices[3 * f + 2]];
+                            vec3 n = (p1 - p0).cross(p2 - p0);
+                            const float area = n.norm();
+                            if (area == 0.f)
+                                continue;
+                            n /= area;
+                            q.add_plane(n, -n.dot(p0), 0.5f * area);
+                            for (uint32_t c = 0; c < 3; c++) {
+                                const uint32_t a = indices[3 * f + c], b = indices[3 * f + (c + 1) % 3];
+                                if ((a != x && b != x) || !is_open(adjacency.face_edges[3 * f + c]))
+                                    continue;
+                                // plane through the edge, perpendicular to the face
+                                const vec3 e = positions[b] - positions[a];
+                                const vec3 en = e.cross(n).normalized();
+                                q.add_plane(en, -en.dot(positions[a]), EDGE_WEIGHT * e.squaredNorm());
+                            }
+                        }
+                        x = next[x];
+                    } while (x != v);
+                }
+            });
+        }
+
+        // target of collapsing 'from' into 'to', false if the kinds forbid it
+        bool can_collapse(uint32_t from, uint32_t to, uint32_t edge, Collapse &collapse) const {
+            collapse = Collapse{from, to, NO_INDEX, NO_INDEX, 0.f};
+            switch (kinds[from]) {
+                case INTERIOR:
+                    return true;
+                case BORDER:
+                    return is_open(edge);
+                case SEAM: {
+                    if (!is_open(edge))
+                        return false;
+                    const uint32_t twin_to = open_neighbor(next[from], to);
+                    if (twin_to == NO_INDEX || twin_to == to)
+                        return false;
+                    collapse.twin_from = next[from];
+                    collapse.twin_to = twin_to;
+                    return true;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        // true if moving 'from' onto 'to' turns over or strongly rotates one of the faces around 'from'
+        bool flips(uint32_t from, uint32_t to) const {
+            const vec3 &p_to = positions[to];
+            for (uint32_t k = adjacency.vertex_face_offsets[from]; k < adjacency.vertex_face_offsets[from + 1]; k++) {
+                const uint32_t f = adjacency.vertex_faces[k];
+                uint32_t v[3] = {remap[indices[3 * f]], remap[indices[3 * f + 1]], remap[indices[3 * f + 2]]};
+                if (v[0] == to || v[1] == to || v[2] == to)
+                    continue;
+                const vec3 n_old = (positions[v[1]] - positions[v[0]]).cross(positions[v[2]] - positions[v[0]]);
+                if (n_old.squaredNorm() == 0.f)
+                    continue;
+                for (uint32_t &x: v)
+                    if (x == from)
+                        x = to;
+                const vec3 &p0 = v[0] == to ? p_to : positions[v[0]];
+                const vec3 n_new = ((v[1] == to ? p_to : positions[v[1]]) - p0).cross(
+                        (v[2] == to ? p_to : positions[v[2]]) - p0);
+                // rejecting large rotations and new degenerate faces keeps slivers from flipping a few passes later
+                if (n_old.dot(n_new) <= MIN_NORMAL_COS * std::sqrt(n_old.squaredNorm() * n_new.squaredNorm()))
+                    return true;
+            }
+            return false;
+        }
+
+        // faces around 'from' that also contain 'to' and degenerate with the collapse
+        uint32_t shared_faces(uint32_t from, uint32_t to) const {
+            uint32_t count = 0;
+            for (uint32_t k = adjacency.vertex_face_offsets[from]; k < adjacency.vertex_face_offsets[from + 1]; k++) {
+                const uint32_t f = adjacency.vertex_faces[k];
+                count += indices[3 * f] == to || indices[3 * f + 1] == to || indices[3 * f + 2] == to;
+            }
+            return count;
+        }
+
+        inline void lock(uint32_t v) {
+            uint32_t x = v;
+            do {
+                locked[x] = 1;
+                x = next[x];
+            } while (x != v);
+        }
+
+        // one round of independent collapses, returns the number of applied ones
+        uint32_t pass(uint32_t target_faces, float max_cost) {
+            const uint32_t num_faces = uint32_t(indices.size() / 3);
+            const uint32_t num_edges = adjacency.num_edges();
+            std::vector<Collapse> candidates(num_edges);
+            parallel_for(0, num_edges, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t e = begin; e < end; e++) {
+                    const uint32_t a = adjacency.edges[2 * e], b = adjacency.edges[2 * e + 1];
+                    Collapse ab, ba;
+                    const bool can_ab = can_collapse(a, b, e, ab), can_ba = can_collapse(b, a, e, ba);
+                    ab.cost = can_ab ? quadrics[wedge[a]].error(positions[b]) : std::numeric_limits<float>::max();
+                    ba.cost = can_ba ? quadrics[wedge[b]].error(positions[a]) : std::numeric_limits<float>::max();
+                    candidates[e] = ab.cost <= ba.cost ? ab : ba;
+                }
+            }, 1024);
+            candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](const Collapse &c) {
+                return c.cost > max_cost;
+            }), candidates.end());
+            std::sort(candidates.begin(), candidates.end(), [](const Collapse &a, const Collapse &b) {
+                return a.cost < b.cost;
+            });
+
+            // most collapses remove two faces
+            const uint32_t goal = (num_faces - target_faces + 1) / 2;
+            const float pass_limit = goal < candidates.size() ? candidates[goal].cost * PASS_ERROR_BOUND
+                                                              : std::numeric_limits<float>::max();
+            remap.resize(num_vertices);
+            std::iota(remap.begin(), remap.end(), 0u);
+            locked.assign(num_vertices, 0);
+            uint32_t removed = 0, applied = 0;
+            for (const Collapse &c: candidates) {
+                if (removed >= num_faces - target_faces || c.cost > pass_limit)
+                    break;
+                if (locked[c.from] || locked[c.to] ||
+                    (c.twin_from != NO_INDEX && (locked[c.twin_from] || locked[c.twin_to])))
+                    continue;
+                if (flips(c.from, c.to) || (c.twin_from != NO_INDEX && flips(c.twin_from, c.twin_to)))
+                    continue;
+                remap[c.from] = c.to;
+                removed += shared_faces(c.from, c.to);
+                if (c.twin_from != NO_INDEX) {
+                    remap[c.twin_from] = c.twin_to;
+                    removed += shared_faces(c.twin_from, c.twin_to);
+                }
+                quadrics[wedge[c.to]].add(quadrics[wedge[c.from]]);
+                lock(c.from);
+                lock(c.to);
+                max_error = std::max(max_error, c.cost);
+                applied++;
+            }
+            if (applied == 0)
+                return 0;
+
+            // apply the collapses and drop the degenerated faces
+            uint32_t out = 0;
+            for (uint32_t f = 0; f < num_faces; f++) {
+                const uint32_t a = remap[indices[3 * f]], b = remap[indices[3 * f + 1]], c = remap[indices[3 * f + 2]];
+                if (a == b || b == c || c == a)
+                    continue;
+                indices[3 * out + 0] = a;
+                indices[3 * out + 1] = b;
+                indices[3 * out + 2] = c;
+                out++;
+            }
+            indices.resize(3 * size_t(out));
+            return applied;
+        }
+
+        // data
+        uint32_t num_vertices = 0;
+        std::vector<vec3> positions;
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> wedge, next, remap;
+        std::vector<uint8_t> kinds, locked;
+        std::vector<Quadric> quadrics;
+        MeshAdjacency adjacency;
+        float max_error = 0.f;
+    };
+
+    std::vector<uint32_t> simplify_indices(const GeometryBase &geometry, const SimplifyOptions &options,
+                                           SimplifyStats *stats) {
+        const auto start = std::chrono::steady_clock::now();
+        GeometryBase geo = geometry;
+        const AttributeView<vec3> positions = geo->positions_view();
+        const AttributeView<uint32_t> indices = geo->indices_view();
+
+        Simplifier s;
+        s.num_vertices = uint32_t(positions.size);
+        if (indices.empty()) {
+            s.indices.resize(s.num_vertices / 3 * 3);
+            std::iota(s.indices.begin(), s.indices.end(), 0u);
+        } else {
+            s.indices.resize(indices.size / 3 * 3);
+            for (size_t i = 0; i < s.indices.size(); i++)
+                s.indices[i] = indices[i];
+        }
+        const uint32_t faces_in = uint32_t(s.indices.size() / 3);
+        const uint32_t target = options.target_faces > 0 ? options.target_faces
+                                                         : uint32_t(float(faces_in) * options.target_ratio);
+
+        // unit cube positions keep the float quadrics precise
+        vec3 bb_min = vec3::Constant(std::numeric_limits<float>::max()), bb_max = -bb_min;
+        for (size_t i = 0; i < positions.size; i++) {
+            bb_min = bb_min.cwiseMin(positions[i]);
+            bb_max = bb_max.cwiseMax(positions[i]);
+        }
+        const float extent = positions.size ? std::max((bb_max - bb_min).maxCoeff(), 1e-20f) : 1.f;
+        const float scale = 1.f / extent;
+        s.positions.resize(positions.size);
+        parallel_for(0, s.num_vertices, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t v = begin; v < end; v++)
+                s.positions[v] = (positions[v] - bb_min) * scale;
+        });
+
+        const float max_cost = options.max_error == std::numeric_limits<float>::infinity()
+                               ? std::numeric_limits<float>::max()
+                               : (options.max_error * scale) * (options.max_error * scale);
+        uint32_t passes = 0;
+        if (faces_in > target) {
+            s.weld();
+            while (s.indices.size() / 3 > target) {
+                s.adjacency.build(s.num_vertices, s.indices.data(), uint32_t(s.indices.size()));
+                if (passes == 0) {
+                    s.classify(options.lock_border);
+                    s.compute_quadrics();
+                }
+                passes++;
+                if (s.pass(target, max_cost) == 0)
+                    break;
+            }
+        }
+
+        if (stats) {
+            std::vector<uint8_t> used(s.num_vertices, 0);
+            for (uint32_t v: s.indices)
+                used[v] = 1;
+            stats->faces_in = faces_in;
+            stats->faces_out = uint32_t(s.indices.size() / 3);
+            stats->vertices_in = s.num_vertices;
+            stats->vertices_out = uint32_t(std::count(used.begin(), used.end(), 1));
+            stats->passes = passes;
+            stats->error = std::sqrt(s.max_error) * extent;
+            stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        return std::move(s.indices);
+    }
+
+    // copy the entries of a custom attribute that belong to the kept vertices
+    template<typename T>
+    static std::vector<T> gather(const T *data, uint32_t dim, const std::vector<uint32_t> &kept) {
+        std::vector<T> out(kept.size() * dim);
+        for (size_t i = 0; i < kept.size(); i++)
+            std::copy(data + size_t(kept[i]) * dim, data + size_t(kept[i] + 1) * dim, out.begin() + i * dim);
+        return out;
+    }
+
+    Geometry simplify(const GeometryBase &geometry, const std::string &name, const SimplifyOptions &options,
+                      SimplifyStats *stats) {
+        GeometryBase geo = geometry;
+        std::vector<uint32_t> indices = simplify_indices(geo, options, stats);
+
+        // referenced vertices in their original order, which keeps the input's vertex locality
+        std::vector<uint32_t> new_index(geo->positions_size(), NO_INDEX), kept;
+        for (uint32_t v: indices)
+            new_index[v] = 0;
+        for (uint32_t v = 0; v < new_index.size(); v++) {
+            if (new_index[v] == 0) {
+                new_index[v] = uint32_t(kept.size());
+                kept.push_back(v);
+            }
+        }
+        for (uint32_t &v: indices)
+            v = new_index[v];
+
+        std::vector<vec3> positions(kept.size()), normals;
+        std::vector<vec2> texcoords;
+        for (size_t i = 0; i < kept.size(); i++)
+            positions[i] = geo->get_position(kept[i]);
+        if (geo->has_normals() && geo->normals_size() == geo->positions_size()) {
+            normals.resize(kept.size());
+            for (size_t i = 0; i < kept.size(); i++)
+                normals[i] = geo->get_normal(kept[i]);
+        }
+        if (geo->has_texcoords() && geo->texcoords_size() == geo->positions_size()) {
+            texcoords.resize(kept.size());
+            for (size_t i = 0; i < kept.size(); i++)
+                texcoords[i] = geo->get_texcoord(kept[i]);
+        }
+        Geometry out(name, positions, indices, normals, texcoords);
+
+        // custom attributes are per vertex if they have one entry per position
+        const uint32_t n = uint32_t(geo->positions_size());
+        for (const auto &[attr_name, attr]: geo->vec4_map) {
+            if (attr.size != n)
+                continue;
+            std::vector<vec4> data = gather(attr.ptr, 1, kept);
+            out->add_attribute_vec4(attr_name, data);
+        }
+        for (const auto &[attr_name, attr]: geo->vec3_map) {
+            if (attr.size != n)
+                continue;
+            std::vector<vec3> data = gather(attr.ptr, 1, kept);
+            out->add_attribute_vec3(attr_name, data);
+        }
+        for (const auto &[attr_name, attr]: geo->vec2_map) {
+            if (attr.size != n)
+                continue;
+            std::vector<vec2> data = gather(attr.ptr, 1, kept);
+            out->add_attribute_vec2(attr_name, data);
+        }
+        for (const auto &[attr_name, attr]: geo->float_map) {
+            if (attr.size != n)
+                continue;
+            std::vector<float> data = gather(attr.ptr, attr.dim, kept);
+            out->add_attribute_float(attr_name, data, attr.dim);
+        }
+        for (const auto &[attr_name, attr]: geo->uint_map) {
+            if (attr.size != n)
+                continue;
+            std::vector<uint32_t> data = gather(attr.ptr, attr.dim, kept);
+            out->add_attribute_uint(attr_name, data, attr.dim);
+        }
+        for (const auto &[attr_name, attr]: geo->int_map) {
+            if (attr.size != n)
+                continue;
+            std::vector<int32_t> data = gather(attr.ptr, attr.dim, kept);
+            out->add_attribute_int(attr_name, data, attr.dim);
+        }
+        return out;
+    }
+
+// -------------------------------------------------------------------
+// LODMeshImpl
+// -------------------------------------------------------------------
+
+    LODMeshImpl::LODMeshImpl(const std::string &name, const Mesh &base, uint32_t num_levels, float ratio,
+                             float pixel_error)
+            : name(name), pixel_error(pixel_error), center(vec3::Zero()), radius(0.f) {
+        if (!base || !base->geometry)
+            throw std::runtime_error("LODMesh " + name + ": base mesh without CPU geometry");
+        const GeometryBase &geo = base->geometry;
+        center = 0.5f * (geo->bb_min + geo->bb_max);
+        radius = 0.5f * (geo->bb_max - geo->bb_min).norm();
+        levels.push_back(base);
+        errors.push_back(0.f);
+        num_faces.push_back(uint32_t(geo->indices_size() / 3));
+
+        SimplifyOptions options;
+        options.target_ratio = ratio;
+        for (uint32_t i = 1; i < num_levels; i++) {
+            const std::string level_name = name + "_lod" + std::to_string(i);
+            SimplifyStats level_stats;
+            Geometry simplified = simplify(levels.back()->geometry, level_name + "_geometry", options, &level_stats);
+            // stop once the simplifier is stuck on locked vertices
+            if (level_stats.faces_out == 0 || float(level_stats.faces_out) > 0.9f * float(level_stats.faces_in)) {
+                simplified.free(true);
+                break;
+            }
+            simplified->bb_min = geo->bb_min;
+            simplified->bb_max = geo->bb_max;
+            Mesh level(level_name, simplified, base->material, base->bufHint);
+            simplified->register_mesh(level);
+            levels.push_back(level);
+            // every level is simplified from the previous one, so the errors add up
+            errors.push_back(errors.back() + level_stats.error);
+            num_faces.push_back(level_stats.faces_out);
+            stats.push_back(level_stats);
+        }
+    }
+
+    LODMeshImpl::~LODMeshImpl() {
+        for (size_t i = 1; i < levels.size(); i++) {
+            GeometryBase geo = levels[i]->geometry;
+            levels[i].free(true);
+            if (GeometryBase::valid(geo->name))
+                GeometryBase::find(geo->name).free(true);
+        }
+    }
+
+    float LODMeshImpl::projected_error(uint32_t level, const mat4 &model, const Camera &cam) const {
+        const float scale = std::max(model.col(0).head<3>().norm(),
+                                     std::max(model.col(1).head<3>().norm(), model.col(2).head<3>().norm()));
+        const float height = float(Context::resolution().y());
+        float pixels_per_unit;
+        if (!cam->perspective) {
+            pixels_per_unit = height / std::abs(cam->top - cam->bottom);
+        } else {
+            // distance to the bounding sphere, inside of it the closest surface may be at the near plane
+            const vec3 world_center = model.block<3, 3>(0, 0) * center + model.block<3, 1>(0, 3);
+            const float distance = std::max((world_center - cam->pos).norm() - scale * radius, cam->near);
+            const float frustum_height = cam->skewed ? std::abs(cam->top - cam->bottom) / cam->near
+                                                     : 2.f * std::tan(0.5f * cam->fov_degree * float(M_PI / 180));
+            pixels_per_unit = height / (frustum_height * distance);
+        }
+        return errors[level] * scale * pixels_per_unit;
+    }
+
+    uint32_t LODMeshImpl::select_level(const mat4 &model, const Camera &cam) const {
+        uint32_t level = 0;
+        while (level + 1 < levels.size() && projected_error(level + 1, model, cam) <= pixel_error)
+            level++;
+        return level;
+    }
+
+    const Mesh &LODMeshImpl::select(const mat4 &model, const Camera &cam) const {
+        return levels[select_level(model, cam)];
+    }
+
+CPPGL_NAMESPACE_END
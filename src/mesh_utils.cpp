@@ -1,81 +1,163 @@
 #include <mesh_utils.h>
+#include "utils/parallel.h"
 
-void cppgl::laplacian_smoothing(cppgl::GeometryBase &geo,
-                                uint32_t iter) {
-    for (unsigned int k = 0; k < iter; k++) {
-        std::map<uint32_t, Laplacian> laplacian_container;
+cppgl::LaplacianSmoother::LaplacianSmoother(const MeshAdjacency &adjacency)
+        : adjacency(adjacency), current(0) {
+    const uint32_t num_vertices = adjacency.num_vertices;
+    weights.resize(adjacency.vertex_neighbors.size());
+    inv_weight_sum.resize(num_vertices);
+    parallel_for(0, num_vertices, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t v = begin; v < end; v++) {
+            float sum = 0.f;
+            for (uint32_t k = adjacency.vertex_neighbor_offsets[v]; k < adjacency.vertex_neighbor_offsets[v + 1]; k++) {
+                weights[k] = float(adjacency.num_edge_faces(adjacency.vertex_neighbor_edges[k]));
+                sum += weights[k];
+            }
+            inv_weight_sum[v] = sum > 0.f ? 1.f / sum : 0.f;
+        }
+    });
+    for (uint32_t b = 0; b < 2; b++) {
+        x[b].resize(num_vertices);
+        y[b].resize(num_vertices);
+        z[b].resize(num_vertices);
+    }
+}
 
-        for (unsigned int i = 0; i < geo->positions_size(); i++) {
-            laplacian_container[i] = Laplacian();
+void cppgl::LaplacianSmoother::load(const float *data) {
+    const uint32_t c = current;
+    parallel_for(0, adjacency.num_vertices, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t v = begin; v < end; v++) {
+            x[c][v] = data[v * 3 + 0];
+            y[c][v] = data[v * 3 + 1];
+            z[c][v] = data[v * 3 + 2];
         }
-        for (unsigned int i = 0; i < geo->indices_size(); i = i + 3) {
-            for (unsigned int j = 0; j < 3; j++) {
-                int index_cur = geo->get_index(i + (j % 3));
-                int index_next = geo->get_index(i + ((j + 1) % 3));
+    });
+}
 
-                laplacian_container[index_cur].sum += geo->get_position(index_next);
-                laplacian_container[index_next].sum += geo->get_position(index_cur);
-                laplacian_container[index_cur].count++;
-                laplacian_container[index_next].count++;
-            }
+void cppgl::LaplacianSmoother::store(float *data) const {
+    const uint32_t c = current;
+    parallel_for(0, adjacency.num_vertices, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t v = begin; v < end; v++) {
+            data[v * 3 + 0] = x[c][v];
+            data[v * 3 + 1] = y[c][v];
+            data[v * 3 + 2] = z[c][v];
         }
-        for (unsigned int i = 0; i < geo->positions_size(); i++) {
-            if (laplacian_container[i].count > 0) {
-                vec3 laplacian_center =
-                        laplacian_container[i].sum / laplacian_container[i].count;
-                geo->set_position(i, laplacian_center);
-            }
+    });
+}
+
+// write the weighted one-ring centers of [begin, end) from buffer 'src' to buffer 1 - src
+// isolated vertices are their own center
+static void gather_centers(cppgl::LaplacianSmoother &smoother, uint32_t src, uint32_t begin, uint32_t end) {
+    const cppgl::MeshAdjacency &adjacency = smoother.adjacency;
+    const uint32_t *offsets = adjacency.vertex_neighbor_offsets.data();
+    const uint32_t *neighbors = adjacency.vertex_neighbors.data();
+    const float *weights = smoother.weights.data();
+    const float *sx = smoother.x[src].data(), *sy = smoother.y[src].data(), *sz = smoother.z[src].data();
+    float *dx = smoother.x[1 - src].data(), *dy = smoother.y[1 - src].data(), *dz = smoother.z[1 - src].data();
+    for (uint32_t v = begin; v < end; v++) {
+        float ax = 0.f, ay = 0.f, az = 0.f;
+        for (uint32_t k = offsets[v]; k < offsets[v + 1]; k++) {
+            const uint32_t n = neighbors[k];
+            ax += weights[k] * sx[n];
+            ay += weights[k] * sy[n];
+            az += weights[k] * sz[n];
         }
+        const float inv = smoother.inv_weight_sum[v];
+        dx[v] = inv > 0.f ? ax * inv : sx[v];
+        dy[v] = inv > 0.f ? ay * inv : sy[v];
+        dz[v] = inv > 0.f ? az * inv : sz[v];
     }
 }
 
-void cppgl::laplacian_depth_smoothing(
-        cppgl::GeometryBase &geo, uint32_t iter, bool smooth_normals,
-        vec3 view_pos, float constribution) {
-    for (unsigned int k = 0; k < iter; k++) {
-        std::map<uint32_t, Laplacian> laplacian_container;
-        std::map<uint32_t, Laplacian> laplacian_normal_container;
+void cppgl::LaplacianSmoother::step(float lambda) {
+    const uint32_t src = current, dst = 1 - current;
+    const float *sx = x[src].data(), *sy = y[src].data(), *sz = z[src].data();
+    float *dx = x[dst].data(), *dy = y[dst].data(), *dz = z[dst].data();
+    parallel_for(0, adjacency.num_vertices, [&](uint32_t begin, uint32_t end) {
+        gather_centers(*this, src, begin, end);
+        // contiguous blend over the SoA buffers, vectorized by the compiler
+        for (uint32_t v = begin; v < end; v++) {
+            dx[v] = sx[v] + lambda * (dx[v] - sx[v]);
+            dy[v] = sy[v] + lambda * (dy[v] - sy[v]);
+            dz[v] = sz[v] + lambda * (dz[v] - sz[v]);
+        }
+    });
+    current = dst;
+}
 
-        for (unsigned int i = 0; i < geo->positions_size(); i++) {
-            laplacian_container[i] = Laplacian();
-            if (smooth_normals)
-                laplacian_normal_container[i] = Laplacian();
+void cppgl::LaplacianSmoother::depth_step(const vec3 &view_pos, float contribution) {
+    const uint32_t src = current, dst = 1 - current;
+    const float *sx = x[src].data(), *sy = y[src].data(), *sz = z[src].data();
+    float *dx = x[dst].data(), *dy = y[dst].data(), *dz = z[dst].data();
+    const float vx = view_pos.x(), vy = view_pos.y(), vz = view_pos.z();
+    parallel_for(0, adjacency.num_vertices, [&](uint32_t begin, uint32_t end) {
+        gather_centers(*this, src, begin, end);
+        for (uint32_t v = begin; v < end; v++) {
+            float rx = sx[v] - vx, ry = sy[v] - vy, rz = sz[v] - vz;
+            const float len = std::sqrt(rx * rx + ry * ry + rz * rz);
+            const float inv_len = len > 0.f ? 1.f / len : 0.f;
+            rx *= inv_len;
+            ry *= inv_len;
+            rz *= inv_len;
+            const float offset = contribution * (rx * (dx[v] - sx[v]) + ry * (dy[v] - sy[v]) + rz * (dz[v] - sz[v]));
+            dx[v] = sx[v] + rx * offset;
+            dy[v] = sy[v] + ry * offset;
+            dz[v] = sz[v] + rz * offset;
         }
-        for (unsigned int i = 0; i < geo->indices_size(); i = i + 3) {
-            for (unsigned int j = 0; j < 3; j++) {
-                int index_cur = geo->get_index(i + (j % 3));
-                int index_next = geo->get_index(i + ((j + 1) % 3));
+    });
+    current = dst;
+}
 
-                laplacian_container[index_cur].sum += geo->get_position(index_next);
-                laplacian_container[index_next].sum += geo->get_position(index_cur);
-                laplacian_container[index_cur].count++;
-                laplacian_container[index_next].count++;
+void cppgl::LaplacianSmoother::smooth(uint32_t iter, float lambda) {
+    for (uint32_t k = 0; k < iter; k++)
+        step(lambda);
+}
 
-                if (smooth_normals) {
-                    laplacian_normal_container[index_cur].sum +=
-                            geo->get_normal(index_next);
-                    laplacian_normal_container[index_next].sum +=
-                            geo->get_normal(index_cur);
-                    laplacian_normal_container[index_cur].count++;
-                    laplacian_normal_container[index_next].count++;
-                }
-            }
-        }
-        for (unsigned int i = 0; i < geo->positions_size(); i++) {
-            if (laplacian_container[i].count > 0) {
-                vec3 laplacian_center =
-                        laplacian_container[i].sum / laplacian_container[i].count;
-                vec3 view_ray = (geo->get_position(i) - view_pos).normalized();
-                float offset = view_ray.dot(laplacian_center - geo->get_position(i));
-                geo->set_position(
-                        i, geo->get_position(i) + view_ray * offset * constribution);
+void cppgl::LaplacianSmoother::taubin(uint32_t iter, float lambda, float mu) {
+    for (uint32_t k = 0; k < iter; k++) {
+        step(lambda);
+        step(mu);
+    }
+}
 
-                if (smooth_normals) {
-                    vec3 laplacian_center_normal = laplacian_normal_container[i].sum /
-                                                   laplacian_normal_container[i].count;
-                    geo->set_normal(i, laplacian_center_normal);
-                }
-            }
-        }
+void cppgl::laplacian_smoothing(cppgl::GeometryBase &geo,
+                                uint32_t iter) {
+    if (geo->positions_size() == 0 || iter == 0)
+        return;
+    LaplacianSmoother smoother(geo->adjacency());
+    smoother.load(geo->positions_ptr());
+    smoother.smooth(iter, 1.f);
+    smoother.store(geo->positions_ptr());
+    geo->mark_dirty("position");
+}
+
+void cppgl::laplacian_depth_smoothing(
+        cppgl::GeometryBase &geo, uint32_t iter, bool smooth_normals,
+        vec3 view_pos, float constribution) {
+    if (geo->positions_size() == 0 || iter == 0)
+        return;
+    LaplacianSmoother smoother(geo->adjacency());
+    smoother.load(geo->positions_ptr());
+    for (unsigned int k = 0; k < iter; k++)
+        smoother.depth_step(view_pos, constribution);
+    smoother.store(geo->positions_ptr());
+    geo->mark_dirty("position");
+
+    if (smooth_normals) {
+        // same weights, the normals are averaged without renormalization
+        smoother.load(geo->normals_ptr());
+        smoother.smooth(iter, 1.f);
+        smoother.store(geo->normals_ptr());
+        geo->mark_dirty("normal");
     }
-}
\ No newline at end of file
+}
+
+void cppgl::taubin_smoothing(cppgl::GeometryBase &geo, uint32_t iter, float lambda, float mu) {
+    if (geo->positions_size() == 0 || iter == 0)
+        return;
+    LaplacianSmoother smoother(geo->adjacency());
+    smoother.load(geo->positions_ptr());
+    smoother.taubin(iter, lambda, mu);
+    smoother.store(geo->positions_ptr());
+    geo->mark_dirty("position");
+}
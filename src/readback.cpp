@@ -0,0 +1,248 @@
+#include "readback.h"
+#include <atomic>
+#include <iostream>
+
+CPPGL_NAMESPACE_BEGIN
+
+    size_t pixel_size_bytes(GLenum format, GLenum type) {
+        // packed types hold all channels of a pixel
+        switch (type) {
+            case GL_UNSIGNED_INT_24_8:
+            case GL_UNSIGNED_INT_10F_11F_11F_REV:
+            case GL_UNSIGNED_INT_5_9_9_9_REV:
+            case GL_UNSIGNED_INT_2_10_10_10_REV:
+            case GL_UNSIGNED_INT_8_8_8_8:
+            case GL_UNSIGNED_INT_8_8_8_8_REV:
+                return 4;
+            case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+                return 8;
+            default:
+                break;
+        }
+        size_t channels = 1;
+        switch (format) {
+            case GL_RG:
+            case GL_RG_INTEGER:
+                channels = 2;
+                break;
+            case GL_RGB:
+            case GL_BGR:
+            case GL_RGB_INTEGER:
+            case GL_BGR_INTEGER:
+                channels = 3;
+                break;
+            case GL_RGBA:
+            case GL_BGRA:
+            case GL_RGBA_INTEGER:
+            case GL_BGRA_INTEGER:
+                channels = 4;
+                break;
+            default:
+                break;
+        }
+        switch (type) {
+            case GL_SHORT:
+            case GL_UNSIGNED_SHORT:
+            case GL_HALF_FLOAT:
+                return channels * 2;
+            case GL_INT:
+            case GL_UNSIGNED_INT:
+            case GL_FLOAT:
+                return channels * 4;
+            default:
+                return channels;
+        }
+    }
+
+    // pack alignment 1 for the lifetime of the object, our buffers hold tightly packed rows
+    struct PackAlignment {
+        PackAlignment() {
+            glGetIntegerv(GL_PACK_ALIGNMENT, &previous);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        }
+
+        ~PackAlignment() { glPixelStorei(GL_PACK_ALIGNMENT, previous); }
+
+        GLint previous;
+    };
+
+    static GPUReadback::Callback promise_callback(const std::shared_ptr<std::promise<std::vector<uint8_t>>> &promise) {
+        return [promise](const uint8_t *data, size_t size_bytes) {
+            promise->set_value(data ? std::vector<uint8_t>(data, data + size_bytes) : std::vector<uint8_t>());
+        };
+    }
+
+    static std::atomic<uint32_t> readback_counter(0);
+
+    GPUReadback::GPUReadback(uint32_t num_buffers) : id(readback_counter++), slots(std::max(1u, num_buffers)) {
+        for (uint32_t i = 0; i < slots.size(); i++) {
+            slots[i].buffer = PPBO("readback_" + std::to_string(id) + "_" + std::to_string(i));
+            free_slots.push_back(uint32_t(slots.size()) - 1 - i);
+        }
+    }
+
+    GPUReadback::~GPUReadback() {
+        finish();
+        for (auto &slot: slots)
+            slot.buffer.free(true);
+    }
+
+    uint32_t GPUReadback::begin_request(size_t size_bytes) {
+        poll();
+        if (free_slots.empty()) {
+            // every pack buffer is in flight: stall on the oldest request
+            glClientWaitSync(slots[pending.front()].fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            poll();
+        }
+        const uint32_t s = free_slots.back();
+        free_slots.pop_back();
+        Slot &slot = slots[s];
+        if (slot.buffer->size_bytes < size_bytes)
+            slot.buffer->resize(size_bytes, GL_STREAM_READ);
+        slot.size_bytes = size_bytes;
+        return s;
+    }
+
+    void GPUReadback::end_request(uint32_t s, const Callback &callback) {
+        Slot &slot = slots[s];
+        slot.callback = callback;
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // make sure the fence reaches the GPU, otherwise polling never sees it signaled
+        glFlush();
+        pending.push_back(s);
+    }
+
+    void GPUReadback::read_texture(GLenum target, GLuint texture, size_t num_texels, GLenum format, GLenum type,
+                                   const Callback &callback) {
+        const uint32_t s = begin_request(num_texels * pixel_size_bytes(format, type));
+        {
+            const PackAlignment alignment;
+            slots[s].buffer->bind();
+            glBindTexture(target, texture);
+            glGetTexImage(target, 0, format, type, nullptr);
+            glBindTexture(target, 0);
+            slots[s].buffer->unbind();
+        }
+        end_request(s, callback);
+    }
+
+    void GPUReadback::read(const Texture2D &texture, GLenum format, GLenum type, const Callback &callback) {
+        read_texture(GL_TEXTURE_2D, texture->id, size_t(texture->w) * texture->h, format, type, callback);
+    }
+
+    void GPUReadback::read(const Texture3D &texture, GLenum format, GLenum type, const Callback &callback) {
+        read_texture(GL_TEXTURE_3D, texture->id, size_t(texture->w) * texture->h * texture->d, format, type,
+                     callback);
+    }
+
+    void GPUReadback::read(const SSBO &buffer, size_t offset_bytes, size_t size_bytes, const Callback &callback) {
+        const uint32_t s = begin_request(size_bytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer->id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, slots[s].buffer->id);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset_bytes, 0, size_bytes);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        end_request(s, callback);
+    }
+
+    void GPUReadback::read_framebuffer(int x, int y, int w, int h, GLenum format, GLenum type,
+                                       const Callback &callback) {
+        const uint32_t s = begin_request(size_t(w) * h * pixel_size_bytes(format, type));
+        {
+            const PackAlignment alignment;
+            slots[s].buffer->bind();
+            glReadPixels(x, y, w, h, format, type, nullptr);
+            slots[s].buffer->unbind();
+        }
+        end_request(s, callback);
+    }
+
+    std::future<std::vector<uint8_t>> GPUReadback::read(const Texture2D &texture, GLenum format, GLenum type) {
+        auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+        read(texture, format, type, promise_callback(promise));
+        return promise->get_future();
+    }
+
+    std::future<std::vector<uint8_t>> GPUReadback::read(const Texture3D &texture, GLenum format, GLenum type) {
+        auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+        read(texture, format, type, promise_callback(promise));
+        return promise->get_future();
+    }
+
+    std::future<std::vector<uint8_t>> GPUReadback::read(const SSBO &buffer, size_t offset_bytes, size_t size_bytes) {
+        auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+        read(buffer, offset_bytes, size_bytes, promise_callback(promise));
+        return promise->get_future();
+    }
+
+    std::future<std::vector<uint8_t>>
+    GPUReadback::read_framebuffer(int x, int y, int w, int h, GLenum format, GLenum type) {
+        auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+        read_framebuffer(x, y, w, h, format, type, promise_callback(promise));
+        return promise->get_future();
+    }
+
+    void GPUReadback::deliver(uint32_t s) {
+        Slot &slot = slots[s];
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        const Callback callback = std::move(slot.callback);
+        slot.callback = nullptr;
+
+        slot.buffer->bind();
+        const void *data = slot.size_bytes > 0 ? glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size_bytes,
+                                                                  GL_MAP_READ_BIT) : nullptr;
+        if (!data && slot.size_bytes > 0)
+            std::cerr << "WARN: GPUReadback: failed to map " << slot.buffer->name << std::endl;
+        // the callback may issue GL calls (including new readbacks), keep the mapping but release the binding
+        slot.buffer->unbind();
+        const auto release = [&]() {
+            if (data) {
+                slot.buffer->bind();
+                slot.buffer->unmap();
+            }
+            free_slots.push_back(s);
+        };
+        try {
+            if (callback)
+                callback(static_cast<const uint8_t *>(data), data ? slot.size_bytes : 0);
+        } catch (...) {
+            release();
+            throw;
+        }
+        release();
+    }
+
+    void GPUReadback::poll() {
+        while (!pending.empty()) {
+            const uint32_t s = pending.front();
+            const GLenum status = glClientWaitSync(slots[s].fence, 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+                break;
+            if (status == GL_WAIT_FAILED)
+                std::cerr << "WARN: GPUReadback: fence wait failed" << std::endl;
+            pending.pop_front();
+            deliver(s);
+        }
+    }
+
+    void GPUReadback::finish() {
+        while (!pending.empty()) {
+            glClientWaitSync(slots[pending.front()].fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            poll();
+        }
+    }
+
+    static std::unique_ptr<GPUReadback> global_readback;
+
+    GPUReadback &GPUReadback::global() {
+        if (!global_readback)
+            global_readback = std::make_unique<GPUReadback>();
+        return *global_readback;
+    }
+
+    void GPUReadback::shutdown_global() {
+        global_readback.reset();
+    }
+
+CPPGL_NAMESPACE_END
@@ -0,0 +1,186 @@
+#include "render_queue.h"
+#include "material.h"
+#include <algorithm>
+
+CPPGL_NAMESPACE_BEGIN
+
+    // key layout for SortMode::STATE, BACK_TO_FRONT moves the inverted depth to the top
+    static constexpr uint32_t SHADER_BITS = 12, MATERIAL_BITS = 12, MESH_BITS = 16, DEPTH_BITS = 24;
+
+    static inline uint64_t key_bits(uint32_t value, uint32_t bits) {
+        return uint64_t(value) & ((uint64_t(1) << bits) - 1);
+    }
+
+    // LSD radix sort on 8 bit digits, stable, digits equal for all keys are skipped
+    template<typename Item>
+    static void radix_sort(std::vector<Item> &items, std::vector<Item> &buffer) {
+        if (items.size() < 2)
+            return;
+        buffer.resize(items.size());
+        for (uint32_t shift = 0; shift < 64; shift += 8) {
+            size_t offsets[256] = {};
+            for (const Item &item: items)
+                offsets[(item.key >> shift) & 0xff]++;
+            if (offsets[(items[0].key >> shift) & 0xff] == items.size())
+                continue;
+            size_t sum = 0;
+            for (size_t &offset: offsets) {
+                const size_t count = offset;
+                offset = sum;
+                sum += count;
+            }
+            for (const Item &item: items)
+                buffer[offsets[(item.key >> shift) & 0xff]++] = item;
+            items.swap(buffer);
+        }
+    }
+
+    RenderQueue::RenderQueue(SortMode mode) : mode(mode), sorted(false) {}
+
+    void RenderQueue::push(const Drawelement &elem) {
+        if (!elem || elem->disable_render)
+            return;
+        items.push_back(Item{0, &*elem});
+        sorted = false;
+    }
+
+    void RenderQueue::push(const GroupedDrawelements &group) {
+        if (!group || group->disable_render)
+            return;
+        for (const auto &elem: group->elems)
+            push(elem);
+    }
+
+    void RenderQueue::clear() {
+        items.clear();
+        sorted = false;
+    }
+
+    uint32_t RenderQueue::state_id(std::unordered_map<const void *, uint32_t> &ids, const void *state) {
+        auto it = ids.find(state);
+        if (it == ids.end())
+            it = ids.emplace(state, uint32_t(ids.size())).first;
+        return it->second;
+    }
+
+    void RenderQueue::sort(const Camera &cam) {
+        shader_ids.clear();
+        material_ids.clear();
+        mesh_ids.clear();
+        const vec3 cam_pos = cam->pos, cam_dir = cam->dir;
+        const float near = cam->near, depth_scale = float((1u << DEPTH_BITS) - 1) / std::max(cam->far - near, 1e-6f);
+        for (Item &item: items) {
+            const DrawelementImpl *elem = item.elem;
+            const MeshImpl *mesh = elem->mesh.ptr.get();
+            // view depth of the bounding box center, or the origin without CPU geometry
+            vec3 center = elem->model.block<3, 1>(0, 3);
+            if (mesh && mesh->geometry) {
+                const vec3 local = 0.5f * (mesh->geometry->bb_min + mesh->geometry->bb_max);
+                center = elem->model.block<3, 3>(0, 0) * local + center;
+            }
+            const float depth = std::clamp((cam_dir.dot(center - cam_pos) - near) * depth_scale, 0.f,
+                                           float((1u << DEPTH_BITS) - 1));
+            // ids only wrap for thousands of distinct states, which costs batching but never correctness
+            const uint64_t shader = key_bits(state_id(shader_ids, elem->shader.ptr.get()), SHADER_BITS);
+            const uint64_t material = key_bits(state_id(material_ids, mesh ? mesh->material.ptr.get() : nullptr),
+                                               MATERIAL_BITS);
+            const uint64_t mesh_id = key_bits(state_id(mesh_ids, mesh), MESH_BITS);
+            const uint64_t state = (shader << (MATERIAL_BITS + MESH_BITS)) | (material << MESH_BITS) | mesh_id;
+            if (mode == SortMode::STATE)
+                item.key = (state << DEPTH_BITS) | uint64_t(depth);
+            else
+                item.key = (key_bits(uint32_t(depth) ^ ((1u << DEPTH_BITS) - 1), DEPTH_BITS)
+                        << (SHADER_BITS + MATERIAL_BITS + MESH_BITS)) | state;
+        }
+        radix_sort(items, sort_buffer);
+        sorted = true;
+    }
+
+    void RenderQueue::bind_material(const ShaderImpl *shader, const MaterialImpl *material) {
+        stats.material_binds++;
+        // values equal to the previous upload are filtered by the shader's uniform cache
+        for (const auto &entry: material->int_map)
+            shader->uniform(entry.first, entry.second);
+        for (const auto &entry: material->float_map)
+            shader->uniform(entry.first, entry.second);
+        for (const auto &entry: material->vec2_map)
+            shader->uniform(entry.first, entry.second);
+        for (const auto &entry: material->vec3_map)
+            shader->uniform(entry.first, entry.second);
+        for (const auto &entry: material->vec4_map)
+            shader->uniform(entry.first, entry.second);
+        // same unit assignment as MaterialImpl::bind, but textures already bound to their unit are kept
+        uint32_t unit = 0;
+        for (const auto &entry: material->texture_map) {
+            if (bound_textures.size() <= unit)
+                bound_textures.resize(unit + 1, 0);
+            if (entry.second && bound_textures[unit] != entry.second->id) {
+                entry.second->bind(unit);
+                bound_textures[unit] = entry.second->id;
+                stats.texture_binds++;
+            }
+            shader->uniform(entry.first, int(unit++));
+        }
+    }
+
+    void RenderQueue::submit() {
+        if (!sorted)
+            sort();
+        stats = Stats();
+        unsorted_stats = Stats();
+        bound_textures.clear();
+        const ShaderImpl *shader = nullptr;
+        const MaterialImpl *material = nullptr;
+        GLuint vao = 0;
+        for (const Item &item: items) {
+            const DrawelementImpl *elem = item.elem;
+            const ShaderImpl *elem_shader = elem->shader.ptr.get();
+            const MeshImpl *mesh = elem->mesh.ptr.get();
+            const MaterialImpl *elem_material = mesh ? mesh->material.ptr.get() : nullptr;
+            if (!elem_shader)
+                continue;
+            // what DrawelementImpl::bind would have done
+            unsorted_stats.draws++;
+            unsorted_stats.program_binds++;
+            unsorted_stats.vao_binds += mesh ? 1 : 0;
+            unsorted_stats.material_binds += elem_material ? 1 : 0;
+            unsorted_stats.texture_binds += elem_material ? uint32_t(elem_material->texture_map.size()) : 0;
+
+            const bool program_changed = elem_shader != shader;
+            if (program_changed) {
+                elem_shader->bind();
+                shader = elem_shader;
+                material = nullptr;  // material uniforms live in the program
+                stats.program_binds++;
+            }
+            if (mesh && mesh->vao != vao) {
+                glBindVertexArray(mesh->vao);
+                vao = mesh->vao;
+                stats.vao_binds++;
+                mesh->bind_quantization(*shader);
+            } else if (mesh && program_changed) {
+                mesh->bind_quantization(*shader);
+            }
+            if (elem_material && elem_material != material) {
+                bind_material(shader, elem_material);
+                material = elem_material;
+            }
+            elem->upload_transforms();
+            elem->draw();
+            stats.draws++;
+        }
+        if (vao)
+            glBindVertexArray(0);
+        for (uint32_t unit = 0; unit < bound_textures.size(); unit++) {
+            if (bound_textures[unit]) {
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+        }
+        if (!bound_textures.empty())
+            glActiveTexture(GL_TEXTURE0);
+        if (shader)
+            shader->unbind();
+    }
+
+CPPGL_NAMESPACE_END
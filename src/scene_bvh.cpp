@@ -0,0 +1,368 @@
+#include "scene_bvh.h"
+#include "utils/parallel.h"
+#include <algorithm>
+#include <limits>
+
+CPPGL_NAMESPACE_BEGIN
+
+    static const uint32_t NO_INDEX = ~0u;
+    static const uint32_t LEAF_SIZE = 8;
+
+// -------------------------------------------------------------------
+// FrustumPlanes
+// -------------------------------------------------------------------
+
+    FrustumPlanes::FrustumPlanes(const mat4 &view_proj) {
+        // Gribb / Hartmann: left, right, bottom, top, near, far
+        for (int i = 0; i < 3; i++) {
+            planes[2 * i] = view_proj.row(3).transpose() + view_proj.row(i).transpose();
+            planes[2 * i + 1] = view_proj.row(3).transpose() - view_proj.row(i).transpose();
+        }
+        for (vec4 &plane: planes)
+            plane /= std::max(plane.head<3>().norm(), 1e-20f);
+    }
+
+    FrustumPlanes::FrustumPlanes(const Camera &cam) : FrustumPlanes(mat4(cam->proj * cam->view)) {}
+
+    bool FrustumPlanes::intersects(const vec3 &bb_min, const vec3 &bb_max) const {
+        for (const vec4 &p: planes) {
+            // corner furthest along the plane normal
+            const float d = p.x() * (p.x() >= 0 ? bb_max.x() : bb_min.x()) +
+                            p.y() * (p.y() >= 0 ? bb_max.y() : bb_min.y()) +
+                            p.z() * (p.z() >= 0 ? bb_max.z() : bb_min.z()) + p.w();
+            if (d < 0)
+                return false;
+        }
+        return true;
+    }
+
+    // 0: outside, 1: intersecting, 2: inside
+    static int classify(const FrustumPlanes &frustum, const float *bb_min, const float *bb_max) {
+        int result = 2;
+        for (const vec4 &p: frustum.planes) {
+            const float *far_corner[3] = {p.x() >= 0 ? bb_max : bb_min, p.y() >= 0 ? bb_max : bb_min,
+                                          p.z() >= 0 ? bb_max : bb_min};
+            const float *near_corner[3] = {p.x() >= 0 ? bb_min : bb_max, p.y() >= 0 ? bb_min : bb_max,
+                                           p.z() >= 0 ? bb_min : bb_max};
+            if (p.x() * far_corner[0][0] + p.y() * far_corner[1][1] + p.z() * far_corner[2][2] + p.w() < 0)
+                return 0;
+            if (p.x() * near_corner[0][0] + p.y() * near_corner[1][1] + p.z() * near_corner[2][2] + p.w() < 0)
+                result = 1;
+        }
+        return result;
+    }
+
+    // world space box of the element's geometry, false without CPU geometry
+    static bool world_bounds(const DrawelementImpl &elem, vec3 &bb_min, vec3 &bb_max) {
+        if (!elem.mesh || !elem.mesh->geometry)
+            return false;
+        const vec3 &local_min = elem.mesh->geometry->bb_min, &local_max = elem.mesh->geometry->bb_max;
+        const vec3 center = 0.5f * (local_min + local_max), extent = 0.5f * (local_max - local_min);
+        const vec3 world_center = elem.model.block<3, 3>(0, 0) * center + elem.model.block<3, 1>(0, 3);
+        const vec3 world_extent = elem.model.block<3, 3>(0, 0).cwiseAbs() * extent;
+        bb_min = world_center - world_extent;
+        bb_max = world_center + world_extent;
+        return true;
+    }
+
+// -------------------------------------------------------------------
+// SceneBVH
+// -------------------------------------------------------------------
+
+    SceneBVH::SceneBVH() : parallel_threshold(1u << 15), needs_build(false) {}
+
+    SceneBVH::~SceneBVH() {
+        clear();
+    }
+
+    void SceneBVH::insert(const Drawelement &elem) {
+        Drawelement handle = elem;
+        if (handle->scene_bvh == this)
+            return;
+        if (handle->scene_bvh)
+            throw std::runtime_error("SceneBVH: " + handle->name + " is already part of another SceneBVH");
+        handle->scene_bvh = this;
+        handle->scene_bvh_index = uint32_t(elements.size());
+        elements.push_back(handle);
+        needs_build = true;
+    }
+
+    void SceneBVH::remove(const Drawelement &elem) {
+        Drawelement handle = elem;
+        if (handle->scene_bvh != this)
+            return;
+        const uint32_t index = handle->scene_bvh_index;
+        handle->scene_bvh = nullptr;
+        if (index + 1 < elements.size()) {
+            elements[index] = elements.back();
+            elements[index]->scene_bvh_index = index;
+        }
+        elements.pop_back();
+        needs_build = true;
+    }
+
+    void SceneBVH::insert_all() {
+        clear();
+        elements.reserve(Drawelement::map.size());
+        for (const auto &[name, elem]: Drawelement::map)
+            insert(elem);
+    }
+
+    void SceneBVH::clear() {
+        for (auto &elem: elements)
+            elem->scene_bvh = nullptr;
+        elements.clear();
+        nodes.clear();
+        dirty.clear();
+        dirty_flags.clear();
+        visible.clear();
+        needs_build = true;
+    }
+
+    void SceneBVH::mark_dirty(const Drawelement &elem) {
+        if (elem->scene_bvh == this)
+            mark_dirty(elem->scene_bvh_index);
+    }
+
+    void SceneBVH::mark_dirty(uint32_t index) {
+        if (needs_build || index >= dirty_flags.size() || dirty_flags[index])
+            return;
+        dirty_flags[index] = 1;
+        dirty.push_back(index);
+    }
+
+    void SceneBVH::rebuild() {
+        needs_build = true;
+    }
+
+    void SceneBVH::compute_bounds(uint32_t slot) {
+        vec3 bb_min, bb_max;
+        if (!world_bounds(*elements[slot_element[slot]], bb_min, bb_max)) {
+            // geometry was removed: keep the element visible
+            bb_min = vec3::Constant(-std::numeric_limits<float>::max());
+            bb_max = vec3::Constant(std::numeric_limits<float>::max());
+        }
+        for (int a = 0; a < 3; a++) {
+            slot_min[a][slot] = bb_min[a];
+            slot_max[a][slot] = bb_max[a];
+        }
+    }
+
+    void SceneBVH::build() {
+        const uint32_t n = uint32_t(elements.size());
+        nodes.clear();
+        parents.clear();
+        unbounded.clear();
+        element_slot.assign(n, NO_INDEX);
+        dirty.clear();
+        dirty_flags.assign(n, 0);
+        needs_build = false;
+
+        std::vector<vec3> box_min(n), box_max(n);
+        std::vector<uint8_t> bounded(n);
+        parallel_for(0, n, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++)
+                bounded[i] = world_bounds(*elements[i], box_min[i], box_max[i]);
+        });
+        std::vector<uint32_t> order;
+        order.reserve(n);
+        for (uint32_t i = 0; i < n; i++)
+            (bounded[i] ? order : unbounded).push_back(i);
+        const uint32_t num_slots = uint32_t(order.size());
+        if (num_slots == 0)
+            return;
+
+        // top-down median split along the longest axis of the centroid bounds, children are allocated in pairs
+        nodes.reserve(2 * (num_slots / LEAF_SIZE + 1));
+        nodes.push_back(Node{{0, 0, 0}, {0, 0, 0}, 0, num_slots});
+        parents.push_back(NO_INDEX);
+        std::vector<uint32_t> stack = {0};
+        while (!stack.empty()) {
+            const uint32_t node = stack.back();
+            stack.pop_back();
+            const uint32_t first = nodes[node].first, count = nodes[node].count;
+            if (count <= LEAF_SIZE)
+                continue;
+            vec3 c_min = vec3::Constant(std::numeric_limits<float>::max()), c_max = -c_min;
+            for (uint32_t k = first; k < first + count; k++) {
+                const vec3 c = box_min[order[k]] + box_max[order[k]];
+                c_min = c_min.cwiseMin(c);
+                c_max = c_max.cwiseMax(c);
+            }
+            int axis = 0;
+            (c_max - c_min).maxCoeff(&axis);
+            const uint32_t mid = first + count / 2;
+            std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + first + count,
+                             [&](uint32_t a, uint32_t b) {
+                                 return box_min[a][axis] + box_max[a][axis] < box_min[b][axis] + box_max[b][axis];
+                             });
+            const uint32_t left = uint32_t(nodes.size());
+            nodes.push_back(Node{{0, 0, 0}, {0, 0, 0}, first, mid - first});
+            nodes.push_back(Node{{0, 0, 0}, {0, 0, 0}, mid, first + count - mid});
+            parents.push_back(node);
+            parents.push_back(node);
+            nodes[node].first = left;
+            nodes[node].count = 0;
+            stack.push_back(left + 1);
+            stack.push_back(left);
+        }
+
+        slot_element = order;
+        slot_leaf.assign(num_slots, 0);
+        for (int a = 0; a < 3; a++) {
+            slot_min[a].resize(num_slots);
+            slot_max[a].resize(num_slots);
+        }
+        for (uint32_t s = 0; s < num_slots; s++) {
+            element_slot[order[s]] = s;
+            for (int a = 0; a < 3; a++) {
+                slot_min[a][s] = box_min[order[s]][a];
+                slot_max[a][s] = box_max[order[s]][a];
+            }
+        }
+        for (uint32_t node = 0; node < nodes.size(); node++)
+            for (uint32_t s = nodes[node].first; nodes[node].count && s < nodes[node].first + nodes[node].count; s++)
+                slot_leaf[s] = node;
+        // children have larger indices than their parent
+        for (uint32_t node = uint32_t(nodes.size()); node-- > 0;)
+            refit_node(node);
+    }
+
+    void SceneBVH::refit_node(uint32_t index) {
+        Node &node = nodes[index];
+        for (int a = 0; a < 3; a++) {
+            float lo, hi;
+            if (node.count) {
+                lo = *std::min_element(&slot_min[a][node.first], &slot_min[a][node.first] + node.count);
+                hi = *std::max_element(&slot_max[a][node.first], &slot_max[a][node.first] + node.count);
+            } else {
+                lo = std::min(nodes[node.first].bb_min[a], nodes[node.first + 1].bb_min[a]);
+                hi = std::max(nodes[node.first].bb_max[a], nodes[node.first + 1].bb_max[a]);
+            }
+            node.bb_min[a] = lo;
+            node.bb_max[a] = hi;
+        }
+    }
+
+    void SceneBVH::refit() {
+        if (dirty.size() > elements.size() / 8) {
+            // many moved: recompute everything, cheaper than walking up from every element
+            parallel_for(0, uint32_t(slot_element.size()), [&](uint32_t begin, uint32_t end) {
+                for (uint32_t s = begin; s < end; s++)
+                    compute_bounds(s);
+            });
+            for (uint32_t node = uint32_t(nodes.size()); node-- > 0;)
+                refit_node(node);
+        } else {
+            for (uint32_t index: dirty) {
+                const uint32_t slot = element_slot[index];
+                if (slot == NO_INDEX)
+                    continue;
+                compute_bounds(slot);
+                for (uint32_t node = slot_leaf[slot]; node != NO_INDEX; node = parents[node])
+                    refit_node(node);
+            }
+        }
+        for (uint32_t index: dirty)
+            dirty_flags[index] = 0;
+        dirty.clear();
+    }
+
+    void SceneBVH::cull_leaf(const FrustumPlanes &frustum, const Node &leaf, bool inside,
+                             std::vector<uint32_t> &out) const {
+        const uint32_t first = leaf.first, count = leaf.count;
+        uint8_t mask[LEAF_SIZE];
+        for (uint32_t k = 0; k < count; k++)
+            mask[k] = 1;
+        if (!inside) {
+            for (const vec4 &p: frustum.planes) {
+                // the corner furthest along the normal is selected once per plane, the loop itself is branch-free
+                const float *xs = (p.x() >= 0 ? slot_max[0] : slot_min[0]).data() + first;
+                const float *ys = (p.y() >= 0 ? slot_max[1] : slot_min[1]).data() + first;
+                const float *zs = (p.z() >= 0 ? slot_max[2] : slot_min[2]).data() + first;
+                for (uint32_t k = 0; k < count; k++)
+                    mask[k] &= uint8_t(p.x() * xs[k] + p.y() * ys[k] + p.z() * zs[k] + p.w() >= 0);
+            }
+        }
+        for (uint32_t k = 0; k < count; k++) {
+            const uint32_t index = slot_element[first + k];
+            if (mask[k] && !elements[index]->disable_render)
+                out.push_back(index);
+        }
+    }
+
+    void SceneBVH::cull_subtree(const FrustumPlanes &frustum, uint32_t root, std::vector<uint32_t> &out) const {
+        // node index and whether an ancestor was already completely inside
+        std::vector<std::pair<uint32_t, bool>> stack = {{root, false}};
+        while (!stack.empty()) {
+            const auto [index, parent_inside] = stack.back();
+            stack.pop_back();
+            const Node &node = nodes[index];
+            bool inside = parent_inside;
+            if (!inside) {
+                const int result = classify(frustum, node.bb_min, node.bb_max);
+                if (result == 0)
+                    continue;
+                inside = result == 2;
+            }
+            if (node.count) {
+                cull_leaf(frustum, node, inside, out);
+            } else {
+                stack.emplace_back(node.first + 1, inside);
+                stack.emplace_back(node.first, inside);
+            }
+        }
+    }
+
+    const std::vector<uint32_t> &SceneBVH::cull(const FrustumPlanes &frustum) {
+        if (needs_build)
+            build();
+        else if (!dirty.empty())
+            refit();
+        visible.clear();
+        if (!nodes.empty()) {
+            if (elements.size() < parallel_threshold) {
+                cull_subtree(frustum, 0, visible);
+            } else {
+                // expand the top of the tree into enough subtrees to keep every thread busy, in traversal order
+                std::vector<uint32_t> frontier = {0};
+                const size_t target = 4 * size_t(parallel_num_threads());
+                while (frontier.size() < target) {
+                    std::vector<uint32_t> next;
+                    for (uint32_t node: frontier) {
+                        if (nodes[node].count) {
+                            next.push_back(node);
+                        } else {
+                            next.push_back(nodes[node].first);
+                            next.push_back(nodes[node].first + 1);
+                        }
+                    }
+                    if (next.size() == frontier.size())
+                        break;
+                    frontier.swap(next);
+                }
+                std::vector<std::vector<uint32_t>> results(frontier.size());
+                parallel_for(0, uint32_t(frontier.size()), [&](uint32_t begin, uint32_t end) {
+                    for (uint32_t i = begin; i < end; i++)
+                        cull_subtree(frustum, frontier[i], results[i]);
+                }, 1);
+                for (const auto &result: results)
+                    visible.insert(visible.end(), result.begin(), result.end());
+            }
+        }
+        for (uint32_t index: unbounded)
+            if (!elements[index]->disable_render)
+                visible.push_back(index);
+        return visible;
+    }
+
+    const std::vector<uint32_t> &SceneBVH::cull(const Camera &cam) {
+        return cull(FrustumPlanes(cam));
+    }
+
+    void SceneBVH::cull(RenderQueue &queue, const Camera &cam) {
+        for (uint32_t index: cull(cam))
+            queue.push(elements[index]);
+    }
+
+CPPGL_NAMESPACE_END
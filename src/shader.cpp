@@ -1,7 +1,11 @@
 #include "shader.h"
+#include "frame_uniforms.h"
+#include "draw_batch.h"
+#include "drawelement.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstring>
 #include <algorithm>
 
 CPPGL_NAMESPACE_BEGIN
@@ -46,6 +50,52 @@ CPPGL_NAMESPACE_BEGIN
         return error_string;
     }
 
+    // insert the FrameUniforms, DrawBatch and instancing declarations after #version and #extension,
+    // unless already declared
+    static void declare_builtin_blocks(GLenum type, std::string &source) {
+        const size_t version_at = source.find("#version");
+        if (version_at == std::string::npos)
+            return;
+        const long version = std::strtol(source.c_str() + version_at + 8, nullptr, 10);
+        std::string declarations;
+        // uniform blocks need GLSL 140. only shaders reading them get them: drivers keep std140 blocks active even
+        // when unused, and DrawelementImpl::bind writes the per-draw block for every shader that has it
+        if (version >= 140 && source.find("cppgl_frame") != std::string::npos &&
+            source.find("CppglFrame") == std::string::npos)
+            declarations += FrameUniforms::GLSL_DECLARATION;
+        if (version >= 140 && source.find("cppgl_object") != std::string::npos &&
+            source.find("CppglObject") == std::string::npos)
+            declarations += FrameUniforms::GLSL_OBJECT_DECLARATION;
+        // storage buffers need GLSL 430, only shaders written for batching get them
+        if (version >= 430 && source.find("cppgl_draw") != std::string::npos &&
+            source.find("CppglDraws") == std::string::npos) {
+            declarations += DrawBatch::GLSL_DECLARATION;
+            if (type == GL_VERTEX_SHADER)
+                declarations += DrawBatch::GLSL_VERTEX_DECLARATION;
+        }
+        // explicit attribute locations need GLSL 330
+        if (type == GL_VERTEX_SHADER && version >= 330 && source.find("cppgl_instance") != std::string::npos)
+            declarations += InstancedDrawelementImpl::GLSL_VERTEX_DECLARATION;
+        // uniform initializers need GLSL 120
+        if (version >= 120 && (source.find("cppgl_dequantize") != std::string::npos ||
+                               source.find("cppgl_oct_decode") != std::string::npos) &&
+            source.find("cppgl_position_min") == std::string::npos)
+            declarations += VertexLayout::GLSL_DECLARATION;
+        if (declarations.empty())
+            return;
+        size_t insert_at = version_at;
+        for (size_t at = version_at; at != std::string::npos; at = source.find("#extension", at + 1))
+            insert_at = at;
+        insert_at = source.find('\n', insert_at);
+        if (insert_at == std::string::npos)
+            return;
+        // restore the numbering of the following lines, so compiler errors point into the file.
+        // before GLSL 330, #line n numbers the next line n + 1
+        const long next_line = long(std::count(source.begin(), source.begin() + insert_at + 1, '\n')) + 1;
+        declarations += "#line " + std::to_string(version >= 330 ? next_line : next_line - 1) + "\n";
+        source.insert(insert_at + 1, declarations);
+    }
+
     static GLuint compile_shader(GLenum type, ShaderImpl &impl) {
         std::cout << "Loading: " << impl.source_files[type] << "..." << std::endl;
         std::string source = read_file(impl.source_files[type]);
@@ -90,6 +140,10 @@ CPPGL_NAMESPACE_BEGIN
             impl.include_timestamps[p] = fs::last_write_time(p);
         }
 
+        // error lines refer to the source without the builtin declarations
+        const std::string file_source = source;
+        declare_builtin_blocks(type, source);
+
         // actually compile shader
         GLuint shader = glCreateShader(type);
         const char *src = source.c_str();
@@ -119,7 +173,7 @@ CPPGL_NAMESPACE_BEGIN
                 }
             }
             // print relevant lines
-            std::stringstream stream(source);
+            std::stringstream stream(file_source);
             int line = 1;
             while (!stream.eof()) {
                 getline(stream, out);
@@ -144,22 +198,31 @@ CPPGL_NAMESPACE_BEGIN
 // ----------------------------------------------------
 // ShaderImpl
 
-    ShaderImpl::ShaderImpl(const std::string &name) : name(name), id(0) {}
+    ShaderImpl::ShaderImpl(const std::string &name)
+            : name(name), id(0), work_group_size(ivec3(1, 1, 1)), object_block(false), draws_block(false),
+              dequantizes(false), skipped_uploads(0) {
+        // slots 0..8, see ShaderImpl::MODEL etc. and ShaderImpl::POSITION_MIN etc.
+        for (const char *builtin: {"model", "model_normal", "view", "view_normal", "proj", "cppgl_position_min",
+                                   "cppgl_position_extent", "cppgl_texcoord_min", "cppgl_texcoord_extent"}) {
+            uniform_table.emplace(builtin, uint32_t(uniform_slots.size()));
+            uniform_slots.push_back(UniformSlot{builtin, -1, 0, 0});
+        }
+    }
 
-    ShaderImpl::ShaderImpl(const std::string &name, const fs::path &compute_source) : name(name), id(0) {
+    ShaderImpl::ShaderImpl(const std::string &name, const fs::path &compute_source) : ShaderImpl(name) {
         set_compute_source(compute_source);
         compile();
     }
 
     ShaderImpl::ShaderImpl(const std::string &name, const fs::path &vertex_source, const fs::path &fragment_source)
-            : name(name), id(0) {
+            : ShaderImpl(name) {
         set_vertex_source(vertex_source);
         set_fragment_source(fragment_source);
         compile();
     }
 
     ShaderImpl::ShaderImpl(const std::string &name, const fs::path &vertex_source, const fs::path &geometry_source,
-                           const fs::path &fragment_source) : name(name), id(0) {
+                           const fs::path &fragment_source) : ShaderImpl(name) {
         set_vertex_source(vertex_source);
         set_geometry_source(geometry_source);
         set_fragment_source(fragment_source);
@@ -176,6 +239,14 @@ CPPGL_NAMESPACE_BEGIN
         id = 0;
         source_files.clear();
         timestamps.clear();
+        for (auto &slot: uniform_slots)
+            slot.location = -1;
+        uniform_shadows.clear();
+        uniform_blocks.clear();
+        storage_blocks.clear();
+        object_block = false;
+        draws_block = false;
+        dequantizes = false;
     }
 
     void ShaderImpl::bind() const { glUseProgram(id); }
@@ -298,11 +369,144 @@ CPPGL_NAMESPACE_BEGIN
         if (glIsProgram(id))
             glDeleteProgram(id);
         id = program;
+        reflect();
+    }
+
+    void ShaderImpl::reflect() {
+        // names keep their slots across reloads, so handles stay valid; the new program starts with fresh values
+        for (auto &slot: uniform_slots) {
+            slot.location = -1;
+            slot.type = 0;
+            slot.array_size = 0;
+        }
+        uniform_shadows.clear();
+        uniform_blocks.clear();
+        storage_blocks.clear();
+
+        // the program resource queries are GL 4.3, lower versions crash on the null entry points
+        if (GLEW_VERSION_4_3 || GLEW_ARB_program_interface_query)
+            reflect_resources();
+        else
+            reflect_legacy();
+
+        // GLSL < 420 cannot declare binding points, so the FrameUniforms blocks are bound here
+        for (const auto &[block_name, binding]: {std::make_pair("CppglFrame", FrameUniforms::FRAME_BINDING),
+                                                 std::make_pair("CppglObject", FrameUniforms::OBJECT_BINDING)}) {
+            const auto it = uniform_blocks.find(block_name);
+            if (it != uniform_blocks.end()) {
+                glUniformBlockBinding(id, it->second.index, binding);
+                it->second.binding = GLint(binding);
+            }
+        }
+        object_block = uniform_blocks.count("CppglObject") > 0;
+        const auto draws = storage_blocks.find("CppglDraws");
+        if (draws != storage_blocks.end()) {
+            glShaderStorageBlockBinding(id, draws->second.index, DrawBatch::DRAWS_BINDING);
+            draws->second.binding = GLint(DrawBatch::DRAWS_BINDING);
+        }
+        draws_block = draws != storage_blocks.end();
+
+        // names the reflection does not report (e.g. single array elements) are resolved by the driver once
+        for (auto &slot: uniform_slots)
+            if (slot.type == 0)
+                slot.location = glGetUniformLocation(id, slot.name.c_str());
+
+        // lets meshes skip the dequantization uniforms for all other shaders
+        const auto ends_with = [](const std::string &str, const std::string &suffix) {
+            return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+        };
+        dequantizes = false;
+        for (const auto &slot: uniform_slots)
+            if (slot.location >= 0 && slot.name.rfind("cppgl_", 0) == 0 &&
+                (ends_with(slot.name, "_min") || ends_with(slot.name, "_extent")))
+                dequantizes = true;
+
+        if (source_files.count(GL_COMPUTE_SHADER))
+            glGetProgramiv(id, GL_COMPUTE_WORK_GROUP_SIZE, &work_group_size.x());
+    }
+
+    void ShaderImpl::set_uniform_slot(const std::string &name, GLint location, GLenum type, GLint array_size) {
+        auto it = uniform_table.find(name);
+        if (it == uniform_table.end()) {
+            it = uniform_table.emplace(name, uint32_t(uniform_slots.size())).first;
+            uniform_slots.push_back(UniformSlot{name, -1, 0, 0});
+        }
+        UniformSlot &slot = uniform_slots[it->second];
+        slot.location = location;
+        slot.type = type;
+        slot.array_size = array_size;
+        // arrays are reported as "name[0]", the plain name refers to the same location
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            set_uniform_slot(name.substr(0, name.size() - 3), location, type, array_size);
+    }
+
+    void ShaderImpl::reflect_resources() {
+        std::vector<char> name_buffer;
+        const auto resource_name = [&](GLenum interface, GLint index, GLint length) {
+            name_buffer.resize(std::max(1, length));
+            glGetProgramResourceName(id, interface, index, GLsizei(name_buffer.size()), nullptr, name_buffer.data());
+            return std::string(name_buffer.data());
+        };
+
+        // default block uniforms
+        GLint num_uniforms = 0;
+        glGetProgramInterfaceiv(id, GL_UNIFORM, GL_ACTIVE_RESOURCES, &num_uniforms);
+        const GLenum uniform_props[] = {GL_NAME_LENGTH, GL_TYPE, GL_ARRAY_SIZE, GL_LOCATION, GL_BLOCK_INDEX};
+        for (GLint i = 0; i < num_uniforms; i++) {
+            GLint values[5];
+            glGetProgramResourceiv(id, GL_UNIFORM, i, 5, uniform_props, 5, nullptr, values);
+            if (values[4] != -1 || values[3] < 0)
+                continue; // member of a uniform block
+            set_uniform_slot(resource_name(GL_UNIFORM, i, values[0]), values[3], GLenum(values[1]), values[2]);
+        }
+
+        // uniform and shader storage blocks
+        const GLenum block_props[] = {GL_NAME_LENGTH, GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE};
+        for (const auto &[interface, blocks]: {std::make_pair(GL_UNIFORM_BLOCK, &uniform_blocks),
+                                               std::make_pair(GL_SHADER_STORAGE_BLOCK, &storage_blocks)}) {
+            GLint num_blocks = 0;
+            glGetProgramInterfaceiv(id, interface, GL_ACTIVE_RESOURCES, &num_blocks);
+            for (GLint i = 0; i < num_blocks; i++) {
+                GLint values[3];
+                glGetProgramResourceiv(id, interface, i, 3, block_props, 3, nullptr, values);
+                (*blocks)[resource_name(interface, i, values[0])] = BlockInfo{GLuint(i), values[1], values[2]};
+            }
+        }
+    }
+
+    void ShaderImpl::reflect_legacy() {
+        GLint num_uniforms = 0, max_length = 0;
+        glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &num_uniforms);
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+        std::vector<char> name_buffer(std::max(1, max_length));
+        for (GLint i = 0; i < num_uniforms; i++) {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(id, GLuint(i), GLsizei(name_buffer.size()), nullptr, &size, &type, name_buffer.data());
+            // block members have no location
+            const GLint location = glGetUniformLocation(id, name_buffer.data());
+            if (location >= 0)
+                set_uniform_slot(name_buffer.data(), location, type, size);
+        }
+
+        // uniform blocks need GL 3.1, shader storage blocks GL 4.3
+        if (!GLEW_VERSION_3_1 && !GLEW_ARB_uniform_buffer_object)
+            return;
+        GLint num_blocks = 0;
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &num_blocks);
+        for (GLint i = 0; i < num_blocks; i++) {
+            GLint length = 0, binding = 0, size_bytes = 0;
+            glGetActiveUniformBlockiv(id, GLuint(i), GL_UNIFORM_BLOCK_NAME_LENGTH, &length);
+            glGetActiveUniformBlockiv(id, GLuint(i), GL_UNIFORM_BLOCK_BINDING, &binding);
+            glGetActiveUniformBlockiv(id, GLuint(i), GL_UNIFORM_BLOCK_DATA_SIZE, &size_bytes);
+            name_buffer.resize(std::max(1, length));
+            glGetActiveUniformBlockName(id, GLuint(i), GLsizei(name_buffer.size()), nullptr, name_buffer.data());
+            uniform_blocks[name_buffer.data()] = BlockInfo{GLuint(i), binding, size_bytes};
+        }
     }
 
     void ShaderImpl::dispatch_compute(uint32_t w, uint32_t h, uint32_t d, GLbitfield memory_barrier_bits) const {
-        ivec3 size;
-        glGetProgramiv(id, GL_COMPUTE_WORK_GROUP_SIZE, &size.x());
+        const ivec3 &size = work_group_size;
         glDispatchCompute(int(ceil(w / float(size.x()))), int(ceil(h / float(size.y()))),
                           int(ceil(d / float(size.z()))));
         if (memory_barrier_bits != 0)
@@ -310,100 +514,225 @@ CPPGL_NAMESPACE_BEGIN
     }
 
     void ShaderImpl::uniform(const std::string &name, int val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform1i(loc, val);
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, int *val, uint32_t count) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform1iv(loc, count, val);
+        uniform(uniform_handle(name), val, count);
     }
 
     void ShaderImpl::uniform(const std::string &name, uint32_t val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform1ui(loc, val);
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, uint32_t *val, uint32_t count) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform1uiv(loc, count, val);
+        uniform(uniform_handle(name), val, count);
     }
 
     void ShaderImpl::uniform(const std::string &name, float val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform1f(loc, val);
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, float *val, uint32_t count) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform1fv(loc, count, val);
+        uniform(uniform_handle(name), val, count);
     }
 
     void ShaderImpl::uniform(const std::string &name, const vec2 &val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform2f(loc, val.x(), val.y());
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, const vec3 &val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform3f(loc, val.x(), val.y(), val.z());
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, const vec4 &val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform4f(loc, val.x(), val.y(), val.z(), val.w());
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, const ivec2 &val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform2i(loc, val.x(), val.y());
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, const ivec3 &val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform3i(loc, val.x(), val.y(), val.z());
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, const ivec4 &val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform4i(loc, val.x(), val.y(), val.z(), val.w());
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, const uvec2 &val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform2ui(loc, val.x(), val.y());
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, const uvec3 &val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform3ui(loc, val.x(), val.y(), val.z());
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, const uvec4 &val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniform4ui(loc, val.x(), val.y(), val.z(), val.w());
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, const mat3 &val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniformMatrix3fv(loc, 1, GL_FALSE, val.data());
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, const mat4 &val) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        glUniformMatrix4fv(loc, 1, GL_FALSE, val.data());
+        uniform(uniform_handle(name), val);
     }
 
     void ShaderImpl::uniform(const std::string &name, const Texture2D &tex, uint32_t unit) const {
-        int loc = glGetUniformLocation(id, name.c_str());
-        tex->bind(unit);
-        glUniform1i(loc, unit);
+        uniform(uniform_handle(name), tex, unit);
     }
 
     void ShaderImpl::uniform(const std::string &name, const Texture3D &tex, uint32_t unit) const {
-        int loc = glGetUniformLocation(id, name.c_str());
+        uniform(uniform_handle(name), tex, unit);
+    }
+
+    UniformHandle ShaderImpl::uniform_handle(const std::string &name) const {
+        const auto it = uniform_table.find(name);
+        if (it != uniform_table.end())
+            return UniformHandle{it->second};
+        const uint32_t slot = uint32_t(uniform_slots.size());
+        const GLint location = glIsProgram(id) ? glGetUniformLocation(id, name.c_str()) : -1;
+        uniform_slots.push_back(UniformSlot{name, location, 0, 0});
+        uniform_table.emplace(name, slot);
+        return UniformHandle{slot};
+    }
+
+    bool ShaderImpl::needs_upload(UniformHandle handle, const void *data, size_t size_bytes, uint32_t count) const {
+        const GLint location = uniform_slots[handle.slot].location;
+        if (location < 0)
+            return false;
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        auto it = uniform_shadows.lower_bound(location);
+        if (it != uniform_shadows.end() && it->first == location && it->second.count == count &&
+            it->second.bytes.size() == size_bytes && std::memcmp(it->second.bytes.data(), data, size_bytes) == 0) {
+            skipped_uploads++;
+            return false;
+        }
+        // drop the shadows this upload overlaps: an array upload starting before it, single elements inside it
+        if (it != uniform_shadows.begin() && std::prev(it)->first + GLint(std::prev(it)->second.count) > location)
+            uniform_shadows.erase(std::prev(it));
+        while (it != uniform_shadows.end() && it->first < location + GLint(count))
+            it = uniform_shadows.erase(it);
+        uniform_shadows.emplace_hint(it, location,
+                                     UniformShadow{count, std::vector<uint8_t>(bytes, bytes + size_bytes)});
+        return true;
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, int val) const {
+        if (needs_upload(handle, &val, sizeof(val)))
+            glUniform1i(location(handle), val);
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, int *val, uint32_t count) const {
+        if (needs_upload(handle, val, sizeof(int) * count, count))
+            glUniform1iv(location(handle), count, val);
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, uint32_t val) const {
+        if (needs_upload(handle, &val, sizeof(val)))
+            glUniform1ui(location(handle), val);
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, uint32_t *val, uint32_t count) const {
+        if (needs_upload(handle, val, sizeof(uint32_t) * count, count))
+            glUniform1uiv(location(handle), count, val);
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, float val) const {
+        if (needs_upload(handle, &val, sizeof(val)))
+            glUniform1f(location(handle), val);
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, float *val, uint32_t count) const {
+        if (needs_upload(handle, val, sizeof(float) * count, count))
+            glUniform1fv(location(handle), count, val);
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const vec2 &val) const {
+        if (needs_upload(handle, val.data(), sizeof(val)))
+            glUniform2f(location(handle), val.x(), val.y());
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const vec3 &val) const {
+        if (needs_upload(handle, val.data(), sizeof(val)))
+            glUniform3f(location(handle), val.x(), val.y(), val.z());
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const vec4 &val) const {
+        if (needs_upload(handle, val.data(), sizeof(val)))
+            glUniform4f(location(handle), val.x(), val.y(), val.z(), val.w());
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const ivec2 &val) const {
+        if (needs_upload(handle, val.data(), sizeof(val)))
+            glUniform2i(location(handle), val.x(), val.y());
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const ivec3 &val) const {
+        if (needs_upload(handle, val.data(), sizeof(val)))
+            glUniform3i(location(handle), val.x(), val.y(), val.z());
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const ivec4 &val) const {
+        if (needs_upload(handle, val.data(), sizeof(val)))
+            glUniform4i(location(handle), val.x(), val.y(), val.z(), val.w());
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const uvec2 &val) const {
+        if (needs_upload(handle, val.data(), sizeof(val)))
+            glUniform2ui(location(handle), val.x(), val.y());
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const uvec3 &val) const {
+        if (needs_upload(handle, val.data(), sizeof(val)))
+            glUniform3ui(location(handle), val.x(), val.y(), val.z());
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const uvec4 &val) const {
+        if (needs_upload(handle, val.data(), sizeof(val)))
+            glUniform4ui(location(handle), val.x(), val.y(), val.z(), val.w());
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const mat3 &val) const {
+        if (needs_upload(handle, val.data(), sizeof(val)))
+            glUniformMatrix3fv(location(handle), 1, GL_FALSE, val.data());
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const mat4 &val) const {
+        if (needs_upload(handle, val.data(), sizeof(val)))
+            glUniformMatrix4fv(location(handle), 1, GL_FALSE, val.data());
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const Texture2D &tex, uint32_t unit) const {
         tex->bind(unit);
-        glUniform1i(loc, unit);
+        const int val = int(unit);
+        if (needs_upload(handle, &val, sizeof(val)))
+            glUniform1i(location(handle), val);
+    }
+
+    void ShaderImpl::uniform(UniformHandle handle, const Texture3D &tex, uint32_t unit) const {
+        tex->bind(unit);
+        const int val = int(unit);
+        if (needs_upload(handle, &val, sizeof(val)))
+            glUniform1i(location(handle), val);
+    }
+
+    GLint ShaderImpl::uniform_location(const std::string &name) const {
+        const auto it = uniform_table.find(name);
+        return it != uniform_table.end() ? uniform_slots[it->second].location : -1;
+    }
+
+    GLint ShaderImpl::uniform_block_binding(const std::string &name) const {
+        const auto it = uniform_blocks.find(name);
+        return it != uniform_blocks.end() ? it->second.binding : -1;
+    }
+
+    GLint ShaderImpl::storage_block_binding(const std::string &name) const {
+        const auto it = storage_blocks.find(name);
+        return it != storage_blocks.end() ? it->second.binding : -1;
     }
 
     bool ShaderImpl::reload_if_modified() {
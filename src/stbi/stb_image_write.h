@@ -257,7 +257,12 @@ int stbi_write_tga_with_rle = 1;
 int stbi_write_force_png_filter = -1;
 #endif
 
+// cppgl: per thread, so images can be encoded concurrently with different flip settings
+#ifdef __cplusplus
+static thread_local int stbi__flip_vertically_on_write = 0;
+#else
 static int stbi__flip_vertically_on_write = 0;
+#endif
 
 STBIWDEF void stbi_flip_vertically_on_write(int flag)
 {
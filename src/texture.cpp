@@ -1,7 +1,9 @@
 #include "texture.h"
 #include <vector>
 #include <iostream>
+#include <cstring>
 #include "image_load_store.h"
+#include "readback.h"
 
 CPPGL_NAMESPACE_BEGIN
 
@@ -35,11 +37,13 @@ CPPGL_NAMESPACE_BEGIN
 // ----------------------------------------------------
 // Texture2D
 
-    Texture2DImpl::Texture2DImpl(const std::string &name, const fs::path &path, bool mipmap) : name(name),
-                                                                                               loaded_from_path(path),
-                                                                                               id(0) {
-        // load image from disk
-        auto [data, w_out, h_out, channels, is_hdr] = image_load(path);
+    Texture2DImpl::Texture2DImpl(const std::string &name, const fs::path &path, bool mipmap)
+            : Texture2DImpl(name, path, image_load(path), mipmap) {}
+
+    Texture2DImpl::Texture2DImpl(const std::string &name, const fs::path &path, const ImageData &image,
+                                 bool mipmap)
+            : name(name), loaded_from_path(path), id(0) {
+        const auto &[data, w_out, h_out, channels, is_hdr] = image;
         this->w = w_out;
         this->h = h_out;
 
@@ -124,11 +128,27 @@ CPPGL_NAMESPACE_BEGIN
     }
 
     void Texture2DImpl::save_ldr(const fs::path &path, bool flip, bool async) const {
-        std::vector<uint8_t> pixels(size_t(w) * h * format_to_channels(format));
+        const int channels = format_to_channels(format);
+        const int w = this->w, h = this->h;
+        if (async) {
+            // no stall: the texels arrive through a pack buffer a few frames later and go to the async writer
+            GPUReadback::global().read_texture(GL_TEXTURE_2D, id, size_t(w) * h, format, GL_UNSIGNED_BYTE,
+                                               [path, w, h, channels, flip](const uint8_t *data, size_t size_bytes) {
+                                                   if (!data)
+                                                       return;
+                                                   std::vector<uint8_t> pixels = ImageWriter::global().acquire(
+                                                           size_bytes);
+                                                   std::memcpy(pixels.data(), data, size_bytes);
+                                                   ImageWriter::global().store_ldr(path, std::move(pixels), w, h,
+                                                                                   channels, flip);
+                                               });
+            return;
+        }
+        std::vector<uint8_t> pixels(size_t(w) * h * channels);
         glBindTexture(GL_TEXTURE_2D, id);
         glGetTexImage(GL_TEXTURE_2D, 0, format, GL_UNSIGNED_BYTE, &pixels[0]);
         glBindTexture(GL_TEXTURE_2D, 0);
-        image_store_ldr(path, pixels.data(), w, h, format_to_channels(format), flip, async);
+        image_store_ldr(path, pixels.data(), w, h, channels, flip);
     }
 
 // ----------------------------------------------------
@@ -0,0 +1,219 @@
+#include "thread_pool.h"
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+CPPGL_NAMESPACE_BEGIN
+
+    // pool and deque index of the calling worker thread
+    static thread_local const ThreadPool *current_pool = nullptr;
+    static thread_local int current_index = -1;
+
+    // tasks queued through enqueue() have nobody to report to
+    static void run_task(std::function<void()> &task) {
+        try {
+            task();
+        } catch (const std::exception &e) {
+            std::cerr << "WARN: ThreadPool: task threw: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "WARN: ThreadPool: task threw an unknown exception" << std::endl;
+        }
+    }
+
+// -------------------------------------------------------------------
+// ThreadPool
+// -------------------------------------------------------------------
+
+    ThreadPool::ThreadPool(uint32_t num_threads, size_t max_queued)
+            : max_queued(max_queued),
+              worker_count(num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency())),
+              queued(0), stopped(false), next_queue(0) {
+        for (uint32_t i = 0; i < worker_count; i++)
+            queues.emplace_back(std::make_unique<WorkerQueue>());
+        for (uint32_t i = 0; i < worker_count; i++)
+            workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+
+    ThreadPool::~ThreadPool() {
+        shutdown();
+    }
+
+    void ThreadPool::enqueue(std::function<void()> task) {
+        const int self = worker_index();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (self < 0 && max_queued > 0)
+                not_full.wait(lock, [this]() { return queued < max_queued || stopped; });
+            if (stopped) {
+                lock.unlock();
+                run_task(task);
+                return;
+            }
+            // the deque is filled while 'mutex' is held, so a worker that sees queued > 0 also finds the task
+            WorkerQueue &queue = *queues[self >= 0 ? uint32_t(self) : next_queue++ % queues.size()];
+            {
+                const std::lock_guard<std::mutex> queue_lock(queue.mutex);
+                queue.tasks.push_back(std::move(task));
+            }
+            queued++;
+        }
+        work_available.notify_one();
+    }
+
+    bool ThreadPool::pop_task(int self, std::function<void()> &task) {
+        const uint32_t num_queues = uint32_t(queues.size());
+        if (num_queues == 0)
+            return false;
+        bool found = false;
+        // own deque from the back: the most recently pushed task has the warmest data
+        if (self >= 0) {
+            WorkerQueue &queue = *queues[self];
+            const std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+                found = true;
+            }
+        }
+        // steal the oldest task of another deque
+        const uint32_t start = self >= 0 ? uint32_t(self) + 1 : next_queue.load();
+        for (uint32_t k = 0; k < num_queues && !found; k++) {
+            WorkerQueue &queue = *queues[(start + k) % num_queues];
+            const std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                found = true;
+            }
+        }
+        if (found) {
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                queued--;
+            }
+            not_full.notify_one();
+        }
+        return found;
+    }
+
+    void ThreadPool::worker_loop(uint32_t index) {
+        current_pool = this;
+        current_index = int(index);
+        std::function<void()> task;
+        while (true) {
+            if (pop_task(int(index), task)) {
+                run_task(task);
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            work_available.wait(lock, [this]() { return queued > 0 || stopped; });
+            if (stopped && queued == 0)
+                return;
+        }
+    }
+
+    bool ThreadPool::try_run_one() {
+        std::function<void()> task;
+        if (!pop_task(worker_index(), task))
+            return false;
+        run_task(task);
+        return true;
+    }
+
+    void ThreadPool::shutdown() {
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            if (stopped)
+                return;
+            stopped = true;
+        }
+        work_available.notify_all();
+        not_full.notify_all();
+        // a task shutting down its own pool cannot join itself
+        const std::thread::id self = std::this_thread::get_id();
+        for (auto &worker: workers) {
+            if (worker.get_id() == self)
+                worker.detach();
+            else
+                worker.join();
+        }
+        workers.clear();
+    }
+
+    uint32_t ThreadPool::num_threads() const {
+        const std::lock_guard<std::mutex> lock(mutex);
+        return stopped ? 0 : worker_count;
+    }
+
+    size_t ThreadPool::num_queued() const {
+        const std::lock_guard<std::mutex> lock(mutex);
+        return queued;
+    }
+
+    bool ThreadPool::is_worker() const {
+        return current_pool == this;
+    }
+
+    int ThreadPool::worker_index() const {
+        return current_pool == this ? current_index : -1;
+    }
+
+    static std::mutex global_pool_mutex;
+    static std::unique_ptr<ThreadPool> global_pool;
+
+    ThreadPool &ThreadPool::global() {
+        const std::lock_guard<std::mutex> lock(global_pool_mutex);
+        if (!global_pool)
+            global_pool = std::make_unique<ThreadPool>();
+        return *global_pool;
+    }
+
+    void ThreadPool::shutdown_global() {
+        const std::lock_guard<std::mutex> lock(global_pool_mutex);
+        // the pool object stays alive, so references handed out by global() remain valid
+        if (global_pool)
+            global_pool->shutdown();
+    }
+
+// -------------------------------------------------------------------
+// TaskGroup
+// -------------------------------------------------------------------
+
+    TaskGroup::TaskGroup(ThreadPool &pool) : pool(pool), unfinished(0) {}
+
+    TaskGroup::~TaskGroup() {
+        try {
+            wait();
+        } catch (...) {}
+    }
+
+    void TaskGroup::finish() {
+        const std::lock_guard<std::mutex> lock(mutex);
+        if (--unfinished == 0)
+            done.notify_all();
+    }
+
+    void TaskGroup::wait() {
+        while (true) {
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                if (unfinished == 0)
+                    break;
+            }
+            // help instead of blocking a thread the outstanding tasks might need
+            if (pool.try_run_one())
+                continue;
+            // the remaining tasks are running elsewhere, they may still spawn work we can help with
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait_for(lock, std::chrono::microseconds(500), [this]() { return unfinished == 0; });
+        }
+        const std::lock_guard<std::mutex> lock(mutex);
+        if (error) {
+            std::exception_ptr first = error;
+            error = nullptr;
+            std::rethrow_exception(first);
+        }
+    }
+
+CPPGL_NAMESPACE_END
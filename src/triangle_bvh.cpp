@@ -0,0 +1,547 @@
+#include "triangle_bvh.h"
+#include "context.h"
+#include "utils/parallel.h"
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+CPPGL_NAMESPACE_BEGIN
+
+    static const uint32_t NUM_BINS = 16;
+    static const uint32_t MAX_LEAF_SIZE = 8;
+    // ranges at least this large are binned in parallel resp. built as a separate task
+    static const uint32_t PARALLEL_BINNING = 1u << 16;
+    static const uint32_t PARALLEL_SUBTREE = 1u << 12;
+    // deeper nodes become leaves regardless of their size, keeps the traversal stack fixed.
+    // depth counts from the root of the whole tree, also for subtrees built as separate tasks
+    static const uint32_t MAX_DEPTH = 60;
+    static const uint32_t STACK_SIZE = MAX_DEPTH + 4;
+
+    static inline float half_area(const vec3 &bb_min, const vec3 &bb_max) {
+        const vec3 e = (bb_max - bb_min).cwiseMax(vec3::Zero());
+        return e.x() * e.y() + e.y() * e.z() + e.z() * e.x();
+    }
+
+    static const float MISS = std::numeric_limits<float>::infinity();
+
+    // slab test clipped to [t_min, t_max], entry distance or MISS
+    static inline float intersect_box(const float *bb_min, const float *bb_max, const float *origin,
+                                      const float *inv_dir, float t_min, float t_max) {
+        for (int a = 0; a < 3; a++) {
+            const float t0 = (bb_min[a] - origin[a]) * inv_dir[a];
+            const float t1 = (bb_max[a] - origin[a]) * inv_dir[a];
+            t_min = std::max(t_min, std::min(t0, t1));
+            t_max = std::min(t_max, std::max(t0, t1));
+        }
+        return t_min <= t_max ? t_min : MISS;
+    }
+
+// -------------------------------------------------------------------
+// Build
+// -------------------------------------------------------------------
+
+    // bounds of one face, partitioned in place so binning reads memory sequentially
+    struct FaceRef {
+        inline float centroid(int axis) const { return 0.5f * (bb_min[axis] + bb_max[axis]); }
+
+        vec3 bb_min;
+        uint32_t face;
+        vec3 bb_max;
+    };
+
+    struct TriangleBVH::BuildContext {
+        std::vector<FaceRef> refs;
+        std::atomic<uint32_t> num_nodes{1};
+        TaskGroup group;
+    };
+
+    static inline uint32_t bin_index(float c, float c_min, float scale) {
+        return std::min(NUM_BINS - 1, uint32_t(std::max(0.f, (c - c_min) * scale)));
+    }
+
+    // face counts and face bounds of NUM_BINS bins along each axis
+    struct Bins {
+        Bins() {
+            for (int a = 0; a < 3; a++) {
+                for (uint32_t b = 0; b < NUM_BINS; b++) {
+                    count[a][b] = 0;
+                    bb_min[a][b] = vec3::Constant(std::numeric_limits<float>::max());
+                    bb_max[a][b] = vec3::Constant(std::numeric_limits<float>::lowest());
+                }
+            }
+        }
+
+        void add(const FaceRef *refs, uint32_t n, const vec3 &c_min, const vec3 &scale) {
+            for (uint32_t i = 0; i < n; i++) {
+                for (int a = 0; a < 3; a++) {
+                    const uint32_t b = bin_index(refs[i].centroid(a), c_min[a], scale[a]);
+                    count[a][b]++;
+                    bb_min[a][b] = bb_min[a][b].cwiseMin(refs[i].bb_min);
+                    bb_max[a][b] = bb_max[a][b].cwiseMax(refs[i].bb_max);
+                }
+            }
+        }
+
+        void merge(const Bins &other) {
+            for (int a = 0; a < 3; a++) {
+                for (uint32_t b = 0; b < NUM_BINS; b++) {
+                    count[a][b] += other.count[a][b];
+                    bb_min[a][b] = bb_min[a][b].cwiseMin(other.bb_min[a][b]);
+                    bb_max[a][b] = bb_max[a][b].cwiseMax(other.bb_max[a][b]);
+                }
+            }
+        }
+
+        uint32_t count[3][NUM_BINS];
+        vec3 bb_min[3][NUM_BINS], bb_max[3][NUM_BINS];
+    };
+
+    void TriangleBVH::build_node(BuildContext &ctx, uint32_t root, uint32_t root_first, uint32_t root_count,
+                                 uint32_t root_depth) {
+        struct Task {
+            uint32_t node, first, count, depth;
+        };
+        std::vector<Task> stack = {{root, root_first, root_count, root_depth}};
+        while (!stack.empty()) {
+            const Task task = stack.back();
+            stack.pop_back();
+            const uint32_t first = task.first, count = task.count, end = first + count;
+            Node &node = nodes[task.node];
+            node.first = first;
+            node.count = count;
+            if (count <= 1 || task.depth >= MAX_DEPTH)
+                continue;
+
+            // centroid bounds
+            vec3 c_min = vec3::Constant(std::numeric_limits<float>::max());
+            vec3 c_max = vec3::Constant(std::numeric_limits<float>::lowest());
+            std::mutex mutex;
+            parallel_for(first, end, [&](uint32_t begin, uint32_t range_end) {
+                vec3 local_min = c_min, local_max = c_max;
+                for (uint32_t i = begin; i < range_end; i++) {
+                    const vec3 c = 0.5f * (ctx.refs[i].bb_min + ctx.refs[i].bb_max);
+                    local_min = local_min.cwiseMin(c);
+                    local_max = local_max.cwiseMax(c);
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                c_min = c_min.cwiseMin(local_min);
+                c_max = c_max.cwiseMax(local_max);
+            }, PARALLEL_BINNING);
+            const vec3 extent = c_max - c_min;
+            vec3 scale;
+            for (int a = 0; a < 3; a++)
+                scale[a] = extent[a] > 0.f ? float(NUM_BINS) * (1.f - 1e-5f) / extent[a] : 0.f;
+
+            // bin all three axes at once
+            Bins bins;
+            if (count < PARALLEL_BINNING) {
+                bins.add(ctx.refs.data() + first, count, c_min, scale);
+            } else {
+                parallel_for(first, end, [&](uint32_t begin, uint32_t range_end) {
+                    Bins local;
+                    local.add(ctx.refs.data() + begin, range_end - begin, c_min, scale);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    bins.merge(local);
+                }, PARALLEL_BINNING);
+            }
+
+            // sweep the split planes between the bins, cost relative to intersecting one triangle
+            vec3 node_min = vec3::Constant(std::numeric_limits<float>::max()), node_max = -node_min;
+            for (uint32_t b = 0; b < NUM_BINS; b++) {
+                node_min = node_min.cwiseMin(bins.bb_min[0][b]);
+                node_max = node_max.cwiseMax(bins.bb_max[0][b]);
+            }
+            const float node_area = std::max(half_area(node_min, node_max), 1e-30f);
+            float best_cost = std::numeric_limits<float>::max();
+            int best_axis = -1;
+            uint32_t best_split = 0;
+            for (int a = 0; a < 3; a++) {
+                if (extent[a] <= 0.f)
+                    continue;
+                float right_area[NUM_BINS];
+                uint32_t right_count[NUM_BINS];
+                vec3 r_min = vec3::Constant(std::numeric_limits<float>::max()), r_max = -r_min;
+                uint32_t r_count = 0;
+                for (uint32_t b = NUM_BINS - 1; b > 0; b--) {
+                    r_min = r_min.cwiseMin(bins.bb_min[a][b]);
+                    r_max = r_max.cwiseMax(bins.bb_max[a][b]);
+                    r_count += bins.count[a][b];
+                    right_area[b] = half_area(r_min, r_max);
+                    right_count[b] = r_count;
+                }
+                vec3 l_min = vec3::Constant(std::numeric_limits<float>::max()), l_max = -l_min;
+                uint32_t l_count = 0;
+                for (uint32_t b = 1; b < NUM_BINS; b++) {
+                    l_min = l_min.cwiseMin(bins.bb_min[a][b - 1]);
+                    l_max = l_max.cwiseMax(bins.bb_max[a][b - 1]);
+                    l_count += bins.count[a][b - 1];
+                    if (l_count == 0 || right_count[b] == 0)
+                        continue;
+                    const float cost = 1.f + (half_area(l_min, l_max) * float(l_count) +
+                                              right_area[b] * float(right_count[b])) / node_area;
+                    if (cost < best_cost) {
+                        best_cost = cost;
+                        best_axis = a;
+                        best_split = b;
+                    }
+                }
+            }
+            if (count <= MAX_LEAF_SIZE && (best_axis < 0 || best_cost >= float(count)))
+                continue;
+
+            uint32_t mid;
+            if (best_axis >= 0) {
+                const int a = best_axis;
+                const auto split = std::partition(ctx.refs.begin() + first, ctx.refs.begin() + end,
+                                                  [&](const FaceRef &ref) {
+                                                      return bin_index(ref.centroid(a), c_min[a], scale[a]) <
+                                                             best_split;
+                                                  });
+                mid = uint32_t(split - ctx.refs.begin());
+            } else {
+                // all centroids coincide, any split is as good as another
+                mid = first + count / 2;
+            }
+
+            const uint32_t left = ctx.num_nodes.fetch_add(2);
+            node.first = left;
+            node.count = 0;
+            const Task left_task = {left, first, mid - first, task.depth + 1};
+            const Task right_task = {left + 1, mid, end - mid, task.depth + 1};
+            if (right_task.count >= PARALLEL_SUBTREE)
+                ctx.group.run([this, &ctx, right_task]() {
+                    build_node(ctx, right_task.node, right_task.first, right_task.count, right_task.depth);
+                });
+            else
+                stack.push_back(right_task);
+            stack.push_back(left_task);
+        }
+    }
+
+// -------------------------------------------------------------------
+// TriangleBVH
+// -------------------------------------------------------------------
+
+    TriangleBVH::TriangleBVH() : num_faces(0) {}
+
+    TriangleBVH::TriangleBVH(const GeometryBase &geometry) : num_faces(0) {
+        build(geometry);
+    }
+
+    void TriangleBVH::clear() {
+        nodes.clear();
+        nodes.shrink_to_fit();
+        blocks.clear();
+        blocks.shrink_to_fit();
+        num_faces = 0;
+    }
+
+    void TriangleBVH::build(const GeometryBase &geometry) {
+        this->geometry = geometry;
+        build();
+    }
+
+    void TriangleBVH::build() {
+        clear();
+        if (!geometry)
+            return;
+        GeometryBaseImpl &geo = *geometry.ptr;
+        const AttributeView<vec3> positions = geo.positions_view();
+        const AttributeView<uint32_t> indices = geo.indices_view();
+        const uint32_t n = uint32_t((indices.empty() ? positions.size : indices.size) / 3);
+        if (n == 0)
+            return;
+
+        BuildContext ctx;
+        ctx.refs.resize(n);
+        parallel_for(0, n, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t f = begin; f < end; f++) {
+                const vec3 &p0 = positions[indices.empty() ? f * 3 + 0 : indices[f * 3 + 0]];
+                const vec3 &p1 = positions[indices.empty() ? f * 3 + 1 : indices[f * 3 + 1]];
+                const vec3 &p2 = positions[indices.empty() ? f * 3 + 2 : indices[f * 3 + 2]];
+                ctx.refs[f] = FaceRef{p0.cwiseMin(p1).cwiseMin(p2), f, p0.cwiseMax(p1).cwiseMax(p2)};
+            }
+        });
+
+        // a binary tree with at least one face per leaf has at most 2n - 1 nodes
+        nodes.resize(2 * size_t(n) - 1);
+        build_node(ctx, 0, 0, n, 0);
+        ctx.group.wait();
+        nodes.resize(ctx.num_nodes.load());
+        nodes.shrink_to_fit();
+
+        // leaves: face range -> blocks of four faces, padding lanes never hit
+        uint32_t num_blocks = 0;
+        for (const Node &node: nodes)
+            num_blocks += (node.count + 3) / 4;
+        blocks.resize(num_blocks);
+        num_blocks = 0;
+        for (Node &node: nodes) {
+            if (node.count == 0)
+                continue;
+            const uint32_t first = node.first, count = node.count;
+            node.first = num_blocks;
+            node.count = (count + 3) / 4;
+            num_blocks += node.count;
+            for (uint32_t k = 0; k < 4 * node.count; k++)
+                blocks[node.first + k / 4].face[k % 4] = k < count ? ctx.refs[first + k].face : RayHit::NO_HIT;
+        }
+        num_faces = n;
+        refit();
+    }
+
+    void TriangleBVH::refit() {
+        if (!geometry || nodes.empty()) {
+            build();
+            return;
+        }
+        GeometryBaseImpl &geo = *geometry.ptr;
+        const AttributeView<vec3> positions = geo.positions_view();
+        const AttributeView<uint32_t> indices = geo.indices_view();
+        if ((indices.empty() ? positions.size : indices.size) / 3 != num_faces) {
+            build();
+            return;
+        }
+
+        // triangle data of all blocks
+        parallel_for(0, uint32_t(blocks.size()), [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                Block &block = blocks[i];
+                for (uint32_t k = 0; k < 4; k++) {
+                    const uint32_t f = block.face[k];
+                    vec3 p0 = vec3::Zero(), p1 = vec3::Zero(), p2 = vec3::Zero();
+                    if (f != RayHit::NO_HIT) {
+                        p0 = positions[indices.empty() ? f * 3 + 0 : indices[f * 3 + 0]];
+                        p1 = positions[indices.empty() ? f * 3 + 1 : indices[f * 3 + 1]];
+                        p2 = positions[indices.empty() ? f * 3 + 2 : indices[f * 3 + 2]];
+                    }
+                    for (int a = 0; a < 3; a++) {
+                        block.v0[a][k] = p0[a];
+                        block.e1[a][k] = p1[a] - p0[a];
+                        block.e2[a][k] = p2[a] - p0[a];
+                    }
+                }
+            }
+        }, 1024);
+
+        // leaf bounds from the vertices as the ray tests see them
+        parallel_for(0, uint32_t(nodes.size()), [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                Node &node = nodes[i];
+                if (node.count == 0)
+                    continue;
+                for (int a = 0; a < 3; a++) {
+                    node.bb_min[a] = std::numeric_limits<float>::max();
+                    node.bb_max[a] = std::numeric_limits<float>::lowest();
+                }
+                for (uint32_t b = node.first; b < node.first + node.count; b++) {
+                    const Block &block = blocks[b];
+                    for (uint32_t k = 0; k < 4 && block.face[k] != RayHit::NO_HIT; k++) {
+                        for (int a = 0; a < 3; a++) {
+                            const float v0 = block.v0[a][k], v1 = v0 + block.e1[a][k], v2 = v0 + block.e2[a][k];
+                            node.bb_min[a] = std::min(node.bb_min[a], std::min(v0, std::min(v1, v2)));
+                            node.bb_max[a] = std::max(node.bb_max[a], std::max(v0, std::max(v1, v2)));
+                        }
+                    }
+                }
+            }
+        });
+
+        // children are allocated after their parent, so a reverse sweep visits them first
+        for (uint32_t i = uint32_t(nodes.size()); i-- > 0;) {
+            Node &node = nodes[i];
+            if (node.count)
+                continue;
+            const Node &left = nodes[node.first], &right = nodes[node.first + 1];
+            for (int a = 0; a < 3; a++) {
+                node.bb_min[a] = std::min(left.bb_min[a], right.bb_min[a]);
+                node.bb_max[a] = std::max(left.bb_max[a], right.bb_max[a]);
+            }
+        }
+    }
+
+    uint32_t TriangleBVH::vertex_index(uint32_t face, uint32_t k) const {
+        GeometryBaseImpl &geo = *geometry.ptr;
+        return geo.indices_size() ? geo.get_index(face * 3 + k) : face * 3 + k;
+    }
+
+    size_t TriangleBVH::memory_usage() const {
+        return nodes.capacity() * sizeof(Node) + blocks.capacity() * sizeof(Block);
+    }
+
+    uint32_t TriangleBVH::depth() const {
+        if (nodes.empty())
+            return 0;
+        uint32_t max_depth = 0;
+        std::vector<std::pair<uint32_t, uint32_t>> stack = {{0, 0}};
+        while (!stack.empty()) {
+            const auto [index, level] = stack.back();
+            stack.pop_back();
+            max_depth = std::max(max_depth, level);
+            if (nodes[index].count == 0) {
+                stack.push_back({nodes[index].first, level + 1});
+                stack.push_back({nodes[index].first + 1, level + 1});
+            }
+        }
+        return max_depth;
+    }
+
+// -------------------------------------------------------------------
+// Traversal
+// -------------------------------------------------------------------
+
+    // Moeller-Trumbore against the four lanes of a block, two-sided, returns the hit lane or -1
+    template<typename Block>
+    static inline int intersect_block(const Block &block, const float *o, const float *d, float t_min, float t_max,
+                                      float &t_hit, float &u_hit, float &v_hit) {
+        float t[4], u[4], v[4];
+        uint8_t valid[4];
+        for (int k = 0; k < 4; k++) {
+            const float e1x = block.e1[0][k], e1y = block.e1[1][k], e1z = block.e1[2][k];
+            const float e2x = block.e2[0][k], e2y = block.e2[1][k], e2z = block.e2[2][k];
+            const float px = d[1] * e2z - d[2] * e2y, py = d[2] * e2x - d[0] * e2z, pz = d[0] * e2y - d[1] * e2x;
+            const float det = e1x * px + e1y * py + e1z * pz;
+            const float inv_det = 1.f / det;
+            const float sx = o[0] - block.v0[0][k], sy = o[1] - block.v0[1][k], sz = o[2] - block.v0[2][k];
+            const float qx = sy * e1z - sz * e1y, qy = sz * e1x - sx * e1z, qz = sx * e1y - sy * e1x;
+            u[k] = (sx * px + sy * py + sz * pz) * inv_det;
+            v[k] = (d[0] * qx + d[1] * qy + d[2] * qz) * inv_det;
+            t[k] = (e2x * qx + e2y * qy + e2z * qz) * inv_det;
+            valid[k] = uint8_t(det != 0.f) & uint8_t(u[k] >= 0.f) & uint8_t(v[k] >= 0.f) &
+                       uint8_t(u[k] + v[k] <= 1.f) & uint8_t(t[k] >= t_min) & uint8_t(t[k] <= t_max);
+        }
+        int lane = -1;
+        for (int k = 0; k < 4; k++) {
+            if (valid[k] && t[k] <= t_max) {
+                t_max = t[k];
+                lane = k;
+            }
+        }
+        if (lane >= 0) {
+            t_hit = t[lane];
+            u_hit = u[lane];
+            v_hit = v[lane];
+        }
+        return lane;
+    }
+
+    template<bool ANY_HIT>
+    bool TriangleBVH::traverse(const Ray &ray, RayHit &hit) const {
+        if (nodes.empty())
+            return false;
+        const float o[3] = {ray.origin.x(), ray.origin.y(), ray.origin.z()};
+        const float d[3] = {ray.dir.x(), ray.dir.y(), ray.dir.z()};
+        const float inv_dir[3] = {1.f / d[0], 1.f / d[1], 1.f / d[2]};
+        float t_max = ray.t_max;
+        bool found = false;
+
+        // node index and entry distance
+        std::pair<uint32_t, float> stack[STACK_SIZE];
+        uint32_t top = 0;
+        const float t_root = intersect_box(nodes[0].bb_min, nodes[0].bb_max, o, inv_dir, ray.t_min, t_max);
+        if (t_root == MISS)
+            return false;
+        stack[top++] = {0, t_root};
+        while (top > 0) {
+            const auto [index, t_entry] = stack[--top];
+            if (t_entry > t_max)
+                continue;
+            const Node &node = nodes[index];
+            if (node.count) {
+                for (uint32_t b = node.first; b < node.first + node.count; b++) {
+                    float t, u, v;
+                    const int lane = intersect_block(blocks[b], o, d, ray.t_min, t_max, t, u, v);
+                    if (lane < 0)
+                        continue;
+                    found = true;
+                    t_max = t;
+                    hit.face = blocks[b].face[lane];
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    if (ANY_HIT)
+                        return true;
+                }
+                continue;
+            }
+            const Node &left = nodes[node.first], &right = nodes[node.first + 1];
+            const float t_left = intersect_box(left.bb_min, left.bb_max, o, inv_dir, ray.t_min, t_max);
+            const float t_right = intersect_box(right.bb_min, right.bb_max, o, inv_dir, ray.t_min, t_max);
+            // the nearer child is popped first
+            const bool near_left = t_left <= t_right;
+            const float t_far = near_left ? t_right : t_left, t_near = near_left ? t_left : t_right;
+            // at most one entry per level plus the two children, MAX_DEPTH bounds the whole tree
+            _CPPGL_ASSERT_LE(top + 2, STACK_SIZE);
+            if (t_far != MISS)
+                stack[top++] = {near_left ? node.first + 1 : node.first, t_far};
+            if (t_near != MISS)
+                stack[top++] = {near_left ? node.first : node.first + 1, t_near};
+        }
+        return found;
+    }
+
+    RayHit TriangleBVH::intersect(const Ray &ray) const {
+        RayHit hit;
+        traverse<false>(ray, hit);
+        return hit;
+    }
+
+    bool TriangleBVH::occluded(const Ray &ray) const {
+        RayHit hit;
+        return traverse<true>(ray, hit);
+    }
+
+    void TriangleBVH::intersect(const std::vector<Ray> &rays, std::vector<RayHit> &hits) const {
+        hits.resize(rays.size());
+        parallel_for(0, uint32_t(rays.size()), [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++)
+                hits[i] = intersect(rays[i]);
+        }, 256);
+    }
+
+    void TriangleBVH::occluded(const std::vector<Ray> &rays, std::vector<uint8_t> &results) const {
+        results.resize(rays.size());
+        parallel_for(0, uint32_t(rays.size()), [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++)
+                results[i] = occluded(rays[i]);
+        }, 256);
+    }
+
+// -------------------------------------------------------------------
+// Picking
+// -------------------------------------------------------------------
+
+    Ray camera_ray(const vec2 &pixel, const vec2 &window_size, const Camera &cam) {
+        const vec2 ndc(2.f * pixel.x() / window_size.x() - 1.f, 1.f - 2.f * pixel.y() / window_size.y());
+        const mat4 inv_view_proj = (cam->proj * cam->view).inverse();
+        vec4 p_near = inv_view_proj * vec4(ndc.x(), ndc.y(), -1.f, 1.f);
+        vec4 p_far = inv_view_proj * vec4(ndc.x(), ndc.y(), 1.f, 1.f);
+        p_near /= p_near.w();
+        p_far /= p_far.w();
+        return Ray(p_near.head<3>(), (p_far.head<3>() - p_near.head<3>()).normalized());
+    }
+
+    PickResult pick(const TriangleBVH &bvh, const mat4 &model, const Camera &cam) {
+        // cursor positions are in screen coordinates, which differ from framebuffer pixels on high-dpi displays
+        int w, h;
+        glfwGetWindowSize(Context::instance().glfw_window, &w, &h);
+        return pick(bvh, camera_ray(Context::mouse_pos(), vec2(float(w), float(h)), cam), model);
+    }
+
+    PickResult pick(const TriangleBVH &bvh, const Ray &ray, const mat4 &model) {
+        // the unnormalized object space direction keeps t comparable to world space
+        const mat4 inv_model = model.inverse();
+        const Ray local((inv_model * vec4(ray.origin.x(), ray.origin.y(), ray.origin.z(), 1.f)).head<3>(),
+                        inv_model.block<3, 3>(0, 0) * ray.dir, ray.t_min, ray.t_max);
+        PickResult result;
+        result.hit = bvh.intersect(local);
+        if (!result.hit)
+            return result;
+        result.position = ray.at(result.hit.t);
+        int k = 0;
+        result.hit.barycentric().maxCoeff(&k);
+        result.vertex = bvh.vertex_index(result.hit.face, uint32_t(k));
+        return result;
+    }
+
+CPPGL_NAMESPACE_END
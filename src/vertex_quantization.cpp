@@ -0,0 +1,321 @@
+#include "vertex_quantization.h"
+#include "utils/parallel.h"
+#include <cmath>
+#include <mutex>
+#include <limits>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+CPPGL_NAMESPACE_BEGIN
+
+    std::string encoding_to_str(AttributeEncoding encoding) {
+        switch (encoding) {
+            case AttributeEncoding::FLOAT:
+                return "float";
+            case AttributeEncoding::UNORM16:
+                return "unorm16";
+            case AttributeEncoding::HALF:
+                return "half";
+            case AttributeEncoding::OCT_SNORM16:
+                return "oct_snorm16";
+            case AttributeEncoding::SNORM_10_10_10_2:
+                return "snorm_10_10_10_2";
+        }
+        return "unknown";
+    }
+
+// -------------------------------------------------------------------
+// Single values
+
+    static inline uint32_t float_bits(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    static inline float bits_float(uint32_t bits) {
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // round to nearest even, overflow to infinity, NaN stays NaN
+    uint16_t float_to_half(float value) {
+        uint32_t f = float_bits(value);
+        const uint32_t sign = f & 0x80000000u;
+        f ^= sign;
+        uint16_t h;
+        if (f >= 0x47800000u) {
+            h = f > 0x7f800000u ? 0x7e00 : 0x7c00;
+        } else if (f < 0x38800000u) {
+            // subnormal half, let the float adder do the rounding
+            const uint32_t magic = ((127 - 15) + (23 - 10) + 1) << 23;
+            h = uint16_t(float_bits(bits_float(f) + bits_float(magic)) - magic);
+        } else {
+            const uint32_t odd = (f >> 13) & 1u;
+            f += (uint32_t(15 - 127) << 23) + 0xfffu + odd;
+            h = uint16_t(f >> 13);
+        }
+        return uint16_t(h | (sign >> 16));
+    }
+
+    float half_to_float(uint16_t value) {
+        const uint32_t sign = uint32_t(value & 0x8000u) << 16;
+        const uint32_t exponent = (value >> 10) & 0x1fu, mantissa = value & 0x3ffu;
+        if (exponent == 0)
+            return bits_float(sign | float_bits(float(mantissa) * 5.9604645e-8f));
+        if (exponent == 31)
+            return bits_float(sign | 0x7f800000u | (mantissa << 13));
+        return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    }
+
+    static inline float from_snorm16(int16_t value) {
+        return std::max(float(value) / 32767.f, -1.f);
+    }
+
+    // octahedron coordinates of a normal in [-1, 1]^2
+    static inline vec2 oct_wrap(const vec3 &n) {
+        const vec3 p = n / (std::abs(n.x()) + std::abs(n.y()) + std::abs(n.z()));
+        if (p.z() >= 0.f)
+            return vec2(p.x(), p.y());
+        return vec2((1.f - std::abs(p.y())) * (p.x() >= 0.f ? 1.f : -1.f),
+                    (1.f - std::abs(p.x())) * (p.y() >= 0.f ? 1.f : -1.f));
+    }
+
+    static inline vec3 oct_unwrap(float x, float y) {
+        vec3 n(x, y, 1.f - std::abs(x) - std::abs(y));
+        const float t = std::max(-n.z(), 0.f);
+        n.x() += n.x() >= 0.f ? -t : t;
+        n.y() += n.y() >= 0.f ? -t : t;
+        return n.normalized();
+    }
+
+    void encode_oct_snorm16(const float *normal, int16_t *encoded) {
+        const vec3 n(normal[0], normal[1], normal[2]);
+        if (n.squaredNorm() == 0.f) {
+            encoded[0] = encoded[1] = 0;
+            return;
+        }
+        const vec3 unit = n.normalized();
+        const vec2 p = oct_wrap(unit) * 32767.f;
+        // the closest of the four neighboring grid points, rounding alone loses about half the precision
+        float best = -2.f;
+        for (uint32_t k = 0; k < 4; k++) {
+            const float x = (k & 1u) ? std::ceil(p.x()) : std::floor(p.x());
+            const float y = (k & 2u) ? std::ceil(p.y()) : std::floor(p.y());
+            const int16_t candidate[2] = {int16_t(std::clamp(x, -32767.f, 32767.f)),
+                                          int16_t(std::clamp(y, -32767.f, 32767.f))};
+            const float cos_angle = decode_oct_snorm16(candidate).dot(unit);
+            if (cos_angle > best) {
+                best = cos_angle;
+                encoded[0] = candidate[0];
+                encoded[1] = candidate[1];
+            }
+        }
+    }
+
+    vec3 decode_oct_snorm16(const int16_t *encoded) {
+        return oct_unwrap(from_snorm16(encoded[0]), from_snorm16(encoded[1]));
+    }
+
+    // GL_INT_2_10_10_10_REV: x in the lowest bits, w = 0
+    uint32_t encode_snorm_10_10_10_2(const float *normal) {
+        const vec3 n = vec3(normal[0], normal[1], normal[2]).normalized();
+        uint32_t packed = 0;
+        for (uint32_t c = 0; c < 3; c++) {
+            const int32_t q = int32_t(std::lround(std::clamp(n[c], -1.f, 1.f) * 511.f));
+            packed |= (uint32_t(q) & 0x3ffu) << (10 * c);
+        }
+        return packed;
+    }
+
+    vec3 decode_snorm_10_10_10_2(uint32_t encoded) {
+        vec3 n;
+        for (uint32_t c = 0; c < 3; c++) {
+            // sign extend the 10 bit component
+            const int32_t q = int32_t(((encoded >> (10 * c)) & 0x3ffu) << 22) >> 22;
+            n[c] = std::max(float(q) / 511.f, -1.f);
+        }
+        return n;
+    }
+
+// -------------------------------------------------------------------
+// Bulk encoders
+
+    void encode_unorm16(const float *src, uint32_t count, uint32_t dim, const float *min, const float *extent,
+                        uint16_t *dst) {
+        float scale[4];
+        for (uint32_t c = 0; c < dim; c++)
+            scale[c] = extent[c] > 0.f ? 1.f / extent[c] : 0.f;
+        parallel_for(0, count, [&](uint32_t begin, uint32_t end) {
+            for (size_t i = begin; i < end; i++) {
+                for (uint32_t c = 0; c < dim; c++) {
+                    const float t = std::clamp((src[i * dim + c] - min[c]) * scale[c], 0.f, 1.f);
+                    dst[i * dim + c] = uint16_t(t * 65535.f + 0.5f);
+                }
+            }
+        });
+    }
+
+    void encode_half(const float *src, uint32_t count, uint16_t *dst) {
+        parallel_for(0, count, [&](uint32_t begin, uint32_t end) {
+            uint32_t i = begin;
+#if defined(__F16C__)
+            for (; i + 8 <= end; i += 8)
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                                 _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+            for (; i < end; i++)
+                dst[i] = float_to_half(src[i]);
+        });
+    }
+
+    void encode_oct_snorm16(const float *normals, uint32_t count, int16_t *dst) {
+        parallel_for(0, count, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++)
+                encode_oct_snorm16(normals + 3 * size_t(i), dst + 2 * size_t(i));
+        }, 1024);
+    }
+
+    void encode_snorm_10_10_10_2(const float *normals, uint32_t count, uint32_t *dst) {
+        parallel_for(0, count, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++)
+                dst[i] = encode_snorm_10_10_10_2(normals + 3 * size_t(i));
+        });
+    }
+
+// -------------------------------------------------------------------
+// Attributes
+
+    // max and mean of error(i) over all elements
+    template<typename Func>
+    static QuantizationError measure(uint32_t count, Func &&error) {
+        QuantizationError result;
+        double sum = 0.0;
+        std::mutex mutex;
+        parallel_for(0, count, [&](uint32_t begin, uint32_t end) {
+            float max = 0.f;
+            double partial = 0.0;
+            for (uint32_t i = begin; i < end; i++) {
+                const float e = error(i);
+                max = std::max(max, e);
+                partial += e;
+            }
+            const std::lock_guard<std::mutex> lock(mutex);
+            result.max = std::max(result.max, max);
+            sum += partial;
+        });
+        result.mean = count ? float(sum / count) : 0.f;
+        return result;
+    }
+
+    // angle between two normals in degrees, atan2 stays precise for the tiny angles acos rounds to zero
+    static inline float angle_degrees(const vec3 &a, const vec3 &b) {
+        if (a.squaredNorm() == 0.f || b.squaredNorm() == 0.f)
+            return 0.f;
+        return std::atan2(a.cross(b).norm(), a.dot(b)) * float(180.0 / M_PI);
+    }
+
+    QuantizedAttribute quantize_attribute(AttributeEncoding encoding, const float *data, uint32_t dim, uint32_t count,
+                                          const float *min, const float *max) {
+        if (dim == 0 || dim > 4)
+            throw std::runtime_error("quantize_attribute: unsupported dimension " + std::to_string(dim));
+        if ((encoding == AttributeEncoding::OCT_SNORM16 || encoding == AttributeEncoding::SNORM_10_10_10_2) &&
+            dim != 3)
+            throw std::runtime_error("quantize_attribute: " + encoding_to_str(encoding) + " needs 3 components");
+        QuantizedAttribute q;
+        q.encoding = encoding;
+        const size_t num_floats = size_t(count) * dim;
+        auto original = [&](uint32_t i, uint32_t c) { return data[size_t(i) * dim + c]; };
+
+        switch (encoding) {
+            case AttributeEncoding::FLOAT: {
+                q.type = GL_FLOAT;
+                q.element_dim = dim;
+                q.data.resize(sizeof(float) * num_floats);
+                std::memcpy(q.data.data(), data, q.data.size());
+                break;
+            }
+            case AttributeEncoding::UNORM16: {
+                q.type = GL_UNSIGNED_SHORT;
+                q.element_dim = dim;
+                q.normalized = true;
+                vec4 lo = vec4::Constant(std::numeric_limits<float>::max()), hi = -lo;
+                if (min && max) {
+                    for (uint32_t c = 0; c < dim; c++)
+                        lo[c] = min[c], hi[c] = max[c];
+                } else {
+                    for (uint32_t i = 0; i < count; i++)
+                        for (uint32_t c = 0; c < dim; c++)
+                            lo[c] = std::min(lo[c], original(i, c)), hi[c] = std::max(hi[c], original(i, c));
+                }
+                q.min = vec4::Zero();
+                q.extent = vec4::Zero();
+                for (uint32_t c = 0; c < dim && count > 0; c++) {
+                    q.min[c] = lo[c];
+                    q.extent[c] = std::max(hi[c] - lo[c], 0.f);
+                }
+                q.data.resize(sizeof(uint16_t) * num_floats);
+                uint16_t *encoded = reinterpret_cast<uint16_t *>(q.data.data());
+                encode_unorm16(data, count, dim, q.min.data(), q.extent.data(), encoded);
+                q.error = measure(count, [&](uint32_t i) {
+                    float d2 = 0.f;
+                    for (uint32_t c = 0; c < dim; c++) {
+                        const float decoded = q.min[c] + float(encoded[size_t(i) * dim + c]) / 65535.f * q.extent[c];
+                        d2 += (decoded - original(i, c)) * (decoded - original(i, c));
+                    }
+                    return std::sqrt(d2);
+                });
+                break;
+            }
+            case AttributeEncoding::HALF: {
+                q.type = GL_HALF_FLOAT;
+                q.element_dim = dim;
+                q.data.resize(sizeof(uint16_t) * num_floats);
+                uint16_t *encoded = reinterpret_cast<uint16_t *>(q.data.data());
+                encode_half(data, uint32_t(num_floats), encoded);
+                q.error = measure(count, [&](uint32_t i) {
+                    float d2 = 0.f;
+                    for (uint32_t c = 0; c < dim; c++) {
+                        const float d = half_to_float(encoded[size_t(i) * dim + c]) - original(i, c);
+                        d2 += d * d;
+                    }
+                    return std::sqrt(d2);
+                });
+                break;
+            }
+            case AttributeEncoding::OCT_SNORM16: {
+                q.type = GL_SHORT;
+                q.element_dim = 2;
+                q.normalized = true;
+                q.data.resize(2 * sizeof(int16_t) * count);
+                int16_t *encoded = reinterpret_cast<int16_t *>(q.data.data());
+                encode_oct_snorm16(data, count, encoded);
+                q.error = measure(count, [&](uint32_t i) {
+                    return angle_degrees(vec3(original(i, 0), original(i, 1), original(i, 2)),
+                                         decode_oct_snorm16(encoded + 2 * size_t(i)));
+                });
+                break;
+            }
+            case AttributeEncoding::SNORM_10_10_10_2: {
+                q.type = GL_INT_2_10_10_10_REV;
+                q.element_dim = 4;
+                q.normalized = true;
+                q.data.resize(sizeof(uint32_t) * count);
+                uint32_t *encoded = reinterpret_cast<uint32_t *>(q.data.data());
+                encode_snorm_10_10_10_2(data, count, encoded);
+                q.error = measure(count, [&](uint32_t i) {
+                    return angle_degrees(vec3(original(i, 0), original(i, 1), original(i, 2)),
+                                         decode_snorm_10_10_10_2(encoded[i]));
+                });
+                break;
+            }
+        }
+        return q;
+    }
+
+CPPGL_NAMESPACE_END